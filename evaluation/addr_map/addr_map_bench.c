@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <libiberty.h>
+#include <libbf/addr_map.h>
+
+/*
+ * Measures the scalability of bf_addr_map from 1 to 64 threads:
+ *	./addr_map_bench [KEYS]
+ *
+ * Three workloads are timed for every thread count:
+ *	- disjoint: each thread inserts its own share of the keys.
+ *	- contended: every thread inserts every key, so all but one insertion
+ *	  per key loses the race and gets the winner back. This is what
+ *	  threads disassembling overlapping code do.
+ *	- lookup: every thread looks up every key of the filled map.
+ */
+
+#define DEFAULT_KEYS 1000000
+#define MAX_THREADS  64
+
+enum workload {
+	disjoint,
+	contended,
+	lookup
+};
+
+struct worker {
+	pthread_t	      thread;
+	struct bf_addr_map *  map;
+	struct bf_addr_node * nodes;
+	enum workload	      type;
+	size_t		      first;
+	size_t		      last;
+	size_t		      keys;
+	size_t		      found;
+};
+
+static bfd_vma key_of(size_t i)
+{
+	/*
+	 * Instruction-like spacing.
+	 */
+	return 0x400000 + i * 4;
+}
+
+static double elapsed(struct timespec * start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void * run_worker(void * param)
+{
+	struct worker * w = param;
+
+	switch(w->type) {
+	case disjoint:
+		for(size_t i = w->first; i < w->last; i++) {
+			bf_addr_map_insert(w->map, &w->nodes[i], key_of(i));
+		}
+
+		break;
+	case contended:
+		for(size_t i = 0; i < w->keys; i++) {
+			bf_addr_map_insert(w->map, &w->nodes[i], key_of(i));
+		}
+
+		break;
+	case lookup:
+		for(size_t i = 0; i < w->keys; i++) {
+			w->found += bf_addr_map_find(w->map, key_of(i)) != NULL;
+		}
+
+		break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Runs one workload and returns the number of operations per second.
+ */
+static double run(enum workload type, int num_threads, size_t keys,
+		struct bf_addr_map * map, struct bf_addr_node ** nodes)
+{
+	struct worker	workers[MAX_THREADS];
+	struct timespec start;
+	size_t		ops = 0;
+	double		secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int t = 0; t < num_threads; t++) {
+		struct worker * w = &workers[t];
+
+		w->map	 = map;
+		w->type	 = type;
+		w->keys	 = keys;
+		w->first = keys * t / num_threads;
+		w->last	 = keys * (t + 1) / num_threads;
+		w->found = 0;
+
+		/*
+		 * In the disjoint case the shares do not overlap, so the
+		 * threads can use the same node array.
+		 */
+		w->nodes = nodes[type == contended ? t : 0];
+		pthread_create(&w->thread, NULL, run_worker, w);
+	}
+
+	for(int t = 0; t < num_threads; t++) {
+		pthread_join(workers[t].thread, NULL);
+		ops += type == disjoint ? workers[t].last - workers[t].first :
+				keys;
+
+		if(type == lookup && workers[t].found != keys) {
+			fprintf(stderr, "Lookup missed %zu keys\n",
+					keys - workers[t].found);
+		}
+	}
+
+	secs = elapsed(&start);
+
+	if(type != lookup && map->count != keys) {
+		fprintf(stderr, "Map holds %zu keys, expected %zu\n",
+				map->count, keys);
+	}
+
+	return ops / secs;
+}
+
+int main(int argc, char ** argv)
+{
+	struct bf_addr_node * nodes[MAX_THREADS];
+	size_t		      keys = DEFAULT_KEYS;
+
+	if(argc > 1) {
+		keys = atol(argv[1]);
+	}
+
+	for(int t = 0; t < MAX_THREADS; t++) {
+		nodes[t] = xcalloc(keys, sizeof(struct bf_addr_node));
+	}
+
+	printf("%zu keys\n", keys);
+	printf("%8s %16s %16s %16s\n", "threads", "disjoint Mops/s",
+			"contended Mops/s", "lookup Mops/s");
+
+	for(int num_threads = 1; num_threads <= MAX_THREADS;
+			num_threads *= 2) {
+		struct bf_addr_map map;
+		double		   rates[3];
+
+		bf_init_addr_map(&map);
+		rates[disjoint] = run(disjoint, num_threads, keys, &map,
+				nodes);
+		rates[lookup]	= run(lookup, num_threads, keys, &map, nodes);
+		bf_close_addr_map(&map);
+
+		bf_init_addr_map(&map);
+		rates[contended] = run(contended, num_threads, keys, &map,
+				nodes);
+		bf_close_addr_map(&map);
+
+		printf("%8d %16.2f %16.2f %16.2f\n", num_threads,
+				rates[disjoint] / 1e6, rates[contended] / 1e6,
+				rates[lookup] / 1e6);
+	}
+
+	for(int t = 0; t < MAX_THREADS; t++) {
+		free(nodes[t]);
+	}
+
+	return EXIT_SUCCESS;
+}
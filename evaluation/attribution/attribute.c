@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <libbf/binary_file.h>
+#include <libbf/sample.h>
+
+/*
+ * Attributes the samples of a perf script dump to the functions (and
+ * optionally basic blocks) of a binary:
+ *	perf record -o perf.data ./target
+ *	perf script -i perf.data --show-mmap-events | ./attribute target -
+ */
+
+static double elapsed(struct timespec * start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void usage(char * prog)
+{
+	fprintf(stderr, "usage: %s [--bias ADDR | --load-base ADDR] "
+			"[--blocks] BINARY SCRIPT|-\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char ** argv)
+{
+	struct bin_file *	   bf;
+	struct bf_sample_profile * profile;
+	struct timespec		   start;
+	FILE *			   stream;
+	char *			   bias	      = NULL;
+	char *			   load_base  = NULL;
+	bool			   blocks     = FALSE;
+	int			   i;
+	size_t			   count;
+
+	for(i = 1; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; i++) {
+		if(strcmp(argv[i], "--bias") == 0 && i + 1 < argc) {
+			bias = argv[++i];
+		} else if(strcmp(argv[i], "--load-base") == 0 && i + 1 < argc) {
+			load_base = argv[++i];
+		} else if(strcmp(argv[i], "--blocks") == 0) {
+			blocks = TRUE;
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	if(argc - i != 2) {
+		usage(argv[0]);
+	}
+
+	stream = strcmp(argv[i + 1], "-") == 0 ? stdin :
+			fopen(argv[i + 1], "r");
+
+	if(stream == NULL) {
+		perror(argv[i + 1]);
+		return EXIT_FAILURE;
+	}
+
+	bf = load_bin_file(argv[i], NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	disasm_bin_file_entry(bf);
+	disasm_all_func_sym(bf);
+	fprintf(stderr, "Disassembly: %.3fs\n", elapsed(&start));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	profile = bf_init_sample_profile(bf);
+
+	if(bias != NULL) {
+		bf_set_sample_bias(profile, strtoull(bias, NULL, 0));
+	} else if(load_base != NULL) {
+		bf_set_sample_load_base(profile, strtoull(load_base, NULL, 0));
+	}
+
+	fprintf(stderr, "Index: %.3fs (%zu functions, %zu blocks)\n",
+			elapsed(&start), profile->func_index.count,
+			profile->bb_index.count);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	count = bf_load_perf_script(profile, stream);
+	fprintf(stderr, "Attribution: %.3fs (%zu samples, %llu unresolved, "
+			"bias 0x%llX)\n", elapsed(&start), count,
+			(unsigned long long)profile->unresolved,
+			(unsigned long long)profile->bias);
+
+	bf_print_func_hits(profile, stdout);
+
+	if(blocks) {
+		printf("\n");
+		bf_print_bb_hits(profile, stdout);
+	}
+
+	bf_close_sample_profile(profile);
+	close_bin_file(bf);
+
+	if(stream != stdin) {
+		fclose(stream);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -3,40 +3,17 @@
 #include <libbf/binary_file.h>
 #include <libbf/basic_blk.h>
 #include <libbf/insn.h>
+#include <libbf/func.h>
 #include <libbf/symbol.h>
-#include <libkern/htable.h>
+#include <libbf/bitmap.h>
 
+/*
+ * The visited blocks are marked by id.
+ */
 struct bb_cmp_info {
-	struct htable	  visited_bbs;
-};
-
-struct visited_bb {
-	struct bf_basic_blk * bb;
-	struct htable_entry   entry;
+	struct bf_bitmap visited_bbs;
 };
 
-void add_visited_bb(struct bb_cmp_info * info, struct bf_basic_blk * bb)
-{
-	struct visited_bb * v_bb = malloc(sizeof(struct visited_bb));
-	v_bb->bb		 = bb;
-
-	htable_add(&info->visited_bbs, &v_bb->entry, &bb->vma,
-			sizeof(bb->vma));
-}
-
-void release_visited_info(struct bb_cmp_info * info)
-{
-	struct htable_entry * cur_entry;
-	struct htable_entry * n;
-	struct visited_bb *   bb;
-
-	htable_for_each_entry_safe(bb, cur_entry, n, &info->visited_bbs,
-			entry) {
-		htable_del_entry(&info->visited_bbs, cur_entry);
-		free(bb);
-	}
-}
-
 /*
  * A quick note here. At the moment both bf_get_bb_insn and bf_get_bb_length
  * are O(n). This can (and probably eventually _should_) be changed to O(K).
@@ -57,7 +34,7 @@ bool bb_cmp(struct bb_cmp_info * info, struct bf_basic_blk * bb,
 	/*
 	 * Already visited.
 	 */
-	} else if(htable_find(&info->visited_bbs, &bb->vma, sizeof(bb->vma))) {
+	} else if(bf_bitmap_test(&info->visited_bbs, bb->entry.id)) {
 		return TRUE;
 	} else {
 		unsigned int length = bf_get_bb_length(bb);
@@ -82,7 +59,7 @@ bool bb_cmp(struct bb_cmp_info * info, struct bf_basic_blk * bb,
 		/*
 		 * Update visited bbs and compare the next bbs in the CFG.
 		 */
-		add_visited_bb(info, bb);
+		bf_bitmap_set(&info->visited_bbs, bb->entry.id);
 		return bb_cmp(info, bb->target, bb2->target) &&
 				bb_cmp(info, bb->target2, bb2->target2);
 	}
@@ -96,32 +73,48 @@ int main(void)
 	struct symbol * sym;
 	struct symbol * sym2;
 
-	struct bf_basic_blk * bb1, * bb2;
-	struct bb_cmp_info    info;
+	struct bf_func *   func1, * func2;
+	struct bb_cmp_info info;
+
+	/*
+	 * Fingerprints are cached, so the CFGs have to be complete first.
+	 */
+	disasm_all_func_sym(bf);
+	disasm_all_func_sym(bf2);
 
 	for_each_symbol(sym, &bf->sym_table) {
 		if((sym->type & SYMBOL_FUNCTION) && (sym->address != 0)) {
 			sym2 = symbol_find(&bf2->sym_table, sym->name);
 
-			if(sym2 == NULL) {
+			if(sym2 == NULL || sym2->address == 0) {
 				printf("%s is new in target1\n", sym->name);
+				continue;
+			}
+
+			func1 = bf_get_func(bf, sym->address);
+			func2 = bf_get_func(bf2, sym2->address);
+
+			if(bf_get_func_fingerprint(bf, func1) ==
+					bf_get_func_fingerprint(bf2, func2)) {
+				printf("%s did not change\n", sym->name);
+				continue;
+			}
+
+			/*
+			 * The lockstep walk only compares mnemonics, so it
+			 * tells whether the change is in the operands.
+			 */
+			bf_init_bitmap(&info.visited_bbs,
+					bf_get_num_basic_blks(bf));
+
+			if(bb_cmp(&info, func1->bb, func2->bb)) {
+				printf("%s did change (operands only)\n",
+						sym->name);
 			} else {
-				bb1 = disasm_bin_file_sym(bf, sym, TRUE);
-				bb2 = disasm_bin_file_sym(bf2, sym2, TRUE);
-
-				htable_init(&info.visited_bbs);
-				
-				if(bb_cmp(&info, bb1, bb2)) {
-					printf("%s did not change\n",
-							sym->name);
- 				} else {
-					printf("%s did change\n",
-							sym->name);
-				}
-
-				release_visited_info(&info);
-				htable_destroy(&info.visited_bbs);
+				printf("%s did change\n", sym->name);
 			}
+
+			bf_close_bitmap(&info.visited_bbs);
 		}
 	}
 
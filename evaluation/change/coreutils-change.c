@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -9,7 +10,9 @@
 #include <libbf/basic_blk.h>
 #include <libbf/insn.h>
 #include <libbf/symbol.h>
-#include <libkern/htable.h>
+#include <libbf/func.h>
+#include <libbf/parallel.h>
+#include <libbf/incremental.h>
 #include "logger.h"
 
 /*
@@ -33,6 +36,97 @@ bool is_func(struct symbol * sym)
 	return (sym->type & SYMBOL_FUNCTION) && (sym->address != 0);
 }
 
+/*
+ * A function present in both binaries.
+ */
+struct func_pair {
+	struct bin_file *     bf;
+	struct bin_file *     bf2;
+	struct symbol *	      sym;
+	struct symbol *	      sym2;
+	struct bf_basic_blk * bb1;
+	struct bf_basic_blk * bb2;
+};
+
+struct cmp_pass {
+	struct func_pair *   pairs;
+	struct change_info * ci;
+	bool		     verify;
+};
+
+/*
+ * Returns the milliseconds elapsed since start.
+ */
+double elapsed_ms(struct timespec * start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 +
+			(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*
+ * Disassembles every function symbol and the entry point.
+ */
+void disasm_all(struct bin_file * bf)
+{
+	disasm_all_func_sym_parallel(bf, 0);
+	disasm_bin_file_entry(bf);
+}
+
+/*
+ * Functions are compared by fingerprint. Setting CHANGE_VERIFY also runs the
+ * lockstep CFG walk and reports the pairs where the two disagree. Each walk
+ * gets its own visited array so the result of a pair does not depend on
+ * which pairs the worker compared before it.
+ */
+void * cmp_pairs(struct bf_task_ctx * ctx, size_t first, size_t last)
+{
+	struct cmp_pass *  pass = ctx->param;
+	struct func_pair * pair = &pass->pairs[first];
+	struct bf_func *   func1, * func2;
+	struct bb_cmp_info info;
+	bool		   same;
+
+	func1 = bf_get_func(pair->bf, pair->sym->address);
+	func2 = bf_get_func(pair->bf2, pair->sym2->address);
+
+	if(func1 == NULL || func2 == NULL) {
+		return func1 == func2 ? pass : NULL;
+	}
+
+	same = bf_get_func_fingerprint(pair->bf, func1) ==
+			bf_get_func_fingerprint(pair->bf2, func2);
+
+	if(pass->verify) {
+		init_visited_info(&info, pair->bf);
+
+		if(bb_cmp(&info, pair->bb1, pair->bb2) != same) {
+			fprintf(stderr, "%s: fingerprint says %s\n",
+					pair->sym->name,
+					same ? "same" : "modified");
+		}
+
+		release_visited_info(&info);
+	}
+
+	return same ? pass : NULL;
+}
+
+void count_pairs(size_t first, size_t last, void * result, void * param)
+{
+	struct change_info * ci = ((struct cmp_pass *)param)->ci;
+
+	// Functions identical
+	if(result != NULL) {
+		ci->same++;
+	// Functions different
+	} else {
+		ci->modified++;
+	}
+}
+
 /*
  * Generates change statistics between two binaries.
  */
@@ -42,15 +136,15 @@ void compare_bins(char * bitiness, char * bin1, char * bin2,
 	struct bin_file * bf  = load_bin_file(bin1, NULL);
 	struct bin_file * bf2 = load_bin_file(bin2, NULL);
 
-	struct symbol *	      sym, * sym2;
-	struct bf_basic_blk * bb1, * bb2;
-	struct bb_cmp_info    info;
-	struct change_info    ci = {0};
+	struct symbol *	   sym, * sym2;
+	struct change_info ci	     = {0};
+	struct func_pair * pairs     = NULL;
+	size_t		   num_pairs = 0;
+	size_t		   capacity  = 0;
+	struct cmp_pass	   pass;
 
 	printf("Comparing \n%s and \n%s:\n", bin1, bin2);
 
-	htable_init(&info.visited_bbs);
-
 	for_each_symbol(sym, &bf->sym_table) {
 		if(is_func(sym)) {
 			sym2 = symbol_find(&bf2->sym_table, sym->name);
@@ -60,33 +154,62 @@ void compare_bins(char * bitiness, char * bin1, char * bin2,
 				ci.removed++;
 			// Function name exists in both binaries
 			} else {
-				// Generate CFGs using the symbols as roots
-				bb1 = disasm_bin_file_sym(bf, sym, TRUE);
-				bb2 = disasm_bin_file_sym(bf2, sym2, TRUE);
-				
-				// Functions identical
-				if(bb_cmp(&info, bb1, bb2)) {
-					ci.same++;
-				// Functions different
- 				} else {
-					ci.modified++;
+				if(num_pairs == capacity) {
+					capacity = capacity ? capacity * 2 : 64;
+					pairs	 = xrealloc(pairs, capacity *
+							sizeof(struct func_pair));
 				}
+
+				pairs[num_pairs].bf   = bf;
+				pairs[num_pairs].bf2  = bf2;
+				pairs[num_pairs].sym  = sym;
+				pairs[num_pairs].sym2 = sym2;
+				num_pairs++;
 			}
 		}
 	}
 
-	release_visited_info(&info);
-	htable_destroy(&info.visited_bbs);
-
-	// Function name exists in bin2 but not bin1 (introduced in bin2)
-	for_each_symbol(sym, &bf2->sym_table) {
-		if(is_func(sym)) {
-			if(!is_func(symbol_find(&bf->sym_table, sym->name))) {
-				ci.added++;
-			}
-		}
+	/*
+	 * All CFGs are generated before any is compared since disassembling
+	 * one function can split the blocks of another. The new version is
+	 * disassembled incrementally from the old one. It is also analysed
+	 * from scratch in a scratch copy to show what the reuse saves.
+	 */
+	struct bin_file *     scratch = load_bin_file(bin2, NULL);
+	struct bf_reuse_stats stats;
+	struct timespec	      start;
+	double		      scratch_ms, incremental_ms;
+	size_t		      total_insns;
+
+	disasm_all(bf);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	disasm_all(scratch);
+	scratch_ms = elapsed_ms(&start);
+	close_bin_file(scratch);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	bf_disasm_incremental(bf2, bf, 0, &stats);
+	incremental_ms = elapsed_ms(&start);
+
+	total_insns = stats.reused_insns + stats.decoded_insns;
+	printf("Disassembly: %.1f ms from scratch, %.1f ms incremental "
+			"(%zu of %zu instructions reused, %.1f%%)\n", scratch_ms,
+			incremental_ms, stats.reused_insns, total_insns,
+			total_insns ? 100.0 * stats.reused_insns / total_insns :
+			0.0);
+
+	for(size_t i = 0; i < num_pairs; i++) {
+		pairs[i].bb1 = bf_get_bb(bf, pairs[i].sym->address);
+		pairs[i].bb2 = bf_get_bb(bf2, pairs[i].sym2->address);
 	}
 
+	pass.pairs  = pairs;
+	pass.ci	    = &ci;
+	pass.verify = getenv("CHANGE_VERIFY") != NULL;
+	bf_parallel_run(0, num_pairs, 1, cmp_pairs, count_pairs, &pass);
+	free(pairs);
+
 	printf("%d functions removed\n", ci.removed);
 	printf("%d functions added\n", ci.added);
 	printf("%d functions modified\n", ci.modified);
@@ -1,35 +1,33 @@
 #include "func_analysis.h"
 
+/*
+ * bf is the bin_file of the blocks passed as bb to bb_cmp().
+ */
+extern void init_visited_info(struct bb_cmp_info * info, struct bin_file * bf)
+{
+	info->num_visited_bbs = bf_get_num_basic_blks(bf);
+	info->visited_bbs     = calloc(info->num_visited_bbs,
+			sizeof(struct bf_basic_blk *));
+}
+
 void add_visited_bb(struct bb_cmp_info * info, struct bf_basic_blk * bb,
 		struct bf_basic_blk * bb2)
 {
-	struct visited_bb * v_bb = malloc(sizeof(struct visited_bb));
-	v_bb->bb		 = bb;
-	v_bb->bb2		 = bb2;
-
-	htable_add(&info->visited_bbs, &v_bb->entry, &bb->vma,
-			sizeof(bb->vma));
+	info->visited_bbs[bb->entry.id] = bb2;
 }
 
 extern void release_visited_info(struct bb_cmp_info * info)
 {
-	struct htable_entry * cur_entry;
-	struct htable_entry * n;
-	struct visited_bb *   v_bb;
-
-	htable_for_each_entry_safe(v_bb, cur_entry, n, &info->visited_bbs,
-			entry) {
-		htable_del_entry(&info->visited_bbs, cur_entry);
-		free(v_bb);
-	}
+	free(info->visited_bbs);
+	info->visited_bbs     = NULL;
+	info->num_visited_bbs = 0;
 }
 
 bool has_visited_bb(struct bb_cmp_info * info, struct bf_basic_blk * bb,
 		struct bf_basic_blk * bb2)
 {
-	struct visited_bb * v_bb = hash_find_entry(&info->visited_bbs,
-			&bb->vma, sizeof(bb->vma), struct visited_bb, entry);
-	return ((v_bb != NULL) && (v_bb->bb2->vma == bb2->vma));
+	struct bf_basic_blk * v_bb2 = info->visited_bbs[bb->entry.id];
+	return ((v_bb2 != NULL) && (v_bb2->vma == bb2->vma));
 }
 
 /*
@@ -1,17 +1,17 @@
 #ifndef FUNC_ANALYSIS_H
 #define FUNC_ANALYSIS_H
 
+#include <libbf/binary_file.h>
 #include <libbf/basic_blk.h>
 #include <libbf/insn.h>
 
+/*
+ * visited_bbs maps the id of each visited block to the block it was paired
+ * with.
+ */
 struct bb_cmp_info {
-	struct htable visited_bbs;
-};
-
-struct visited_bb {
-	struct bf_basic_blk * bb;
-	struct bf_basic_blk * bb2;
-	struct htable_entry   entry;
+	struct bf_basic_blk ** visited_bbs;
+	uint32_t	       num_visited_bbs;
 };
 
 struct change_info {
@@ -23,6 +23,7 @@ struct change_info {
 
 bool bb_cmp(struct bb_cmp_info * info, struct bf_basic_blk * bb,
 		struct bf_basic_blk * bb2);
+void init_visited_info(struct bb_cmp_info * info, struct bin_file * bf);
 void release_visited_info(struct bb_cmp_info * info);
 
 #endif
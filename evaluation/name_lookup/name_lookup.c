@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <libiberty.h>
+#include <libbf/binary_file.h>
+#include <libbf/func.h>
+#include <libbf/symbol.h>
+
+/*
+ * Measures name lookups against the symbol name index:
+ *	./name_lookup /usr/lib/x86_64-linux-gnu/libLLVM.so [LOOKUPS]
+ */
+
+#define DEFAULT_LOOKUPS 1000000
+
+static double elapsed(struct timespec * start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char ** argv)
+{
+	struct bin_file * bf;
+	struct symbol *	  sym;
+	struct timespec	  start;
+	char **		  names;
+	size_t		  count	  = 0;
+	size_t		  found	  = 0;
+	size_t		  funcs	  = 0;
+	long		  lookups = DEFAULT_LOOKUPS;
+	double		  secs;
+
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s BINARY [LOOKUPS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(argc > 2) {
+		lookups = atol(argv[2]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	bf = load_bin_file(argv[1], NULL);
+	printf("Loaded %zu symbols in %.3fs (%u buckets)\n",
+			bf->sym_table.symbol_count, elapsed(&start),
+			bf->sym_table.symbol_hash_size);
+
+	names = xmalloc((bf->sym_table.symbol_count + 1) * sizeof(char *));
+
+	for_each_symbol(sym, &bf->sym_table) {
+		names[count++] = sym->name;
+
+		if((sym->type & SYMBOL_FUNCTION) && sym->address != 0) {
+			disasm_bin_file_sym(bf, sym, TRUE);
+		}
+	}
+
+	if(count == 0) {
+		fprintf(stderr, "%s has no symbols\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 * Walk the names with a large odd stride so consecutive lookups do not
+	 * hit neighbouring buckets.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(long i = 0; i < lookups; i++) {
+		found += symbol_find(&bf->sym_table,
+				names[(i * 7919) % count]) != NULL;
+	}
+
+	secs = elapsed(&start);
+	printf("symbol_find: %ld lookups in %.3fs (%.1fns/lookup, %zu hits)\n",
+			lookups, secs, secs * 1e9 / lookups, found);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(long i = 0; i < lookups; i++) {
+		funcs += bf_get_func_from_name(bf,
+				names[(i * 7919) % count]) != NULL;
+	}
+
+	secs = elapsed(&start);
+	printf("bf_get_func_from_name: %ld lookups in %.3fs "
+			"(%.1fns/lookup, %zu hits)\n", lookups, secs,
+			secs * 1e9 / lookups, funcs);
+
+	free(names);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
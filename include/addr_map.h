@@ -0,0 +1,236 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file addr_map.h
+ * @brief Definition and API of bf_addr_map.
+ * @details A bf_addr_map is a concurrent map from VMAs to objects. It holds
+ * the bf_insn, bf_basic_blk and bf_func objects of a bin_file.
+ *
+ * The map is a hash trie. The root has BF_ADDR_MAP_ROOT_SLOTS slots and
+ * every inner node has 16. Slots are only ever filled or replaced with
+ * compare-and-swap, so:
+ *	- Insertion is insert-if-absent. When several threads race to add an
+ *	  object at the same VMA exactly one wins and every caller gets the
+ *	  winner back.
+ *	- Lookups and iteration take no locks and never block, even while
+ *	  other threads are inserting.
+ *
+ * Objects are never removed individually. The map does not need to be
+ * resized since it grows a level wherever two keys share a slot. Objects
+ * embed a bf_addr_node, in the same way as the libkern hashtables use a
+ * struct htable_entry.
+ *
+ * Every object also gets a dense id in insertion order, which never changes.
+ * bf_addr_map_get() maps ids back to objects, so analyses can keep their
+ * per-object state in plain arrays and bitmaps indexed by id. When several
+ * threads race to add the same VMA, the ids drawn by the losers are left
+ * unused and bf_addr_map_get() returns NULL for them.
+ */
+
+#ifndef BF_ADDR_MAP_H
+#define BF_ADDR_MAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <bfd.h>
+
+/**
+ * @brief The number of slots of the root of a bf_addr_map.
+ */
+#define BF_ADDR_MAP_ROOT_BITS  12
+#define BF_ADDR_MAP_ROOT_SLOTS (1 << BF_ADDR_MAP_ROOT_BITS)
+
+/**
+ * @brief The number of ids per chunk of the id directory of a bf_addr_map.
+ */
+#define BF_ADDR_MAP_ID_CHUNK_BITS 16
+#define BF_ADDR_MAP_ID_CHUNK_SIZE (1 << BF_ADDR_MAP_ID_CHUNK_BITS)
+
+/**
+ * @brief The number of chunks of the id directory, which bounds the number
+ * of objects a bf_addr_map can hold.
+ */
+#define BF_ADDR_MAP_ID_CHUNKS	  (1 << 12)
+
+/**
+ * @struct bf_addr_node
+ * @brief Entry of an object in a bf_addr_map.
+ */
+struct bf_addr_node {
+	/**
+	 * @var key
+	 * @brief The VMA the object is stored at.
+	 */
+	bfd_vma		      key;
+
+	/**
+	 * @internal
+	 * @var hash
+	 * @brief The mixed key, which selects the slot at every level.
+	 */
+	uint64_t	      hash;
+
+	/**
+	 * @var id
+	 * @brief The dense id of the object, see bf_addr_map_get().
+	 */
+	uint32_t	      id;
+
+	/**
+	 * @internal
+	 * @var next
+	 * @brief The previously inserted node, for iteration.
+	 */
+	struct bf_addr_node * next;
+};
+
+/**
+ * @struct bf_addr_map
+ * @brief A lock-free map from VMAs to objects.
+ */
+struct bf_addr_map {
+	/**
+	 * @internal
+	 * @var root
+	 * @brief The root slots. Each holds NULL, a bf_addr_node or a tagged
+	 * pointer to an inner node.
+	 */
+	void **			root;
+
+	/**
+	 * @internal
+	 * @var head
+	 * @brief The most recently inserted node.
+	 */
+	struct bf_addr_node *	head;
+
+	/**
+	 * @var count
+	 * @brief The number of objects held.
+	 */
+	size_t			count;
+
+	/**
+	 * @internal
+	 * @var id_chunks
+	 * @brief The id directory. Chunks are allocated as ids reach them.
+	 */
+	struct bf_addr_node *** id_chunks;
+
+	/**
+	 * @var num_ids
+	 * @brief The number of ids handed out. Arrays indexed by id need this
+	 * many entries.
+	 */
+	uint32_t		num_ids;
+};
+
+/**
+ * @brief Gets the object holding a bf_addr_node.
+ * @param node The bf_addr_node embedded in the object.
+ * @param type The type of the object.
+ * @param member The name of the bf_addr_node within type.
+ */
+#define bf_addr_map_entry(node, type, member) \
+	((type *)((char *)(node) - offsetof(type, member)))
+
+/**
+ * @brief Iterates over the objects of a bf_addr_map, newest first.
+ * @param obj Pointer to the object type to use as a loop cursor.
+ * @param cur struct bf_addr_node * to use as temporary storage.
+ * @param map The bf_addr_map being iterated.
+ * @param member The name of the bf_addr_node within the object.
+ * @note Safe while other threads insert. Objects inserted after the
+ * iteration started are not visited.
+ */
+#define bf_addr_map_for_each_entry(obj, cur, map, member) \
+	for(cur = __atomic_load_n(&(map)->head, __ATOMIC_ACQUIRE); \
+			cur != NULL && ((obj = bf_addr_map_entry(cur, \
+			typeof(*obj), member)), 1); \
+			cur = cur->next)
+
+/**
+ * @brief Iterates over the objects of a bf_addr_map, allowing the current
+ * object to be freed.
+ * @param obj Pointer to the object type to use as a loop cursor.
+ * @param cur struct bf_addr_node * to use as temporary storage.
+ * @param n Another struct bf_addr_node * to use as temporary storage.
+ * @param map The bf_addr_map being iterated.
+ * @param member The name of the bf_addr_node within the object.
+ */
+#define bf_addr_map_for_each_entry_safe(obj, cur, n, map, member) \
+	for(cur = (map)->head; \
+			cur != NULL && ((n = cur->next), (obj = \
+			bf_addr_map_entry(cur, typeof(*obj), member)), 1); \
+			cur = n)
+
+/**
+ * @brief Initialises an empty bf_addr_map.
+ * @param map The bf_addr_map to be initialised.
+ * @note bf_close_addr_map() must be called to release the memory.
+ */
+extern void bf_init_addr_map(struct bf_addr_map * map);
+
+/**
+ * @brief Adds an object unless one is already stored at the same VMA.
+ * @param map The bf_addr_map to be added to.
+ * @param node The bf_addr_node embedded in the object.
+ * @param key The VMA of the object.
+ * @return node if it was added, otherwise the node already stored at key.
+ * @note Safe to call from several threads at once.
+ */
+extern struct bf_addr_node * bf_addr_map_insert(struct bf_addr_map * map,
+		struct bf_addr_node * node, bfd_vma key);
+
+/**
+ * @brief Gets the object stored at a VMA.
+ * @param map The bf_addr_map to be searched.
+ * @param key The VMA being searched for.
+ * @return The bf_addr_node stored at key or NULL.
+ * @note Never blocks, even while other threads insert.
+ */
+extern struct bf_addr_node * bf_addr_map_find(struct bf_addr_map * map,
+		bfd_vma key);
+
+/**
+ * @brief Gets the object with a given id.
+ * @param map The bf_addr_map to be searched.
+ * @param id The id of the object.
+ * @return The bf_addr_node of the object or NULL if no object has the id.
+ * @note Never blocks, even while other threads insert.
+ */
+extern struct bf_addr_node * bf_addr_map_get(struct bf_addr_map * map,
+		uint32_t id);
+
+/**
+ * @brief Releases the memory held by a bf_addr_map.
+ * @param map The bf_addr_map to be closed.
+ * @note The objects themselves are not freed. bf_addr_map_for_each_entry_safe()
+ * can be used to free them first.
+ */
+extern void bf_close_addr_map(struct bf_addr_map * map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
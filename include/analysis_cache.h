@@ -0,0 +1,68 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file analysis_cache.h
+ * @brief API for persisting the analysis results of a bin_file.
+ * @details The bf_insn, bf_basic_blk and bf_func objects discovered by
+ * disassembly can be written to the on-disk cache (see cache.h) and restored
+ * the next time the same binary is loaded, which is much faster than
+ * disassembling it again.
+ *
+ * The cache file is a flat image: a header followed by arrays of fixed size
+ * records which refer to each other by index and to their strings by offset,
+ * so it contains no pointers and can be mapped directly. The header records
+ * the format version, the layout of the records and a checksum; any mismatch
+ * makes bf_load_analysis() fail without touching the bin_file, in which case
+ * the caller simply analyses the binary again.
+ *
+ * When the cache is enabled load_bin_file() tries bf_load_analysis() and
+ * close_bin_file() calls bf_save_analysis() if new objects were discovered
+ * in between. Symbols are not part of the file since the symbol table keeps
+ * its own cache.
+ */
+
+#ifndef BF_ANALYSIS_CACHE_H
+#define BF_ANALYSIS_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "binary_file.h"
+
+/**
+ * @brief Writes the analysis results of a bin_file to the cache.
+ * @param bf The analysed bin_file.
+ * @return TRUE if the cache file was written. FALSE if caching is disabled or
+ * the file could not be written.
+ */
+extern bool bf_save_analysis(struct bin_file * bf);
+
+/**
+ * @brief Restores the analysis results of a bin_file from the cache.
+ * @param bf The bin_file to be populated. It must not have been analysed yet.
+ * @return TRUE if the results were restored. FALSE if caching is disabled, no
+ * matching cache file exists or it is corrupt or of another version.
+ */
+extern bool bf_load_analysis(struct bin_file * bf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
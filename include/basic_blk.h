@@ -70,11 +70,11 @@ struct bf_basic_blk {
 	struct bf_insn ** insn_vec;
 
 	/**
-	 * @internal
 	 * @var entry
-	 * @brief Entry into the bin_file.bb_table hashtable of bin_file.
+	 * @brief Entry into the bin_file.bb_table map of bin_file. entry.id is
+	 * the dense id of the bf_basic_blk, see bf_get_bb_by_id().
 	 */
-	struct htable_entry entry;
+	struct bf_addr_node entry;
 
 	/**
 	 * @var target
@@ -99,10 +99,20 @@ struct bf_basic_blk {
 	struct bf_basic_blk * target2;
 
 	/**
+	 * @internal
 	 * @var sym
 	 * @brief A bf_sym associated with basic_blk.vma.
+	 * @details Only valid once bf_basic_blk.sym_resolved is set, use
+	 * bf_get_bb_sym() to read it.
 	 */
 	struct symbol * sym;
+
+	/**
+	 * @internal
+	 * @var sym_resolved
+	 * @brief Whether bf_basic_blk.sym has been looked up.
+	 */
+	bool sym_resolved;
 };
 
 /**
@@ -124,6 +134,8 @@ extern struct bf_basic_blk * bf_init_basic_blk(struct bin_file * bf,
  * @param bb The bf_basic_blk to be split.
  * @param vma The VMA where the split should occur.
  * @return The new basic_blk starting at vma.
+ * @details The new block takes over the targets of bb and bb falls through
+ * to the new block.
  */
 extern struct bf_basic_blk * bf_split_blk(struct bin_file * bf,
 		struct bf_basic_blk * bb, bfd_vma vma);
@@ -173,11 +185,14 @@ extern void bf_close_basic_blk(struct bf_basic_blk * bb);
 
 /**
  * @internal
- * @brief Adds a bf_basic_blk to the bin_file.bb_table.
+ * @brief Adds a bf_basic_blk to the bin_file.bb_table unless one already
+ * exists at the same VMA.
  * @param bf The bin_file holding the bin_file.bb_table to be added to.
  * @param bb The bf_basic_blk to be added.
+ * @return bb if it was added, otherwise the bf_basic_blk already held.
  */
-extern void bf_add_bb(struct bin_file * bf, struct bf_basic_blk * bb);
+extern struct bf_basic_blk * bf_add_bb(struct bin_file * bf,
+		struct bf_basic_blk * bb);
 
 /**
  * @brief Gets the bf_basic_blk object for the starting VMA.
@@ -188,6 +203,17 @@ extern void bf_add_bb(struct bin_file * bf, struct bf_basic_blk * bb);
  */
 extern struct bf_basic_blk * bf_get_bb(struct bin_file * bf, bfd_vma vma);
 
+/**
+ * @brief Gets the symbol associated with the start of a bf_basic_blk.
+ * @param bf The bin_file holding bb.
+ * @param bb The bf_basic_blk to get the symbol of.
+ * @return The symbol at bf_basic_blk.vma or NULL if there is none.
+ * @details The symbol is looked up on the first call, so building blocks
+ * does not force bin_file.sym_table to be loaded.
+ */
+extern struct symbol * bf_get_bb_sym(struct bin_file * bf,
+		struct bf_basic_blk * bb);
+
 /**
  * @brief Gets the size in bytes of a bf_basic_blk object.
  * @param bb The bf_basic_blk to get the size of.
@@ -219,6 +245,26 @@ extern struct bf_insn * bf_get_bb_insn(struct bf_basic_blk * bb,
  */
 extern bool bf_exists_bb(struct bin_file * bf, bfd_vma vma);
 
+/**
+ * @brief Gets the bf_basic_blk object with a given id.
+ * @param bf The bin_file to be searched.
+ * @param id The id of the bf_basic_blk, as found in its entry.id.
+ * @return The bf_basic_blk with that id or NULL if there is none.
+ * @details Ids are handed out from 0 in the order the objects are discovered
+ * and never change, so per-object state can be kept in arrays of
+ * bf_get_num_basic_blks() entries indexed by id.
+ */
+extern struct bf_basic_blk * bf_get_bb_by_id(struct bin_file * bf,
+		uint32_t id);
+
+/**
+ * @brief Gets the number of ids handed out to bf_basic_blk objects.
+ * @param bf The bin_file being analysed.
+ * @return One more than the largest id. A few ids may be unused if threads
+ * raced to discover the same basic block.
+ */
+extern uint32_t bf_get_num_basic_blks(struct bin_file * bf);
+
 /**
  * @internal
  * @brief Releases memory for all currently discovered bf_basic_blk objects.
@@ -243,8 +289,8 @@ extern void bf_enum_basic_blk(struct bin_file * bf,
  * @param bf struct bin_file holding the bf_basic_blk objects.
  */
 #define bf_for_each_basic_blk(bb, bf) \
-	struct htable_entry * cur_entry; \
-	htable_for_each_entry(bb, cur_entry, &bf->bb_table, entry)
+	struct bf_addr_node * cur_entry; \
+	bf_addr_map_for_each_entry(bb, cur_entry, &bf->bb_table, entry)
 
 /**
  * @brief Invokes a callback for each bf_insn in a bf_basic_blk.
@@ -0,0 +1,224 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file batch.h
+ * @brief API for analysing many binaries at once.
+ * @details bf_run_batch() loads, disassembles and closes each binary of a
+ * list in a pool of worker processes. As soon as a binary is done, its
+ * bf_batch_result is passed to a handler in the calling process, so results
+ * stream out in completion order instead of list order.
+ *
+ * Workers are processes rather than threads because libbfd keeps global
+ * state (its file cache and error status) which is not safe to use from
+ * several threads at once. This also means a binary which crashes the
+ * disassembler only loses its own result: the worker is replaced and the
+ * batch carries on.
+ *
+ * The memory used by all binaries being analysed is bounded by
+ * bf_batch_options.mem_budget. The cost of a binary is estimated from its
+ * size on disk and a binary is only handed to a worker while the estimated
+ * cost of all binaries in flight fits in the budget. A binary whose cost
+ * alone exceeds the budget is analysed when nothing else is in flight.
+ */
+
+#ifndef BF_BATCH_H
+#define BF_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "binary_file.h"
+
+/**
+ * @enum bf_batch_status
+ * @brief The outcome of analysing one binary.
+ */
+enum bf_batch_status {
+	/**
+	 * @brief The binary was analysed.
+	 */
+	BF_BATCH_OK,
+
+	/**
+	 * @brief The binary could not be loaded, e.g. it is not an object
+	 * file.
+	 */
+	BF_BATCH_LOAD_FAILED,
+
+	/**
+	 * @brief bf_batch_options.analyse returned FALSE.
+	 */
+	BF_BATCH_ANALYSE_FAILED,
+
+	/**
+	 * @brief The worker analysing the binary died.
+	 */
+	BF_BATCH_CRASHED
+};
+
+/**
+ * @struct bf_batch_result
+ * @brief The result of analysing one binary.
+ */
+struct bf_batch_result {
+	/**
+	 * @var path
+	 * @brief The path of the binary as given to bf_run_batch().
+	 */
+	const char *	     path;
+
+	/**
+	 * @var index
+	 * @brief The position of the binary in the list given to
+	 * bf_run_batch().
+	 */
+	size_t		     index;
+
+	/**
+	 * @var status
+	 * @brief The outcome of the analysis.
+	 */
+	enum bf_batch_status status;
+
+	/**
+	 * @var num_insns
+	 * @brief The number of bf_insn objects discovered.
+	 */
+	size_t		     num_insns;
+
+	/**
+	 * @var num_basic_blks
+	 * @brief The number of bf_basic_blk objects discovered.
+	 */
+	size_t		     num_basic_blks;
+
+	/**
+	 * @var num_funcs
+	 * @brief The number of bf_func objects discovered.
+	 */
+	size_t		     num_funcs;
+
+	/**
+	 * @var load_ms
+	 * @brief The time taken by load_bin_file() in milliseconds.
+	 */
+	double		     load_ms;
+
+	/**
+	 * @var analyse_ms
+	 * @brief The time taken by disassembly and bf_batch_options.analyse in
+	 * milliseconds.
+	 */
+	double		     analyse_ms;
+
+	/**
+	 * @var output
+	 * @brief The text written by bf_batch_options.analyse. It is
+	 * NUL-terminated and only valid for the duration of the handler.
+	 */
+	const char *	     output;
+
+	/**
+	 * @var output_len
+	 * @brief The length of output, not counting the NUL.
+	 */
+	size_t		     output_len;
+};
+
+/**
+ * @struct bf_batch_options
+ * @brief Parameters of bf_run_batch().
+ * @details bf_init_batch_options() fills in the defaults.
+ */
+struct bf_batch_options {
+	/**
+	 * @var num_workers
+	 * @brief The number of worker processes. 0 means
+	 * bf_get_num_workers(0).
+	 */
+	unsigned int num_workers;
+
+	/**
+	 * @var mem_budget
+	 * @brief The estimated number of bytes all binaries in flight may use
+	 * together. 0 means unlimited.
+	 */
+	size_t	     mem_budget;
+
+	/**
+	 * @var mem_factor
+	 * @brief The estimated cost of a binary is its size on disk times this.
+	 */
+	unsigned int mem_factor;
+
+	/**
+	 * @var disasm
+	 * @brief If TRUE, every function symbol and the entry point are
+	 * disassembled before analyse is invoked.
+	 */
+	bool	     disasm;
+
+	/**
+	 * @var analyse
+	 * @brief Invoked in the worker for each loaded binary. Anything it
+	 * writes to the FILE ends up in bf_batch_result.output. Can be NULL.
+	 */
+	bool	     (*analyse)(struct bin_file *, FILE *, void *);
+
+	/**
+	 * @var param
+	 * @brief Passed to analyse each time it is invoked.
+	 */
+	void *	     param;
+};
+
+/**
+ * @brief Fills in the default bf_batch_options.
+ * @param options The bf_batch_options to be initialised.
+ */
+extern void bf_init_batch_options(struct bf_batch_options * options);
+
+/**
+ * @brief Analyses a list of binaries in parallel worker processes.
+ * @param paths The paths of the binaries.
+ * @param count The number of paths.
+ * @param options The parameters of the batch. NULL selects the defaults.
+ * @param handler Invoked in the calling process with the result of each
+ * binary as soon as it is available.
+ * @param param This will be passed to the handler each time it is invoked. It
+ * can be used to pass data to the callback.
+ * @return The number of binaries with status BF_BATCH_OK.
+ * @note Since analyse runs in a forked worker, any changes it makes to
+ * memory are not visible to the caller. Results have to be passed back
+ * through its FILE.
+ */
+extern size_t bf_run_batch(char ** paths, size_t count,
+		struct bf_batch_options * options,
+		void (*handler)(struct bf_batch_result *, void *),
+		void * param);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
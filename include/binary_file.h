@@ -40,10 +40,13 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 #include <libiberty.h>
+#include <pthread.h>
 
 #include <libkern/htable.h>
 
 #include "symbol.h"
+#include "strpool.h"
+#include "addr_map.h"
 
 #define IS_BF_ARCH_32(BF) (BF->bitiness == arch_32)
 
@@ -106,6 +109,22 @@ enum insn_part_type {
  * function.
  */
 struct disasm_context {
+  /**
+   * @internal
+   * @var bf
+   * @brief The bin_file being disassembled.
+   */
+  struct bin_file * bf;
+
+  /**
+   * @internal
+   * @var info
+   * @brief The <b>libopcodes</b> state of this disassembly. It is copied
+   * from bin_file.disasm_config and its stream points back to the
+   * disasm_context, so each caller decodes with its own state.
+   */
+  struct disassemble_info info;
+
   /**
    * @internal
    * @var insn
@@ -173,39 +192,57 @@ struct bin_file {
    * @var disasm_config
    * @brief Holds the configuration used by <b>libopcodes</b> for
    * disassembly.
+   * @details This is only a template. Every disassembly works on a copy held
+   * in its own disasm_context and never modifies it.
    * @note This is defined in dis-asm.h in the binutils distribution.
    */
   struct disassemble_info disasm_config;
 
+  /**
+   * @internal
+   * @var cflow_lock
+   * @brief Serialises changes to the CFG, i.e. the insertion of bf_insn,
+   * bf_basic_blk and bf_func objects and the splitting and linking of
+   * blocks.
+   * @details Decoding itself is done outside of the lock so several threads
+   * can disassemble the same bin_file concurrently.
+   */
+  pthread_mutex_t cflow_lock;
+
+  /**
+   * @internal
+   * @var mem_lock
+   * @brief Protects bin_file.mem_table.
+   */
+  pthread_mutex_t mem_lock;
+
   /**
    * @internal
    * @var func_table
-   * @brief Hashtable holding list of all the currently discovered bf_func
-   * objects.
+   * @brief Map holding all the currently discovered bf_func objects.
    * @details The implementation is that the address of a function is
-   * its key.
+   * its key. Lookups do not lock, see addr_map.h.
    */
-  struct htable func_table;
+  struct bf_addr_map func_table;
 
   /**
    * @internal
    * @var bb_table
-   * @brief Hashtable holding list of all the currently discovered
-   * bf_basic_blk objects.
+   * @brief Map holding all the currently discovered bf_basic_blk
+   * objects.
    * @details The implementation is that the address of a basic block
-   * is its key.
+   * is its key. Lookups do not lock, see addr_map.h.
    */
-  struct htable bb_table;
+  struct bf_addr_map bb_table;
 
   /**
    * @internal
    * @var insn_table
-   * @brief Hashtable holding list of all currently discovered bf_insn
-   * objects.
+   * @brief Map holding all currently discovered bf_insn objects.
    * @details The implementation is that the address of a instruction is
-   * its key.
+   * its key. Lookups do not lock, see addr_map.h.
    */
-  struct htable insn_table;
+  struct bf_addr_map insn_table;
 
   /**
    * @internal
@@ -216,6 +253,22 @@ struct bin_file {
    */
   struct symbol_table sym_table;
 
+  /**
+   * @internal
+   * @var strpool
+   * @brief Pool interning the symbol names and instruction parts.
+   */
+  struct bf_strpool * strpool;
+
+  /**
+   * @internal
+   * @var analysis_dirty
+   * @brief TRUE if objects were discovered or bf_basic_blk objects were
+   * linked since the analysis was last restored from or written to the
+   * cache.
+   */
+  bool analysis_dirty;
+
   /**
    * @internal
    * @var mem_table
@@ -228,10 +281,36 @@ struct bin_file {
 
   /**
    * @internal
-   * @var context
-   * @brief Internal disassembly state.
+   * @var cfg_generation
+   * @brief Incremented whenever a bf_basic_blk is added or blocks are
+   * linked, so results derived from the CFG can tell whether they are
+   * stale.
+   */
+  unsigned long cfg_generation;
+
+  /**
+   * @internal
+   * @var reuse
+   * @brief The analysis of a previous version consulted by the
+   * disassembler, see bf_disasm_incremental(). NULL otherwise.
+   */
+  struct bf_reuse_map * reuse;
+
+  /**
+   * @internal
+   * @var xref_index
+   * @brief The cross-reference index updated by the disassembler, see
+   * bf_init_xref_index(). NULL until one is created.
+   */
+  struct bf_xref_index * xref_index;
+
+  /**
+   * @internal
+   * @var insn_index
+   * @brief The inverted instruction index updated by the disassembler, see
+   * bf_init_insn_index(). NULL until one is created.
    */
-  struct disasm_context context;
+  struct bf_insn_index * insn_index;
 };
 
 /**
@@ -280,6 +359,10 @@ extern struct bf_basic_blk * disasm_bin_file_entry(struct bin_file * bf);
  * reliable heuristic to detect whether a bf_basic_blk represents the start of
  * a function other than it being a call target. Since we can not analyse
  * backwards, we need to be instructed how the root should be treated.
+ *
+ * Several threads may disassemble the same bin_file at once. Each call
+ * decodes with its own disasm_context and the CFG is only changed under
+ * bin_file.cflow_lock.
  */
 extern struct bf_basic_blk * disasm_bin_file_sym(struct bin_file * bf,
 		struct symbol * sym, bool is_func);
@@ -294,6 +377,32 @@ extern struct bf_basic_blk * disasm_bin_file_sym(struct bin_file * bf,
  */
 extern void disasm_all_func_sym(struct bin_file * bf);
 
+/**
+ * @brief Builds a Control Flow Graph (CFG) disassembling every symbol
+ * representing a function in parallel.
+ * @param bf The bin_file being analysed.
+ * @param num_threads The number of threads to use. 0 means
+ * bf_get_num_workers(0).
+ * @details The result is the same as that of disasm_all_func_sym().
+ */
+extern void disasm_all_func_sym_parallel(struct bin_file * bf,
+		unsigned int num_threads);
+
+/**
+ * @brief Disassembles every code section with a linear sweep.
+ * @param bf The bin_file being analysed.
+ * @param num_threads The number of threads to use. 0 means
+ * bf_get_num_workers(0). Each section is swept by one thread.
+ * @details Every address following the last instruction decoded by the sweep
+ * which does not already hold a bf_insn becomes the root of a new CFG. This
+ * finds code which is not reachable from any symbol (e.g. in stripped
+ * binaries), at the price of also decoding data embedded in code sections.
+ * It is best run after the symbol based disassembly so that the roots found
+ * from symbols are treated as functions.
+ */
+extern void disasm_bin_file_sweep(struct bin_file * bf,
+		unsigned int num_threads);
+
 #ifdef __cplusplus
 }
 #endif
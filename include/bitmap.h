@@ -0,0 +1,98 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bitmap.h
+ * @brief Definition and API of bf_bitmap.
+ * @details A bf_bitmap is a set of small integers, typically the ids of the
+ * bf_insn, bf_basic_blk or bf_func objects an analysis has visited. It grows
+ * as bits are set, so it can be used without knowing how many objects there
+ * are. Sizing it with bf_get_num_basic_blks() or the like up front avoids
+ * the reallocations.
+ */
+
+#ifndef BF_BITMAP_H
+#define BF_BITMAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @struct bf_bitmap
+ * @brief A growable set of bits.
+ */
+struct bf_bitmap {
+	/**
+	 * @internal
+	 * @var words
+	 * @brief The bits, least significant first.
+	 */
+	unsigned long * words;
+
+	/**
+	 * @internal
+	 * @var num_words
+	 * @brief The number of words allocated.
+	 */
+	size_t		num_words;
+};
+
+/**
+ * @brief Initialises an empty bf_bitmap.
+ * @param bitmap The bf_bitmap to be initialised.
+ * @param num_bits The number of bits to allocate up front. May be 0.
+ * @note bf_close_bitmap() must be called to release the memory.
+ */
+extern void bf_init_bitmap(struct bf_bitmap * bitmap, size_t num_bits);
+
+/**
+ * @brief Tests a bit.
+ * @param bitmap The bf_bitmap to be tested.
+ * @param bit The index of the bit.
+ * @return TRUE if the bit is set, FALSE otherwise.
+ */
+extern bool bf_bitmap_test(struct bf_bitmap * bitmap, size_t bit);
+
+/**
+ * @brief Sets a bit, growing the bf_bitmap if needed.
+ * @param bitmap The bf_bitmap to be modified.
+ * @param bit The index of the bit.
+ * @return TRUE if the bit was already set, FALSE otherwise.
+ */
+extern bool bf_bitmap_set(struct bf_bitmap * bitmap, size_t bit);
+
+/**
+ * @brief Clears every bit, keeping the memory.
+ * @param bitmap The bf_bitmap to be cleared.
+ */
+extern void bf_clear_bitmap(struct bf_bitmap * bitmap);
+
+/**
+ * @brief Releases the memory held by a bf_bitmap.
+ * @param bitmap The bf_bitmap to be closed.
+ */
+extern void bf_close_bitmap(struct bf_bitmap * bitmap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
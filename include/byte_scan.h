@@ -0,0 +1,304 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file byte_scan.h
+ * @brief Definition and API of bf_byte_scanner.
+ * @details bf_byte_scanner searches raw bytes for many signatures at once,
+ * e.g. for triage of a binary against a library of known code or data.
+ * Signatures may contain wildcard bytes and nibbles, written as in
+ *
+ *	55 48 89 e5 ?? 8b 4? 10
+ *
+ * A run of up to BF_SCAN_MAX_ATOM exact bytes of every signature is its
+ * anchor, preferring bytes other than the padding and filler bytes 00, ff,
+ * 90 and cc. The anchors of all signatures are compiled into an Aho-Corasick
+ * automaton, so the bytes are read once
+ * whatever the number of signatures, and the rest of a signature is only
+ * compared where its anchor was found. Signatures without a single exact
+ * byte are compared at every position, so they should be rare.
+ *
+ * bf_scan_sections() sweeps every allocated section of a bin_file, as
+ * mapped by the memory manager, in parallel.
+ */
+
+#ifndef BF_BYTE_SCAN_H
+#define BF_BYTE_SCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+
+/**
+ * @brief The longest anchor taken from a signature. Longer anchors are
+ * hardly more selective but make the automaton larger.
+ */
+#define BF_SCAN_MAX_ATOM 4
+
+/**
+ * @struct bf_byte_match
+ * @brief A signature found by a bf_byte_scanner.
+ */
+struct bf_byte_match {
+	/**
+	 * @var sig
+	 * @brief The id of the signature, as returned by
+	 * bf_add_byte_signature().
+	 */
+	int		 sig;
+
+	/**
+	 * @var param
+	 * @brief The param the signature was added with.
+	 */
+	void *		 param;
+
+	/**
+	 * @var vma
+	 * @brief The VMA of the first byte of the match.
+	 */
+	bfd_vma		 vma;
+
+	/**
+	 * @var section
+	 * @brief The section holding the match, NULL for bf_scan_bytes()
+	 * without a section.
+	 */
+	asection *	 section;
+
+	/**
+	 * @var data
+	 * @brief The matched bytes.
+	 */
+	const bfd_byte * data;
+};
+
+/**
+ * @internal
+ * @struct bf_byte_sig
+ * @brief A signature of a bf_byte_scanner.
+ */
+struct bf_byte_sig {
+	/**
+	 * @var bytes
+	 * @brief The bytes of the signature.
+	 */
+	bfd_byte * bytes;
+
+	/**
+	 * @var mask
+	 * @brief The bits of bytes which have to match.
+	 */
+	bfd_byte * mask;
+
+	/**
+	 * @var length
+	 * @brief The number of bytes.
+	 */
+	size_t	   length;
+
+	/**
+	 * @var atom_offset
+	 * @brief The offset of the anchor.
+	 */
+	size_t	   atom_offset;
+
+	/**
+	 * @var atom_length
+	 * @brief The length of the anchor, 0 if the signature has no exact
+	 * byte.
+	 */
+	size_t	   atom_length;
+
+	/**
+	 * @var param
+	 * @brief Reported with every match.
+	 */
+	void *	   param;
+
+	/**
+	 * @var next
+	 * @brief The next signature with the same anchor or -1.
+	 */
+	int	   next;
+};
+
+/**
+ * @struct bf_byte_scanner
+ * @brief A set of byte signatures compiled into one automaton.
+ */
+struct bf_byte_scanner {
+	/**
+	 * @var num_sigs
+	 * @brief The number of signatures.
+	 */
+	int		     num_sigs;
+
+	/**
+	 * @var max_length
+	 * @brief The length of the longest signature.
+	 */
+	size_t		     max_length;
+
+	/**
+	 * @internal
+	 * @var sigs
+	 * @brief The signatures.
+	 */
+	struct bf_byte_sig * sigs;
+
+	/**
+	 * @internal
+	 * @var compiled
+	 * @brief TRUE if the automaton reflects every signature.
+	 */
+	bool		     compiled;
+
+	/**
+	 * @internal
+	 * @var delta
+	 * @brief The transitions of the automaton, 256 per state. Missing
+	 * trie edges are filled in from the failure links, so scanning takes
+	 * exactly one lookup per byte. The top bit marks the states at which
+	 * signatures may be found.
+	 */
+	uint32_t *	     delta;
+
+	/**
+	 * @internal
+	 * @var num_states
+	 * @brief The number of states. State 0 is the root.
+	 */
+	uint32_t	     num_states;
+
+	/**
+	 * @internal
+	 * @var state_sigs
+	 * @brief The first signature whose anchor ends in each state or -1.
+	 */
+	int *		     state_sigs;
+
+	/**
+	 * @internal
+	 * @var out_links
+	 * @brief The nearest state along the failure links of each state
+	 * which ends anchors, or 0.
+	 */
+	uint32_t *	     out_links;
+
+	/**
+	 * @internal
+	 * @var unanchored
+	 * @brief The signatures without an anchor.
+	 */
+	int *		     unanchored;
+
+	/**
+	 * @internal
+	 * @var num_unanchored
+	 * @brief The number of entries in unanchored.
+	 */
+	int		     num_unanchored;
+};
+
+/**
+ * @brief Creates an empty bf_byte_scanner.
+ * @return A bf_byte_scanner object.
+ * @note bf_close_byte_scanner() must be called to allow the object to
+ * properly clean up.
+ */
+extern struct bf_byte_scanner * bf_init_byte_scanner(void);
+
+/**
+ * @brief Adds a signature written in hex to a bf_byte_scanner.
+ * @param scanner The bf_byte_scanner to be added to.
+ * @param sig Pairs of hex digits, optionally separated by spaces. A ? in
+ * place of a digit matches any nibble.
+ * @param param Reported with every match of the signature.
+ * @return The id of the signature, counting from 0, or -1 if sig is
+ * malformed or empty.
+ * @details Must not be called while the scanner is in use.
+ */
+extern int bf_add_byte_signature(struct bf_byte_scanner * scanner,
+		const char * sig, void * param);
+
+/**
+ * @brief Adds a masked signature to a bf_byte_scanner.
+ * @param scanner The bf_byte_scanner to be added to.
+ * @param bytes The bytes of the signature.
+ * @param mask The bits of each byte which have to match, or NULL if all of
+ * them do.
+ * @param length The number of bytes.
+ * @param param Reported with every match of the signature.
+ * @return The id of the signature, counting from 0, or -1 if length is 0.
+ * @details Must not be called while the scanner is in use.
+ */
+extern int bf_add_byte_signature_masked(struct bf_byte_scanner * scanner,
+		const bfd_byte * bytes, const bfd_byte * mask, size_t length,
+		void * param);
+
+/**
+ * @brief Searches a buffer for the signatures of a bf_byte_scanner.
+ * @param scanner The bf_byte_scanner.
+ * @param buf The bytes to be searched.
+ * @param size The number of bytes.
+ * @param vma The VMA of the first byte, used to report matches.
+ * @param section The section reported with matches. Can be NULL.
+ * @param handler The callback invoked for each match, in the order the
+ * anchors are found. The match is only valid during the call.
+ * @param param Passed to handler.
+ * @return The number of matches.
+ * @details The automaton is built by the first scan after signatures were
+ * added. Several threads may scan at once once it is built.
+ */
+extern size_t bf_scan_bytes(struct bf_byte_scanner * scanner,
+		const bfd_byte * buf, size_t size, bfd_vma vma,
+		asection * section,
+		void (*handler)(struct bf_byte_match *, void *), void * param);
+
+/**
+ * @brief Searches every allocated section of a bin_file for the signatures
+ * of a bf_byte_scanner.
+ * @param scanner The bf_byte_scanner.
+ * @param bf The bin_file whose sections are searched. They are loaded
+ * through the memory manager.
+ * @param num_threads The number of threads to use. 0 means
+ * bf_get_num_workers(0). Large sections are split between threads.
+ * @param handler The callback invoked for each match on the calling thread,
+ * sorted by VMA.
+ * @param param Passed to handler.
+ * @return The number of matches.
+ */
+extern size_t bf_scan_sections(struct bf_byte_scanner * scanner,
+		struct bin_file * bf, unsigned int num_threads,
+		void (*handler)(struct bf_byte_match *, void *), void * param);
+
+/**
+ * @brief Closes a bf_byte_scanner object.
+ * @param scanner The bf_byte_scanner to be closed.
+ */
+extern void bf_close_byte_scanner(struct bf_byte_scanner * scanner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file cache.h
+ * @brief API of the <b>libbf</b> on-disk cache.
+ * @details Results which are expensive to recompute (e.g. the symbol table)
+ * can be stored in a cache directory and mapped back into memory the next
+ * time the same binary is loaded. Cache files are named after a key built
+ * from the ELF build-id of the binary (or its path when it has none), its
+ * modification time and its size, so a rebuilt binary never matches a stale
+ * entry.
+ *
+ * Caching is disabled by default. It is enabled either by setting the
+ * LIBBF_CACHE_DIR environment variable or by calling bf_enable_cache(). When
+ * no directory is given, $XDG_CACHE_HOME/libbf or ~/.cache/libbf is used.
+ *
+ * Cache files are written to a temporary file first and renamed into place so
+ * concurrent processes never observe a partially written entry.
+ */
+
+#ifndef BF_CACHE_H
+#define BF_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <bfd.h>
+
+/**
+ * @brief Enables the on-disk cache for this process.
+ * @param dir The cache directory or NULL to use the default location. It is
+ * created if it does not exist.
+ */
+extern void bf_enable_cache(const char * dir);
+
+/**
+ * @brief Disables the on-disk cache for this process.
+ */
+extern void bf_disable_cache(void);
+
+/**
+ * @brief Gets whether the on-disk cache is enabled.
+ * @return TRUE if cache files will be read and written.
+ */
+extern bool bf_cache_enabled(void);
+
+/**
+ * @brief Gets the path of a cache file for a binary.
+ * @param abfd The BFD of the binary the cache file describes.
+ * @param kind A suffix distinguishing the different kinds of cache files,
+ * e.g. "sym".
+ * @return The path, which must be released with free(), or NULL if caching
+ * is disabled or the binary can not be identified.
+ */
+extern char * bf_get_cache_path(bfd * abfd, const char * kind);
+
+/**
+ * @brief Maps a cache file into memory.
+ * @param path The path of the cache file.
+ * @param size Receives the size of the mapping.
+ * @return The read-only mapping or NULL if the file does not exist or can not
+ * be mapped.
+ * @note bf_unmap_cache_file() must be called to release the mapping.
+ */
+extern void * bf_map_cache_file(const char * path, size_t * size);
+
+/**
+ * @brief Releases a mapping returned by bf_map_cache_file().
+ * @param addr The start of the mapping.
+ * @param size The size of the mapping.
+ */
+extern void bf_unmap_cache_file(void * addr, size_t size);
+
+/**
+ * @brief Atomically writes a cache file.
+ * @param path The path of the cache file.
+ * @param data The contents to be written.
+ * @param size The number of bytes in data.
+ * @return TRUE if the file was written.
+ */
+extern bool bf_write_cache_file(const char * path, const void * data,
+		size_t size);
+
+/**
+ * @brief Computes the checksum stored in cache file headers.
+ * @param data The bytes to be checksummed.
+ * @param size The number of bytes in data.
+ * @return A 64-bit FNV-1a hash of data.
+ */
+extern uint64_t bf_cache_checksum(const void * data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file call_graph.h
+ * @brief Definition and API of bf_call_graph.
+ * @details bf_call_graph is the call graph of a bin_file, built from the
+ * calls the disassembler linked into the CFG. Every bf_func is a node, and
+ * the node of a bf_func is its dense id (see bf_get_func_by_id()), so nodes
+ * are stable across updates and arrays indexed by node only have to be
+ * extended.
+ *
+ * Three kinds of call sites are recorded:
+ *	- Direct calls, which are edges from the caller to the callee.
+ *	- Calls to PLT stubs, which are edges to the node of the stub. The
+ *	  node is marked with the name of the imported function, taken from
+ *	  the synthetic @plt symbol or the relocation of the GOT slot the stub
+ *	  jumps through.
+ *	- Indirect calls the disassembler could not resolve, which are kept as
+ *	  call sites without an edge.
+ *
+ * Callees and callers are stored in compressed sparse row form and each
+ * list is sorted and free of duplicates. The strongly connected components
+ * are found when the graph is built.
+ */
+
+#ifndef BF_CALL_GRAPH_H
+#define BF_CALL_GRAPH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "func.h"
+#include "symbol.h"
+#include "bitmap.h"
+
+/**
+ * @brief The node returned for a bf_func which is not in the graph.
+ */
+#define BF_NO_NODE UINT32_MAX
+
+/**
+ * @struct bf_call_graph
+ * @brief A call graph in compressed sparse row form.
+ */
+struct bf_call_graph {
+	/**
+	 * @var bf
+	 * @brief The bin_file the graph was built from.
+	 */
+	struct bin_file *   bf;
+
+	/**
+	 * @var generation
+	 * @brief The bin_file.cfg_generation the graph reflects.
+	 */
+	unsigned long	    generation;
+
+	/**
+	 * @var num_nodes
+	 * @brief The number of nodes, i.e. bf_get_num_funcs() when the graph
+	 * was last updated.
+	 */
+	uint32_t	    num_nodes;
+
+	/**
+	 * @var funcs
+	 * @brief Maps nodes to bf_func objects. Unused ids map to NULL.
+	 */
+	struct bf_func **   funcs;
+
+	/**
+	 * @var imports
+	 * @brief The name of the imported function of every PLT stub node,
+	 * NULL for the other nodes. The names are interned in the strpool of
+	 * the bin_file.
+	 */
+	const char **	    imports;
+
+	/**
+	 * @var callee_offsets
+	 * @brief num_nodes + 1 offsets into callees.
+	 */
+	uint32_t *	    callee_offsets;
+
+	/**
+	 * @var callees
+	 * @brief The nodes called by every node.
+	 */
+	uint32_t *	    callees;
+
+	/**
+	 * @var caller_offsets
+	 * @brief num_nodes + 1 offsets into callers.
+	 */
+	uint32_t *	    caller_offsets;
+
+	/**
+	 * @var callers
+	 * @brief The nodes calling every node.
+	 */
+	uint32_t *	    callers;
+
+	/**
+	 * @var num_edges
+	 * @brief The number of entries in callees and in callers.
+	 */
+	uint32_t	    num_edges;
+
+	/**
+	 * @var site_offsets
+	 * @brief num_nodes + 1 offsets into sites.
+	 */
+	uint32_t *	    site_offsets;
+
+	/**
+	 * @var sites
+	 * @brief The call sites of every node, in bf_enum_func_basic_blk()
+	 * order.
+	 */
+	struct call_site *  sites;
+
+	/**
+	 * @var num_sites
+	 * @brief The number of call sites.
+	 */
+	uint32_t	    num_sites;
+
+	/**
+	 * @var num_unresolved
+	 * @brief The number of call sites without a known callee, mostly
+	 * indirect calls.
+	 */
+	uint32_t	    num_unresolved;
+
+	/**
+	 * @var scc
+	 * @brief The strongly connected component of every node.
+	 * Components are numbered in reverse topological order, so a
+	 * component only calls components with lower numbers and itself.
+	 */
+	uint32_t *	    scc;
+
+	/**
+	 * @var num_sccs
+	 * @brief The number of strongly connected components.
+	 */
+	uint32_t	    num_sccs;
+
+	/**
+	 * @var scc_offsets
+	 * @brief num_sccs + 1 offsets into scc_nodes.
+	 */
+	uint32_t *	    scc_offsets;
+
+	/**
+	 * @var scc_nodes
+	 * @brief The nodes of every component.
+	 */
+	uint32_t *	    scc_nodes;
+
+	/**
+	 * @internal
+	 * @var num_threads
+	 * @brief The number of threads updates use.
+	 */
+	unsigned int	    num_threads;
+};
+
+/**
+ * @brief Builds the bf_call_graph of every discovered bf_func.
+ * @param bf The bin_file being analysed.
+ * @param num_threads The number of threads collecting the call sites or 0
+ * for the default.
+ * @return A bf_call_graph object.
+ * @note bf_close_call_graph() must be called to allow the object to properly
+ * clean up.
+ */
+extern struct bf_call_graph * bf_init_call_graph(struct bin_file * bf,
+		unsigned int num_threads);
+
+/**
+ * @brief Brings a bf_call_graph up to date with the CFG of its bin_file.
+ * @param graph The bf_call_graph to be updated.
+ * @return TRUE if the CFG had changed since the graph was built or last
+ * updated, FALSE if there was nothing to do.
+ * @details Must not be called while the bin_file is being disassembled.
+ */
+extern bool bf_update_call_graph(struct bf_call_graph * graph);
+
+/**
+ * @brief Gets the node of a bf_func.
+ * @param graph The bf_call_graph to be searched.
+ * @param func The bf_func being searched for.
+ * @return The node of func, which is func->entry.id, or BF_NO_NODE if func
+ * is not in the graph.
+ */
+extern uint32_t bf_get_call_graph_node(struct bf_call_graph * graph,
+		struct bf_func * func);
+
+/**
+ * @brief Finds the nodes reachable from a node through calls.
+ * @param graph The bf_call_graph to be searched.
+ * @param node The node to start from. It is only reported as reachable if
+ * it can call itself.
+ * @param reached Receives a bit for every reachable node. It must have been
+ * initialised with bf_init_bitmap() and is cleared first.
+ * @return The number of reachable nodes.
+ */
+extern uint32_t bf_get_reachable_nodes(struct bf_call_graph * graph,
+		uint32_t node, struct bf_bitmap * reached);
+
+/**
+ * @brief Tests whether a node can reach another through calls.
+ * @param graph The bf_call_graph to be searched.
+ * @param from The calling node.
+ * @param to The node being searched for.
+ * @return TRUE if from calls to, directly or transitively.
+ */
+extern bool bf_call_graph_reaches(struct bf_call_graph * graph,
+		uint32_t from, uint32_t to);
+
+/**
+ * @brief Tests whether a node is part of a recursion.
+ * @param graph The bf_call_graph holding the node.
+ * @param node The node to be tested.
+ * @return TRUE if the component of node has several nodes or node calls
+ * itself.
+ */
+extern bool bf_is_recursive_node(struct bf_call_graph * graph,
+		uint32_t node);
+
+/**
+ * @brief Closes a bf_call_graph object.
+ * @param graph The bf_call_graph to be closed.
+ */
+extern void bf_close_call_graph(struct bf_call_graph * graph);
+
+/**
+ * @brief Iterate over the callees of a node.
+ * @param i uint32_t to use as a loop cursor. It indexes callees.
+ * @param graph struct bf_call_graph holding the node.
+ * @param node The calling node.
+ */
+#define bf_for_each_callee(i, graph, node) \
+	for(i = (graph)->callee_offsets[node]; \
+			i < (graph)->callee_offsets[(node) + 1]; i++)
+
+/**
+ * @brief Iterate over the callers of a node.
+ * @param i uint32_t to use as a loop cursor. It indexes callers.
+ * @param graph struct bf_call_graph holding the node.
+ * @param node The called node.
+ */
+#define bf_for_each_caller(i, graph, node) \
+	for(i = (graph)->caller_offsets[node]; \
+			i < (graph)->caller_offsets[(node) + 1]; i++)
+
+/**
+ * @brief Iterate over the call sites of a node.
+ * @param i uint32_t to use as a loop cursor. It indexes sites.
+ * @param graph struct bf_call_graph holding the node.
+ * @param node The calling node.
+ */
+#define bf_for_each_call_site(i, graph, node) \
+	for(i = (graph)->site_offsets[node]; \
+			i < (graph)->site_offsets[(node) + 1]; i++)
+
+/**
+ * @brief Iterate over the nodes of a strongly connected component.
+ * @param i uint32_t to use as a loop cursor. It indexes scc_nodes.
+ * @param graph struct bf_call_graph holding the component.
+ * @param comp The number of the component.
+ */
+#define bf_for_each_scc_node(i, graph, comp) \
+	for(i = (graph)->scc_offsets[comp]; \
+			i < (graph)->scc_offsets[(comp) + 1]; i++)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -37,9 +37,21 @@ extern "C" {
 /**
  * @brief Prints the CFG starting at a bf_basic_blk to stdout.
  * @param bb The bf_basic_blk of the root of the CFG.
+ * @note Symbols of blocks are looked up on demand through their bin_file,
+ * so this only prints the ones which were already looked up. Use
+ * print_bf_cfg_stdout() to print all of them.
  */
 extern void print_cfg_stdout(struct bf_basic_blk * bb);
 
+/**
+ * @brief Prints the CFG starting at a bf_basic_blk to stdout, along with
+ * the symbol of each block.
+ * @param bf The bin_file holding the bf_basic_blk objects.
+ * @param bb The bf_basic_blk of the root of the CFG.
+ */
+extern void print_bf_cfg_stdout(struct bin_file * bf,
+		struct bf_basic_blk * bb);
+
 /**
  * @brief Prints the CFG starting at a bf_basic_blk as a DOT file.
  * @param stream An open FILE to be written to.
@@ -77,6 +89,8 @@ extern void print_all_bf_insn(struct bin_file * bf, FILE * stream);
  * @note Theoretically, if the disassembler engine performs lossless parsing of
  * instructions, the output from this function should be the same as the output
  * from print_all_bf_insn (minus any spaces).
+ * @note Both functions print the bf_insn objects in VMA order. The text is
+ * rendered in parallel on bf_get_num_workers(0) threads.
  */
 extern void print_all_bf_insn_semantic_gen(struct bin_file * bf,
 		FILE * stream);
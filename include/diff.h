@@ -0,0 +1,213 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file diff.h
+ * @brief Definition and API of bf_diff.
+ * @details bf_diff matches the bf_func objects of two disassembled bin_file
+ * objects without relying on symbols, so renamed functions, stripped
+ * binaries and functions with small changes are still paired up.
+ *
+ * Matching runs in rounds, from the most to the least reliable signal:
+ * - functions with the same symbol name.
+ * - functions with the same fingerprint (see bf_get_func_fingerprint()) when
+ * the fingerprint is unique in both binaries.
+ * - unmatched callees and callers of matched functions, paired by their
+ * position in the call graph.
+ * - the remaining functions, scored against candidates which share rare
+ * features (mnemonic trigrams and constants) with them.
+ *
+ * Candidates are found through an inverted index over the features of the
+ * second binary rather than by comparing all pairs. Features shared by many
+ * functions are ignored for candidate generation, so the work per function
+ * stays bounded.
+ */
+
+#ifndef BF_DIFF_H
+#define BF_DIFF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "binary_file.h"
+#include "func.h"
+
+/**
+ * @enum bf_match_kind
+ * @brief The signal a bf_func_match was found by.
+ */
+enum bf_match_kind {
+	/**
+	 * @brief Both functions have the same symbol name.
+	 */
+	BF_MATCH_NAME,
+
+	/**
+	 * @brief Both functions have the same unique fingerprint.
+	 */
+	BF_MATCH_FINGERPRINT,
+
+	/**
+	 * @brief Both functions are called from, or call, the same matched
+	 * function.
+	 */
+	BF_MATCH_CALL_GRAPH,
+
+	/**
+	 * @brief The functions were the best scoring candidates of each other.
+	 */
+	BF_MATCH_FUZZY
+};
+
+/**
+ * @struct bf_func_match
+ * @brief A pair of corresponding functions.
+ */
+struct bf_func_match {
+	/**
+	 * @var func
+	 * @brief The bf_func in the first bin_file.
+	 */
+	struct bf_func *   func;
+
+	/**
+	 * @var func2
+	 * @brief The bf_func in the second bin_file.
+	 */
+	struct bf_func *   func2;
+
+	/**
+	 * @var similarity
+	 * @brief How alike the functions are, from 0 to 1. It is 1 exactly when
+	 * their fingerprints are equal.
+	 */
+	double		   similarity;
+
+	/**
+	 * @var kind
+	 * @brief The signal the match was found by.
+	 */
+	enum bf_match_kind kind;
+};
+
+/**
+ * @struct bf_diff
+ * @brief The result of matching the functions of two bin_file objects.
+ */
+struct bf_diff {
+	/**
+	 * @var bf
+	 * @brief The first bin_file.
+	 */
+	struct bin_file *      bf;
+
+	/**
+	 * @var bf2
+	 * @brief The second bin_file.
+	 */
+	struct bin_file *      bf2;
+
+	/**
+	 * @var matches
+	 * @brief The matched pairs, sorted by the VMA of bf_func_match.func.
+	 */
+	struct bf_func_match * matches;
+
+	/**
+	 * @var num_matches
+	 * @brief The number of matched pairs.
+	 */
+	size_t		       num_matches;
+
+	/**
+	 * @var removed
+	 * @brief The functions of the first bin_file without a match, sorted by
+	 * VMA.
+	 */
+	struct bf_func **      removed;
+
+	/**
+	 * @var num_removed
+	 * @brief The number of functions in removed.
+	 */
+	size_t		       num_removed;
+
+	/**
+	 * @var added
+	 * @brief The functions of the second bin_file without a match, sorted by
+	 * VMA.
+	 */
+	struct bf_func **      added;
+
+	/**
+	 * @var num_added
+	 * @brief The number of functions in added.
+	 */
+	size_t		       num_added;
+};
+
+/**
+ * @brief Matches the functions of two bin_file objects.
+ * @param bf The first bin_file. It should have been disassembled already.
+ * @param bf2 The second bin_file. It should have been disassembled already.
+ * @param num_threads The number of threads to use. 0 means
+ * bf_get_num_workers(0).
+ * @param threshold The lowest similarity a fuzzy or call graph match is
+ * accepted with. 0 selects the default of 0.5.
+ * @return A bf_diff object.
+ * @note bf_close_diff() must be called to allow the object to properly clean
+ * up.
+ */
+extern struct bf_diff * bf_diff_bins(struct bin_file * bf,
+		struct bin_file * bf2, unsigned int num_threads,
+		double threshold);
+
+/**
+ * @brief Gets the match of a function of the first bin_file.
+ * @param diff The bf_diff to be searched.
+ * @param func A bf_func of bf_diff.bf.
+ * @return The bf_func_match of func or NULL if it was not matched.
+ */
+extern struct bf_func_match * bf_get_func_match(struct bf_diff * diff,
+		struct bf_func * func);
+
+/**
+ * @brief Prints a bf_diff to a FILE.
+ * @param diff The bf_diff to be printed.
+ * @param stream An open FILE to be written to.
+ * @param all If FALSE, pairs with a similarity of 1 are left out.
+ * @details Each line holds a mark, the similarity, the signal and the names
+ * (or VMAs) of the two functions. The mark is '=' for identical pairs, '~'
+ * for changed pairs, '-' for removed and '+' for added functions.
+ */
+extern void bf_print_diff(struct bf_diff * diff, FILE * stream, bool all);
+
+/**
+ * @brief Closes a bf_diff object.
+ * @param diff The bf_diff to be closed.
+ */
+extern void bf_close_diff(struct bf_diff * diff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file extent.h
+ * @brief Definition and API of bf_extent_index.
+ * @details A bf_extent_index is a sorted array of [start, end) address ranges
+ * each associated with an object (e.g. a bf_basic_blk or a bf_func). It
+ * answers "which object contains this address" queries, which the
+ * address-keyed hashtables of bin_file can not answer since they only find
+ * objects starting exactly at an address.
+ *
+ * The start addresses are kept in their own contiguous array so that the
+ * search only touches one cache line per step. Lookups are performed with a
+ * branchless lower bound which makes resolving large batches of addresses
+ * (e.g. profiler samples) cheap.
+ */
+
+#ifndef BF_EXTENT_H
+#define BF_EXTENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <bfd.h>
+
+/**
+ * @struct bf_extent
+ * @brief A single [start, end) address range.
+ */
+struct bf_extent {
+	/**
+	 * @var start
+	 * @brief The first VMA covered by the extent.
+	 */
+	bfd_vma start;
+
+	/**
+	 * @var end
+	 * @brief The first VMA past the end of the extent.
+	 */
+	bfd_vma end;
+
+	/**
+	 * @var obj
+	 * @brief The object the extent describes.
+	 */
+	void *	obj;
+};
+
+/**
+ * @struct bf_extent_index
+ * @brief A sorted collection of bf_extent objects.
+ * @details Extents are added with bf_add_extent() and become searchable once
+ * bf_sort_extent_index() has been called.
+ */
+struct bf_extent_index {
+	/**
+	 * @var starts
+	 * @brief The start VMAs of the extents in sorted order.
+	 */
+	bfd_vma *	   starts;
+
+	/**
+	 * @var extents
+	 * @brief The extents in the same order as bf_extent_index.starts.
+	 */
+	struct bf_extent * extents;
+
+	/**
+	 * @internal
+	 * @var parents
+	 * @brief The position of the innermost extent enclosing each extent,
+	 * or -1 if there is none.
+	 */
+	long *		   parents;
+
+	/**
+	 * @var count
+	 * @brief The number of extents held.
+	 */
+	size_t		   count;
+
+	/**
+	 * @internal
+	 * @var capacity
+	 * @brief The number of extents that can be held without growing.
+	 */
+	size_t		   capacity;
+};
+
+/**
+ * @brief Initialises an empty bf_extent_index.
+ * @param index The bf_extent_index to be initialised.
+ * @note bf_close_extent_index() must be called to release the memory.
+ */
+extern void bf_init_extent_index(struct bf_extent_index * index);
+
+/**
+ * @brief Adds an extent to a bf_extent_index.
+ * @param index The bf_extent_index to be added to.
+ * @param start The first VMA of the extent.
+ * @param end The first VMA past the end of the extent.
+ * @param obj The object to be associated with the extent.
+ * @note The extent can not be found until bf_sort_extent_index() is called.
+ */
+extern void bf_add_extent(struct bf_extent_index * index, bfd_vma start,
+		bfd_vma end, void * obj);
+
+/**
+ * @brief Adds an extent for every code section of a BFD and sorts the
+ * bf_extent_index.
+ * @param index The bf_extent_index to be added to.
+ * @param abfd The BFD whose sections are added. Each extent is associated
+ * with its asection.
+ */
+extern void bf_add_code_sections(struct bf_extent_index * index,
+		bfd * abfd);
+
+/**
+ * @brief Sorts the extents so that they can be searched.
+ * @param index The bf_extent_index to be sorted.
+ */
+extern void bf_sort_extent_index(struct bf_extent_index * index);
+
+/**
+ * @brief Gets the position of the last extent starting at or before a VMA.
+ * @param index The sorted bf_extent_index to be searched.
+ * @param vma The VMA being searched for.
+ * @return The position of the extent or -1 if every extent starts after vma.
+ * @note The returned extent does not necessarily contain vma.
+ */
+extern long bf_lower_extent(struct bf_extent_index * index, bfd_vma vma);
+
+/**
+ * @brief Gets the extent containing a VMA.
+ * @param index The sorted bf_extent_index to be searched.
+ * @param vma The VMA being searched for.
+ * @return The bf_extent containing vma or NULL if there is none.
+ * @note If extents are nested the innermost one containing vma is returned.
+ */
+extern struct bf_extent * bf_find_extent(struct bf_extent_index * index,
+		bfd_vma vma);
+
+/**
+ * @brief Gets the extents containing each of an array of VMAs.
+ * @param index The sorted bf_extent_index to be searched.
+ * @param vmas The VMAs being searched for.
+ * @param count The number of VMAs in vmas.
+ * @param positions Filled with the position in bf_extent_index.extents of
+ * the extent containing each VMA, or -1 if there is none.
+ * @return The number of VMAs which were contained in an extent.
+ */
+extern size_t bf_find_extents(struct bf_extent_index * index,
+		const bfd_vma * vmas, size_t count, long * positions);
+
+/**
+ * @brief Releases the memory held by a bf_extent_index.
+ * @param index The bf_extent_index to be closed.
+ */
+extern void bf_close_extent_index(struct bf_extent_index * index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file flow_graph.h
+ * @brief Definition and API of bf_flow_graph.
+ * @details bf_flow_graph is a compact copy of the CFG of a bin_file meant
+ * for graph algorithms. Blocks are numbered by their dense bf_basic_blk ids,
+ * see bf_get_bb_by_id(), and the edges are stored in compressed sparse row
+ * form: the successors of block id are
+ * succs[succ_offsets[id]] up to succs[succ_offsets[id + 1]], and likewise
+ * for the predecessors. Each edge is tagged with a bf_edge_kind, so
+ * intraprocedural analyses can skip calls and backward analyses can walk the
+ * predecessors without searching.
+ *
+ * The graph is a snapshot. bf_update_flow_graph() brings it up to date after
+ * more code has been disassembled. Blocks keep their ids across updates and
+ * new blocks are numbered after the existing ones, so arrays indexed by id
+ * only have to be extended. The few ids left unused by racing disassembler
+ * threads have a NULL entry in blocks and no edges.
+ */
+
+#ifndef BF_FLOW_GRAPH_H
+#define BF_FLOW_GRAPH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "basic_blk.h"
+#include "func.h"
+
+/**
+ * @brief The id returned for a bf_basic_blk which is not in the graph.
+ */
+#define BF_NO_BLOCK UINT32_MAX
+
+/**
+ * @enum bf_edge_kind
+ * @brief The way control flows along an edge.
+ */
+enum bf_edge_kind {
+	/**
+	 * @brief Execution continues with the next instruction, e.g. after a
+	 * conditional branch which is not taken or a call which returns.
+	 */
+	BF_EDGE_FALLTHROUGH,
+
+	/**
+	 * @brief A jump, taken conditional branch or detour.
+	 */
+	BF_EDGE_BRANCH,
+
+	/**
+	 * @brief A call to the start of a subroutine.
+	 */
+	BF_EDGE_CALL
+};
+
+/**
+ * @struct bf_flow_graph
+ * @brief A CFG in compressed sparse row form.
+ */
+struct bf_flow_graph {
+	/**
+	 * @var bf
+	 * @brief The bin_file the graph was built from.
+	 */
+	struct bin_file *      bf;
+
+	/**
+	 * @var generation
+	 * @brief The bin_file.cfg_generation the graph reflects.
+	 */
+	unsigned long	       generation;
+
+	/**
+	 * @var blocks
+	 * @brief Maps ids to bf_basic_blk objects. Unused ids map to NULL.
+	 */
+	struct bf_basic_blk ** blocks;
+
+	/**
+	 * @var num_blocks
+	 * @brief The number of ids, i.e. bf_get_num_basic_blks() when the
+	 * graph was last updated.
+	 */
+	uint32_t	       num_blocks;
+
+	/**
+	 * @var num_edges
+	 * @brief The number of edges.
+	 */
+	uint32_t	       num_edges;
+
+	/**
+	 * @var succ_offsets
+	 * @brief num_blocks + 1 offsets into succs and succ_kinds.
+	 */
+	uint32_t *	       succ_offsets;
+
+	/**
+	 * @var succs
+	 * @brief The ids of the successors of every block.
+	 */
+	uint32_t *	       succs;
+
+	/**
+	 * @var succ_kinds
+	 * @brief The bf_edge_kind of each entry of succs.
+	 */
+	uint8_t *	       succ_kinds;
+
+	/**
+	 * @var pred_offsets
+	 * @brief num_blocks + 1 offsets into preds and pred_kinds.
+	 */
+	uint32_t *	       pred_offsets;
+
+	/**
+	 * @var preds
+	 * @brief The ids of the predecessors of every block.
+	 */
+	uint32_t *	       preds;
+
+	/**
+	 * @var pred_kinds
+	 * @brief The bf_edge_kind of each entry of preds.
+	 */
+	uint8_t *	       pred_kinds;
+};
+
+/**
+ * @brief Builds a bf_flow_graph of every discovered bf_basic_blk.
+ * @param bf The bin_file being analysed.
+ * @return A bf_flow_graph object.
+ * @note bf_close_flow_graph() must be called to allow the object to properly
+ * clean up.
+ */
+extern struct bf_flow_graph * bf_init_flow_graph(struct bin_file * bf);
+
+/**
+ * @brief Brings a bf_flow_graph up to date with the CFG of its bin_file.
+ * @param graph The bf_flow_graph to be updated.
+ * @return TRUE if the CFG had changed since the graph was built or last
+ * updated, FALSE if there was nothing to do.
+ * @details Must not be called while the bin_file is being disassembled.
+ */
+extern bool bf_update_flow_graph(struct bf_flow_graph * graph);
+
+/**
+ * @brief Gets the id of a bf_basic_blk.
+ * @param graph The bf_flow_graph to be searched.
+ * @param bb The bf_basic_blk being searched for.
+ * @return The id of bb, which is bb->entry.id, or BF_NO_BLOCK if bb is not
+ * in the graph.
+ */
+extern uint32_t bf_get_flow_graph_id(struct bf_flow_graph * graph,
+		struct bf_basic_blk * bb);
+
+/**
+ * @brief Gets the ids of the blocks of a bf_func.
+ * @param graph The bf_flow_graph holding the blocks.
+ * @param func The bf_func whose blocks are collected.
+ * @param count Receives the number of ids.
+ * @return An array which must be released with free(). The ids are in
+ * bf_enum_func_basic_blk() order, so the first one is the entry.
+ */
+extern uint32_t * bf_collect_func_block_ids(struct bf_flow_graph * graph,
+		struct bf_func * func, uint32_t * count);
+
+/**
+ * @brief Closes a bf_flow_graph object.
+ * @param graph The bf_flow_graph to be closed.
+ */
+extern void bf_close_flow_graph(struct bf_flow_graph * graph);
+
+/**
+ * @brief Iterate over the successor edges of a block.
+ * @param edge uint32_t to use as a loop cursor. It indexes succs and
+ * succ_kinds.
+ * @param graph struct bf_flow_graph holding the block.
+ * @param id The id of the block.
+ */
+#define bf_for_each_succ_edge(edge, graph, id) \
+	for(edge = (graph)->succ_offsets[id]; \
+			edge < (graph)->succ_offsets[(id) + 1]; edge++)
+
+/**
+ * @brief Iterate over the predecessor edges of a block.
+ * @param edge uint32_t to use as a loop cursor. It indexes preds and
+ * pred_kinds.
+ * @param graph struct bf_flow_graph holding the block.
+ * @param id The id of the block.
+ */
+#define bf_for_each_pred_edge(edge, graph, id) \
+	for(edge = (graph)->pred_offsets[id]; \
+			edge < (graph)->pred_offsets[(id) + 1]; edge++)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,9 +32,13 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 #include "binary_file.h"
 #include "symbol.h"
 
+struct bf_func_flow;
+
 /**
  * @struct bf_func
  * @brief <b>libbf</b>'s abstraction of a function.
@@ -49,11 +53,11 @@ struct bf_func {
 	bfd_vma		      vma;
 
 	/**
-	 * @internal
 	 * @var entry
-	 * @brief Entry into the bin_file.func_table hashtable of bin_file.
+	 * @brief Entry into the bin_file.func_table map of bin_file.
+	 * entry.id is the dense id of the bf_func, see bf_get_func_by_id().
 	 */
-	struct htable_entry   entry;
+	struct bf_addr_node   entry;
 
 
 	/**
@@ -62,12 +66,43 @@ struct bf_func {
 	 */
 	struct bf_basic_blk * bb;
 
-	/*
+	/**
+	 * @internal
 	 * @var sym
 	 * @brief A symbol associated with bf_func.vma.
-	 * @note This is the same as bf_func.bb->sym.
+	 * @details Only valid once bf_func.sym_resolved is set, use
+	 * bf_get_func_sym() to read it.
 	 */
 	struct symbol *	      sym;
+
+	/**
+	 * @internal
+	 * @var sym_resolved
+	 * @brief Whether bf_func.sym has been looked up.
+	 */
+	bool		      sym_resolved;
+
+	/**
+	 * @internal
+	 * @var fingerprint
+	 * @brief The cached result of bf_get_func_fingerprint().
+	 */
+	uint64_t	      fingerprint;
+
+	/**
+	 * @internal
+	 * @var fingerprint_generation
+	 * @brief One more than the bin_file.cfg_generation
+	 * bf_func.fingerprint was computed at, 0 if it has not been computed.
+	 */
+	unsigned long	      fingerprint_generation;
+
+	/**
+	 * @internal
+	 * @var flow
+	 * @brief The cached result of bf_get_func_flow() or NULL.
+	 */
+	struct bf_func_flow * flow;
 };
 
 /**
@@ -93,11 +128,14 @@ extern void bf_close_func(struct bf_func * func);
 
 /**
  * @internal
- * @brief Adds a bf_func to the bin_file.func_table.
+ * @brief Adds a bf_func to the bin_file.func_table unless one already
+ * exists at the same VMA.
  * @param bf The bin_file holding the bin_file.func_table to be added to.
  * @param func The bf_func to be added.
+ * @return func if it was added, otherwise the bf_func already held.
  */
-extern void bf_add_func(struct bin_file * bf, struct bf_func * func);
+extern struct bf_func * bf_add_func(struct bin_file * bf,
+		struct bf_func * func);
 
 /**
  * @brief Gets the bf_func object for the starting VMA.
@@ -108,6 +146,17 @@ extern void bf_add_func(struct bin_file * bf, struct bf_func * func);
  */
 extern struct bf_func * bf_get_func(struct bin_file * bf, bfd_vma vma);
 
+/**
+ * @brief Gets the symbol associated with the start of a bf_func.
+ * @param bf The bin_file holding func.
+ * @param func The bf_func to get the symbol of.
+ * @return The symbol at bf_func.vma or NULL if there is none.
+ * @details The symbol is looked up on the first call, so building functions
+ * does not force bin_file.sym_table to be loaded.
+ */
+extern struct symbol * bf_get_func_sym(struct bin_file * bf,
+		struct bf_func * func);
+
 /**
  * @brief Gets the bf_func object with symbol information corresponding to a
  * particular name.
@@ -115,6 +164,10 @@ extern struct bf_func * bf_get_func(struct bin_file * bf, bfd_vma vma);
  * @param name The name information to be searched for.
  * @return The bf_func corresponding to name or NULL if no bf_func has contains
  * such information.
+ * @details The name is resolved through the symbol name index of
+ * bin_file.sym_table, so this does not need to enumerate the bf_func objects.
+ * A name which is not the raw name of any symbol is looked up as a demangled
+ * name, so C++ functions can be found by either.
  */
 extern struct bf_func * bf_get_func_from_name(struct bin_file * bf,
 		char * name);
@@ -127,6 +180,26 @@ extern struct bf_func * bf_get_func_from_name(struct bin_file * bf,
  */
 extern bool bf_exists_func(struct bin_file * bf, bfd_vma vma);
 
+/**
+ * @brief Gets the bf_func object with a given id.
+ * @param bf The bin_file to be searched.
+ * @param id The id of the bf_func, as found in its entry.id.
+ * @return The bf_func with that id or NULL if there is none.
+ * @details Ids are handed out from 0 in the order the objects are discovered
+ * and never change, so per-object state can be kept in arrays of
+ * bf_get_num_funcs() entries indexed by id.
+ */
+extern struct bf_func * bf_get_func_by_id(struct bin_file * bf,
+		uint32_t id);
+
+/**
+ * @brief Gets the number of ids handed out to bf_func objects.
+ * @param bf The bin_file being analysed.
+ * @return One more than the largest id. A few ids may be unused if threads
+ * raced to discover the same function.
+ */
+extern uint32_t bf_get_num_funcs(struct bin_file * bf);
+
 /**
  * @internal
  * @brief Releases memory for all currently discovered bf_func objects.
@@ -145,14 +218,52 @@ extern void bf_enum_func(struct bin_file * bf,
 		void (*handler)(struct bin_file *, struct bf_func *,
 		void *), void * param);
 
+/**
+ * @brief Invokes a callback for each bf_basic_blk belonging to a bf_func.
+ * @param bf The bin_file holding the bf_func.
+ * @param func The bf_func whose blocks are enumerated.
+ * @param handler The callback to be invoked for each bf_basic_blk.
+ * @param param This will be passed to the handler each time it is invoked. It
+ * can be used to pass data to the callback.
+ * @details The blocks are those reachable from bf_func.bb without following
+ * calls or entering another bf_func (e.g. through a tail jump). They are
+ * visited in depth first order, following bf_basic_blk.target before
+ * bf_basic_blk.target2, so the order only depends on the shape of the CFG and
+ * not on the addresses of the blocks.
+ */
+extern void bf_enum_func_basic_blk(struct bin_file * bf, struct bf_func * func,
+		void (*handler)(struct bin_file *, struct bf_basic_blk *,
+		void *), void * param);
+
+/**
+ * @brief Gets a structural hash of a bf_func.
+ * @param bf The bin_file holding the bf_func.
+ * @param func The bf_func to be hashed.
+ * @return The fingerprint of func.
+ * @details The hash covers the mnemonics and operand classes of the
+ * instructions of every block in bf_enum_func_basic_blk() order, together
+ * with the edges between those blocks. Register operands and small constants
+ * are part of the hash. Branch and call targets, absolute addresses,
+ * RIP-relative displacements and immediates which fall inside the address
+ * range of the binary are masked, since they change whenever code or data
+ * moves. Two versions of a function which only differ in layout therefore
+ * have the same fingerprint.
+ *
+ * The fingerprint is computed on first use and cached in the bf_func. It is
+ * recomputed if the CFG has changed since, but should only be requested once
+ * disassembly has finished.
+ */
+extern uint64_t bf_get_func_fingerprint(struct bin_file * bf,
+		struct bf_func * func);
+
 /**
  * @brief Iterate over the bf_func objects of a bin_file.
  * @param func struct bf_func to use as a loop cursor.
  * @param bf struct bin_file holding the bf_func objects.
  */
 #define bf_for_each_func(func, bf) \
-	struct htable_entry * cur_entry; \
-	htable_for_each_entry(func, cur_entry, &bf->func_table, entry)
+	struct bf_addr_node * cur_entry; \
+	bf_addr_map_for_each_entry(func, cur_entry, &bf->func_table, entry)
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,285 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file func_flow.h
+ * @brief Definition and API of bf_func_flow.
+ * @details bf_func_flow holds the control flow analyses of one bf_func:
+ * reverse post-order, dominators, post-dominators and the loop nest. They are
+ * computed over the blocks bf_enum_func_basic_blk() visits, so calls and
+ * jumps into other functions are not edges.
+ *
+ * Blocks are referred to by their index in bf_func_flow.blocks, with the
+ * entry at index 0. Dominators are found with the iterative algorithm of
+ * Cooper, Harvey and Kennedy, which only needs the predecessors and the
+ * reverse post-order and converges in a few passes on the small graphs of
+ * single functions.
+ * Post-dominators are found the same way on the reversed graph, with a
+ * virtual exit succeeding every block that has no successors.
+ *
+ * A loop is the natural loop of a header h, i.e. h and every block reaching
+ * a back edge to h without passing through h. Back edges are edges whose
+ * target dominates their source, so the cycles of irreducible regions are
+ * not reported as loops.
+ *
+ * The result is cached on the bf_func. It is recomputed by the next
+ * bf_get_func_flow() once more code has been disassembled, which also frees
+ * the old result.
+ */
+
+#ifndef BF_FUNC_FLOW_H
+#define BF_FUNC_FLOW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "basic_blk.h"
+#include "func.h"
+#include "flow_graph.h"
+
+/**
+ * @struct bf_loop
+ * @brief A natural loop.
+ */
+struct bf_loop {
+	/**
+	 * @var header
+	 * @brief The index of the header, the only block entered from
+	 * outside the loop.
+	 */
+	uint32_t header;
+
+	/**
+	 * @var parent
+	 * @brief The index of the innermost enclosing loop or BF_NO_BLOCK.
+	 */
+	uint32_t parent;
+
+	/**
+	 * @var depth
+	 * @brief The nesting depth, 1 for an outermost loop.
+	 */
+	uint32_t depth;
+
+	/**
+	 * @var num_back_edges
+	 * @brief The number of back edges to the header.
+	 */
+	uint32_t num_back_edges;
+
+	/**
+	 * @var first_block
+	 * @brief The offset of the blocks of the loop in
+	 * bf_func_flow.loop_blocks. The header comes first.
+	 */
+	uint32_t first_block;
+
+	/**
+	 * @var num_blocks
+	 * @brief The number of blocks of the loop, including those of nested
+	 * loops.
+	 */
+	uint32_t num_blocks;
+};
+
+/**
+ * @struct bf_func_flow
+ * @brief The control flow analyses of a bf_func.
+ */
+struct bf_func_flow {
+	/**
+	 * @var func
+	 * @brief The bf_func analysed.
+	 */
+	struct bf_func *       func;
+
+	/**
+	 * @internal
+	 * @var generation
+	 * @brief The bin_file.cfg_generation the analyses reflect.
+	 */
+	unsigned long	       generation;
+
+	/**
+	 * @var num_blocks
+	 * @brief The number of blocks of the function.
+	 */
+	uint32_t	       num_blocks;
+
+	/**
+	 * @var blocks
+	 * @brief The blocks in bf_enum_func_basic_blk() order.
+	 */
+	struct bf_basic_blk ** blocks;
+
+	/**
+	 * @var succ_offsets
+	 * @brief num_blocks + 1 offsets into succs.
+	 */
+	uint32_t *	       succ_offsets;
+
+	/**
+	 * @var succs
+	 * @brief The indices of the successors of every block.
+	 */
+	uint32_t *	       succs;
+
+	/**
+	 * @var pred_offsets
+	 * @brief num_blocks + 1 offsets into preds.
+	 */
+	uint32_t *	       pred_offsets;
+
+	/**
+	 * @var preds
+	 * @brief The indices of the predecessors of every block.
+	 */
+	uint32_t *	       preds;
+
+	/**
+	 * @var rpo
+	 * @brief The indices of the blocks in reverse post-order.
+	 */
+	uint32_t *	       rpo;
+
+	/**
+	 * @var rpo_index
+	 * @brief The position of every block in rpo.
+	 */
+	uint32_t *	       rpo_index;
+
+	/**
+	 * @var idom
+	 * @brief The immediate dominator of every block. BF_NO_BLOCK for the
+	 * entry.
+	 */
+	uint32_t *	       idom;
+
+	/**
+	 * @var ipdom
+	 * @brief The immediate post-dominator of every block. BF_NO_BLOCK if
+	 * the block is only post-dominated by the virtual exit or can not
+	 * reach an exit at all.
+	 */
+	uint32_t *	       ipdom;
+
+	/**
+	 * @var loops
+	 * @brief The loops, ordered so that every loop comes after the loops
+	 * enclosing it.
+	 */
+	struct bf_loop *       loops;
+
+	/**
+	 * @var num_loops
+	 * @brief The number of loops.
+	 */
+	uint32_t	       num_loops;
+
+	/**
+	 * @var loop_blocks
+	 * @brief The indices of the blocks of every loop, see
+	 * bf_loop.first_block.
+	 */
+	uint32_t *	       loop_blocks;
+
+	/**
+	 * @var block_loop
+	 * @brief The innermost loop of every block or BF_NO_BLOCK.
+	 */
+	uint32_t *	       block_loop;
+
+	/**
+	 * @internal
+	 * @var lookup
+	 * @brief The bf_basic_blk id of every block in the high half and its
+	 * index in the low half, sorted.
+	 */
+	uint64_t *	       lookup;
+};
+
+/**
+ * @brief Gets the control flow analyses of a bf_func.
+ * @param bf The bin_file holding the bf_func.
+ * @param func The bf_func being analysed.
+ * @return The bf_func_flow cached on func, computed first if it is missing
+ * or stale. It is owned by func.
+ * @note The result must not be used after the bin_file has been disassembled
+ * further, since the next call frees it. Safe to call from several threads,
+ * but not while the bin_file is being disassembled.
+ */
+extern struct bf_func_flow * bf_get_func_flow(struct bin_file * bf,
+		struct bf_func * func);
+
+/**
+ * @brief Computes the control flow analyses of every bf_func.
+ * @param bf The bin_file holding the bf_func objects.
+ * @param num_threads The number of threads to use or 0 for the default.
+ * @details Functions are analysed in parallel. Afterwards bf_get_func_flow()
+ * returns the cached results until more code is disassembled.
+ */
+extern void bf_analyse_func_flows(struct bin_file * bf,
+		unsigned int num_threads);
+
+/**
+ * @brief Gets the index of a bf_basic_blk in a bf_func_flow.
+ * @param flow The bf_func_flow to be searched.
+ * @param bb The bf_basic_blk being searched for.
+ * @return The index of bb in bf_func_flow.blocks or BF_NO_BLOCK if it is not
+ * a block of the function.
+ */
+extern uint32_t bf_get_func_flow_index(struct bf_func_flow * flow,
+		struct bf_basic_blk * bb);
+
+/**
+ * @brief Tests whether a block dominates another.
+ * @param flow The bf_func_flow holding the blocks.
+ * @param dom The index of the possible dominator.
+ * @param index The index of the dominated block.
+ * @return TRUE if every path from the entry to index passes through dom.
+ * Every block dominates itself.
+ */
+extern bool bf_dominates(struct bf_func_flow * flow, uint32_t dom,
+		uint32_t index);
+
+/**
+ * @internal
+ * @brief Closes a bf_func_flow object.
+ * @param flow The bf_func_flow to be closed. May be NULL.
+ */
+extern void bf_close_func_flow(struct bf_func_flow * flow);
+
+/**
+ * @brief Iterate over the blocks of a bf_loop.
+ * @param i uint32_t to use as a loop cursor. It indexes
+ * bf_func_flow.loop_blocks.
+ * @param flow struct bf_func_flow holding the loop.
+ * @param loop struct bf_loop * being iterated.
+ */
+#define bf_for_each_loop_block(i, flow, loop) \
+	for(i = (loop)->first_block; \
+			i < (loop)->first_block + (loop)->num_blocks; i++)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file incremental.h
+ * @brief API for analysing a new version of a binary incrementally.
+ * @details Successive releases of a program share most of their code, but
+ * the linker usually moves it. bf_disasm_incremental() disassembles a new
+ * version of a binary the same way disasm_all_func_sym() does, except that
+ * instructions which are unchanged since an already analysed version are
+ * copied from it instead of being decoded again.
+ *
+ * Functions are matched by symbol name. For each matched function the
+ * distance it moved is known, so every instruction address in the new
+ * version maps to an address in the old one. An instruction is copied if its
+ * bytes are identical at both addresses and it decodes the same wherever it
+ * is placed. Instructions with PC-relative operands (direct branches and
+ * calls, RIP-relative memory references) print their absolute target, so
+ * they are only copied if the function did not move. Everything else is
+ * decoded as usual. The CFG is built by the usual traversal, so new and
+ * changed regions are found exactly as they would be from scratch.
+ */
+
+#ifndef BF_INCREMENTAL_H
+#define BF_INCREMENTAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "binary_file.h"
+#include "insn.h"
+#include "extent.h"
+#include "mem_manager.h"
+
+/**
+ * @struct bf_reuse_stats
+ * @brief Statistics of an incremental disassembly.
+ */
+struct bf_reuse_stats {
+	/**
+	 * @var matched_funcs
+	 * @brief The number of functions matched to the previous version.
+	 */
+	size_t matched_funcs;
+
+	/**
+	 * @var reused_insns
+	 * @brief The number of bf_insn objects copied from the previous
+	 * version.
+	 */
+	size_t reused_insns;
+
+	/**
+	 * @var decoded_insns
+	 * @brief The number of bf_insn objects decoded by <b>libopcodes</b>.
+	 */
+	size_t decoded_insns;
+};
+
+/**
+ * @internal
+ * @struct bf_reuse_map
+ * @brief Maps the functions of a bin_file to those of a previous version.
+ */
+struct bf_reuse_map {
+	/**
+	 * @var old_bf
+	 * @brief The analysed previous version.
+	 */
+	struct bin_file *      old_bf;
+
+	/**
+	 * @var funcs
+	 * @brief The extents of the matched functions in the new version. The
+	 * object of each extent is the symbol of the function in old_bf.
+	 */
+	struct bf_extent_index funcs;
+
+	/**
+	 * @var stats
+	 * @brief Updated atomically by the disassembling threads.
+	 */
+	struct bf_reuse_stats  stats;
+};
+
+/**
+ * @brief Disassembles a bin_file reusing the analysis of a previous version.
+ * @param bf The bin_file being analysed.
+ * @param old_bf A previous version of the same program which has already been
+ * disassembled. It must not be modified during the call.
+ * @param num_threads The number of threads to use. 0 means
+ * bf_get_num_workers(0).
+ * @param stats Filled with statistics about the reuse. Can be NULL.
+ * @details The result is the same as that of disasm_all_func_sym() followed
+ * by disasm_bin_file_entry().
+ */
+extern void bf_disasm_incremental(struct bin_file * bf,
+		struct bin_file * old_bf, unsigned int num_threads,
+		struct bf_reuse_stats * stats);
+
+/**
+ * @internal
+ * @brief Gets the instruction of the previous version which can be copied to
+ * a VMA.
+ * @param map The bf_reuse_map of the bin_file being disassembled.
+ * @param mem The section holding vma in the new version.
+ * @param vma The VMA about to be decoded.
+ * @return The bf_insn of the previous version or NULL if the instruction has
+ * to be decoded.
+ */
+extern struct bf_insn * bf_find_reusable_insn(struct bf_reuse_map * map,
+		struct bf_mem_block * mem, bfd_vma vma);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -45,6 +45,10 @@ extern "C" {
  */
 struct bf_insn_part {
 	struct list_head list;
+
+	/*
+	 * Interned in bin_file.strpool and released along with it.
+	 */
 	char *		 str;
 };
 
@@ -133,12 +137,11 @@ struct bf_insn {
 	struct list_head      part_list;
 
 	/**
-	 * @internal
 	 * @var entry
-	 * @brief Entry into the bin_file.insn_table hashtable of
-	 * bin_file.
+	 * @brief Entry into the bin_file.insn_table map of bin_file.
+	 * entry.id is the dense id of the bf_insn, see bf_get_insn_by_id().
 	 */
-	struct htable_entry   entry;
+	struct bf_addr_node   entry;
 
 	/**
 	 * @var bb
@@ -160,10 +163,12 @@ extern struct bf_insn * bf_init_insn(struct bf_basic_blk * bb, bfd_vma vma);
 /**
  * @internal
  * @brief Appends to the tail of the parts list.
+ * @param bf The bin_file whose strpool holds the part.
  * @param insn The bf_insn whose parts list is to be appended to.
- * @param str The string to append.
+ * @param str The string to append. It is interned in bin_file.strpool.
  */
-extern void bf_add_insn_part(struct bf_insn * insn, char * str);
+extern void bf_add_insn_part(struct bin_file * bf, struct bf_insn * insn,
+		char * str);
 
 /**
  * @internal
@@ -286,11 +291,14 @@ extern void bf_close_insn(struct bf_insn * insn);
 
 /**
  * @internal
- * @brief Adds a bf_insn to the bin_file.insn_table.
+ * @brief Adds a bf_insn to the bin_file.insn_table unless one already
+ * exists at the same VMA.
  * @param bf The bin_file holding the bin_file.insn_table to be added to.
  * @param insn The bf_insn to be added.
+ * @return insn if it was added, otherwise the bf_insn already held.
  */
-extern void bf_add_insn(struct bin_file * bf, struct bf_insn * insn);
+extern struct bf_insn * bf_add_insn(struct bin_file * bf,
+		struct bf_insn * insn);
 
 /**
  * @brief Gets the bf_insn object for the starting VMA.
@@ -309,6 +317,26 @@ extern struct bf_insn * bf_get_insn(struct bin_file * bf, bfd_vma vma);
  */
 extern bool bf_exists_insn(struct bin_file * bf, bfd_vma vma);
 
+/**
+ * @brief Gets the bf_insn object with a given id.
+ * @param bf The bin_file to be searched.
+ * @param id The id of the bf_insn, as found in its entry.id.
+ * @return The bf_insn with that id or NULL if there is none.
+ * @details Ids are handed out from 0 in the order the objects are discovered
+ * and never change, so per-object state can be kept in arrays of
+ * bf_get_num_insns() entries indexed by id.
+ */
+extern struct bf_insn * bf_get_insn_by_id(struct bin_file * bf,
+		uint32_t id);
+
+/**
+ * @brief Gets the number of ids handed out to bf_insn objects.
+ * @param bf The bin_file being analysed.
+ * @return One more than the largest id. A few ids may be unused if threads
+ * raced to discover the same instruction.
+ */
+extern uint32_t bf_get_num_insns(struct bin_file * bf);
+
 /**
  * @internal
  * @brief Releases memory for all currently discovered bf_insn objects.
@@ -333,8 +361,8 @@ extern void bf_enum_insn(struct bin_file * bf,
  * @param bf struct bin_file holding the bf_insn objects.
  */
 #define bf_for_each_insn(insn, bf) \
-	struct htable_entry * cur_entry; \
-	htable_for_each_entry(insn, cur_entry, &bf->insn_table, entry)
+	struct bf_addr_node * cur_entry; \
+	bf_addr_map_for_each_entry(insn, cur_entry, &bf->insn_table, entry)
 
 /**
  * @brief Invokes a callback for each part in a bf_insn.
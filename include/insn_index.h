@@ -0,0 +1,223 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file insn_index.h
+ * @brief Definition and API of bf_insn_index.
+ * @details bf_insn_index is an inverted index from the mnemonic and the tag
+ * of the first operand of a bf_insn to the dense ids of the instructions
+ * having them (see bf_get_insn_by_id()). Queries such as "every syscall" or
+ * "every jmpq through a register" then cost time proportional to the number
+ * of results rather than to the size of bin_file.insn_table.
+ *
+ * The index is optional. Once a bin_file has one, the disassembler adds
+ * every new bf_insn to it, so it can be created before or after the CFG is
+ * built. Queries take bin_file.cflow_lock, which the disassembler holds
+ * while it adds to the index, so they can run while other threads are
+ * disassembling.
+ */
+
+#ifndef BF_INSN_INDEX_H
+#define BF_INSN_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "insn.h"
+
+/**
+ * @brief Passed as the operand tag of a query to match any first operand,
+ * including none.
+ */
+#define BF_ANY_OPERAND -1
+
+/**
+ * @internal
+ * @struct bf_insn_posting
+ * @brief The ids of the instructions with one mnemonic and first operand
+ * tag.
+ */
+struct bf_insn_posting {
+	/**
+	 * @var mnemonic
+	 * @brief The mnemonic of the instructions.
+	 */
+	enum insn_mnemonic mnemonic;
+
+	/**
+	 * @var tag
+	 * @brief The tag of the first operand, 0 if there is none.
+	 */
+	enum operand_type  tag;
+
+	/**
+	 * @var ids
+	 * @brief The ids. The first bf_insn_posting.sorted of them are in
+	 * ascending order, the rest in the order the instructions were
+	 * indexed.
+	 */
+	uint32_t *	   ids;
+
+	/**
+	 * @var count
+	 * @brief The number of ids. 0 marks an empty slot.
+	 */
+	uint32_t	   count;
+
+	/**
+	 * @var sorted
+	 * @brief The number of leading ids known to be in ascending order.
+	 * Queries sort the rest.
+	 */
+	uint32_t	   sorted;
+
+	/**
+	 * @var capacity
+	 * @brief The capacity of ids.
+	 */
+	uint32_t	   capacity;
+};
+
+/**
+ * @struct bf_insn_index
+ * @brief An inverted index of the instructions of a bin_file.
+ */
+struct bf_insn_index {
+	/**
+	 * @var bf
+	 * @brief The bin_file the index belongs to.
+	 */
+	struct bin_file *	 bf;
+
+	/**
+	 * @var num_insns
+	 * @brief The number of indexed instructions.
+	 */
+	size_t			 num_insns;
+
+	/**
+	 * @internal
+	 * @var postings
+	 * @brief Open addressing table of the posting lists.
+	 */
+	struct bf_insn_posting * postings;
+
+	/**
+	 * @internal
+	 * @var num_slots
+	 * @brief The number of slots in postings, always a power of two.
+	 */
+	size_t			 num_slots;
+
+	/**
+	 * @internal
+	 * @var num_postings
+	 * @brief The number of used slots in postings.
+	 */
+	size_t			 num_postings;
+};
+
+/**
+ * @brief Creates the bf_insn_index of a bin_file.
+ * @param bf The bin_file to be indexed.
+ * @return The bf_insn_index, which is also stored in bin_file.insn_index.
+ * If the bin_file already has one, it is returned instead.
+ * @details Indexes every bf_insn discovered so far. Must not be called while
+ * the bin_file is being disassembled. The index is kept up to date by later
+ * disassembly and closed along with the bin_file.
+ */
+extern struct bf_insn_index * bf_init_insn_index(struct bin_file * bf);
+
+/**
+ * @brief Rebuilds a bf_insn_index from every discovered bf_insn.
+ * @param index The bf_insn_index to be rebuilt.
+ * @details Only needed if instructions were added behind the disassembler's
+ * back. Must not be called while the bin_file is being disassembled.
+ */
+extern void bf_rebuild_insn_index(struct bf_insn_index * index);
+
+/**
+ * @internal
+ * @brief Adds a new bf_insn to a bf_insn_index.
+ * @param index The bf_insn_index to be added to.
+ * @param insn The bf_insn, which must already be in bin_file.insn_table.
+ * @details Must be called with bin_file.cflow_lock held.
+ */
+extern void bf_index_insn(struct bf_insn_index * index,
+		struct bf_insn * insn);
+
+/**
+ * @brief Gets the ids of the instructions with a mnemonic and first operand
+ * tag.
+ * @param index The bf_insn_index to be searched.
+ * @param mnemonic The mnemonic being searched for.
+ * @param tag The operand_type of the first operand or 0 for instructions
+ * without operands.
+ * @param ids Receives the ids in ascending order. They stay valid until the
+ * index next changes, which is as soon as more of the bin_file is
+ * disassembled.
+ * @return The number of ids.
+ */
+extern size_t bf_get_insn_ids(struct bf_insn_index * index,
+		enum insn_mnemonic mnemonic, enum operand_type tag,
+		uint32_t ** ids);
+
+/**
+ * @brief Counts the instructions with a mnemonic and first operand tag.
+ * @param index The bf_insn_index to be searched.
+ * @param mnemonic The mnemonic being searched for.
+ * @param tag The operand_type of the first operand, 0 for instructions
+ * without operands or BF_ANY_OPERAND.
+ * @return The number of instructions.
+ */
+extern size_t bf_count_insns(struct bf_insn_index * index,
+		enum insn_mnemonic mnemonic, int tag);
+
+/**
+ * @brief Invokes a callback for each instruction with a mnemonic and first
+ * operand tag.
+ * @param index The bf_insn_index to be searched.
+ * @param mnemonic The mnemonic being searched for.
+ * @param tag The operand_type of the first operand, 0 for instructions
+ * without operands or BF_ANY_OPERAND.
+ * @param handler The callback to be invoked for each bf_insn. The
+ * instructions of each operand tag are visited in ascending id order. The
+ * callback may disassemble more of the bin_file, but the instructions it
+ * discovers are not visited.
+ * @param param This will be passed to the handler each time it is invoked. It
+ * can be used to pass data to the callback.
+ */
+extern void bf_enum_indexed_insn(struct bf_insn_index * index,
+		enum insn_mnemonic mnemonic, int tag,
+		void (*handler)(struct bin_file *, struct bf_insn *, void *),
+		void * param);
+
+/**
+ * @brief Closes a bf_insn_index object and detaches it from its bin_file.
+ * @param index The bf_insn_index to be closed.
+ */
+extern void bf_close_insn_index(struct bf_insn_index * index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,496 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file insn_pattern.h
+ * @brief Definition and API of bf_pattern_set and bf_pattern_matcher.
+ * @details A bf_pattern_set holds instruction sequence patterns such as
+ * stack canary checks, PLT stubs or detour signatures. All the patterns of
+ * a set are compiled into a single automaton, which a bf_pattern_matcher
+ * runs over a stream of bf_insn objects in one pass, reporting every match
+ * to a callback as soon as its last instruction is fed.
+ *
+ * A pattern is a list of instructions separated by semicolons:
+ *
+ *	pushq imm:0; movl imm:1; retq
+ *	mov fs=0x28; ...; xor|sub fs=0x28; je|jne
+ *
+ * Each instruction is a mnemonic, several mnemonics separated by | or * for
+ * any mnemonic, followed by constraints on the first operands separated by
+ * commas. An operand constraint is _ for any operand, one of the classes
+ * val, imm, addr, reg, regptr, index, indexptr, fs and gs (see
+ * operand_type), or a register such as %eax or *%rax. val, imm, addr, fs
+ * and gs may be followed by =value to require a value, and every constraint
+ * by :n to capture the operand into bf_pattern_match.captures[n]. Operands
+ * without a constraint can be anything. ... matches any number of
+ * instructions, including none.
+ *
+ * The automaton tracks at most one partial match per state. When two reach
+ * the same state the one which started first is kept, so of the matches of
+ * a pattern ending at the same instruction, only the longest is reported.
+ */
+
+#ifndef BF_INSN_PATTERN_H
+#define BF_INSN_PATTERN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "basic_blk.h"
+#include "func.h"
+#include "insn.h"
+
+/**
+ * @brief The number of captures a pattern may use.
+ */
+#define BF_MAX_CAPTURES 8
+
+/**
+ * @brief The number of alternative mnemonics of a pattern instruction.
+ */
+#define BF_MAX_ALTERNATIVES 4
+
+/**
+ * @struct bf_pattern_capture
+ * @brief An operand captured by a match.
+ */
+struct bf_pattern_capture {
+	/**
+	 * @var insn
+	 * @brief The bf_insn holding the operand, NULL if nothing was
+	 * captured.
+	 */
+	struct bf_insn *      insn;
+
+	/**
+	 * @var operand
+	 * @brief The captured operand of insn.
+	 */
+	struct insn_operand * operand;
+};
+
+/**
+ * @struct bf_pattern_match
+ * @brief A match reported by a bf_pattern_matcher.
+ */
+struct bf_pattern_match {
+	/**
+	 * @var pattern
+	 * @brief The id of the pattern, as returned by bf_add_pattern().
+	 */
+	int			  pattern;
+
+	/**
+	 * @var param
+	 * @brief The param the pattern was added with.
+	 */
+	void *			  param;
+
+	/**
+	 * @var first
+	 * @brief The first matched bf_insn.
+	 */
+	struct bf_insn *	  first;
+
+	/**
+	 * @var last
+	 * @brief The last matched bf_insn.
+	 */
+	struct bf_insn *	  last;
+
+	/**
+	 * @var captures
+	 * @brief The captured operands.
+	 */
+	struct bf_pattern_capture captures[BF_MAX_CAPTURES];
+};
+
+/**
+ * @internal
+ * @struct bf_pattern_operand
+ * @brief A constraint on an operand.
+ */
+struct bf_pattern_operand {
+	/**
+	 * @var tag
+	 * @brief The required operand_type or 0 for any operand.
+	 */
+	int	 tag;
+
+	/**
+	 * @var has_value
+	 * @brief TRUE if the operand must also have value.
+	 */
+	bool	 has_value;
+
+	/**
+	 * @var value
+	 * @brief The required value, an address, immediate, offset or
+	 * insn_reg.
+	 */
+	uint64_t value;
+
+	/**
+	 * @var capture
+	 * @brief The capture slot of the operand or -1.
+	 */
+	int	 capture;
+};
+
+/**
+ * @internal
+ * @enum bf_pattern_step_kind
+ * @brief The kinds of states of the automaton.
+ */
+enum bf_pattern_step_kind {
+	/**
+	 * @brief Consumes one instruction meeting the constraints.
+	 */
+	BF_STEP_INSN,
+
+	/**
+	 * @brief Consumes any number of instructions.
+	 */
+	BF_STEP_GAP,
+
+	/**
+	 * @brief The pattern has matched.
+	 */
+	BF_STEP_ACCEPT
+};
+
+/**
+ * @internal
+ * @struct bf_pattern_step
+ * @brief A state of the automaton.
+ */
+struct bf_pattern_step {
+	/**
+	 * @var kind
+	 * @brief The kind of the state.
+	 */
+	enum bf_pattern_step_kind kind;
+
+	/**
+	 * @var pattern
+	 * @brief The id of the pattern the state belongs to.
+	 */
+	int			  pattern;
+
+	/**
+	 * @var mnemonics
+	 * @brief The accepted mnemonics.
+	 */
+	enum insn_mnemonic	  mnemonics[BF_MAX_ALTERNATIVES];
+
+	/**
+	 * @var num_mnemonics
+	 * @brief The number of mnemonics, 0 for any mnemonic.
+	 */
+	int			  num_mnemonics;
+
+	/**
+	 * @var operands
+	 * @brief The constraints on the three operands.
+	 */
+	struct bf_pattern_operand operands[3];
+};
+
+/**
+ * @internal
+ * @struct bf_pattern_start
+ * @brief Maps a mnemonic to a pattern starting with it.
+ */
+struct bf_pattern_start {
+	/**
+	 * @var mnemonic
+	 * @brief The mnemonic of the first instruction.
+	 */
+	enum insn_mnemonic mnemonic;
+
+	/**
+	 * @var state
+	 * @brief The first state of the pattern.
+	 */
+	uint32_t	   state;
+};
+
+/**
+ * @struct bf_pattern_set
+ * @brief A set of patterns compiled into one automaton.
+ */
+struct bf_pattern_set {
+	/**
+	 * @var num_patterns
+	 * @brief The number of patterns.
+	 */
+	int			  num_patterns;
+
+	/**
+	 * @internal
+	 * @var params
+	 * @brief The param of every pattern.
+	 */
+	void **			  params;
+
+	/**
+	 * @internal
+	 * @var steps
+	 * @brief The states of all patterns. The states of a pattern are
+	 * consecutive and end with a BF_STEP_ACCEPT state.
+	 */
+	struct bf_pattern_step *  steps;
+
+	/**
+	 * @internal
+	 * @var num_steps
+	 * @brief The number of states.
+	 */
+	uint32_t		  num_steps;
+
+	/**
+	 * @internal
+	 * @var first_steps
+	 * @brief The first state of every pattern.
+	 */
+	uint32_t *		  first_steps;
+
+	/**
+	 * @internal
+	 * @var starts
+	 * @brief The patterns whose first instruction has a mnemonic,
+	 * sorted by mnemonic, so only the patterns which can start at an
+	 * instruction are tried there.
+	 */
+	struct bf_pattern_start * starts;
+
+	/**
+	 * @internal
+	 * @var num_starts
+	 * @brief The number of entries in starts.
+	 */
+	size_t			  num_starts;
+
+	/**
+	 * @internal
+	 * @var any_starts
+	 * @brief The first states of the patterns starting with any
+	 * mnemonic.
+	 */
+	uint32_t *		  any_starts;
+
+	/**
+	 * @internal
+	 * @var num_any_starts
+	 * @brief The number of entries in any_starts.
+	 */
+	size_t			  num_any_starts;
+};
+
+/**
+ * @internal
+ * @struct bf_pattern_thread
+ * @brief A partial match being tracked by a bf_pattern_matcher.
+ */
+struct bf_pattern_thread {
+	/**
+	 * @var state
+	 * @brief The state the partial match is in.
+	 */
+	uint32_t		  state;
+
+	/**
+	 * @var first
+	 * @brief The first instruction of the partial match.
+	 */
+	struct bf_insn *	  first;
+
+	/**
+	 * @var captures
+	 * @brief The operands captured so far.
+	 */
+	struct bf_pattern_capture captures[BF_MAX_CAPTURES];
+};
+
+/**
+ * @struct bf_pattern_matcher
+ * @brief Runs a bf_pattern_set over a stream of instructions.
+ */
+struct bf_pattern_matcher {
+	/**
+	 * @var set
+	 * @brief The bf_pattern_set being matched.
+	 */
+	struct bf_pattern_set *	   set;
+
+	/**
+	 * @var num_matches
+	 * @brief The number of matches reported so far.
+	 */
+	uint64_t		   num_matches;
+
+	/**
+	 * @internal
+	 * @var handler
+	 * @brief The callback invoked for each match.
+	 */
+	void			   (*handler)(struct bf_pattern_match *,
+			void *);
+
+	/**
+	 * @internal
+	 * @var param
+	 * @brief Passed to handler.
+	 */
+	void *			   param;
+
+	/**
+	 * @internal
+	 * @var threads
+	 * @brief The partial matches after the last instruction, at most one
+	 * per state.
+	 */
+	struct bf_pattern_thread * threads;
+
+	/**
+	 * @internal
+	 * @var num_threads
+	 * @brief The number of partial matches.
+	 */
+	uint32_t		   num_threads;
+
+	/**
+	 * @internal
+	 * @var next
+	 * @brief The partial matches being built from the current
+	 * instruction.
+	 */
+	struct bf_pattern_thread * next;
+
+	/**
+	 * @internal
+	 * @var num_next
+	 * @brief The number of entries in next.
+	 */
+	uint32_t		   num_next;
+
+	/**
+	 * @internal
+	 * @var stamps
+	 * @brief The instruction count at which each state was last added
+	 * to next, so no state is tracked twice.
+	 */
+	uint64_t *		   stamps;
+
+	/**
+	 * @internal
+	 * @var count
+	 * @brief The number of instructions fed so far.
+	 */
+	uint64_t		   count;
+};
+
+/**
+ * @brief Creates an empty bf_pattern_set.
+ * @return A bf_pattern_set object.
+ * @note bf_close_pattern_set() must be called to allow the object to
+ * properly clean up.
+ */
+extern struct bf_pattern_set * bf_init_pattern_set(void);
+
+/**
+ * @brief Compiles a pattern and adds it to a bf_pattern_set.
+ * @param set The bf_pattern_set to be added to.
+ * @param pattern The pattern, see insn_pattern.h for the syntax.
+ * @param param Reported with every match of the pattern.
+ * @return The id of the pattern, counting from 0, or -1 if the pattern is
+ * malformed.
+ * @details Must not be called while a bf_pattern_matcher uses the set.
+ */
+extern int bf_add_pattern(struct bf_pattern_set * set, const char * pattern,
+		void * param);
+
+/**
+ * @brief Closes a bf_pattern_set object.
+ * @param set The bf_pattern_set to be closed.
+ */
+extern void bf_close_pattern_set(struct bf_pattern_set * set);
+
+/**
+ * @brief Creates a bf_pattern_matcher.
+ * @param set The patterns to be matched.
+ * @param handler The callback invoked for each match. The match is only
+ * valid during the call.
+ * @param param Passed to handler.
+ * @return A bf_pattern_matcher object.
+ * @note bf_close_pattern_matcher() must be called to allow the object to
+ * properly clean up.
+ */
+extern struct bf_pattern_matcher * bf_init_pattern_matcher(
+		struct bf_pattern_set * set,
+		void (*handler)(struct bf_pattern_match *, void *),
+		void * param);
+
+/**
+ * @brief Feeds the next instruction of the stream to a bf_pattern_matcher.
+ * @param matcher The bf_pattern_matcher.
+ * @param insn The next bf_insn. Matches ending with it are reported before
+ * the function returns.
+ */
+extern void bf_feed_pattern_matcher(struct bf_pattern_matcher * matcher,
+		struct bf_insn * insn);
+
+/**
+ * @brief Ends the current stream, dropping every partial match.
+ * @param matcher The bf_pattern_matcher.
+ */
+extern void bf_reset_pattern_matcher(struct bf_pattern_matcher * matcher);
+
+/**
+ * @brief Closes a bf_pattern_matcher object.
+ * @param matcher The bf_pattern_matcher to be closed.
+ */
+extern void bf_close_pattern_matcher(struct bf_pattern_matcher * matcher);
+
+/**
+ * @brief Matches the instructions of a bf_basic_blk.
+ * @param matcher The bf_pattern_matcher, which is reset before and after
+ * the block.
+ * @param bb The bf_basic_blk to be matched.
+ */
+extern void bf_match_patterns_bb(struct bf_pattern_matcher * matcher,
+		struct bf_basic_blk * bb);
+
+/**
+ * @brief Matches every bf_basic_blk of a bf_func.
+ * @param matcher The bf_pattern_matcher.
+ * @param bf The bin_file holding the bf_func.
+ * @param func The bf_func to be matched. Each block is a separate stream,
+ * in bf_enum_func_basic_blk() order.
+ */
+extern void bf_match_patterns_func(struct bf_pattern_matcher * matcher,
+		struct bin_file * bf, struct bf_func * func);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file parallel.h
+ * @brief API of the bf_parallel work-stealing scheduler.
+ * @details bf_parallel runs an analysis pass over many independent items
+ * (e.g. every bf_func of a bin_file) on several threads. It is the parallel
+ * counterpart of bf_enum_func() and friends.
+ *
+ * A pass has two callbacks:
+ *	- map is invoked once per task on one of the worker threads and returns
+ *	  a result. Tasks are spread over per-worker deques and idle workers
+ *	  steal from the others (Chase-Lev), so uneven tasks keep every worker
+ *	  busy.
+ *	- reduce is invoked once per task on the calling thread after all
+ *	  tasks have finished. It is always invoked in task order, so the
+ *	  output of a pass does not depend on the number of threads or on how
+ *	  the tasks were scheduled.
+ *
+ * Every worker has a bf_arena for scratch allocations. Memory allocated from
+ * it stays valid until the reduction has finished, so map can return
+ * results allocated there without reduce having to free them.
+ *
+ * The number of threads can be given explicitly. When it is 0 the
+ * LIBBF_THREADS environment variable is used, or the number of online CPUs
+ * if that is not set.
+ */
+
+#ifndef BF_PARALLEL_H
+#define BF_PARALLEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "binary_file.h"
+#include "basic_blk.h"
+#include "func.h"
+#include "insn.h"
+
+/**
+ * @internal
+ * @struct bf_arena_chunk
+ * @brief A block of arena memory.
+ */
+struct bf_arena_chunk {
+	/**
+	 * @var next
+	 * @brief The previously filled chunk.
+	 */
+	struct bf_arena_chunk * next;
+
+	/**
+	 * @var used
+	 * @brief The number of bytes of data in use.
+	 */
+	size_t			used;
+
+	/**
+	 * @var size
+	 * @brief The number of bytes available in data.
+	 */
+	size_t			size;
+
+	/**
+	 * @var data
+	 * @brief The storage.
+	 */
+	char			data[] __attribute__((aligned(16)));
+};
+
+/**
+ * @struct bf_arena
+ * @brief A bump allocator owned by one worker.
+ */
+struct bf_arena {
+	/**
+	 * @internal
+	 * @var chunks
+	 * @brief The chunk currently being filled, linked to the older ones.
+	 */
+	struct bf_arena_chunk * chunks;
+};
+
+/**
+ * @struct bf_task_ctx
+ * @brief The context a map callback is invoked with.
+ */
+struct bf_task_ctx {
+	/**
+	 * @var worker
+	 * @brief The index of the worker running the task, from 0 up to the
+	 * number of workers. Can be used to index per-worker state.
+	 */
+	unsigned int	  worker;
+
+	/**
+	 * @var arena
+	 * @brief Scratch memory of the worker.
+	 */
+	struct bf_arena * arena;
+
+	/**
+	 * @var param
+	 * @brief The param passed to the pass.
+	 */
+	void *		  param;
+};
+
+/**
+ * @brief Allocates memory from a bf_arena.
+ * @param arena The bf_arena to allocate from.
+ * @param size The number of bytes required.
+ * @return Memory aligned to 16 bytes. It is released when the pass ends.
+ */
+extern void * bf_arena_alloc(struct bf_arena * arena, size_t size);
+
+/**
+ * @brief Copies a string into a bf_arena.
+ * @param arena The bf_arena to allocate from.
+ * @param str The string to be copied.
+ * @return The copy.
+ */
+extern char * bf_arena_strdup(struct bf_arena * arena, const char * str);
+
+/**
+ * @brief Gets the number of workers a pass will use.
+ * @param num_threads The number of threads requested or 0 for the default.
+ * @return The number of workers, at least 1.
+ */
+extern unsigned int bf_get_num_workers(unsigned int num_threads);
+
+/**
+ * @brief Runs a pass over a range of items.
+ * @param num_threads The number of threads to use or 0 for the default.
+ * @param count The number of items.
+ * @param grain The number of consecutive items making up one task.
+ * @param map Invoked for each task with the range [first, last) of its items.
+ * Its return value is handed to reduce.
+ * @param reduce Invoked on the calling thread for each task, in order, once
+ * every task has finished. Can be NULL.
+ * @param param Passed to map through bf_task_ctx.param and to reduce.
+ */
+extern void bf_parallel_run(unsigned int num_threads, size_t count,
+		size_t grain, void * (*map)(struct bf_task_ctx *, size_t,
+		size_t), void (*reduce)(size_t, size_t, void *, void *),
+		void * param);
+
+/**
+ * @brief Runs a pass over every bf_func of a bin_file.
+ * @param bf The bin_file holding the bf_func objects.
+ * @param num_threads The number of threads to use or 0 for the default.
+ * @param map Invoked for each bf_func on a worker thread.
+ * @param reduce Invoked for each bf_func on the calling thread, in VMA order,
+ * with the result of map. Can be NULL.
+ * @param param Passed to map through bf_task_ctx.param and to reduce.
+ */
+extern void bf_parallel_enum_func(struct bin_file * bf,
+		unsigned int num_threads,
+		void * (*map)(struct bf_task_ctx *, struct bf_func *),
+		void (*reduce)(struct bf_func *, void *, void *),
+		void * param);
+
+/**
+ * @brief Runs a pass over every bf_basic_blk of a bin_file.
+ * @param bf The bin_file holding the bf_basic_blk objects.
+ * @param num_threads The number of threads to use or 0 for the default.
+ * @param map Invoked for each bf_basic_blk on a worker thread.
+ * @param reduce Invoked for each bf_basic_blk on the calling thread, in VMA
+ * order, with the result of map. Can be NULL.
+ * @param param Passed to map through bf_task_ctx.param and to reduce.
+ */
+extern void bf_parallel_enum_basic_blk(struct bin_file * bf,
+		unsigned int num_threads,
+		void * (*map)(struct bf_task_ctx *, struct bf_basic_blk *),
+		void (*reduce)(struct bf_basic_blk *, void *, void *),
+		void * param);
+
+/**
+ * @brief Gets every bf_insn of a bin_file sorted by VMA.
+ * @param bf The bin_file holding the bf_insn objects.
+ * @param count Receives the number of bf_insn objects.
+ * @return An array which must be released with free().
+ */
+extern struct bf_insn ** bf_collect_insns(struct bin_file * bf,
+		size_t * count);
+
+/**
+ * @brief Gets every bf_basic_blk of a bin_file sorted by VMA.
+ * @param bf The bin_file holding the bf_basic_blk objects.
+ * @param count Receives the number of bf_basic_blk objects.
+ * @return An array which must be released with free().
+ */
+extern struct bf_basic_blk ** bf_collect_basic_blks(struct bin_file * bf,
+		size_t * count);
+
+/**
+ * @brief Gets every bf_func of a bin_file sorted by VMA.
+ * @param bf The bin_file holding the bf_func objects.
+ * @param count Receives the number of bf_func objects.
+ * @return An array which must be released with free().
+ */
+extern struct bf_func ** bf_collect_funcs(struct bin_file * bf,
+		size_t * count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
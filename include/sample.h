@@ -0,0 +1,266 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file sample.h
+ * @brief Definition and API of bf_sample_profile.
+ * @details bf_sample_profile attributes sampled instruction pointers (e.g.
+ * from <i>perf script</i>) to the bf_func and bf_basic_blk objects
+ * discovered in a bin_file. A typical workflow is to disassemble the
+ * bin_file, create a profile with bf_init_sample_profile(), feed it samples
+ * with bf_load_perf_script() or bf_add_sample() and finally read the hit
+ * histograms with bf_enum_func_hits() and bf_enum_bb_hits().
+ *
+ * Samples are runtime addresses. For position independent targets the load
+ * bias has to be known to map them back to VMAs. It can be set explicitly
+ * with bf_set_sample_bias() or bf_set_sample_load_base(), otherwise it is
+ * inferred from the PERF_RECORD_MMAP events of the target when the dump
+ * contains them (<i>perf script --show-mmap-events</i>).
+ *
+ * The blocks and functions are resolved through a bf_extent_index which is
+ * built once when the profile is created, so the profile should be created
+ * after disassembly has finished.
+ */
+
+#ifndef BF_SAMPLE_H
+#define BF_SAMPLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "binary_file.h"
+#include "basic_blk.h"
+#include "func.h"
+#include "extent.h"
+
+/**
+ * @struct bf_sample_profile
+ * @brief Per-function and per-block sample histograms of a bin_file.
+ */
+struct bf_sample_profile {
+	/**
+	 * @var bf
+	 * @brief The bin_file the samples are attributed to.
+	 */
+	struct bin_file *      bf;
+
+	/**
+	 * @var bias
+	 * @brief The difference between runtime addresses and VMAs.
+	 */
+	bfd_vma		       bias;
+
+	/**
+	 * @var has_bias
+	 * @brief TRUE if bias has been set or inferred.
+	 */
+	bool		       has_bias;
+
+	/**
+	 * @var total
+	 * @brief The number of samples attributed so far.
+	 */
+	uint64_t	       total;
+
+	/**
+	 * @var unresolved
+	 * @brief The number of attributed samples which were not contained in
+	 * any discovered bf_basic_blk.
+	 */
+	uint64_t	       unresolved;
+
+	/**
+	 * @internal
+	 * @var pending
+	 * @brief Buffer of samples not yet attributed.
+	 */
+	bfd_vma *	       pending;
+
+	/**
+	 * @internal
+	 * @var num_pending
+	 * @brief The number of samples held in pending.
+	 */
+	size_t		       num_pending;
+
+	/**
+	 * @internal
+	 * @var positions
+	 * @brief Scratch space for the batch lookups.
+	 */
+	long *		       positions;
+
+	/**
+	 * @internal
+	 * @var bb_index
+	 * @brief Extents of all bf_basic_blk objects.
+	 */
+	struct bf_extent_index bb_index;
+
+	/**
+	 * @internal
+	 * @var func_index
+	 * @brief Extents of all bf_func objects.
+	 */
+	struct bf_extent_index func_index;
+
+	/**
+	 * @internal
+	 * @var bb_hits
+	 * @brief Hit counts in the same order as bb_index.extents.
+	 */
+	uint64_t *	       bb_hits;
+
+	/**
+	 * @internal
+	 * @var func_hits
+	 * @brief Hit counts in the same order as func_index.extents.
+	 */
+	uint64_t *	       func_hits;
+};
+
+/**
+ * @brief Creates a new bf_sample_profile.
+ * @param bf The bin_file the samples belong to. It should have been
+ * disassembled already.
+ * @return A bf_sample_profile object.
+ * @note bf_close_sample_profile() must be called to allow the object to
+ * properly clean up.
+ */
+extern struct bf_sample_profile * bf_init_sample_profile(
+		struct bin_file * bf);
+
+/**
+ * @brief Sets the load bias of the target.
+ * @param profile The bf_sample_profile being populated.
+ * @param bias The value to subtract from runtime addresses to get VMAs.
+ */
+extern void bf_set_sample_bias(struct bf_sample_profile * profile,
+		bfd_vma bias);
+
+/**
+ * @brief Sets the load bias of the target from its runtime load address.
+ * @param profile The bf_sample_profile being populated.
+ * @param load_base The runtime address the first page of the target was
+ * mapped at.
+ */
+extern void bf_set_sample_load_base(struct bf_sample_profile * profile,
+		bfd_vma load_base);
+
+/**
+ * @brief Records a single sample.
+ * @param profile The bf_sample_profile being populated.
+ * @param addr The sampled runtime address.
+ * @details Samples are buffered and attributed in batches. Call
+ * bf_attribute_samples() before reading the histograms.
+ */
+extern void bf_add_sample(struct bf_sample_profile * profile, bfd_vma addr);
+
+/**
+ * @brief Records all samples of the target found in a <i>perf script</i>
+ * dump.
+ * @param profile The bf_sample_profile being populated.
+ * @param stream An open FILE holding the output of <i>perf script</i>. The
+ * default output format, <i>-F ip</i> and callchain (<i>-g</i>) dumps are
+ * understood.
+ * @return The number of samples recorded.
+ * @details Samples whose DSO is not the target are skipped. Samples without
+ * DSO information are assumed to belong to the target. Once the whole stream
+ * has been consumed the samples are attributed.
+ */
+extern size_t bf_load_perf_script(struct bf_sample_profile * profile,
+		FILE * stream);
+
+/**
+ * @brief Attributes all buffered samples.
+ * @param profile The bf_sample_profile being populated.
+ */
+extern void bf_attribute_samples(struct bf_sample_profile * profile);
+
+/**
+ * @brief Gets the bf_func containing a VMA.
+ * @param profile The bf_sample_profile to be searched.
+ * @param vma The VMA being searched for.
+ * @return The bf_func containing vma or NULL.
+ */
+extern struct bf_func * bf_get_sample_func(struct bf_sample_profile * profile,
+		bfd_vma vma);
+
+/**
+ * @brief Gets the bf_basic_blk containing a VMA.
+ * @param profile The bf_sample_profile to be searched.
+ * @param vma The VMA being searched for.
+ * @return The bf_basic_blk containing vma or NULL.
+ */
+extern struct bf_basic_blk * bf_get_sample_bb(
+		struct bf_sample_profile * profile, bfd_vma vma);
+
+/**
+ * @brief Invokes a callback for each bf_func with at least one hit, hottest
+ * first.
+ * @param profile The bf_sample_profile holding the histogram.
+ * @param handler The callback to be invoked for each bf_func.
+ * @param param This will be passed to the handler each time it is invoked. It
+ * can be used to pass data to the callback.
+ */
+extern void bf_enum_func_hits(struct bf_sample_profile * profile,
+		void (*handler)(struct bf_sample_profile *, struct bf_func *,
+		uint64_t, void *), void * param);
+
+/**
+ * @brief Invokes a callback for each bf_basic_blk with at least one hit,
+ * hottest first.
+ * @param profile The bf_sample_profile holding the histogram.
+ * @param handler The callback to be invoked for each bf_basic_blk.
+ * @param param This will be passed to the handler each time it is invoked. It
+ * can be used to pass data to the callback.
+ */
+extern void bf_enum_bb_hits(struct bf_sample_profile * profile,
+		void (*handler)(struct bf_sample_profile *,
+		struct bf_basic_blk *, uint64_t, void *), void * param);
+
+/**
+ * @brief Prints the per-function histogram to a FILE.
+ * @param profile The bf_sample_profile holding the histogram.
+ * @param stream An open FILE to be written to.
+ */
+extern void bf_print_func_hits(struct bf_sample_profile * profile,
+		FILE * stream);
+
+/**
+ * @brief Prints the per-block histogram to a FILE.
+ * @param profile The bf_sample_profile holding the histogram.
+ * @param stream An open FILE to be written to.
+ */
+extern void bf_print_bb_hits(struct bf_sample_profile * profile,
+		FILE * stream);
+
+/**
+ * @brief Closes a bf_sample_profile object.
+ * @param profile The bf_sample_profile to be closed.
+ */
+extern void bf_close_sample_profile(struct bf_sample_profile * profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
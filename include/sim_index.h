@@ -0,0 +1,326 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file sim_index.h
+ * @brief Definition and API of bf_sim_index.
+ * @details bf_sim_index is an on-disk index of the functions of many
+ * binaries which answers the question "where else does a function like this
+ * one appear?".
+ *
+ * Every function is summarised by a bf_minhash, a MinHash signature of the
+ * set of mnemonic trigrams of its blocks. The fraction of equal values in two
+ * signatures estimates the Jaccard similarity of the two trigram sets.
+ * Signatures are split into BF_LSH_BANDS bands of BF_LSH_ROWS values and the
+ * hash of each band is a key in the index. Two functions become candidates
+ * when any of their bands are equal, which for this layout happens with a
+ * probability of about 0.5 at a similarity of 0.5 and 0.99 at 0.8. Only the
+ * candidates are compared, so a query does not scan the corpus.
+ *
+ * The index is a directory. Signatures and strings are appended to two data
+ * files and every flush writes the band keys of the new functions as a
+ * separate sorted segment file, so binaries can be added at any time without
+ * rewriting what is already there. Segments are merged once there are too
+ * many of them. Only one process may add to an index at a time, which is
+ * enforced by a lock file held while the index is open for writing, but any
+ * number of processes may query it.
+ */
+
+#ifndef BF_SIM_INDEX_H
+#define BF_SIM_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "func.h"
+
+/**
+ * @brief The number of bands the signature is split into.
+ */
+#define BF_LSH_BANDS 16
+
+/**
+ * @brief The number of signature values per band.
+ */
+#define BF_LSH_ROWS 4
+
+/**
+ * @brief The number of values in a bf_minhash.
+ */
+#define BF_MINHASH_SIZE (BF_LSH_BANDS * BF_LSH_ROWS)
+
+/**
+ * @struct bf_minhash
+ * @brief A MinHash signature of a bf_func.
+ */
+struct bf_minhash {
+	/**
+	 * @var values
+	 * @brief The smallest hash of any trigram under each hash function.
+	 */
+	uint32_t values[BF_MINHASH_SIZE];
+};
+
+/**
+ * @struct bf_sim_match
+ * @brief A function found by bf_query_sim_index().
+ * @details The strings point into the index and remain valid until the index
+ * is flushed or closed.
+ */
+struct bf_sim_match {
+	/**
+	 * @var binary
+	 * @brief The path the binary holding the function was added with.
+	 */
+	const char * binary;
+
+	/**
+	 * @var name
+	 * @brief The symbol name of the function or NULL if it had none.
+	 */
+	const char * name;
+
+	/**
+	 * @var vma
+	 * @brief The VMA of the function in its binary.
+	 */
+	bfd_vma	     vma;
+
+	/**
+	 * @var similarity
+	 * @brief The estimated Jaccard similarity to the query, from 0 to 1.
+	 */
+	double	     similarity;
+};
+
+struct bf_sim_segment;
+
+/**
+ * @struct bf_sim_index
+ * @brief An open on-disk similarity index.
+ */
+struct bf_sim_index {
+	/**
+	 * @internal
+	 * @var dir
+	 * @brief The directory holding the index.
+	 */
+	char *			dir;
+
+	/**
+	 * @internal
+	 * @var writable
+	 * @brief TRUE if functions may be added.
+	 */
+	bool			writable;
+
+	/**
+	 * @internal
+	 * @var lock_fd
+	 * @brief The locked lock file of a writable index or -1.
+	 */
+	int			lock_fd;
+
+	/**
+	 * @var num_records
+	 * @brief The number of functions which can be queried.
+	 */
+	size_t			num_records;
+
+	/**
+	 * @internal
+	 * @var records
+	 * @brief Mapping of the committed signatures.
+	 */
+	void *			records;
+
+	/**
+	 * @internal
+	 * @var records_map_size
+	 * @brief The size of the mapping of records.
+	 */
+	size_t			records_map_size;
+
+	/**
+	 * @internal
+	 * @var strings
+	 * @brief Mapping of the committed strings.
+	 */
+	char *			strings;
+
+	/**
+	 * @internal
+	 * @var strings_size
+	 * @brief The number of committed bytes in strings.
+	 */
+	size_t			strings_size;
+
+	/**
+	 * @internal
+	 * @var strings_map_size
+	 * @brief The size of the mapping of strings.
+	 */
+	size_t			strings_map_size;
+
+	/**
+	 * @internal
+	 * @var segments
+	 * @brief The mapped band key segments, oldest first.
+	 */
+	struct bf_sim_segment * segments;
+
+	/**
+	 * @internal
+	 * @var num_segments
+	 * @brief The number of segments.
+	 */
+	size_t			num_segments;
+
+	/**
+	 * @internal
+	 * @var pending
+	 * @brief Signatures added since the last flush.
+	 */
+	void *			pending;
+
+	/**
+	 * @internal
+	 * @var num_pending
+	 * @brief The number of signatures in pending.
+	 */
+	size_t			num_pending;
+
+	/**
+	 * @internal
+	 * @var pending_capacity
+	 * @brief The capacity of pending.
+	 */
+	size_t			pending_capacity;
+
+	/**
+	 * @internal
+	 * @var pending_strings
+	 * @brief Strings added since the last flush.
+	 */
+	char *			pending_strings;
+
+	/**
+	 * @internal
+	 * @var pending_strings_size
+	 * @brief The number of bytes in pending_strings.
+	 */
+	size_t			pending_strings_size;
+
+	/**
+	 * @internal
+	 * @var pending_strings_capacity
+	 * @brief The capacity of pending_strings.
+	 */
+	size_t			pending_strings_capacity;
+};
+
+/**
+ * @brief Computes the MinHash signature of a bf_func.
+ * @param bf The bin_file holding the bf_func.
+ * @param func The bf_func to be summarised.
+ * @param sig Receives the signature.
+ * @return FALSE if the function is too small for its signature to be
+ * meaningful, TRUE otherwise.
+ * @details The trigrams are built from the mnemonics and operand classes of
+ * the instructions of each block, as enumerated by bf_enum_func_basic_blk().
+ * Registers, addresses and constants are left out, so the signature
+ * survives relinking, register allocation changes and different builds.
+ */
+extern bool bf_get_func_minhash(struct bin_file * bf, struct bf_func * func,
+		struct bf_minhash * sig);
+
+/**
+ * @brief Estimates the similarity of two functions from their signatures.
+ * @param sig The first signature.
+ * @param sig2 The second signature.
+ * @return The fraction of equal values, from 0 to 1.
+ */
+extern double bf_compare_minhash(struct bf_minhash * sig,
+		struct bf_minhash * sig2);
+
+/**
+ * @brief Opens a bf_sim_index.
+ * @param dir The directory holding the index. It is created if writable is
+ * TRUE and it does not exist.
+ * @param writable TRUE if functions will be added to the index.
+ * @return A bf_sim_index or NULL if the directory can not be used.
+ * @details A writable open waits until any other writer has closed the
+ * index.
+ * @note bf_close_sim_index() must be called to allow the object to properly
+ * clean up.
+ */
+extern struct bf_sim_index * bf_open_sim_index(const char * dir,
+		bool writable);
+
+/**
+ * @brief Adds every function of a bin_file to a bf_sim_index.
+ * @param index The bf_sim_index opened with writable set.
+ * @param bf The bin_file holding the functions. It should have been
+ * disassembled already.
+ * @param path The name the binary is reported under by queries.
+ * @param num_threads The number of threads computing the signatures. 0 means
+ * bf_get_num_workers(0).
+ * @return The number of functions added. Functions for which
+ * bf_get_func_minhash() returns FALSE are skipped.
+ * @details The functions only become visible to queries once the index is
+ * flushed.
+ */
+extern size_t bf_add_to_sim_index(struct bf_sim_index * index,
+		struct bin_file * bf, const char * path,
+		unsigned int num_threads);
+
+/**
+ * @brief Writes the functions added since the last flush to disk.
+ * @param index The bf_sim_index to be flushed.
+ * @return TRUE if the index was written.
+ */
+extern bool bf_flush_sim_index(struct bf_sim_index * index);
+
+/**
+ * @brief Finds the functions of a bf_sim_index similar to a signature.
+ * @param index The bf_sim_index to be searched.
+ * @param sig The signature of the function being searched for.
+ * @param min_similarity The lowest similarity to be reported.
+ * @param matches Receives the matches, most similar first.
+ * @param max_matches The capacity of matches.
+ * @return The number of matches stored.
+ */
+extern size_t bf_query_sim_index(struct bf_sim_index * index,
+		struct bf_minhash * sig, double min_similarity,
+		struct bf_sim_match * matches, size_t max_matches);
+
+/**
+ * @brief Closes a bf_sim_index object.
+ * @param index The bf_sim_index to be closed. Pending functions are flushed
+ * first.
+ */
+extern void bf_close_sim_index(struct bf_sim_index * index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file snapshot.h
+ * @brief Definition and API of bf_snapshot.
+ * @details A bf_snapshot is an immutable copy of the analysis results of a
+ * bin_file. Once created with bf_freeze_bin_file() it is never modified, so
+ * any number of threads can query it concurrently without locking, and it
+ * does not refer back to the bin_file, which can be closed while the
+ * snapshot is still in use.
+ *
+ * The objects are stored in arrays sorted by VMA and refer to each other by
+ * index rather than by pointer. Lookups by address are binary searches and
+ * the CFG edges are held in compressed sparse row (CSR) form: the successors
+ * of block i are succs[succ_offsets[i]] to succs[succ_offsets[i + 1] - 1],
+ * and the predecessors are stored the same way.
+ *
+ * Snapshots are reference counted. bf_freeze_bin_file() returns a snapshot
+ * holding one reference, bf_snapshot_get() adds one and bf_snapshot_put()
+ * drops one, freeing the snapshot with the last.
+ */
+
+#ifndef BF_SNAPSHOT_H
+#define BF_SNAPSHOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "insn_decoder.h"
+
+/**
+ * @brief The index used where a bf_snapshot object refers to nothing.
+ */
+#define BF_SNAPSHOT_NONE 0xFFFFFFFF
+
+/**
+ * @struct bf_snapshot_insn
+ * @brief The frozen form of a bf_insn.
+ */
+struct bf_snapshot_insn {
+	/**
+	 * @var vma
+	 * @brief The VMA of the instruction.
+	 */
+	bfd_vma		    vma;
+
+	/**
+	 * @var extra_info
+	 * @brief See bf_insn.extra_info.
+	 */
+	bfd_vma		    extra_info;
+
+	/**
+	 * @var mnemonic
+	 * @brief See bf_insn.mnemonic.
+	 */
+	enum insn_mnemonic  mnemonic;
+
+	/**
+	 * @var secondary_mnemonic
+	 * @brief See bf_insn.secondary_mnemonic.
+	 */
+	enum insn_mnemonic  secondary_mnemonic;
+
+	/**
+	 * @var operands
+	 * @brief The three operands of the instruction.
+	 */
+	struct insn_operand operands[3];
+
+	/**
+	 * @var size
+	 * @brief The size in bytes of the instruction.
+	 */
+	uint32_t	    size;
+
+	/**
+	 * @var is_data
+	 * @brief Non-zero if the contents at vma represent data.
+	 */
+	uint32_t	    is_data;
+
+	/**
+	 * @var bb
+	 * @brief Index of the containing block in bf_snapshot.bbs.
+	 */
+	uint32_t	    bb;
+
+	/**
+	 * @var text
+	 * @brief Offset in bf_snapshot.strings of the disassembly text.
+	 */
+	uint32_t	    text;
+};
+
+/**
+ * @struct bf_snapshot_bb
+ * @brief The frozen form of a bf_basic_blk.
+ */
+struct bf_snapshot_bb {
+	/**
+	 * @var vma
+	 * @brief The starting VMA of the block.
+	 */
+	bfd_vma	 vma;
+
+	/**
+	 * @var first_insn
+	 * @brief Offset in bf_snapshot.bb_insns of the first instruction.
+	 */
+	uint32_t first_insn;
+
+	/**
+	 * @var num_insns
+	 * @brief The number of instructions in the block.
+	 */
+	uint32_t num_insns;
+
+	/**
+	 * @var target
+	 * @brief Index of bf_basic_blk.target or BF_SNAPSHOT_NONE.
+	 */
+	uint32_t target;
+
+	/**
+	 * @var target2
+	 * @brief Index of bf_basic_blk.target2 or BF_SNAPSHOT_NONE.
+	 */
+	uint32_t target2;
+
+	/**
+	 * @var name
+	 * @brief Offset in bf_snapshot.strings of the symbol name or
+	 * BF_SNAPSHOT_NONE.
+	 */
+	uint32_t name;
+};
+
+/**
+ * @struct bf_snapshot_func
+ * @brief The frozen form of a bf_func.
+ */
+struct bf_snapshot_func {
+	/**
+	 * @var vma
+	 * @brief The VMA that the function starts at.
+	 */
+	bfd_vma	 vma;
+
+	/**
+	 * @var bb
+	 * @brief Index of the first block or BF_SNAPSHOT_NONE.
+	 */
+	uint32_t bb;
+
+	/**
+	 * @var name
+	 * @brief Offset in bf_snapshot.strings of the symbol name or
+	 * BF_SNAPSHOT_NONE.
+	 */
+	uint32_t name;
+};
+
+/**
+ * @struct bf_snapshot
+ * @brief An immutable, reference counted copy of the analysis of a bin_file.
+ */
+struct bf_snapshot {
+	/**
+	 * @internal
+	 * @var refcount
+	 * @brief The number of references held, updated atomically.
+	 */
+	unsigned int		  refcount;
+
+	/**
+	 * @var bitiness
+	 * @brief The bitiness of the bin_file.
+	 */
+	enum arch_bitiness	  bitiness;
+
+	/**
+	 * @var insns
+	 * @brief All instructions sorted by VMA.
+	 */
+	struct bf_snapshot_insn * insns;
+	uint32_t		  num_insns;
+
+	/**
+	 * @var bbs
+	 * @brief All basic blocks sorted by VMA.
+	 */
+	struct bf_snapshot_bb *	  bbs;
+	uint32_t		  num_bbs;
+
+	/**
+	 * @var funcs
+	 * @brief All functions sorted by VMA.
+	 */
+	struct bf_snapshot_func * funcs;
+	uint32_t		  num_funcs;
+
+	/**
+	 * @var bb_insns
+	 * @brief Instruction indices of each block, in block order.
+	 */
+	uint32_t *		  bb_insns;
+
+	/**
+	 * @var succ_offsets
+	 * @brief CSR row offsets of the successor lists (num_bbs + 1 entries).
+	 */
+	uint32_t *		  succ_offsets;
+
+	/**
+	 * @var succs
+	 * @brief CSR successor block indices.
+	 */
+	uint32_t *		  succs;
+
+	/**
+	 * @var pred_offsets
+	 * @brief CSR row offsets of the predecessor lists (num_bbs + 1
+	 * entries).
+	 */
+	uint32_t *		  pred_offsets;
+
+	/**
+	 * @var preds
+	 * @brief CSR predecessor block indices.
+	 */
+	uint32_t *		  preds;
+
+	/**
+	 * @var funcs_by_name
+	 * @brief Indices of the named functions sorted by name.
+	 */
+	uint32_t *		  funcs_by_name;
+	uint32_t		  num_named_funcs;
+
+	/**
+	 * @var strings
+	 * @brief The names and disassembly text referred to by offset.
+	 */
+	char *			  strings;
+	size_t			  strings_size;
+};
+
+/**
+ * @brief Creates a frozen snapshot of the analysis results of a bin_file.
+ * @param bf The analysed bin_file.
+ * @return A bf_snapshot holding one reference, or NULL if the results are
+ * too large to be referred to by 32-bit indices and offsets.
+ * @note The bin_file must not be modified while this runs. The snapshot is
+ * independent of it afterwards.
+ */
+extern struct bf_snapshot * bf_freeze_bin_file(struct bin_file * bf);
+
+/**
+ * @brief Adds a reference to a bf_snapshot.
+ * @param snap The bf_snapshot being referenced.
+ * @return snap.
+ */
+extern struct bf_snapshot * bf_snapshot_get(struct bf_snapshot * snap);
+
+/**
+ * @brief Drops a reference to a bf_snapshot, freeing it with the last one.
+ * @param snap The bf_snapshot being released.
+ */
+extern void bf_snapshot_put(struct bf_snapshot * snap);
+
+/**
+ * @brief Gets the instruction starting at a VMA.
+ * @param snap The bf_snapshot to be searched.
+ * @param vma The VMA of the instruction.
+ * @return The instruction or NULL.
+ */
+extern const struct bf_snapshot_insn * bf_snapshot_get_insn(
+		const struct bf_snapshot * snap, bfd_vma vma);
+
+/**
+ * @brief Gets the basic block starting at a VMA.
+ * @param snap The bf_snapshot to be searched.
+ * @param vma The VMA of the block.
+ * @return The index of the block in bf_snapshot.bbs or BF_SNAPSHOT_NONE.
+ */
+extern uint32_t bf_snapshot_get_bb(const struct bf_snapshot * snap,
+		bfd_vma vma);
+
+/**
+ * @brief Gets the basic block containing a VMA.
+ * @param snap The bf_snapshot to be searched.
+ * @param vma Any VMA covered by one of the block's instructions.
+ * @return The index of the block in bf_snapshot.bbs or BF_SNAPSHOT_NONE.
+ */
+extern uint32_t bf_snapshot_find_bb(const struct bf_snapshot * snap,
+		bfd_vma vma);
+
+/**
+ * @brief Gets the function starting at a VMA.
+ * @param snap The bf_snapshot to be searched.
+ * @param vma The VMA of the function.
+ * @return The function or NULL.
+ */
+extern const struct bf_snapshot_func * bf_snapshot_get_func(
+		const struct bf_snapshot * snap, bfd_vma vma);
+
+/**
+ * @brief Gets a function by symbol name.
+ * @param snap The bf_snapshot to be searched.
+ * @param name The raw symbol name.
+ * @return The function or NULL.
+ */
+extern const struct bf_snapshot_func * bf_snapshot_get_func_from_name(
+		const struct bf_snapshot * snap, const char * name);
+
+/**
+ * @brief Gets the successors of a basic block.
+ * @param snap The bf_snapshot holding the block.
+ * @param bb The index of the block.
+ * @param count Receives the number of successors.
+ * @return The indices of the successor blocks.
+ */
+extern const uint32_t * bf_snapshot_bb_succs(const struct bf_snapshot * snap,
+		uint32_t bb, uint32_t * count);
+
+/**
+ * @brief Gets the predecessors of a basic block.
+ * @param snap The bf_snapshot holding the block.
+ * @param bb The index of the block.
+ * @param count Receives the number of predecessors.
+ * @return The indices of the predecessor blocks.
+ */
+extern const uint32_t * bf_snapshot_bb_preds(const struct bf_snapshot * snap,
+		uint32_t bb, uint32_t * count);
+
+/**
+ * @brief Gets the disassembly text of an instruction.
+ * @param snap The bf_snapshot holding the instruction.
+ * @param insn The instruction.
+ * @return The concatenated bf_insn_part strings of the instruction.
+ */
+extern const char * bf_snapshot_insn_text(const struct bf_snapshot * snap,
+		const struct bf_snapshot_insn * insn);
+
+/**
+ * @brief Gets a string referred to by a snapshot object.
+ * @param snap The bf_snapshot holding the string.
+ * @param offset The offset of the string, e.g. bf_snapshot_func.name.
+ * @return The string or NULL if offset is BF_SNAPSHOT_NONE.
+ */
+extern const char * bf_snapshot_string(const struct bf_snapshot * snap,
+		uint32_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
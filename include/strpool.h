@@ -0,0 +1,208 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file strpool.h
+ * @brief Definition and API of bf_strpool.
+ * @details A bf_strpool interns strings: each distinct string is copied once
+ * into an arena and every later request for an equal string returns the same
+ * pointer. Interned strings therefore compare equal if and only if their
+ * pointers do.
+ *
+ * Every bin_file owns a bf_strpool holding its symbol names and instruction
+ * parts. These are short and highly repetitive (",", "%rax", import names
+ * which appear in several relocations), so interning them removes one
+ * allocation per string and most of the memory they used.
+ *
+ * The strings are never moved or freed before bf_close_strpool() so pointers
+ * returned by bf_strpool_intern() stay valid for the lifetime of the pool.
+ */
+
+#ifndef BF_STRPOOL_H
+#define BF_STRPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @internal
+ * @struct bf_strpool_chunk
+ * @brief A block of arena memory holding interned strings.
+ */
+struct bf_strpool_chunk {
+	/**
+	 * @var next
+	 * @brief The previously filled chunk.
+	 */
+	struct bf_strpool_chunk * next;
+
+	/**
+	 * @var used
+	 * @brief The number of bytes of data in use.
+	 */
+	size_t			  used;
+
+	/**
+	 * @var size
+	 * @brief The number of bytes available in data.
+	 */
+	size_t			  size;
+
+	/**
+	 * @var data
+	 * @brief The string storage.
+	 */
+	char			  data[];
+};
+
+/**
+ * @internal
+ * @struct bf_strpool_table
+ * @brief An open addressing table of interned strings.
+ * @details Readers search the current table without locking, so a table is
+ * not freed when it is outgrown but kept until bf_close_strpool().
+ */
+struct bf_strpool_table {
+	/**
+	 * @var prev
+	 * @brief The table this one replaced.
+	 */
+	struct bf_strpool_table * prev;
+
+	/**
+	 * @var capacity
+	 * @brief The number of slots, always a power of two.
+	 */
+	size_t			  capacity;
+
+	/**
+	 * @var hashes
+	 * @brief The hash of the string in the matching slot.
+	 */
+	uint32_t *		  hashes;
+
+	/**
+	 * @var slots
+	 * @brief The interned strings.
+	 */
+	const char *		  slots[];
+};
+
+/**
+ * @struct bf_strpool
+ * @brief A deduplicating string arena.
+ */
+struct bf_strpool {
+	/**
+	 * @internal
+	 * @var chunks
+	 * @brief The chunk currently being filled, linked to the older ones.
+	 */
+	struct bf_strpool_chunk * chunks;
+
+	/**
+	 * @internal
+	 * @var table
+	 * @brief The table strings are inserted into, linked to the older ones.
+	 */
+	struct bf_strpool_table * table;
+
+	/**
+	 * @var count
+	 * @brief The number of distinct strings held.
+	 */
+	size_t			  count;
+
+	/**
+	 * @var bytes
+	 * @brief The number of bytes used by the strings held.
+	 */
+	size_t			  bytes;
+
+	/**
+	 * @internal
+	 * @var lock
+	 * @brief Serialises insertions so the pool can be shared by threads
+	 * disassembling the same bin_file. Lookups do not take it.
+	 */
+	pthread_mutex_t		  lock;
+};
+
+/**
+ * @brief Creates an empty bf_strpool.
+ * @return A bf_strpool object.
+ * @note bf_close_strpool() must be called to release the pool and every
+ * string interned in it.
+ */
+extern struct bf_strpool * bf_init_strpool(void);
+
+/**
+ * @brief Interns a string.
+ * @param pool The bf_strpool to be used.
+ * @param str The NUL terminated string to be interned.
+ * @return The pooled copy of str.
+ */
+extern const char * bf_strpool_intern(struct bf_strpool * pool,
+		const char * str);
+
+/**
+ * @brief Interns the first len characters of a string.
+ * @param pool The bf_strpool to be used.
+ * @param str The string to be interned. It need not be NUL terminated.
+ * @param len The number of characters of str to be interned.
+ * @return The pooled, NUL terminated copy.
+ */
+extern const char * bf_strpool_intern_len(struct bf_strpool * pool,
+		const char * str, size_t len);
+
+/**
+ * @brief Interns a string without copying it.
+ * @param pool The bf_strpool to be used.
+ * @param str The NUL terminated string to be interned. If no equal string is
+ * held yet, str itself becomes the pooled string, so it must stay valid for
+ * the lifetime of the pool (e.g. it lives in a mapped cache file).
+ * @return The pooled string, which is str unless an equal string was already
+ * held.
+ */
+extern const char * bf_strpool_intern_ref(struct bf_strpool * pool,
+		const char * str);
+
+/**
+ * @brief Gets the pooled copy of a string without interning it.
+ * @param pool The bf_strpool to be searched.
+ * @param str The NUL terminated string being searched for.
+ * @return The pooled copy of str or NULL if it has not been interned.
+ */
+extern const char * bf_strpool_find(struct bf_strpool * pool,
+		const char * str);
+
+/**
+ * @brief Releases a bf_strpool and all strings interned in it.
+ * @param pool The bf_strpool to be closed.
+ */
+extern void bf_close_strpool(struct bf_strpool * pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -51,12 +51,16 @@ extern "C" {
 #include <string.h>
 #include <bfd.h>
 #include <libelf.h>
+#include <pthread.h>
 
 #include <libkern/jhash.h>
 #include <libkern/hlist.h>
 #include <libkern/list.h>
 #include <libkern/rbtree.h>
 
+#include "extent.h"
+#include "strpool.h"
+
 struct bin_file;
 
 #if defined(__x86_64__)
@@ -87,6 +91,7 @@ enum symbol_type {
   SYMBOL_WEAK       = 0x20,
   SYMBOL_DEBUGGING  = 0x40,
   SYMBOL_COMMON     = 0x80,
+  SYMBOL_RELOCATION = 0x100,  /* the symbol names a relocated slot */
 };
 
 enum plt_type {
@@ -103,8 +108,10 @@ enum plt_type {
  * asymbol structure.
  */
 struct symbol {
-  /** The symbol name */
+  /** The raw (mangled) symbol name, interned in the symbol_table strpool */
   char *name;
+  /** The demangled name, NULL until symbol_demangled_name() is called */
+  char *demangled;
   /** The symbol address */
   bfd_vma address;
   /** The symbol size */
@@ -117,32 +124,111 @@ struct symbol {
   asymbol *asymbol;
   /** The symbol PLT type */
   enum plt_type plt_type;
+  /** Hash of the symbol name, kept to avoid rehashing on table growth */
+  uint32_t name_hash;
   /** Symbol hash */
   struct hlist_node symbol_hash;
   /** Symbol tree */
   struct rb_node rb_symbol;
 };
 
+/**
+ * @struct call_site
+ * @brief A call instruction, as recorded by bf_call_graph.
+ */
 struct call_site {
-  struct list_head caller, callee;
+  /** The symbols of the calling and the called function, NULL if unknown */
   struct symbol *from, *to;
+  /** The address of the call and the address it returns to */
   void *addr, *ret_addr;
+  /** The size of the call instruction */
   size_t size;
+  /** The call graph node called, -1 for an unresolved indirect call */
   int index;
 };
 
 struct symbol_table {
+  /** The BFD the symbols are loaded from */
+  bfd *abfd;
+  /** Whether the symbols have been loaded, see symbol_table_ensure() */
+  bool loaded;
+  /** Whether the symbols are being loaded by the thread holding @p lock */
+  bool loading;
+  /** Serialises loading and the lazy index builds, recursive */
+  pthread_mutex_t lock;
+  /** Mapped symbol cache file backing the names, or NULL */
+  void *cache_map;
+  /** Size of @p cache_map */
+  size_t cache_size;
+  /** Pool holding the symbol names, which are compared by pointer */
+  struct bf_strpool *strpool;
   struct hlist_head *symbol_hash;
+  /** Number of buckets in @p symbol_hash, always a power of two */
+  unsigned int symbol_hash_size;
+  /** Number of symbols in @p symbol_hash */
+  size_t symbol_count;
   struct rb_root rb_symbol;
+  /** Sorted [address, address + size) extents, built on first lookup */
+  struct bf_extent_index extents;
+  /** Whether @p extents reflects the symbols currently in the table */
+  bool extents_valid;
+  /** Open addressing index of the symbols by demangled name */
+  struct symbol **demangled_index;
+  /** Number of slots in @p demangled_index, always a power of two */
+  size_t demangled_index_size;
+  /** Whether @p demangled_index reflects the symbols currently in the table */
+  bool demangled_valid;
 };
 
-#define symbol_hashfn(n) jhash(n, strlen(n), 0) & (symbolhash_size - 1)
+#define symbol_hashfn(n) jhash(n, strlen(n), 0)
+#define symbol_bucket(table, hash) \
+    (&(table)->symbol_hash[(hash) & ((table)->symbol_hash_size - 1)])
 #define symbolhash_size 16
 #define symbolhash_shift 4
 
 #define symbolhash_entry(node) hlist_entry((node), struct symbol, symbol_hash)
 
+/**
+ * @brief Gets a symbol by name.
+ * @param table The symbol table to be searched.
+ * @param name The name of the symbol.
+ * @return The symbol called @p name or NULL if there is none.
+ * @details The table starts with symbolhash_size buckets and doubles
+ * whenever it holds more symbols than buckets, so lookups stay O(1)
+ * expected regardless of the number of symbols.
+ */
 extern struct symbol *symbol_find(struct symbol_table *table, const char *name);
+
+/**
+ * @brief Gets the demangled name of a symbol.
+ * @param sym The symbol whose name is wanted.
+ * @return The demangled name, or the raw name if it is not a mangled C++
+ * name (or demangling is not supported).
+ * @details Symbols are loaded with their raw names only. The name is
+ * demangled on the first call and cached in the symbol.
+ */
+extern const char *symbol_demangled_name(struct symbol *sym);
+
+/**
+ * @brief Gets a symbol by its demangled name.
+ * @param table The symbol table to be searched.
+ * @param name The demangled name, e.g. "foo::bar(int)".
+ * @return The first symbol whose demangled name is @p name or NULL.
+ * @details The first call demangles every symbol of the table to build the
+ * index, later calls are O(1) expected. Use symbol_find() to search by raw
+ * name.
+ */
+extern struct symbol *symbol_find_demangled(struct symbol_table *table,
+                                            const char *name);
+
+/**
+ * @brief Adds a symbol to the name index.
+ * @param table The symbol table to be added to.
+ * @param sym The symbol to be added. Nothing is done if a symbol with the same
+ * name already exists.
+ * @note The name is replaced by its copy in the table strpool, so the caller
+ * keeps ownership of the original string.
+ */
 extern void symbol_add(struct symbol_table *table, struct symbol *sym);
 
 /**
@@ -151,7 +237,8 @@ extern void symbol_add(struct symbol_table *table, struct symbol *sym);
  * @param hash The symbol table
  */
 #define for_each_symbol(sym, table) \
-    for (int i = 0; i < symbolhash_size; ++i) \
+    for (unsigned int i = (symbol_table_ensure(table), 0); \
+         i < (table)->symbol_hash_size; ++i) \
         for (sym = symbolhash_entry((table)->symbol_hash[i].first); \
              &sym->symbol_hash; \
              sym = symbolhash_entry(sym->symbol_hash.next))
@@ -159,7 +246,48 @@ extern void symbol_add(struct symbol_table *table, struct symbol *sym);
 extern struct symbol *rb_search_symbol(struct symbol_table *table, void *addr);
 extern struct symbol *rb_insert_symbol(struct symbol_table *table, void *addr, struct rb_node *node);
 
-extern void symbol_table_init(struct symbol_table *table);
+/**
+ * @brief Gets the symbol containing an address.
+ * @param table The symbol table to be searched.
+ * @param addr The address to be symbolized.
+ * @param offset If not NULL, receives the offset of @p addr into the symbol.
+ * @return The symbol whose [address, address + size) range contains @p addr
+ * or NULL if there is none.
+ */
+extern struct symbol *symbol_lookup_address(struct symbol_table *table,
+                                            bfd_vma addr, bfd_vma *offset);
+
+/**
+ * @brief Symbolizes an array of addresses in one pass.
+ * @param table The symbol table to be searched.
+ * @param addrs The addresses to be symbolized.
+ * @param count The number of addresses in @p addrs.
+ * @param syms Receives the containing symbol (or NULL) of each address.
+ * @param offsets If not NULL, receives the offset of each address into its
+ * symbol.
+ * @return The number of addresses which were contained in a symbol.
+ * @details Sorted input is resolved with a single merge walk over the
+ * symbol extents, otherwise each address takes a branchless binary search.
+ */
+extern size_t symbol_lookup_addresses(struct symbol_table *table,
+                                      const bfd_vma *addrs, size_t count,
+                                      struct symbol **syms, bfd_vma *offsets);
+
+extern void symbol_table_init(struct symbol_table *table, bfd *abfd,
+                              struct bf_strpool *strpool);
+
+/**
+ * @brief Loads the symbols if that has not happened yet.
+ * @param table The symbol table to be loaded.
+ * @details Symbol tables are loaded lazily on the first query rather than
+ * when the bin_file is opened. All lookup functions and for_each_symbol()
+ * call this, so it only needs to be called directly before walking
+ * @p rb_symbol. When the cache is enabled (see cache.h) the symbols are
+ * read from a mapped cache file if one matches the binary, otherwise they
+ * are read through BFD and written to the cache. Concurrent callers wait
+ * for the thread doing the load.
+ */
+extern void symbol_table_ensure(struct symbol_table *table);
 extern void symbol_table_destroy(struct symbol_table *table);
 
 extern int load_sym_table(struct bin_file * bf);
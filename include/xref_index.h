@@ -0,0 +1,261 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file xref_index.h
+ * @brief Definition and API of bf_xref_index.
+ * @details bf_xref_index answers "who references this address?" for
+ * function pointers, strings, globals and jump tables without scanning every
+ * instruction. It maps target addresses to the instructions and relocations
+ * referencing them, sorted by target so that a whole object or section can
+ * be queried as a range.
+ *
+ * References are taken from:
+ *	- OP_VAL operands, i.e. branch and call targets and absolute memory
+ *	  operands.
+ *	- OP_IMM operands whose value lies within the allocated sections, e.g.
+ *	  mov $str,%edi.
+ *	- OP_ADDR_PTR operands, e.g. jmp *0x804a00c.
+ *	- Displacements of index operands. RIP-relative ones are resolved
+ *	  against the next instruction, others are kept if they lie within the
+ *	  allocated sections, e.g. the table of jmp *0x8048f00(,%eax,4).
+ *	- bf_insn.extra_info.
+ *	- Relocations whose symbol is defined in the binary.
+ *
+ * Once a bin_file has an index, the disassembler adds the references of
+ * every new bf_insn to it. They are merged into the sorted array by the next
+ * query, so building a CFG does not pay for sorting.
+ */
+
+#ifndef BF_XREF_INDEX_H
+#define BF_XREF_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "binary_file.h"
+#include "insn.h"
+
+/**
+ * @brief The insn of a bf_xref which does not come from an instruction.
+ */
+#define BF_NO_INSN UINT32_MAX
+
+/**
+ * @enum bf_xref_kind
+ * @brief The way an address is referenced.
+ */
+enum bf_xref_kind {
+	/**
+	 * @brief The target of a call.
+	 */
+	BF_XREF_CALL,
+
+	/**
+	 * @brief The target of a jump or conditional branch.
+	 */
+	BF_XREF_BRANCH,
+
+	/**
+	 * @brief Memory accessed by the instruction.
+	 */
+	BF_XREF_DATA,
+
+	/**
+	 * @brief An immediate which looks like an address, e.g. a function
+	 * pointer or string being passed around.
+	 */
+	BF_XREF_IMM,
+
+	/**
+	 * @brief A relocated slot holding the address.
+	 */
+	BF_XREF_RELOC
+};
+
+/**
+ * @struct bf_xref
+ * @brief A reference to an address.
+ */
+struct bf_xref {
+	/**
+	 * @var target
+	 * @brief The referenced address.
+	 */
+	bfd_vma		  target;
+
+	/**
+	 * @var from
+	 * @brief The VMA of the referencing instruction or relocated slot.
+	 */
+	bfd_vma		  from;
+
+	/**
+	 * @var insn
+	 * @brief The dense id of the referencing bf_insn, see
+	 * bf_get_insn_by_id(), or BF_NO_INSN for relocations.
+	 */
+	uint32_t	  insn;
+
+	/**
+	 * @var kind
+	 * @brief The kind of the reference.
+	 */
+	enum bf_xref_kind kind;
+};
+
+/**
+ * @struct bf_xref_index
+ * @brief The references of a bin_file, sorted by target.
+ */
+struct bf_xref_index {
+	/**
+	 * @var bf
+	 * @brief The bin_file the index belongs to.
+	 */
+	struct bin_file * bf;
+
+	/**
+	 * @var xrefs
+	 * @brief The references sorted by target, then by from.
+	 */
+	struct bf_xref *  xrefs;
+
+	/**
+	 * @var num_xrefs
+	 * @brief The number of references in xrefs.
+	 */
+	size_t		  num_xrefs;
+
+	/**
+	 * @internal
+	 * @var capacity
+	 * @brief The capacity of xrefs.
+	 */
+	size_t		  capacity;
+
+	/**
+	 * @internal
+	 * @var pending
+	 * @brief References added by the disassembler since the last query,
+	 * unsorted. Protected by bin_file.cflow_lock.
+	 */
+	struct bf_xref *  pending;
+
+	/**
+	 * @internal
+	 * @var num_pending
+	 * @brief The number of references in pending.
+	 */
+	size_t		  num_pending;
+
+	/**
+	 * @internal
+	 * @var pending_capacity
+	 * @brief The capacity of pending.
+	 */
+	size_t		  pending_capacity;
+
+	/**
+	 * @internal
+	 * @var start
+	 * @brief The lowest VMA of the allocated sections.
+	 */
+	bfd_vma		  start;
+
+	/**
+	 * @internal
+	 * @var end
+	 * @brief The end of the highest allocated section.
+	 */
+	bfd_vma		  end;
+};
+
+/**
+ * @brief Creates the bf_xref_index of a bin_file.
+ * @param bf The bin_file to be indexed.
+ * @param num_threads The number of threads scanning the instructions
+ * discovered so far. 0 means bf_get_num_workers(0).
+ * @return The bf_xref_index, which is also stored in bin_file.xref_index.
+ * If the bin_file already has one, it is returned instead.
+ * @details Must not be called while the bin_file is being disassembled. The
+ * index is kept up to date by later disassembly and closed along with the
+ * bin_file.
+ */
+extern struct bf_xref_index * bf_init_xref_index(struct bin_file * bf,
+		unsigned int num_threads);
+
+/**
+ * @brief Rebuilds a bf_xref_index from every discovered bf_insn.
+ * @param index The bf_xref_index to be rebuilt.
+ * @param num_threads The number of threads scanning the instructions. 0
+ * means bf_get_num_workers(0).
+ * @details Only needed if instructions were added behind the disassembler's
+ * back. Must not be called while the bin_file is being disassembled.
+ */
+extern void bf_rebuild_xref_index(struct bf_xref_index * index,
+		unsigned int num_threads);
+
+/**
+ * @internal
+ * @brief Adds the references of a new bf_insn.
+ * @param index The bf_xref_index to be added to.
+ * @param insn The bf_insn, which must already be in bin_file.insn_table.
+ * @details Must be called with bin_file.cflow_lock held.
+ */
+extern void bf_add_insn_xrefs(struct bf_xref_index * index,
+		struct bf_insn * insn);
+
+/**
+ * @brief Gets the references to a range of addresses.
+ * @param index The bf_xref_index to be searched.
+ * @param start The first address of the range.
+ * @param end The end of the range, which is not included.
+ * @param xrefs Receives the first reference, the rest follow it in order.
+ * They stay valid until the next query or rebuild of the index.
+ * @return The number of references.
+ * @details Safe while the bin_file is being disassembled, in which case the
+ * result holds the references found so far. Queries must not race each
+ * other or bf_rebuild_xref_index().
+ */
+extern size_t bf_get_xrefs(struct bf_xref_index * index, bfd_vma start,
+		bfd_vma end, struct bf_xref ** xrefs);
+
+/**
+ * @brief Gets the references to an address.
+ * @param index The bf_xref_index to be searched.
+ * @param vma The referenced address.
+ * @param xrefs Receives the first reference, see bf_get_xrefs().
+ * @return The number of references.
+ */
+extern size_t bf_get_xrefs_to(struct bf_xref_index * index, bfd_vma vma,
+		struct bf_xref ** xrefs);
+
+/**
+ * @brief Closes a bf_xref_index object and detaches it from its bin_file.
+ * @param index The bf_xref_index to be closed.
+ */
+extern void bf_close_xref_index(struct bf_xref_index * index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
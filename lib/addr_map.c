@@ -0,0 +1,254 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "addr_map.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <libiberty.h>
+
+#define BF_ADDR_MAP_NODE_BITS  4
+#define BF_ADDR_MAP_NODE_SLOTS (1 << BF_ADDR_MAP_NODE_BITS)
+
+/*
+ * Inner nodes are told apart from bf_addr_node leaves by the low bit of the
+ * slot, which is clear for both since they are at least 8 byte aligned.
+ */
+#define IS_INNER(p)   (((uintptr_t)(p)) & 1)
+#define TO_INNER(p)   ((struct BF_ADDR_INNER *)((uintptr_t)(p) & ~1))
+#define TAG_INNER(p)  ((void *)((uintptr_t)(p) | 1))
+
+struct BF_ADDR_INNER {
+	void * slots[BF_ADDR_MAP_NODE_SLOTS];
+};
+
+/*
+ * The SplitMix64 finaliser. It is a bijection, so two different keys never
+ * have the same hash and the trie is never more than
+ * (64 - BF_ADDR_MAP_ROOT_BITS) / BF_ADDR_MAP_NODE_BITS levels deep. VMAs
+ * differ mostly in their low bits, which it spreads over the whole word.
+ */
+static uint64_t mix(bfd_vma key)
+{
+	uint64_t h = key;
+
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return h ^ (h >> 31);
+}
+
+static size_t slot_index(uint64_t hash, unsigned int depth)
+{
+	if(depth == 0) {
+		return hash & (BF_ADDR_MAP_ROOT_SLOTS - 1);
+	}
+
+	return (hash >> (BF_ADDR_MAP_ROOT_BITS + (depth - 1) *
+			BF_ADDR_MAP_NODE_BITS)) & (BF_ADDR_MAP_NODE_SLOTS - 1);
+}
+
+void bf_init_addr_map(struct bf_addr_map * map)
+{
+	map->root      = xcalloc(BF_ADDR_MAP_ROOT_SLOTS, sizeof(void *));
+	map->head      = NULL;
+	map->count     = 0;
+	map->id_chunks = xcalloc(BF_ADDR_MAP_ID_CHUNKS,
+			sizeof(struct bf_addr_node **));
+	map->num_ids   = 0;
+}
+
+/*
+ * Makes a node that won its slot reachable through its id.
+ */
+static void publish_id(struct bf_addr_map * map, struct bf_addr_node * node)
+{
+	struct bf_addr_node *** chunk = &map->id_chunks[node->id >>
+			BF_ADDR_MAP_ID_CHUNK_BITS];
+	struct bf_addr_node **	cur   = __atomic_load_n(chunk,
+			__ATOMIC_ACQUIRE);
+
+	assert(node->id >> BF_ADDR_MAP_ID_CHUNK_BITS < BF_ADDR_MAP_ID_CHUNKS);
+
+	if(cur == NULL) {
+		struct bf_addr_node ** fresh = xcalloc(
+				BF_ADDR_MAP_ID_CHUNK_SIZE,
+				sizeof(struct bf_addr_node *));
+
+		if(__atomic_compare_exchange_n(chunk, &cur, fresh, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			cur = fresh;
+		} else {
+			free(fresh);
+		}
+	}
+
+	__atomic_store_n(&cur[node->id & (BF_ADDR_MAP_ID_CHUNK_SIZE - 1)],
+			node, __ATOMIC_RELEASE);
+}
+
+/*
+ * Links a node that won its slot into the iteration list.
+ */
+static void push_node(struct bf_addr_map * map, struct bf_addr_node * node)
+{
+	node->next = __atomic_load_n(&map->head, __ATOMIC_RELAXED);
+
+	while(!__atomic_compare_exchange_n(&map->head, &node->next, node,
+			true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	}
+
+	__atomic_add_fetch(&map->count, 1, __ATOMIC_RELAXED);
+}
+
+struct bf_addr_node * bf_addr_map_insert(struct bf_addr_map * map,
+		struct bf_addr_node * node, bfd_vma key)
+{
+	void **	     slots    = map->root;
+	unsigned int depth    = 0;
+	bool	     reserved = FALSE;
+
+	node->key  = key;
+	node->hash = mix(key);
+	node->next = NULL;
+
+	for(;;) {
+		void ** slot = &slots[slot_index(node->hash, depth)];
+		void *	cur  = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+		if(cur == NULL) {
+			/*
+			 * The id is drawn before the node becomes visible, so
+			 * whoever finds the node also sees its id.
+			 */
+			if(!reserved) {
+				node->id = __atomic_fetch_add(&map->num_ids, 1,
+						__ATOMIC_RELAXED);
+				reserved = TRUE;
+			}
+
+			/*
+			 * The release half publishes the key, hash and id of
+			 * the node together with the node.
+			 */
+			if(__atomic_compare_exchange_n(slot, &cur, node, false,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				push_node(map, node);
+				publish_id(map, node);
+				return node;
+			}
+		}
+
+		if(IS_INNER(cur)) {
+			slots = TO_INNER(cur)->slots;
+			depth++;
+		} else if(cur != NULL) {
+			struct bf_addr_node *  leaf = cur;
+			struct BF_ADDR_INNER * inner;
+
+			if(leaf->key == key) {
+				return leaf;
+			}
+
+			/*
+			 * Two keys share the slot. Push the existing leaf one
+			 * level down and retry. Losing the race to another
+			 * thread doing the same just wastes the node.
+			 */
+			inner = xcalloc(1, sizeof(struct BF_ADDR_INNER));
+			inner->slots[slot_index(leaf->hash, depth + 1)] = leaf;
+
+			if(!__atomic_compare_exchange_n(slot, &cur,
+					TAG_INNER(inner), false,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				free(inner);
+			}
+		}
+	}
+}
+
+struct bf_addr_node * bf_addr_map_find(struct bf_addr_map * map,
+		bfd_vma key)
+{
+	uint64_t     hash  = mix(key);
+	void **	     slots = map->root;
+	unsigned int depth = 0;
+
+	for(;;) {
+		void * cur = __atomic_load_n(&slots[slot_index(hash, depth)],
+				__ATOMIC_ACQUIRE);
+
+		if(IS_INNER(cur)) {
+			slots = TO_INNER(cur)->slots;
+			depth++;
+		} else if(cur != NULL &&
+				((struct bf_addr_node *)cur)->key == key) {
+			return cur;
+		} else {
+			return NULL;
+		}
+	}
+}
+
+struct bf_addr_node * bf_addr_map_get(struct bf_addr_map * map,
+		uint32_t id)
+{
+	struct bf_addr_node ** chunk;
+
+	if(id >= __atomic_load_n(&map->num_ids, __ATOMIC_RELAXED)) {
+		return NULL;
+	}
+
+	chunk = __atomic_load_n(&map->id_chunks[id >>
+			BF_ADDR_MAP_ID_CHUNK_BITS], __ATOMIC_ACQUIRE);
+
+	return chunk ? __atomic_load_n(&chunk[id &
+			(BF_ADDR_MAP_ID_CHUNK_SIZE - 1)], __ATOMIC_ACQUIRE) :
+			NULL;
+}
+
+static void free_inner(struct BF_ADDR_INNER * inner)
+{
+	for(size_t i = 0; i < BF_ADDR_MAP_NODE_SLOTS; i++) {
+		if(IS_INNER(inner->slots[i])) {
+			free_inner(TO_INNER(inner->slots[i]));
+		}
+	}
+
+	free(inner);
+}
+
+void bf_close_addr_map(struct bf_addr_map * map)
+{
+	for(size_t i = 0; i < BF_ADDR_MAP_ROOT_SLOTS; i++) {
+		if(IS_INNER(map->root[i])) {
+			free_inner(TO_INNER(map->root[i]));
+		}
+	}
+
+	for(size_t i = 0; i < BF_ADDR_MAP_ID_CHUNKS; i++) {
+		free(map->id_chunks[i]);
+	}
+
+	free(map->root);
+	free(map->id_chunks);
+	map->root      = NULL;
+	map->head      = NULL;
+	map->count     = 0;
+	map->id_chunks = NULL;
+	map->num_ids   = 0;
+}
@@ -0,0 +1,597 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "analysis_cache.h"
+#include "basic_blk.h"
+#include "cache.h"
+#include "func.h"
+#include "insn.h"
+
+#define BF_ANALYSIS_MAGIC   "LIBBFCFG"
+#define BF_ANALYSIS_VERSION 1
+#define BF_NO_INDEX	    0xFFFFFFFF
+
+struct BF_ANALYSIS_HEADER {
+	char	 magic[8];
+	uint32_t version;
+	uint32_t bitiness;
+
+	/*
+	 * Size of the variable parts of the layout, so files written by a build
+	 * with a different operand representation are rejected.
+	 */
+	uint32_t insn_size;
+	uint32_t operand_size;
+	uint32_t num_insns;
+	uint32_t num_bbs;
+	uint32_t num_funcs;
+	uint32_t num_parts;
+	uint32_t num_bb_insns;
+	uint32_t strings_size;
+	uint64_t checksum;
+};
+
+struct BF_ANALYSIS_INSN {
+	uint64_t	    vma;
+	uint64_t	    extra_info;
+	int32_t		    size;
+	uint32_t	    is_data;
+	uint64_t	    mnemonic;
+	uint64_t	    secondary_mnemonic;
+	struct insn_operand operands[3];
+	uint32_t	    first_part;
+	uint32_t	    num_parts;
+};
+
+struct BF_ANALYSIS_BB {
+	uint64_t vma;
+	uint32_t target;
+	uint32_t target2;
+	uint32_t first_insn;
+	uint32_t num_insns;
+};
+
+struct BF_ANALYSIS_FUNC {
+	uint64_t vma;
+	uint32_t bb;
+	uint32_t pad;
+};
+
+/*
+ * Pointers to the sections of an analysis image.
+ */
+struct BF_ANALYSIS_IMAGE {
+	struct BF_ANALYSIS_HEADER * header;
+	struct BF_ANALYSIS_INSN *   insns;
+	struct BF_ANALYSIS_BB *	    bbs;
+	struct BF_ANALYSIS_FUNC *   funcs;
+	uint32_t *		    parts;
+	uint32_t *		    bb_insns;
+	char *			    strings;
+	size_t			    size;
+};
+
+static size_t image_size(struct BF_ANALYSIS_HEADER * header)
+{
+	return sizeof(struct BF_ANALYSIS_HEADER) +
+			(size_t)header->num_insns *
+			sizeof(struct BF_ANALYSIS_INSN) +
+			(size_t)header->num_bbs * sizeof(struct BF_ANALYSIS_BB) +
+			(size_t)header->num_funcs *
+			sizeof(struct BF_ANALYSIS_FUNC) +
+			(size_t)header->num_parts * sizeof(uint32_t) +
+			(size_t)header->num_bb_insns * sizeof(uint32_t) +
+			header->strings_size;
+}
+
+static void map_image(struct BF_ANALYSIS_IMAGE * image, char * buf)
+{
+	struct BF_ANALYSIS_HEADER * header = (struct BF_ANALYSIS_HEADER *)buf;
+
+	image->header	= header;
+	image->insns	= (struct BF_ANALYSIS_INSN *)(header + 1);
+	image->bbs	= (struct BF_ANALYSIS_BB *)(image->insns +
+			header->num_insns);
+	image->funcs	= (struct BF_ANALYSIS_FUNC *)(image->bbs +
+			header->num_bbs);
+	image->parts	= (uint32_t *)(image->funcs + header->num_funcs);
+	image->bb_insns	= image->parts + header->num_parts;
+	image->strings	= (char *)(image->bb_insns + header->num_bb_insns);
+	image->size	= image_size(header);
+}
+
+static int cmp_insn_vma(const void * elem1, const void * elem2)
+{
+	const struct bf_insn * i1 = *(struct bf_insn * const *)elem1;
+	const struct bf_insn * i2 = *(struct bf_insn * const *)elem2;
+
+	return i1->vma < i2->vma ? -1 : i1->vma > i2->vma;
+}
+
+static int cmp_bb_vma(const void * elem1, const void * elem2)
+{
+	const struct bf_basic_blk * b1 =
+			*(struct bf_basic_blk * const *)elem1;
+	const struct bf_basic_blk * b2 =
+			*(struct bf_basic_blk * const *)elem2;
+
+	return b1->vma < b2->vma ? -1 : b1->vma > b2->vma;
+}
+
+/*
+ * Returns the position of the object starting at vma in an array sorted by
+ * VMA. The first member of bf_insn and bf_basic_blk is the VMA.
+ */
+static uint32_t find_index(void ** sorted, size_t count, bfd_vma vma)
+{
+	size_t lo = 0;
+	size_t hi = count;
+
+	while(lo < hi) {
+		size_t	mid	= lo + (hi - lo) / 2;
+		bfd_vma mid_vma = *(bfd_vma *)sorted[mid];
+
+		if(mid_vma < vma) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo < count && *(bfd_vma *)sorted[lo] == vma ? lo : BF_NO_INDEX;
+}
+
+/*
+ * Strings are deduplicated through the bin_file strpool: interned strings
+ * are unique pointers so a string only needs to be written once.
+ */
+struct BF_ANALYSIS_STRINGS {
+	struct htable table;
+	char *	      buf;
+	size_t	      size;
+	size_t	      capacity;
+};
+
+struct BF_ANALYSIS_STRING {
+	struct htable_entry entry;
+	const char *	    str;
+	uint32_t	    offset;
+};
+
+static uint32_t add_string(struct BF_ANALYSIS_STRINGS * strings,
+		const char * str)
+{
+	struct BF_ANALYSIS_STRING * s = hash_find_entry(&strings->table,
+			&str, sizeof(str), struct BF_ANALYSIS_STRING, entry);
+	size_t			    len;
+
+	if(s != NULL) {
+		return s->offset;
+	}
+
+	len = strlen(str) + 1;
+
+	if(strings->size + len > strings->capacity) {
+		strings->capacity = (strings->size + len) * 2;
+		strings->buf	  = xrealloc(strings->buf, strings->capacity);
+	}
+
+	s	  = xmalloc(sizeof(struct BF_ANALYSIS_STRING));
+	s->str	  = str;
+	s->offset = strings->size;
+	htable_add(&strings->table, &s->entry, &s->str, sizeof(s->str));
+
+	memcpy(strings->buf + strings->size, str, len);
+	strings->size += len;
+	return s->offset;
+}
+
+static void close_strings(struct BF_ANALYSIS_STRINGS * strings)
+{
+	struct htable_entry *	    cur_entry;
+	struct htable_entry *	    n;
+	struct BF_ANALYSIS_STRING * s;
+
+	htable_for_each_entry_safe(s, cur_entry, n, &strings->table, entry) {
+		htable_del_entry(&strings->table, cur_entry);
+		free(s);
+	}
+
+	htable_destroy(&strings->table);
+	free(strings->buf);
+}
+
+/*
+ * Collects the objects of a hashtable into an array sorted by VMA.
+ */
+static size_t collect_insns(struct bin_file * bf, struct bf_insn *** out)
+{
+	struct bf_insn * insn;
+	size_t		 count = 0;
+	size_t		 capacity = 1024;
+
+	*out = xmalloc(capacity * sizeof(struct bf_insn *));
+
+	bf_for_each_insn(insn, bf) {
+		if(count == capacity) {
+			capacity *= 2;
+			*out	  = xrealloc(*out, capacity *
+					sizeof(struct bf_insn *));
+		}
+
+		(*out)[count++] = insn;
+	}
+
+	qsort(*out, count, sizeof(struct bf_insn *), cmp_insn_vma);
+	return count;
+}
+
+static size_t collect_bbs(struct bin_file * bf, struct bf_basic_blk *** out)
+{
+	struct bf_basic_blk * bb;
+	size_t		      count = 0;
+	size_t		      capacity = 1024;
+
+	*out = xmalloc(capacity * sizeof(struct bf_basic_blk *));
+
+	bf_for_each_basic_blk(bb, bf) {
+		if(count == capacity) {
+			capacity *= 2;
+			*out	  = xrealloc(*out, capacity *
+					sizeof(struct bf_basic_blk *));
+		}
+
+		(*out)[count++] = bb;
+	}
+
+	qsort(*out, count, sizeof(struct bf_basic_blk *), cmp_bb_vma);
+	return count;
+}
+
+static size_t count_funcs(struct bin_file * bf)
+{
+	struct bf_func * func;
+	size_t		 count = 0;
+
+	bf_for_each_func(func, bf) {
+		count++;
+	}
+
+	return count;
+}
+
+bool bf_save_analysis(struct bin_file * bf)
+{
+	struct BF_ANALYSIS_HEADER  header = {{0}};
+	struct BF_ANALYSIS_IMAGE   image;
+	struct BF_ANALYSIS_STRINGS strings;
+	struct bf_insn **	   insns;
+	struct bf_basic_blk **	   bbs;
+	struct bf_func *	   func;
+	size_t			   num_parts = 0;
+	size_t			   num_bb_insns = 0;
+	size_t			   pos;
+	char *			   path = bf_get_cache_path(bf->abfd, "cfg");
+	char *			   buf;
+	bool			   success;
+
+	if(path == NULL) {
+		return FALSE;
+	}
+
+	header.num_insns = collect_insns(bf, &insns);
+	header.num_bbs	 = collect_bbs(bf, &bbs);
+	header.num_funcs = count_funcs(bf);
+
+	for(size_t i = 0; i < header.num_insns; i++) {
+		struct bf_insn_part * part;
+
+		list_for_each_entry(part, &insns[i]->part_list, list) {
+			num_parts++;
+		}
+	}
+
+	for(size_t i = 0; i < header.num_bbs; i++) {
+		num_bb_insns += bf_get_bb_length(bbs[i]);
+	}
+
+	memcpy(header.magic, BF_ANALYSIS_MAGIC, sizeof(header.magic));
+	header.version	    = BF_ANALYSIS_VERSION;
+	header.bitiness	    = bf->bitiness;
+	header.insn_size    = sizeof(struct BF_ANALYSIS_INSN);
+	header.operand_size = sizeof(struct insn_operand);
+	header.num_parts    = num_parts;
+	header.num_bb_insns = num_bb_insns;
+
+	htable_init(&strings.table);
+	strings.buf	 = NULL;
+	strings.size	 = 0;
+	strings.capacity = 0;
+
+	/*
+	 * The strings have to be gathered first since their total size is part
+	 * of the layout.
+	 */
+	for(size_t i = 0; i < header.num_insns; i++) {
+		struct bf_insn_part * part;
+
+		list_for_each_entry(part, &insns[i]->part_list, list) {
+			add_string(&strings, part->str);
+		}
+	}
+
+	header.strings_size = strings.size;
+	buf		    = xcalloc(1, image_size(&header));
+	memcpy(buf, &header, sizeof(header));
+	map_image(&image, buf);
+
+	pos = 0;
+
+	for(size_t i = 0; i < header.num_insns; i++) {
+		struct BF_ANALYSIS_INSN * rec  = &image.insns[i];
+		struct bf_insn *	  insn = insns[i];
+		struct bf_insn_part *	  part;
+
+		rec->vma		= insn->vma;
+		rec->extra_info		= insn->extra_info;
+		rec->size		= insn->size;
+		rec->is_data		= insn->is_data;
+		rec->mnemonic		= insn->mnemonic;
+		rec->secondary_mnemonic = insn->secondary_mnemonic;
+		rec->operands[0]	= insn->operand1;
+		rec->operands[1]	= insn->operand2;
+		rec->operands[2]	= insn->operand3;
+		rec->first_part		= pos;
+
+		list_for_each_entry(part, &insn->part_list, list) {
+			image.parts[pos++] = add_string(&strings, part->str);
+		}
+
+		rec->num_parts = pos - rec->first_part;
+	}
+
+	pos = 0;
+
+	for(size_t i = 0; i < header.num_bbs; i++) {
+		struct BF_ANALYSIS_BB * rec = &image.bbs[i];
+		struct bf_basic_blk *	bb  = bbs[i];
+		unsigned int		len = bf_get_bb_length(bb);
+
+		rec->vma	= bb->vma;
+		rec->target	= bb->target ? find_index((void **)bbs,
+				header.num_bbs, bb->target->vma) : BF_NO_INDEX;
+		rec->target2	= bb->target2 ? find_index((void **)bbs,
+				header.num_bbs, bb->target2->vma) :
+				BF_NO_INDEX;
+		rec->first_insn = pos;
+		rec->num_insns	= len;
+
+		for(unsigned int j = 0; j < len; j++) {
+			image.bb_insns[pos++] = find_index((void **)insns,
+					header.num_insns,
+					bb->insn_vec[j]->vma);
+		}
+	}
+
+	pos = 0;
+
+	bf_for_each_func(func, bf) {
+		image.funcs[pos].vma = func->vma;
+		image.funcs[pos].bb  = func->bb ? find_index((void **)bbs,
+				header.num_bbs, func->bb->vma) : BF_NO_INDEX;
+		pos++;
+	}
+
+	memcpy(image.strings, strings.buf, strings.size);
+	image.header->checksum = bf_cache_checksum(image.insns,
+			image.size - sizeof(header));
+
+	success = bf_write_cache_file(path, buf, image.size);
+
+	close_strings(&strings);
+	free(buf);
+	free(insns);
+	free(bbs);
+	free(path);
+	return success;
+}
+
+/*
+ * Checks every index and offset of a mapped image before anything is built
+ * from it.
+ */
+static bool validate_image(struct BF_ANALYSIS_IMAGE * image, size_t size,
+		struct bin_file * bf)
+{
+	struct BF_ANALYSIS_HEADER * header = image->header;
+
+	if(size < sizeof(struct BF_ANALYSIS_HEADER) ||
+			memcmp(header->magic, BF_ANALYSIS_MAGIC,
+			sizeof(header->magic)) != 0 ||
+			header->version != BF_ANALYSIS_VERSION ||
+			header->insn_size != sizeof(struct BF_ANALYSIS_INSN) ||
+			header->operand_size != sizeof(struct insn_operand) ||
+			header->bitiness != bf->bitiness ||
+			image->size != size) {
+		return FALSE;
+	}
+
+	if(header->checksum != bf_cache_checksum(image->insns,
+			size - sizeof(struct BF_ANALYSIS_HEADER))) {
+		return FALSE;
+	}
+
+	if(header->strings_size != 0 &&
+			image->strings[header->strings_size - 1] != '\0') {
+		return FALSE;
+	}
+
+	for(uint32_t i = 0; i < header->num_insns; i++) {
+		struct BF_ANALYSIS_INSN * rec = &image->insns[i];
+
+		/*
+		 * Objects are written in VMA order, which also guarantees
+		 * that no VMA is claimed twice.
+		 */
+		if((i > 0 && rec->vma <= image->insns[i - 1].vma) ||
+				rec->first_part > header->num_parts ||
+				rec->num_parts > header->num_parts -
+				rec->first_part) {
+			return FALSE;
+		}
+	}
+
+	for(uint32_t i = 0; i < header->num_parts; i++) {
+		if(image->parts[i] >= header->strings_size) {
+			return FALSE;
+		}
+	}
+
+	for(uint32_t i = 0; i < header->num_bbs; i++) {
+		struct BF_ANALYSIS_BB * rec = &image->bbs[i];
+
+		if((i > 0 && rec->vma <= image->bbs[i - 1].vma) ||
+				(rec->target != BF_NO_INDEX &&
+				rec->target >= header->num_bbs) ||
+				(rec->target2 != BF_NO_INDEX &&
+				rec->target2 >= header->num_bbs) ||
+				rec->first_insn > header->num_bb_insns ||
+				rec->num_insns > header->num_bb_insns -
+				rec->first_insn) {
+			return FALSE;
+		}
+	}
+
+	for(uint32_t i = 0; i < header->num_bb_insns; i++) {
+		if(image->bb_insns[i] >= header->num_insns) {
+			return FALSE;
+		}
+	}
+
+	for(uint32_t i = 0; i < header->num_funcs; i++) {
+		if(image->funcs[i].bb != BF_NO_INDEX &&
+				image->funcs[i].bb >= header->num_bbs) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+bool bf_load_analysis(struct bin_file * bf)
+{
+	struct BF_ANALYSIS_IMAGE image;
+	struct bf_insn **	 insns;
+	struct bf_basic_blk **	 bbs;
+	size_t			 size;
+	char *			 path = bf_get_cache_path(bf->abfd, "cfg");
+	char *			 map  = path ? bf_map_cache_file(path, &size) :
+			NULL;
+
+	free(path);
+
+	if(map == NULL) {
+		return FALSE;
+	}
+
+	/*
+	 * The header has to be checked before its counts are used to lay out
+	 * the rest of the image.
+	 */
+	if(size < sizeof(struct BF_ANALYSIS_HEADER)) {
+		bf_unmap_cache_file(map, size);
+		return FALSE;
+	}
+
+	map_image(&image, map);
+
+	if(!validate_image(&image, size, bf)) {
+		bf_unmap_cache_file(map, size);
+		return FALSE;
+	}
+
+	insns = xmalloc((image.header->num_insns + 1) *
+			sizeof(struct bf_insn *));
+	bbs   = xmalloc((image.header->num_bbs + 1) *
+			sizeof(struct bf_basic_blk *));
+
+	for(uint32_t i = 0; i < image.header->num_bbs; i++) {
+		bbs[i] = bf_init_basic_blk(bf, image.bbs[i].vma);
+		bf_add_bb(bf, bbs[i]);
+	}
+
+	for(uint32_t i = 0; i < image.header->num_insns; i++) {
+		struct BF_ANALYSIS_INSN * rec = &image.insns[i];
+		struct bf_insn *	  insn = bf_init_insn(NULL, rec->vma);
+
+		insn->size		 = rec->size;
+		insn->is_data		 = rec->is_data;
+		insn->extra_info	 = rec->extra_info;
+		insn->mnemonic		 = rec->mnemonic;
+		insn->secondary_mnemonic = rec->secondary_mnemonic;
+		insn->operand1		 = rec->operands[0];
+		insn->operand2		 = rec->operands[1];
+		insn->operand3		 = rec->operands[2];
+
+		for(uint32_t j = 0; j < rec->num_parts; j++) {
+			bf_add_insn_part(bf, insn, image.strings +
+					image.parts[rec->first_part + j]);
+		}
+
+		insns[i] = insn;
+		bf_add_insn(bf, insn);
+	}
+
+	for(uint32_t i = 0; i < image.header->num_bbs; i++) {
+		struct BF_ANALYSIS_BB * rec = &image.bbs[i];
+
+		if(rec->target != BF_NO_INDEX) {
+			bbs[i]->target = bbs[rec->target];
+		}
+
+		if(rec->target2 != BF_NO_INDEX) {
+			bbs[i]->target2 = bbs[rec->target2];
+		}
+
+		for(uint32_t j = 0; j < rec->num_insns; j++) {
+			struct bf_insn * insn =
+					insns[image.bb_insns[rec->first_insn + j]];
+
+			insn->bb = bbs[i];
+			bf_add_insn_to_bb(bbs[i], insn);
+		}
+	}
+
+	for(uint32_t i = 0; i < image.header->num_funcs; i++) {
+		struct BF_ANALYSIS_FUNC * rec = &image.funcs[i];
+
+		if(!bf_exists_func(bf, rec->vma)) {
+			bf_add_func(bf, bf_init_func(bf, rec->bb != BF_NO_INDEX ?
+					bbs[rec->bb] : NULL, rec->vma));
+		}
+	}
+
+	free(insns);
+	free(bbs);
+	bf_unmap_cache_file(map, size);
+
+	/*
+	 * Everything held now matches the cache file.
+	 */
+	bf->analysis_dirty = FALSE;
+	return TRUE;
+}
@@ -24,8 +24,8 @@ struct bf_basic_blk * bf_init_basic_blk(struct bin_file * bf, bfd_vma vma)
 	bb->vma			 = vma;
 	bb->target		 = NULL;
 	bb->target2		 = NULL;
-	bb->sym			 = rb_search_symbol(&bf->sym_table,
-			(void *)vma);
+	bb->sym			 = NULL;
+	bb->sym_resolved	 = FALSE;
 	bb->insn_vec		 = NULL;
 
 	vec_init(bb->insn_vec, 100);
@@ -48,6 +48,13 @@ struct bf_basic_blk * bf_split_blk(struct bin_file * bf,
 		}
 	}
 
+	/*
+	 * The flow leaving the old block now leaves from the new one.
+	 */
+	bb_new->target	= bb->target;
+	bb_new->target2 = bb->target2;
+	bb->target	= bb_new;
+	bb->target2	= NULL;
 	return bb_new;
 }
 
@@ -99,17 +106,41 @@ void bf_close_basic_blk(struct bf_basic_blk * bb)
 	}
 }
 
-void bf_add_bb(struct bin_file * bf, struct bf_basic_blk * bb)
+struct bf_basic_blk * bf_add_bb(struct bin_file * bf,
+		struct bf_basic_blk * bb)
 {
-	assert(!bf_exists_bb(bf, bb->vma));
+	struct bf_basic_blk * added = bf_addr_map_entry(bf_addr_map_insert(
+			&bf->bb_table, &bb->entry, bb->vma),
+			struct bf_basic_blk, entry);
+
+	if(added == bb) {
+		__atomic_fetch_add(&bf->cfg_generation, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&bf->analysis_dirty, TRUE, __ATOMIC_RELAXED);
+	}
 
-	htable_add(&bf->bb_table, &bb->entry, &bb->vma, sizeof(bb->vma));
+	return added;
 }
 
 struct bf_basic_blk * bf_get_bb(struct bin_file * bf, bfd_vma vma)
 {
-	return hash_find_entry(&bf->bb_table, &vma, sizeof(vma),
-			struct bf_basic_blk, entry);
+	struct bf_addr_node * node = bf_addr_map_find(&bf->bb_table, vma);
+
+	return node ? bf_addr_map_entry(node, struct bf_basic_blk, entry) :
+			NULL;
+}
+
+/*
+ * Racing lookups store the same symbol, so the flag only has to publish it.
+ */
+struct symbol * bf_get_bb_sym(struct bin_file * bf, struct bf_basic_blk * bb)
+{
+	if(!__atomic_load_n(&bb->sym_resolved, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&bb->sym, rb_search_symbol(&bf->sym_table,
+				(void *)bb->vma), __ATOMIC_RELAXED);
+		__atomic_store_n(&bb->sym_resolved, TRUE, __ATOMIC_RELEASE);
+	}
+
+	return __atomic_load_n(&bb->sym, __ATOMIC_RELAXED);
 }
 
 unsigned int bf_get_bb_size(struct bf_basic_blk * bb)
@@ -140,17 +171,30 @@ struct bf_insn * bf_get_bb_insn(struct bf_basic_blk * bb, unsigned int index)
 
 bool bf_exists_bb(struct bin_file * bf, bfd_vma vma)
 {
-	return htable_find(&bf->bb_table, &vma, sizeof(vma));
+	return bf_addr_map_find(&bf->bb_table, vma) != NULL;
+}
+
+struct bf_basic_blk * bf_get_bb_by_id(struct bin_file * bf, uint32_t id)
+{
+	struct bf_addr_node * node = bf_addr_map_get(&bf->bb_table, id);
+
+	return node ? bf_addr_map_entry(node, struct bf_basic_blk, entry) :
+			NULL;
+}
+
+uint32_t bf_get_num_basic_blks(struct bin_file * bf)
+{
+	return __atomic_load_n(&bf->bb_table.num_ids, __ATOMIC_RELAXED);
 }
 
 void bf_close_bb_table(struct bin_file * bf)
 {
-	struct htable_entry * cur_entry;
-	struct htable_entry * n;
+	struct bf_addr_node * cur_entry;
+	struct bf_addr_node * n;
 	struct bf_basic_blk * bb;
 
-	htable_for_each_entry_safe(bb, cur_entry, n, &bf->bb_table, entry) {
-		htable_del_entry(&bf->bb_table, cur_entry);
+	bf_addr_map_for_each_entry_safe(bb, cur_entry, n, &bf->bb_table,
+			entry) {
 		bf_close_basic_blk(bb);
 	}
 }
@@ -159,10 +203,10 @@ void bf_enum_basic_blk(struct bin_file * bf,
 		void (*handler)(struct bin_file *, struct bf_basic_blk *,
 		void * param), void * param)
 {
-	struct htable_entry * cur_entry;
+	struct bf_addr_node * cur_entry;
 	struct bf_basic_blk * bb;
 
-	htable_for_each_entry(bb, cur_entry, &bf->bb_table, entry) {
+	bf_addr_map_for_each_entry(bb, cur_entry, &bf->bb_table, entry) {
 		handler(bf, bb, param);
 	}
 }
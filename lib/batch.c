@@ -0,0 +1,425 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <libiberty.h>
+
+/*
+ * Sent by a worker for each binary, followed by output_len bytes of output.
+ */
+struct BF_BATCH_RECORD {
+	size_t		     index;
+	enum bf_batch_status status;
+	size_t		     num_insns;
+	size_t		     num_basic_blks;
+	size_t		     num_funcs;
+	double		     load_ms;
+	double		     analyse_ms;
+	size_t		     output_len;
+};
+
+struct BF_BATCH_WORKER {
+	pid_t  pid;
+	int    job_fd;
+	int    result_fd;
+	bool   busy;
+	size_t index;
+	size_t cost;
+};
+
+struct BF_BATCH {
+	char **			  paths;
+	struct bf_batch_options * options;
+	struct BF_BATCH_WORKER *  workers;
+	unsigned int		  num_workers;
+};
+
+void bf_init_batch_options(struct bf_batch_options * options)
+{
+	options->num_workers = 0;
+	options->mem_budget  = 0;
+	options->mem_factor  = 16;
+	options->disasm	     = TRUE;
+	options->analyse     = NULL;
+	options->param	     = NULL;
+}
+
+static bool read_full(int fd, void * buf, size_t size)
+{
+	char * pos = buf;
+
+	while(size > 0) {
+		ssize_t n = read(fd, pos, size);
+
+		if(n < 0 && errno == EINTR) {
+			continue;
+		} else if(n <= 0) {
+			return FALSE;
+		}
+
+		pos  += n;
+		size -= n;
+	}
+
+	return TRUE;
+}
+
+static bool write_full(int fd, const void * buf, size_t size)
+{
+	const char * pos = buf;
+
+	while(size > 0) {
+		ssize_t n = write(fd, pos, size);
+
+		if(n < 0 && errno == EINTR) {
+			continue;
+		} else if(n <= 0) {
+			return FALSE;
+		}
+
+		pos  += n;
+		size -= n;
+	}
+
+	return TRUE;
+}
+
+static double elapsed_ms(struct timespec * start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1000.0 +
+			(end.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void analyse_binary(struct BF_BATCH * batch, size_t index,
+		int result_fd)
+{
+	struct bf_batch_options * options = batch->options;
+	struct BF_BATCH_RECORD	  record  = {0};
+	char *			  output  = NULL;
+	size_t			  size	  = 0;
+	struct timespec		  start;
+	struct bin_file *	  bf;
+
+	record.index = index;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	bf	       = load_bin_file(batch->paths[index], NULL);
+	record.load_ms = elapsed_ms(&start);
+
+	if(bf == NULL) {
+		record.status = BF_BATCH_LOAD_FAILED;
+	} else {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if(options->disasm) {
+			disasm_all_func_sym(bf);
+			disasm_bin_file_entry(bf);
+		}
+
+		record.status = BF_BATCH_OK;
+
+		if(options->analyse != NULL) {
+			FILE * stream = open_memstream(&output, &size);
+
+			if(!options->analyse(bf, stream, options->param)) {
+				record.status = BF_BATCH_ANALYSE_FAILED;
+			}
+
+			fclose(stream);
+		}
+
+		record.analyse_ms     = elapsed_ms(&start);
+		record.num_insns      = bf->insn_table.count;
+		record.num_basic_blks = bf->bb_table.count;
+		record.num_funcs      = bf->func_table.count;
+		record.output_len     = size;
+		close_bin_file(bf);
+	}
+
+	if(!write_full(result_fd, &record, sizeof(record)) ||
+			!write_full(result_fd, output, size)) {
+		_exit(1);
+	}
+
+	free(output);
+}
+
+static void spawn_worker(struct BF_BATCH * batch, unsigned int w)
+{
+	struct BF_BATCH_WORKER * worker = &batch->workers[w];
+	int			 job_pipe[2];
+	int			 result_pipe[2];
+
+	if(pipe(job_pipe) != 0 || pipe(result_pipe) != 0) {
+		perror("pipe");
+		xexit(-1);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	worker->pid = fork();
+
+	if(worker->pid < 0) {
+		perror("fork");
+		xexit(-1);
+	} else if(worker->pid == 0) {
+		size_t index;
+
+		/*
+		 * Drop the ends of the other workers' pipes so that each worker
+		 * sees EOF as soon as the parent closes its job pipe.
+		 */
+		for(unsigned int i = 0; i < batch->num_workers; i++) {
+			if(i != w && batch->workers[i].pid > 0) {
+				close(batch->workers[i].job_fd);
+				close(batch->workers[i].result_fd);
+			}
+		}
+
+		close(job_pipe[1]);
+		close(result_pipe[0]);
+
+		/*
+		 * libbf reports load failures on stdout, which may be where the
+		 * caller streams its results.
+		 */
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+
+		while(read_full(job_pipe[0], &index, sizeof(index))) {
+			analyse_binary(batch, index, result_pipe[1]);
+		}
+
+		_exit(0);
+	}
+
+	close(job_pipe[0]);
+	close(result_pipe[1]);
+	worker->job_fd	  = job_pipe[1];
+	worker->result_fd = result_pipe[0];
+	worker->busy	  = FALSE;
+}
+
+static void reap_worker(struct BF_BATCH_WORKER * worker)
+{
+	close(worker->job_fd);
+	close(worker->result_fd);
+	waitpid(worker->pid, NULL, 0);
+	worker->pid = 0;
+}
+
+static size_t estimate_cost(struct BF_BATCH * batch, size_t index)
+{
+	struct stat st;
+
+	if(stat(batch->paths[index], &st) != 0) {
+		return 0;
+	}
+
+	return st.st_size * batch->options->mem_factor;
+}
+
+/*
+ * Reads the result of the binary a worker was busy with and passes it to the
+ * handler. If the worker died the binary is reported as crashed.
+ */
+static enum bf_batch_status collect_result(struct BF_BATCH * batch,
+		struct BF_BATCH_WORKER * worker,
+		void (*handler)(struct bf_batch_result *, void *),
+		void * param)
+{
+	struct BF_BATCH_RECORD record;
+	struct bf_batch_result result;
+	char *		       output = NULL;
+	bool		       alive  = FALSE;
+
+	if(read_full(worker->result_fd, &record, sizeof(record)) &&
+			record.index == worker->index) {
+		output = xmalloc(record.output_len + 1);
+		alive  = read_full(worker->result_fd, output,
+				record.output_len);
+		output[record.output_len] = '\0';
+	}
+
+	memset(&result, 0, sizeof(result));
+	result.path  = batch->paths[worker->index];
+	result.index = worker->index;
+
+	if(alive) {
+		result.status	      = record.status;
+		result.num_insns      = record.num_insns;
+		result.num_basic_blks = record.num_basic_blks;
+		result.num_funcs      = record.num_funcs;
+		result.load_ms	      = record.load_ms;
+		result.analyse_ms     = record.analyse_ms;
+		result.output	      = output;
+		result.output_len     = record.output_len;
+	} else {
+		result.status = BF_BATCH_CRASHED;
+		result.output = "";
+	}
+
+	handler(&result, param);
+	free(output);
+	return result.status;
+}
+
+size_t bf_run_batch(char ** paths, size_t count,
+		struct bf_batch_options * options,
+		void (*handler)(struct bf_batch_result *, void *),
+		void * param)
+{
+	struct bf_batch_options defaults;
+	struct BF_BATCH		batch;
+	struct pollfd *		fds;
+	void			(*old_sigpipe)(int);
+	size_t			next	  = 0;
+	size_t			done	  = 0;
+	size_t			succeeded = 0;
+	size_t			in_flight = 0;
+	size_t			cost	  = 0;
+
+	if(options == NULL) {
+		bf_init_batch_options(&defaults);
+		options = &defaults;
+	}
+
+	batch.paths	  = paths;
+	batch.options	  = options;
+	batch.num_workers = bf_get_num_workers(options->num_workers);
+
+	if(batch.num_workers > count) {
+		batch.num_workers = count ? count : 1;
+	}
+
+	batch.workers = xcalloc(batch.num_workers,
+			sizeof(struct BF_BATCH_WORKER));
+	fds	      = xcalloc(batch.num_workers, sizeof(struct pollfd));
+
+	/*
+	 * A worker dying between two jobs must not take the batch with it.
+	 */
+	old_sigpipe = signal(SIGPIPE, SIG_IGN);
+
+	for(unsigned int w = 0; w < batch.num_workers; w++) {
+		spawn_worker(&batch, w);
+	}
+
+	while(done < count) {
+		unsigned int num_fds = 0;
+
+		/*
+		 * Hand out binaries in list order while they fit in the
+		 * budget.
+		 */
+		for(unsigned int w = 0; w < batch.num_workers && next < count;
+				w++) {
+			struct BF_BATCH_WORKER * worker = &batch.workers[w];
+			size_t			 next_cost;
+
+			if(worker->busy) {
+				continue;
+			}
+
+			next_cost = estimate_cost(&batch, next);
+
+			if(options->mem_budget != 0 && in_flight > 0 &&
+					cost + next_cost > options->mem_budget) {
+				break;
+			}
+
+			worker->busy  = TRUE;
+			worker->index = next;
+			worker->cost  = next_cost;
+			cost	     += next_cost;
+			in_flight++;
+			next++;
+
+			/*
+			 * If the write fails the worker is dead and poll()
+			 * reports it below.
+			 */
+			write_full(worker->job_fd, &worker->index,
+					sizeof(worker->index));
+		}
+
+		for(unsigned int w = 0; w < batch.num_workers; w++) {
+			if(batch.workers[w].busy) {
+				fds[num_fds].fd	     = batch.workers[w].result_fd;
+				fds[num_fds].events  = POLLIN;
+				fds[num_fds].revents = 0;
+				num_fds++;
+			}
+		}
+
+		if(poll(fds, num_fds, -1) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			perror("poll");
+			break;
+		}
+
+		for(unsigned int w = 0, f = 0; w < batch.num_workers; w++) {
+			struct BF_BATCH_WORKER * worker = &batch.workers[w];
+			enum bf_batch_status	 status;
+
+			if(!worker->busy || fds[f++].revents == 0) {
+				continue;
+			}
+
+			worker->busy = FALSE;
+			cost	    -= worker->cost;
+			in_flight--;
+			done++;
+
+			status = collect_result(&batch, worker, handler,
+					param);
+
+			if(status == BF_BATCH_OK) {
+				succeeded++;
+			} else if(status == BF_BATCH_CRASHED) {
+				reap_worker(worker);
+				spawn_worker(&batch, w);
+			}
+		}
+	}
+
+	for(unsigned int w = 0; w < batch.num_workers; w++) {
+		reap_worker(&batch.workers[w]);
+	}
+
+	signal(SIGPIPE, old_sigpipe);
+	free(fds);
+	free(batch.workers);
+	return succeeded;
+}
@@ -28,9 +28,15 @@
 #include <unistd.h>
 
 #include "disasm.h"
+#include "cache.h"
+#include "analysis_cache.h"
 #include "func.h"
 #include "basic_blk.h"
 #include "mem_manager.h"
+#include "parallel.h"
+#include "extent.h"
+#include "xref_index.h"
+#include "insn_index.h"
 
 static const char * resolve_file(const char * filename) {
 	struct stat statbuf;
@@ -145,10 +151,18 @@ static void init_bf_disassembler(struct bin_file * bf)
  */
 static void init_bf(struct bin_file * bf)
 {
-	htable_init(&bf->func_table);
-	htable_init(&bf->bb_table);
-	htable_init(&bf->insn_table);
-	symbol_table_init(&bf->sym_table);
+	bf_init_addr_map(&bf->func_table);
+	bf_init_addr_map(&bf->bb_table);
+	bf_init_addr_map(&bf->insn_table);
+	pthread_mutex_init(&bf->cflow_lock, NULL);
+	pthread_mutex_init(&bf->mem_lock, NULL);
+	bf->strpool	   = bf_init_strpool();
+	bf->analysis_dirty = FALSE;
+	bf->cfg_generation = 0;
+	bf->reuse	   = NULL;
+	bf->xref_index	   = NULL;
+	bf->insn_index	   = NULL;
+	symbol_table_init(&bf->sym_table, bf->abfd, bf->strpool);
 	htable_init(&bf->mem_table);
 
 	bf->bitiness = bfd_arch_bits_per_address(bf->abfd) == 64 ?
@@ -211,7 +225,10 @@ struct bin_file * load_bin_file(char * target_path, char * output_path)
 
 			init_bf(bf);
 			init_bf_disassembler(bf);
-			load_sym_table(bf);
+
+			if(bf_cache_enabled()) {
+				bf_load_analysis(bf);
+			}
 		}
 	}
 
@@ -222,17 +239,32 @@ bool close_bin_file(struct bin_file * bf)
 {
 	bool success;
 
+	if(bf->analysis_dirty && bf_cache_enabled()) {
+		bf_save_analysis(bf);
+	}
+
+	if(bf->xref_index != NULL) {
+		bf_close_xref_index(bf->xref_index);
+	}
+
+	if(bf->insn_index != NULL) {
+		bf_close_insn_index(bf->insn_index);
+	}
+
 	close_sym_table(bf);
 	bf_close_func_table(bf);
 	bf_close_bb_table(bf);
 	bf_close_insn_table(bf);
 	unload_all_sections(bf);
 
-	htable_destroy(&bf->func_table);
-	htable_destroy(&bf->bb_table);
-	htable_destroy(&bf->insn_table);
+	bf_close_addr_map(&bf->func_table);
+	bf_close_addr_map(&bf->bb_table);
+	bf_close_addr_map(&bf->insn_table);
 	symbol_table_destroy(&bf->sym_table);
 	htable_destroy(&bf->mem_table);
+	pthread_mutex_destroy(&bf->cflow_lock);
+	pthread_mutex_destroy(&bf->mem_lock);
+	bf_close_strpool(bf->strpool);
 	success = bfd_close(bf->abfd);
 
 	free(bf->output_path);
@@ -261,3 +293,95 @@ void disasm_all_func_sym(struct bin_file * bf)
 		}
 	}
 }
+
+struct DISASM_PASS {
+	struct bin_file *  bf;
+	struct symbol **   syms;
+	struct bf_extent * sections;
+};
+
+static void * disasm_syms(struct bf_task_ctx * ctx, size_t first, size_t last)
+{
+	struct DISASM_PASS * pass = ctx->param;
+
+	for(size_t i = first; i < last; i++) {
+		disasm_from_sym(pass->bf, pass->syms[i], TRUE);
+	}
+
+	return NULL;
+}
+
+void disasm_all_func_sym_parallel(struct bin_file * bf,
+		unsigned int num_threads)
+{
+	struct DISASM_PASS pass;
+	struct symbol *	   sym;
+	size_t		   count    = 0;
+	size_t		   capacity = 64;
+
+	pass.bf	      = bf;
+	pass.syms     = xmalloc(capacity * sizeof(struct symbol *));
+	pass.sections = NULL;
+
+	for_each_symbol(sym, &bf->sym_table) {
+		if((sym->type & SYMBOL_FUNCTION) && (sym->address != 0)) {
+			if(count == capacity) {
+				capacity  *= 2;
+				pass.syms  = xrealloc(pass.syms,
+						capacity * sizeof(struct symbol *));
+			}
+
+			pass.syms[count++] = sym;
+		}
+	}
+
+	bf_parallel_run(num_threads, count, 1, disasm_syms, NULL, &pass);
+	free(pass.syms);
+}
+
+/*
+ * Decodes every address of a section which is not covered yet. Each address
+ * not already holding a bf_insn becomes the root of a new CFG, so code
+ * reachable from it is also followed recursively.
+ */
+static void * sweep_section(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct DISASM_PASS * pass = ctx->param;
+	struct bf_extent *   s	  = &pass->sections[first];
+	bfd_vma		     vma  = s->start;
+
+	while(vma < s->end) {
+		struct bf_insn * insn = bf_get_insn(pass->bf, vma);
+
+		if(insn == NULL) {
+			disasm_generate_cflow(pass->bf, vma, FALSE);
+			insn = bf_get_insn(pass->bf, vma);
+		}
+
+		vma += (insn != NULL && insn->size > 0) ? insn->size : 1;
+	}
+
+	return NULL;
+}
+
+void disasm_bin_file_sweep(struct bin_file * bf, unsigned int num_threads)
+{
+	struct bf_extent_index sections;
+	struct DISASM_PASS     pass;
+
+	bf_init_extent_index(&sections);
+	bf_add_code_sections(&sections, bf->abfd);
+
+	pass.bf	      = bf;
+	pass.syms     = NULL;
+	pass.sections = sections.extents;
+
+	/*
+	 * Sections are the unit of work. Splitting a section would make the
+	 * sweep start inside instructions.
+	 */
+	bf_parallel_run(num_threads, sections.count, 1, sweep_section, NULL,
+			&pass);
+	bf_close_extent_index(&sections);
+}
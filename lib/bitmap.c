@@ -0,0 +1,81 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bitmap.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libiberty.h>
+
+#define BITS_PER_WORD (sizeof(unsigned long) * CHAR_BIT)
+
+void bf_init_bitmap(struct bf_bitmap * bitmap, size_t num_bits)
+{
+	bitmap->num_words = (num_bits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	bitmap->words	  = bitmap->num_words ? xcalloc(bitmap->num_words,
+			sizeof(unsigned long)) : NULL;
+}
+
+bool bf_bitmap_test(struct bf_bitmap * bitmap, size_t bit)
+{
+	size_t word = bit / BITS_PER_WORD;
+
+	return word < bitmap->num_words &&
+			(bitmap->words[word] >> (bit % BITS_PER_WORD) & 1);
+}
+
+bool bf_bitmap_set(struct bf_bitmap * bitmap, size_t bit)
+{
+	size_t	      word = bit / BITS_PER_WORD;
+	unsigned long mask = 1UL << (bit % BITS_PER_WORD);
+	bool	      was_set;
+
+	if(word >= bitmap->num_words) {
+		size_t num_words = bitmap->num_words ? bitmap->num_words : 16;
+
+		while(num_words <= word) {
+			num_words *= 2;
+		}
+
+		bitmap->words = xrealloc(bitmap->words, num_words *
+				sizeof(unsigned long));
+		memset(bitmap->words + bitmap->num_words, 0,
+				(num_words - bitmap->num_words) *
+				sizeof(unsigned long));
+		bitmap->num_words = num_words;
+	}
+
+	was_set		      = (bitmap->words[word] & mask) != 0;
+	bitmap->words[word] |= mask;
+	return was_set;
+}
+
+void bf_clear_bitmap(struct bf_bitmap * bitmap)
+{
+	if(bitmap->num_words) {
+		memset(bitmap->words, 0, bitmap->num_words *
+				sizeof(unsigned long));
+	}
+}
+
+void bf_close_bitmap(struct bf_bitmap * bitmap)
+{
+	free(bitmap->words);
+	bitmap->words	  = NULL;
+	bitmap->num_words = 0;
+}
@@ -0,0 +1,591 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "byte_scan.h"
+
+#include <ctype.h>
+#include <libiberty.h>
+
+#include "mem_manager.h"
+#include "parallel.h"
+
+/*
+ * Sections are split into tasks of this many bytes.
+ */
+#define SCAN_GRAIN (1024 * 1024)
+
+/*
+ * Set in the transitions of delta into states which end an anchor or have
+ * an out link, so the scan only looks up the signatures at such states.
+ */
+#define SCAN_OUTPUT 0x80000000u
+
+/*
+ * A part of a section scanned by one task. Matches starting in
+ * [start, end) are reported, and the bytes up to the end of the longest
+ * signature after end are read to find them.
+ */
+struct SCAN_CHUNK {
+	asection *	 section;
+	const bfd_byte * buf;
+	size_t		 size;
+	bfd_vma		 vma;
+	size_t		 start;
+	size_t		 end;
+};
+
+/*
+ * The matches of a SCAN_CHUNK, handed from the workers to report_chunk().
+ */
+struct SCAN_RESULT {
+	struct bf_byte_match * matches;
+	size_t		       count;
+	size_t		       capacity;
+};
+
+struct SCAN_SECTIONS {
+	struct bf_byte_scanner * scanner;
+	struct SCAN_CHUNK *	 chunks;
+	size_t			 num_chunks;
+	size_t			 capacity;
+	void			 (*handler)(struct bf_byte_match *, void *);
+	void *			 param;
+	size_t			 count;
+};
+
+struct bf_byte_scanner * bf_init_byte_scanner(void)
+{
+	return xcalloc(1, sizeof(struct bf_byte_scanner));
+}
+
+/*
+ * Bytes which are common in any binary make poor anchors since they would
+ * be found everywhere.
+ */
+static int get_byte_score(bfd_byte b)
+{
+	return b == 0x00 || b == 0xff || b == 0x90 || b == 0xcc ? 1 : 2;
+}
+
+/*
+ * Picks the run of at most BF_SCAN_MAX_ATOM exact bytes with the highest
+ * score, the earliest one if several score the same.
+ */
+static void choose_atom(struct bf_byte_sig * sig)
+{
+	int best = 0;
+
+	sig->atom_offset = 0;
+	sig->atom_length = 0;
+
+	for(size_t i = 0; i < sig->length; i++) {
+		int    score  = 0;
+		size_t length = 0;
+
+		while(i + length < sig->length && length < BF_SCAN_MAX_ATOM &&
+				sig->mask[i + length] == 0xff) {
+			score += get_byte_score(sig->bytes[i + length]);
+			length++;
+		}
+
+		if(score > best) {
+			best		 = score;
+			sig->atom_offset = i;
+			sig->atom_length = length;
+		}
+	}
+}
+
+int bf_add_byte_signature_masked(struct bf_byte_scanner * scanner,
+		const bfd_byte * bytes, const bfd_byte * mask, size_t length,
+		void * param)
+{
+	struct bf_byte_sig * sig;
+
+	if(length == 0) {
+		return -1;
+	}
+
+	scanner->sigs = xrealloc(scanner->sigs, (scanner->num_sigs + 1) *
+			sizeof(struct bf_byte_sig));
+	sig	      = &scanner->sigs[scanner->num_sigs];
+	sig->bytes    = xmalloc(length);
+	sig->mask     = xmalloc(length);
+	sig->length   = length;
+	sig->param    = param;
+	sig->next     = -1;
+
+	for(size_t i = 0; i < length; i++) {
+		sig->mask[i]  = mask != NULL ? mask[i] : 0xff;
+		sig->bytes[i] = bytes[i] & sig->mask[i];
+	}
+
+	choose_atom(sig);
+
+	if(length > scanner->max_length) {
+		scanner->max_length = length;
+	}
+
+	scanner->compiled = FALSE;
+	return scanner->num_sigs++;
+}
+
+static int get_nibble(char c, bfd_byte * value, bfd_byte * mask)
+{
+	if(c == '?') {
+		*value = 0;
+		*mask  = 0;
+	} else if(isxdigit((unsigned char)c)) {
+		*value = isdigit((unsigned char)c) ? c - '0' :
+				tolower((unsigned char)c) - 'a' + 10;
+		*mask  = 0xf;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+int bf_add_byte_signature(struct bf_byte_scanner * scanner,
+		const char * sig, void * param)
+{
+	size_t	   length = strlen(sig) / 2;
+	bfd_byte * bytes  = xmalloc(length + 1);
+	bfd_byte * mask	  = xmalloc(length + 1);
+	size_t	   count  = 0;
+	int	   id	  = -1;
+
+	while(*sig != '\0') {
+		bfd_byte high, high_mask, low, low_mask;
+
+		if(isspace((unsigned char)*sig)) {
+			sig++;
+			continue;
+		}
+
+		if(get_nibble(sig[0], &high, &high_mask) == -1 ||
+				get_nibble(sig[1], &low, &low_mask) == -1) {
+			goto out;
+		}
+
+		bytes[count]  = high << 4 | low;
+		mask[count++] = high_mask << 4 | low_mask;
+		sig	     += 2;
+	}
+
+	id = bf_add_byte_signature_masked(scanner, bytes, mask, count, param);
+
+out:
+	free(bytes);
+	free(mask);
+	return id;
+}
+
+/*
+ * Builds the automaton of the anchors. The trie is built first, its edges
+ * stored straight in delta, then the failure links are computed breadth
+ * first. A state is only processed after every shorter one, so the row of
+ * its failure state is complete and its missing edges can be copied from
+ * there.
+ */
+static void compile_scanner(struct bf_byte_scanner * scanner)
+{
+	uint32_t   max_states = 1;
+	uint32_t * fail;
+	uint32_t * queue;
+	uint32_t   head	      = 0;
+	uint32_t   tail	      = 0;
+
+	for(int i = 0; i < scanner->num_sigs; i++) {
+		max_states += scanner->sigs[i].atom_length;
+	}
+
+	scanner->delta	    = xrealloc(scanner->delta, (size_t)max_states *
+			256 * sizeof(uint32_t));
+	scanner->state_sigs = xrealloc(scanner->state_sigs, max_states *
+			sizeof(int));
+	scanner->out_links  = xrealloc(scanner->out_links, max_states *
+			sizeof(uint32_t));
+	scanner->unanchored = xrealloc(scanner->unanchored,
+			(scanner->num_sigs + 1) * sizeof(int));
+	memset(scanner->delta, 0, 256 * sizeof(uint32_t));
+	scanner->state_sigs[0]	= -1;
+	scanner->out_links[0]	= 0;
+	scanner->num_states	= 1;
+	scanner->num_unanchored = 0;
+
+	/*
+	 * Signatures are added in reverse so that every chain lists them by
+	 * id.
+	 */
+	for(int i = scanner->num_sigs - 1; i >= 0; i--) {
+		struct bf_byte_sig * sig   = &scanner->sigs[i];
+		uint32_t	     state = 0;
+
+		if(sig->atom_length == 0) {
+			continue;
+		}
+
+		for(size_t j = 0; j < sig->atom_length; j++) {
+			uint32_t * edge = &scanner->delta[(size_t)state * 256 +
+					sig->bytes[sig->atom_offset + j]];
+
+			if(*edge == 0) {
+				*edge = scanner->num_states++;
+				memset(&scanner->delta[(size_t)*edge * 256], 0,
+						256 * sizeof(uint32_t));
+				scanner->state_sigs[*edge] = -1;
+			}
+
+			state = *edge;
+		}
+
+		sig->next		  = scanner->state_sigs[state];
+		scanner->state_sigs[state] = i;
+	}
+
+	for(int i = 0; i < scanner->num_sigs; i++) {
+		if(scanner->sigs[i].atom_length == 0) {
+			scanner->unanchored[scanner->num_unanchored++] = i;
+		}
+	}
+
+	fail  = xmalloc(scanner->num_states * sizeof(uint32_t));
+	queue = xmalloc(scanner->num_states * sizeof(uint32_t));
+
+	for(int c = 0; c < 256; c++) {
+		uint32_t child = scanner->delta[c];
+
+		if(child != 0) {
+			fail[child]		  = 0;
+			scanner->out_links[child] = 0;
+			queue[tail++]		  = child;
+		}
+	}
+
+	while(head < tail) {
+		uint32_t   state = queue[head++];
+		uint32_t * row	 = &scanner->delta[(size_t)state * 256];
+		uint32_t * frow	 = &scanner->delta[(size_t)fail[state] * 256];
+
+		for(int c = 0; c < 256; c++) {
+			uint32_t child = row[c];
+			uint32_t f;
+
+			if(child == 0) {
+				row[c] = frow[c];
+				continue;
+			}
+
+			f			  = frow[c];
+			fail[child]		  = f;
+			scanner->out_links[child] = scanner->state_sigs[f] !=
+					-1 ? f : scanner->out_links[f];
+			queue[tail++]		  = child;
+		}
+	}
+
+	for(size_t i = 0; i < (size_t)scanner->num_states * 256; i++) {
+		uint32_t state = scanner->delta[i];
+
+		if(scanner->state_sigs[state] != -1 ||
+				scanner->out_links[state] != 0) {
+			scanner->delta[i] |= SCAN_OUTPUT;
+		}
+	}
+
+	free(fail);
+	free(queue);
+	scanner->compiled = TRUE;
+}
+
+static bool match_sig(struct bf_byte_sig * sig, const bfd_byte * buf)
+{
+	for(size_t i = 0; i < sig->length; i++) {
+		if((buf[i] & sig->mask[i]) != sig->bytes[i]) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Scans buf[start, size) and reports the matches starting in
+ * [start, end). The scan stops as soon as no such match can be found any
+ * more.
+ */
+static size_t scan_range(struct bf_byte_scanner * scanner,
+		const bfd_byte * buf, size_t size, size_t start, size_t end,
+		bfd_vma vma, asection * section,
+		void (*handler)(struct bf_byte_match *, void *), void * param)
+{
+	size_t		     stop  = end + scanner->max_length - 1;
+	uint32_t	     state = 0;
+	size_t		     count = 0;
+	struct bf_byte_match match;
+
+	match.section = section;
+
+	if(stop > size) {
+		stop = size;
+	}
+
+	for(size_t i = start; i < stop; i++) {
+		uint32_t s;
+
+		for(int j = 0; j < scanner->num_unanchored && i < end; j++) {
+			struct bf_byte_sig * sig =
+					&scanner->sigs[scanner->unanchored[j]];
+
+			if(i + sig->length <= size && match_sig(sig, buf + i)) {
+				match.sig   = scanner->unanchored[j];
+				match.param = sig->param;
+				match.vma   = vma + i;
+				match.data  = buf + i;
+				handler(&match, param);
+				count++;
+			}
+		}
+
+		state = scanner->delta[(size_t)state * 256 + buf[i]];
+
+		if(!(state & SCAN_OUTPUT)) {
+			continue;
+		}
+
+		state &= ~SCAN_OUTPUT;
+		s      = scanner->state_sigs[state] != -1 ? state :
+				scanner->out_links[state];
+
+		for(; s != 0; s = scanner->out_links[s]) {
+			for(int id = scanner->state_sigs[s]; id != -1;
+					id = scanner->sigs[id].next) {
+				struct bf_byte_sig * sig = &scanner->sigs[id];
+				size_t		     skip;
+				size_t		     first;
+
+				skip = sig->atom_offset + sig->atom_length;
+
+				if(i + 1 < start + skip) {
+					continue;
+				}
+
+				first = i + 1 - skip;
+
+				if(first >= end || first + sig->length > size ||
+						!match_sig(sig, buf + first)) {
+					continue;
+				}
+
+				match.sig   = id;
+				match.param = sig->param;
+				match.vma   = vma + first;
+				match.data  = buf + first;
+				handler(&match, param);
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+size_t bf_scan_bytes(struct bf_byte_scanner * scanner,
+		const bfd_byte * buf, size_t size, bfd_vma vma,
+		asection * section,
+		void (*handler)(struct bf_byte_match *, void *), void * param)
+{
+	if(!scanner->compiled) {
+		compile_scanner(scanner);
+	}
+
+	return scan_range(scanner, buf, size, 0, size, vma, section, handler,
+			param);
+}
+
+static void add_section_chunks(bfd * abfd, asection * s, void * param)
+{
+	struct SCAN_SECTIONS * pass  = param;
+	flagword	       want  = SEC_ALLOC | SEC_LOAD | SEC_HAS_CONTENTS;
+	flagword	       flags = bfd_get_section_flags(abfd, s);
+	bfd_vma		       vma   = bfd_get_section_vma(abfd, s);
+	size_t		       size  = bfd_section_size(abfd, s);
+
+	if((flags & want) != want || size == 0) {
+		return;
+	}
+
+	for(size_t start = 0; start < size; start += SCAN_GRAIN) {
+		struct SCAN_CHUNK * chunk;
+
+		if(pass->num_chunks == pass->capacity) {
+			pass->capacity = pass->capacity ? pass->capacity * 2 :
+					16;
+			pass->chunks   = xrealloc(pass->chunks, pass->capacity *
+					sizeof(struct SCAN_CHUNK));
+		}
+
+		chunk	       = &pass->chunks[pass->num_chunks++];
+		chunk->section = s;
+		chunk->buf     = NULL;
+		chunk->size    = size;
+		chunk->vma     = vma;
+		chunk->start   = start;
+		chunk->end     = size - start > SCAN_GRAIN ?
+				start + SCAN_GRAIN : size;
+	}
+}
+
+static int cmp_chunk(const void * a, const void * b)
+{
+	const struct SCAN_CHUNK * x = a;
+	const struct SCAN_CHUNK * y = b;
+
+	if(x->vma != y->vma) {
+		return x->vma < y->vma ? -1 : 1;
+	} else if(x->section != y->section) {
+		return x->section->index < y->section->index ? -1 : 1;
+	}
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int cmp_match(const void * a, const void * b)
+{
+	const struct bf_byte_match * x = a;
+	const struct bf_byte_match * y = b;
+
+	if(x->vma != y->vma) {
+		return x->vma < y->vma ? -1 : 1;
+	}
+
+	return x->sig - y->sig;
+}
+
+static void collect_match(struct bf_byte_match * match, void * param)
+{
+	struct SCAN_RESULT * result = param;
+
+	if(result->count == result->capacity) {
+		result->capacity = result->capacity ? result->capacity * 2 :
+				16;
+		result->matches	 = xrealloc(result->matches,
+				result->capacity *
+				sizeof(struct bf_byte_match));
+	}
+
+	result->matches[result->count++] = *match;
+}
+
+static void * scan_chunk(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct SCAN_SECTIONS * pass   = ctx->param;
+	struct SCAN_RESULT *   result = xcalloc(1,
+			sizeof(struct SCAN_RESULT));
+
+	for(size_t i = first; i < last; i++) {
+		struct SCAN_CHUNK * chunk = &pass->chunks[i];
+
+		if(chunk->buf != NULL) {
+			scan_range(pass->scanner, chunk->buf, chunk->size,
+					chunk->start, chunk->end, chunk->vma,
+					chunk->section, collect_match, result);
+		}
+	}
+
+	return result;
+}
+
+static void report_chunk(size_t first, size_t last, void * result,
+		void * param)
+{
+	struct SCAN_SECTIONS * pass    = param;
+	struct SCAN_RESULT *   matches = result;
+
+	if(matches->count > 1) {
+		qsort(matches->matches, matches->count,
+				sizeof(struct bf_byte_match), cmp_match);
+	}
+
+	for(size_t i = 0; i < matches->count; i++) {
+		pass->handler(&matches->matches[i], pass->param);
+	}
+
+	pass->count += matches->count;
+	free(matches->matches);
+	free(matches);
+}
+
+size_t bf_scan_sections(struct bf_byte_scanner * scanner,
+		struct bin_file * bf, unsigned int num_threads,
+		void (*handler)(struct bf_byte_match *, void *), void * param)
+{
+	struct SCAN_SECTIONS pass = {scanner, NULL, 0, 0, handler, param, 0};
+
+	if(!scanner->compiled) {
+		compile_scanner(scanner);
+	}
+
+	bfd_map_over_sections(bf->abfd, add_section_chunks, &pass);
+	qsort(pass.chunks, pass.num_chunks, sizeof(struct SCAN_CHUNK),
+			cmp_chunk);
+
+	/*
+	 * The sections are loaded up front so that the workers only read.
+	 * Sections sharing their VMA with another one can not be told apart
+	 * by the memory manager and are skipped.
+	 */
+	for(size_t i = 0; i < pass.num_chunks; i++) {
+		struct SCAN_CHUNK *   chunk = &pass.chunks[i];
+		struct bf_mem_block * mem;
+
+		if(i > 0 && chunk->section == pass.chunks[i - 1].section) {
+			chunk->buf = pass.chunks[i - 1].buf;
+			continue;
+		}
+
+		mem = load_section_for_vma(bf, chunk->vma);
+
+		if(mem != NULL && mem->section == chunk->section &&
+				mem->buffer_length >= chunk->size) {
+			chunk->buf = mem->buffer;
+		}
+	}
+
+	bf_parallel_run(num_threads, pass.num_chunks, 1, scan_chunk,
+			report_chunk, &pass);
+
+	free(pass.chunks);
+	return pass.count;
+}
+
+void bf_close_byte_scanner(struct bf_byte_scanner * scanner)
+{
+	for(int i = 0; i < scanner->num_sigs; i++) {
+		free(scanner->sigs[i].bytes);
+		free(scanner->sigs[i].mask);
+	}
+
+	free(scanner->sigs);
+	free(scanner->delta);
+	free(scanner->state_sigs);
+	free(scanner->out_links);
+	free(scanner->unanchored);
+	free(scanner);
+}
@@ -0,0 +1,260 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libiberty.h>
+#include <libkern/jhash.h>
+
+/*
+ * NULL until the cache has been configured, either explicitly or from the
+ * environment on first use.
+ */
+static char * cache_dir;
+static bool   cache_configured;
+
+/*
+ * Creates a directory and its missing parents.
+ */
+static bool make_dirs(char * path)
+{
+	for(char * p = path + 1; *p != '\0'; p++) {
+		if(*p == '/') {
+			*p = '\0';
+
+			if(mkdir(path, 0755) != 0 && errno != EEXIST) {
+				*p = '/';
+				return FALSE;
+			}
+
+			*p = '/';
+		}
+	}
+
+	return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static char * default_cache_dir(void)
+{
+	char * xdg  = getenv("XDG_CACHE_HOME");
+	char * home = getenv("HOME");
+
+	if(xdg != NULL && *xdg != '\0') {
+		return concat(xdg, "/libbf", NULL);
+	} else if(home != NULL && *home != '\0') {
+		return concat(home, "/.cache/libbf", NULL);
+	} else {
+		return NULL;
+	}
+}
+
+void bf_enable_cache(const char * dir)
+{
+	free(cache_dir);
+	cache_dir	 = dir != NULL ? xstrdup(dir) : default_cache_dir();
+	cache_configured = TRUE;
+
+	if(cache_dir != NULL && !make_dirs(cache_dir)) {
+		free(cache_dir);
+		cache_dir = NULL;
+	}
+}
+
+void bf_disable_cache(void)
+{
+	free(cache_dir);
+	cache_dir	 = NULL;
+	cache_configured = TRUE;
+}
+
+bool bf_cache_enabled(void)
+{
+	if(!cache_configured) {
+		char * dir = getenv("LIBBF_CACHE_DIR");
+
+		if(dir != NULL) {
+			bf_enable_cache(*dir != '\0' ? dir : NULL);
+		} else {
+			cache_configured = TRUE;
+		}
+	}
+
+	return cache_dir != NULL;
+}
+
+/*
+ * Writes the hex encoded GNU build-id of abfd into buf. Returns FALSE if the
+ * binary does not carry one.
+ */
+static bool get_build_id(bfd * abfd, char * buf, size_t size)
+{
+	asection *	  sec = bfd_get_section_by_name(abfd, ".note.gnu.build-id");
+	bfd_byte *	  contents;
+	uint32_t	  namesz, descsz;
+	bfd_size_type	  sec_size;
+	bool		  found = FALSE;
+
+	if(sec == NULL) {
+		return FALSE;
+	}
+
+	sec_size = bfd_section_size(abfd, sec);
+
+	if(sec_size < 12) {
+		return FALSE;
+	}
+
+	contents = xmalloc(sec_size);
+
+	if(bfd_get_section_contents(abfd, sec, contents, 0, sec_size)) {
+		size_t desc;
+
+		memcpy(&namesz, contents, sizeof(namesz));
+		memcpy(&descsz, contents + 4, sizeof(descsz));
+		desc = 12 + ((namesz + 3) & ~3);
+
+		if(descsz != 0 && desc + descsz <= sec_size &&
+				descsz * 2 < size) {
+			for(uint32_t i = 0; i < descsz; i++) {
+				sprintf(buf + i * 2, "%02x", contents[desc + i]);
+			}
+
+			found = TRUE;
+		}
+	}
+
+	free(contents);
+	return found;
+}
+
+char * bf_get_cache_path(bfd * abfd, const char * kind)
+{
+	const char * filename = bfd_get_filename(abfd);
+	char	     id[128];
+	char *	     path;
+	struct stat  st;
+
+	if(!bf_cache_enabled() || stat(filename, &st) != 0) {
+		return NULL;
+	}
+
+	if(!get_build_id(abfd, id, sizeof(id))) {
+		char * real = realpath(filename, NULL);
+
+		if(real == NULL) {
+			return NULL;
+		}
+
+		snprintf(id, sizeof(id), "path-%08x",
+				jhash(real, strlen(real), 0));
+		free(real);
+	}
+
+	path = xmalloc(strlen(cache_dir) + strlen(id) + strlen(kind) + 64);
+	sprintf(path, "%s/%s-%llx-%llx.%s", cache_dir, id,
+			(unsigned long long)st.st_mtime,
+			(unsigned long long)st.st_size, kind);
+	return path;
+}
+
+void * bf_map_cache_file(const char * path, size_t * size)
+{
+	struct stat st;
+	void *	    addr;
+	int	    fd = open(path, O_RDONLY);
+
+	if(fd == -1) {
+		return NULL;
+	}
+
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(addr == MAP_FAILED) {
+		return NULL;
+	}
+
+	*size = st.st_size;
+	return addr;
+}
+
+void bf_unmap_cache_file(void * addr, size_t size)
+{
+	if(addr != NULL) {
+		munmap(addr, size);
+	}
+}
+
+bool bf_write_cache_file(const char * path, const void * data, size_t size)
+{
+	char	     tmp[strlen(path) + 32];
+	const char * pos = data;
+	int	     fd;
+
+	sprintf(tmp, "%s.%ld.tmp", path, (long)getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if(fd == -1) {
+		return FALSE;
+	}
+
+	while(size > 0) {
+		ssize_t written = write(fd, pos, size);
+
+		if(written <= 0) {
+			close(fd);
+			unlink(tmp);
+			return FALSE;
+		}
+
+		pos  += written;
+		size -= written;
+	}
+
+	if(close(fd) != 0 || rename(tmp, path) != 0) {
+		unlink(tmp);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+uint64_t bf_cache_checksum(const void * data, size_t size)
+{
+	const unsigned char * bytes = data;
+	uint64_t	      hash  = 14695981039346656037ULL;
+
+	for(size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
@@ -0,0 +1,535 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "call_graph.h"
+
+#include <libiberty.h>
+
+#include "basic_blk.h"
+#include "insn.h"
+#include "parallel.h"
+
+/*
+ * Functions are scanned for call sites in chunks of this many.
+ */
+#define CALL_GRAPH_GRAIN 64
+
+/*
+ * The call sites of a chunk of nodes, handed from the workers to
+ * append_sites().
+ */
+struct CALL_CHUNK {
+	struct call_site * sites;
+	uint32_t	   num_sites;
+	uint32_t	   capacity;
+};
+
+struct COLLECT_SITES {
+	struct bf_call_graph * graph;
+	struct bf_func *       func;
+	struct CALL_CHUNK *    chunk;
+};
+
+uint32_t bf_get_call_graph_node(struct bf_call_graph * graph,
+		struct bf_func * func)
+{
+	if(func == NULL || func->entry.id >= graph->num_nodes ||
+			graph->funcs[func->entry.id] != func) {
+		return BF_NO_NODE;
+	}
+
+	return func->entry.id;
+}
+
+/*
+ * Interns a symbol name without its version or @plt suffix.
+ */
+static const char * intern_import(struct bin_file * bf, const char * name)
+{
+	const char * at = strchr(name, '@');
+
+	return at ? bf_strpool_intern_len(bf->strpool, name, at - name) :
+			bf_strpool_intern(bf->strpool, name);
+}
+
+/*
+ * Gets the name of the function imported through a PLT stub. The stub is
+ * either named by a synthetic foo@plt symbol or is a single indirect jump
+ * through a GOT slot with a relocation naming the import.
+ */
+static const char * get_import(struct bin_file * bf, struct bf_func * func)
+{
+	struct bf_basic_blk * bb  = func->bb;
+	struct symbol *	      sym = bf_get_func_sym(bf, func);
+	struct bf_insn *      insn;
+	bfd_vma		      slot;
+	size_t		      len;
+
+	if(sym != NULL) {
+		len = strlen(sym->name);
+
+		if(len > 4 && strcmp(sym->name + len - 4, "@plt") == 0) {
+			return intern_import(bf, sym->name);
+		}
+	}
+
+	if(bb == NULL || bb->target != NULL || bf_get_bb_length(bb) != 1) {
+		return NULL;
+	}
+
+	insn = bf_get_bb_insn(bb, 0);
+
+	if(insn->mnemonic != jmp_insn && insn->mnemonic != jmpq_insn) {
+		return NULL;
+	}
+
+	/*
+	 * RIP-relative slots are only known from the disassembler comment.
+	 */
+	slot = insn->extra_info;
+
+	if(slot == 0 && insn->operand1.tag == OP_ADDR_PTR) {
+		slot = insn->operand1.operand_info.addr_ptr;
+	}
+
+	sym = slot ? rb_search_symbol(&bf->sym_table, (void *)slot) : NULL;
+	return sym && (sym->type & SYMBOL_RELOCATION) ?
+			intern_import(bf, sym->name) : NULL;
+}
+
+static void collect_site(struct bin_file * bf, struct bf_basic_blk * bb,
+		void * param)
+{
+	struct COLLECT_SITES * collect = param;
+	struct CALL_CHUNK *    chunk   = collect->chunk;
+	unsigned int	       length  = bf_get_bb_length(bb);
+	struct bf_insn *       last    = length ? bf_get_bb_insn(bb,
+			length - 1) : NULL;
+	struct bf_basic_blk *  target;
+	struct bf_func *       callee  = NULL;
+	struct call_site *     site;
+
+	if(last == NULL || !calls_subroutine(last->mnemonic)) {
+		return;
+	}
+
+	/*
+	 * The callee is linked after the return site, so it is target2
+	 * unless the return site could not be disassembled.
+	 */
+	target = bb->target2;
+
+	if(target == NULL && bb->target != NULL &&
+			bb->target->vma != last->vma + last->size) {
+		target = bb->target;
+	}
+
+	if(target != NULL) {
+		callee = bf_get_func(bf, target->vma);
+	}
+
+	if(chunk->num_sites == chunk->capacity) {
+		chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 64;
+		chunk->sites	= xrealloc(chunk->sites, chunk->capacity *
+				sizeof(struct call_site));
+	}
+
+	site	       = &chunk->sites[chunk->num_sites++];
+	site->from     = bf_get_func_sym(bf, collect->func);
+	site->to       = callee ? bf_get_func_sym(bf, callee) : NULL;
+	site->addr     = (void *)last->vma;
+	site->ret_addr = (void *)(last->vma + last->size);
+	site->size     = last->size;
+	site->index    = bf_get_call_graph_node(collect->graph, callee) ==
+			BF_NO_NODE ? -1 : (int)callee->entry.id;
+}
+
+static void * scan_funcs(struct bf_task_ctx * ctx, size_t first, size_t last)
+{
+	struct bf_call_graph * graph = ctx->param;
+	struct CALL_CHUNK *    chunk = xcalloc(1, sizeof(struct CALL_CHUNK));
+
+	for(size_t node = first; node < last; node++) {
+		struct COLLECT_SITES collect = {graph, graph->funcs[node],
+				chunk};
+		uint32_t	     before  = chunk->num_sites;
+
+		if(collect.func == NULL) {
+			graph->site_offsets[node + 1] = 0;
+			continue;
+		}
+
+		graph->imports[node] = get_import(graph->bf, collect.func);
+		bf_enum_func_basic_blk(graph->bf, collect.func, collect_site,
+				&collect);
+
+		/*
+		 * Counts for now, turned into offsets once every chunk is
+		 * in.
+		 */
+		graph->site_offsets[node + 1] = chunk->num_sites - before;
+	}
+
+	return chunk;
+}
+
+static void append_sites(size_t first, size_t last, void * result,
+		void * param)
+{
+	struct bf_call_graph * graph = param;
+	struct CALL_CHUNK *    chunk = result;
+
+	if(chunk->num_sites > 0) {
+		graph->sites = xrealloc(graph->sites, (graph->num_sites +
+				chunk->num_sites) * sizeof(struct call_site));
+		memcpy(graph->sites + graph->num_sites, chunk->sites,
+				chunk->num_sites * sizeof(struct call_site));
+		graph->num_sites += chunk->num_sites;
+	}
+
+	free(chunk->sites);
+	free(chunk);
+}
+
+static int cmp_node(const void * a, const void * b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void build_edges(struct bf_call_graph * graph)
+{
+	uint32_t   n	     = graph->num_nodes;
+	uint32_t   num_edges = 0;
+	uint32_t * fill;
+
+	graph->callee_offsets = xmalloc((n + 1) * sizeof(uint32_t));
+	graph->caller_offsets = xcalloc(n + 1, sizeof(uint32_t));
+	graph->callees	      = xmalloc((graph->num_sites + 1) *
+			sizeof(uint32_t));
+
+	/*
+	 * Sort the callees of every node and drop the duplicates.
+	 */
+	for(uint32_t node = 0; node < n; node++) {
+		uint32_t first = num_edges;
+		uint32_t i;
+
+		graph->callee_offsets[node] = num_edges;
+
+		bf_for_each_call_site(i, graph, node) {
+			if(graph->sites[i].index >= 0) {
+				graph->callees[num_edges++] =
+						graph->sites[i].index;
+			}
+		}
+
+		qsort(graph->callees + first, num_edges - first,
+				sizeof(uint32_t), cmp_node);
+
+		for(i = first; i < num_edges; i++) {
+			if(i == first || graph->callees[i] !=
+					graph->callees[first - 1]) {
+				graph->callees[first++] = graph->callees[i];
+				graph->caller_offsets[graph->callees[i] + 1]++;
+			}
+		}
+
+		num_edges = first;
+	}
+
+	graph->callee_offsets[n] = num_edges;
+	graph->num_edges	 = num_edges;
+
+	for(uint32_t node = 0; node < n; node++) {
+		graph->caller_offsets[node + 1] += graph->caller_offsets[node];
+	}
+
+	/*
+	 * Filling in node order leaves the callers sorted too.
+	 */
+	graph->callers = xmalloc((num_edges + 1) * sizeof(uint32_t));
+	fill	       = xmalloc((n + 1) * sizeof(uint32_t));
+	memcpy(fill, graph->caller_offsets, (n + 1) * sizeof(uint32_t));
+
+	for(uint32_t node = 0; node < n; node++) {
+		uint32_t i;
+
+		bf_for_each_callee(i, graph, node) {
+			graph->callers[fill[graph->callees[i]]++] = node;
+		}
+	}
+
+	free(fill);
+}
+
+/*
+ * Tarjan's algorithm with an explicit stack, since call chains can be too
+ * deep for recursion. Components are completed callees first, which gives
+ * the reverse topological numbering.
+ */
+static void find_sccs(struct bf_call_graph * graph)
+{
+	uint32_t   n	     = graph->num_nodes;
+	uint32_t * index     = xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t * low	     = xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t * next	     = xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t * calls     = xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t * stack     = xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t   depth     = 0;
+	uint32_t   top	     = 0;
+	uint32_t   counter   = 0;
+	uint32_t   num_nodes = 0;
+
+	graph->scc	   = xmalloc((n + 1) * sizeof(uint32_t));
+	graph->scc_offsets = xmalloc((n + 1) * sizeof(uint32_t));
+	graph->scc_nodes   = xmalloc((n + 1) * sizeof(uint32_t));
+	graph->num_sccs	   = 0;
+
+	for(uint32_t node = 0; node < n; node++) {
+		index[node]	 = BF_NO_NODE;
+		graph->scc[node] = BF_NO_NODE;
+	}
+
+	for(uint32_t root = 0; root < n; root++) {
+		if(index[root] != BF_NO_NODE) {
+			continue;
+		}
+
+		index[root]    = counter;
+		low[root]      = counter++;
+		next[root]     = graph->callee_offsets[root];
+		calls[depth++] = root;
+		stack[top++]   = root;
+
+		while(depth > 0) {
+			uint32_t node = calls[depth - 1];
+
+			if(next[node] < graph->callee_offsets[node + 1]) {
+				uint32_t callee = graph->callees[next[node]++];
+
+				if(index[callee] == BF_NO_NODE) {
+					index[callee]  = counter;
+					low[callee]    = counter++;
+					next[callee]   =
+						graph->callee_offsets[callee];
+					calls[depth++] = callee;
+					stack[top++]   = callee;
+				} else if(graph->scc[callee] == BF_NO_NODE &&
+						index[callee] < low[node]) {
+					/*
+					 * Still on the stack.
+					 */
+					low[node] = index[callee];
+				}
+
+				continue;
+			}
+
+			depth--;
+
+			if(depth > 0 && low[node] < low[calls[depth - 1]]) {
+				low[calls[depth - 1]] = low[node];
+			}
+
+			if(low[node] == index[node]) {
+				uint32_t member;
+
+				graph->scc_offsets[graph->num_sccs] = num_nodes;
+
+				do {
+					member			     =
+							stack[--top];
+					graph->scc[member]	     =
+							graph->num_sccs;
+					graph->scc_nodes[num_nodes++] = member;
+				} while(member != node);
+
+				graph->num_sccs++;
+			}
+		}
+	}
+
+	graph->scc_offsets[graph->num_sccs] = num_nodes;
+
+	free(index);
+	free(low);
+	free(next);
+	free(calls);
+	free(stack);
+}
+
+static void build_graph(struct bf_call_graph * graph)
+{
+	struct bin_file * bf = graph->bf;
+	uint32_t	  n;
+
+	graph->generation = __atomic_load_n(&bf->cfg_generation,
+			__ATOMIC_RELAXED);
+	graph->num_nodes  = n = bf_get_num_funcs(bf);
+	graph->funcs	  = xmalloc((n + 1) * sizeof(struct bf_func *));
+	graph->imports	  = xcalloc(n + 1, sizeof(const char *));
+	graph->site_offsets = xcalloc(n + 1, sizeof(uint32_t));
+
+	for(uint32_t node = 0; node < n; node++) {
+		graph->funcs[node] = bf_get_func_by_id(bf, node);
+	}
+
+	bf_parallel_run(graph->num_threads, n, CALL_GRAPH_GRAIN, scan_funcs,
+			append_sites, graph);
+
+	for(uint32_t node = 0; node < n; node++) {
+		graph->site_offsets[node + 1] += graph->site_offsets[node];
+	}
+
+	for(uint32_t i = 0; i < graph->num_sites; i++) {
+		graph->num_unresolved += graph->sites[i].index < 0;
+	}
+
+	build_edges(graph);
+	find_sccs(graph);
+}
+
+static void free_graph(struct bf_call_graph * graph)
+{
+	free(graph->funcs);
+	free(graph->imports);
+	free(graph->callee_offsets);
+	free(graph->callees);
+	free(graph->caller_offsets);
+	free(graph->callers);
+	free(graph->site_offsets);
+	free(graph->sites);
+	free(graph->scc);
+	free(graph->scc_offsets);
+	free(graph->scc_nodes);
+}
+
+struct bf_call_graph * bf_init_call_graph(struct bin_file * bf,
+		unsigned int num_threads)
+{
+	struct bf_call_graph * graph = xcalloc(1,
+			sizeof(struct bf_call_graph));
+
+	graph->bf	   = bf;
+	graph->num_threads = num_threads;
+	build_graph(graph);
+	return graph;
+}
+
+bool bf_update_call_graph(struct bf_call_graph * graph)
+{
+	struct bin_file * bf	      = graph->bf;
+	unsigned int	  num_threads = graph->num_threads;
+
+	if(__atomic_load_n(&bf->cfg_generation, __ATOMIC_RELAXED) ==
+			graph->generation) {
+		return FALSE;
+	}
+
+	/*
+	 * Nodes are the bf_func ids, so rebuilding keeps them stable.
+	 */
+	free_graph(graph);
+	memset(graph, 0, sizeof(struct bf_call_graph));
+	graph->bf	   = bf;
+	graph->num_threads = num_threads;
+	build_graph(graph);
+	return TRUE;
+}
+
+uint32_t bf_get_reachable_nodes(struct bf_call_graph * graph, uint32_t node,
+		struct bf_bitmap * reached)
+{
+	uint32_t * queue = xmalloc((graph->num_nodes + 1) * sizeof(uint32_t));
+	uint32_t   head	 = 0;
+	uint32_t   tail	 = 0;
+
+	bf_clear_bitmap(reached);
+	queue[tail++] = node;
+
+	/*
+	 * node itself is only marked once it is reached through a call.
+	 */
+	while(head < tail) {
+		uint32_t caller = queue[head++];
+		uint32_t i;
+
+		bf_for_each_callee(i, graph, caller) {
+			uint32_t callee = graph->callees[i];
+
+			if(!bf_bitmap_set(reached, callee) && callee != node) {
+				queue[tail++] = callee;
+			}
+		}
+	}
+
+	free(queue);
+
+	/*
+	 * Every node but the start was queued exactly once.
+	 */
+	return tail - 1 + bf_bitmap_test(reached, node);
+}
+
+bool bf_call_graph_reaches(struct bf_call_graph * graph, uint32_t from,
+		uint32_t to)
+{
+	struct bf_bitmap reached;
+	bool		 found;
+
+	/*
+	 * Calls never lead from a component to one with a higher number.
+	 */
+	if(graph->scc[to] > graph->scc[from]) {
+		return FALSE;
+	} else if(graph->scc[to] == graph->scc[from]) {
+		return from != to || bf_is_recursive_node(graph, from);
+	}
+
+	bf_init_bitmap(&reached, graph->num_nodes);
+	bf_get_reachable_nodes(graph, from, &reached);
+	found = bf_bitmap_test(&reached, to);
+	bf_close_bitmap(&reached);
+	return found;
+}
+
+bool bf_is_recursive_node(struct bf_call_graph * graph, uint32_t node)
+{
+	uint32_t comp = graph->scc[node];
+	uint32_t i;
+
+	if(graph->scc_offsets[comp + 1] - graph->scc_offsets[comp] > 1) {
+		return TRUE;
+	}
+
+	bf_for_each_callee(i, graph, node) {
+		if(graph->callees[i] == node) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void bf_close_call_graph(struct bf_call_graph * graph)
+{
+	free_graph(graph);
+	free(graph);
+}
@@ -17,66 +17,71 @@
 
 #include "cfg.h"
 
+#include <stdlib.h>
+#include "bitmap.h"
+#include "parallel.h"
+
 /*
- * Currently used as a hashmap entry to signify whether the block has already
- * been printed. We can add more members later if necessary. If not, we can
- * use a bitmap instead.
+ * Without the bin_file only the symbols which were already resolved can be
+ * printed.
  */
-struct bb_visited {
-	struct htable_entry entry;
-};
-
-static void print_cfg_bb_stdout(struct bf_basic_blk * bb)
+static void print_cfg_bb_stdout(struct bin_file * bf,
+		struct bf_basic_blk * bb)
 {
-	printf("New block: %s\n", bb->sym ? bb->sym->name: "");
+	struct symbol * sym = NULL;
+
+	if(bf != NULL) {
+		sym = bf_get_bb_sym(bf, bb);
+	} else if(__atomic_load_n(&bb->sym_resolved, __ATOMIC_ACQUIRE)) {
+		sym = bb->sym;
+	}
+
+	printf("New block: %s\n", sym ? symbol_demangled_name(sym) : "");
 	bf_print_basic_blk(bb);
 	printf("\n\n");
 }
 
-static void print_cfg_bb_stdout_recur(struct htable * table,
-		struct bf_basic_blk * bb)
+/*
+ * The visited blocks are marked by id in a bf_bitmap.
+ */
+static void print_cfg_bb_stdout_recur(struct bf_bitmap * visited,
+		struct bin_file * bf, struct bf_basic_blk * bb)
 {
 	if(bb != NULL) {
-		if(htable_find(table, &bb->vma, sizeof(bb->vma))) {
+		if(bf_bitmap_set(visited, bb->entry.id)) {
 			return;
 		}
 
-		struct bb_visited * v = xmalloc(sizeof(struct bb_visited));
-		htable_add(table, &v->entry, &bb->vma, sizeof(bb->vma));
+		print_cfg_bb_stdout(bf, bb);
 
-		print_cfg_bb_stdout(bb);
-
-		print_cfg_bb_stdout_recur(table, bb->target);
-		print_cfg_bb_stdout_recur(table, bb->target2);
+		print_cfg_bb_stdout_recur(visited, bf, bb->target);
+		print_cfg_bb_stdout_recur(visited, bf, bb->target2);
 	}
 }
 
-void print_cfg_stdout(struct bf_basic_blk * bb)
+void print_bf_cfg_stdout(struct bin_file * bf, struct bf_basic_blk * bb)
 {
-	struct htable	      table;
-	struct htable_entry * cur_entry;
-	struct htable_entry * n;
-
-	htable_init(&table);
+	struct bf_bitmap visited;
 
-	print_cfg_bb_stdout_recur(&table, bb);
-
-	htable_for_each_safe(cur_entry, n, &table) {
-		struct bb_visited * v = hash_entry(cur_entry,
-				struct bb_visited, entry);
-		htable_del_entry(&table, cur_entry);
-		free(v);
-	}
+	bf_init_bitmap(&visited, 0);
+	print_cfg_bb_stdout_recur(&visited, bf, bb);
+	bf_close_bitmap(&visited);
+}
 
-	htable_destroy(&table);
+void print_cfg_stdout(struct bf_basic_blk * bb)
+{
+	print_bf_cfg_stdout(NULL, bb);
 }
 
 static void print_cfg_bb_dot(FILE * stream, struct bin_file * bf,
 		struct bf_basic_blk * bb)
 {
+	struct symbol * sym = bf_get_bb_sym(bf, bb);
+
 	fprintf(stream, "\t\"%lX\" [label=\"", bb->vma);
-	if(bb->sym) {
-		fprintf(stream, "        %s\\l\\n", bb->sym->name);
+	if(sym) {
+		fprintf(stream, "        %s\\l\\n",
+				symbol_demangled_name(sym));
 	}
 
 	bf_print_basic_blk_dot(stream, bb);
@@ -93,25 +98,24 @@ static void print_cfg_bb_dot(FILE * stream, struct bin_file * bf,
 	}
 }
 
-static void print_cfg_bb_dot_recur(struct htable * table, FILE * stream,
-		struct bin_file * bf, struct bf_basic_blk * bb)
+static void print_cfg_bb_dot_recur(struct bf_bitmap * visited,
+		FILE * stream, struct bin_file * bf, struct bf_basic_blk * bb)
 {
 	if(bb != NULL) {
-		if(htable_find(table, &bb->vma, sizeof(bb->vma))) {
+		if(bf_bitmap_set(visited, bb->entry.id)) {
 			return;
 		}
 
-		struct bb_visited * v = xmalloc(sizeof(struct bb_visited));
-		htable_add(table, &v->entry, &bb->vma, sizeof(bb->vma));
-
 		print_cfg_bb_dot(stream, bf, bb);
 
 		if(bb->target != 0) {
-			print_cfg_bb_dot_recur(table, stream, bf, bb->target);
+			print_cfg_bb_dot_recur(visited, stream, bf,
+					bb->target);
 		}
 
 		if(bb->target2 != 0) {
-			print_cfg_bb_dot_recur(table, stream, bf, bb->target2);
+			print_cfg_bb_dot_recur(visited, stream, bf,
+					bb->target2);
 		}
 	}
 }
@@ -120,25 +124,15 @@ void print_cfg_dot(FILE * stream, struct bin_file * bf,
 		struct bf_basic_blk * bb)
 {
 	if(bb != NULL) {
-		struct htable	      table;
-		struct htable_entry * cur_entry;
-		struct htable_entry * n;
+		struct bf_bitmap visited;
 
-		htable_init(&table);
+		bf_init_bitmap(&visited, bf_get_num_basic_blks(bf));
 
 		fprintf(stream, "digraph G {\n");
-		print_cfg_bb_dot_recur(&table, stream, bf, bb);
-		fprintf(stream, "}");		
-
-		htable_for_each_safe(cur_entry, n, &table) {
-			struct bb_visited * v = hash_entry(cur_entry,
-					struct bb_visited, entry);
-
-			htable_del_entry(&table, cur_entry);
-			free(v);
-		}
+		print_cfg_bb_dot_recur(&visited, stream, bf, bb);
+		fprintf(stream, "}");
 
-		htable_destroy(&table);
+		bf_close_bitmap(&visited);
 	}
 }
 
@@ -147,7 +141,7 @@ void print_entire_cfg_stdout(struct bin_file * bf)
 	struct bf_basic_blk * bb;
 
 	bf_for_each_basic_blk(bb, bf) {
-		print_cfg_bb_stdout(bb);
+		print_cfg_bb_stdout(bf, bb);
 	}
 }
 
@@ -164,39 +158,78 @@ void print_entire_cfg_dot(struct bin_file * bf, FILE * stream)
 	fprintf(stream, "}");
 }
 
-static void print_each_bf_insn(struct bin_file * bf, struct bf_insn * insn,
-		void * param)
-{
-	bf_print_insn_to_file(param, insn);
-	fprintf(param, "\n");
-}
-
-void print_all_bf_insn(struct bin_file * bf, FILE * stream)
-{
-	bf_enum_insn(bf, print_each_bf_insn, stream);
-}
+/*
+ * Instructions are rendered in chunks of this many by the workers.
+ */
+#define PRINT_INSN_GRAIN 1024
 
 struct PRINT_INSN_INFO {
 	FILE *		   stream;
 	enum arch_bitiness bitiness;
+	struct bf_insn **  insns;
+	bool		   semantic_gen;
 };
 
-static void print_each_bf_insn_semantic_gen(struct bin_file * bf,
-		struct bf_insn * insn, void * param)
+/*
+ * Each chunk is rendered into its own buffer. The buffers are written out in
+ * VMA order by print_insn_chunk() once all chunks have been rendered.
+ */
+static void * render_insn_chunk(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct PRINT_INSN_INFO * info	= ctx->param;
+	char *			 buf	= NULL;
+	size_t			 size	= 0;
+	FILE *			 stream = open_memstream(&buf, &size);
+
+	for(size_t i = first; i < last; i++) {
+		struct bf_insn * insn = info->insns[i];
+
+		if(!info->semantic_gen) {
+			bf_print_insn_to_file(stream, insn);
+			fprintf(stream, "\n");
+		} else if(!insn->is_data) {
+			bf_print_insn_semantic_gen_to_file(stream, insn,
+					info->bitiness);
+			fprintf(stream, "\n");
+		}
+	}
+
+	fclose(stream);
+	return buf;
+}
+
+static void print_insn_chunk(size_t first, size_t last, void * result,
+		void * param)
 {
 	struct PRINT_INSN_INFO * info = param;
 
-	if(!insn->is_data) {
-		bf_print_insn_semantic_gen_to_file(info->stream, insn,
-				info->bitiness);
-		fprintf(info->stream, "\n");
-	}
+	fputs(result, info->stream);
+	free(result);
 }
 
-void print_all_bf_insn_semantic_gen(struct bin_file * bf, FILE * stream)
+static void print_insns(struct bin_file * bf, FILE * stream,
+		bool semantic_gen)
 {
 	struct PRINT_INSN_INFO info;
-	info.stream   = stream;
-	info.bitiness = bf->bitiness;
-	bf_enum_insn(bf, print_each_bf_insn_semantic_gen, &info);
+	size_t		       count;
+
+	info.stream	  = stream;
+	info.bitiness	  = bf->bitiness;
+	info.insns	  = bf_collect_insns(bf, &count);
+	info.semantic_gen = semantic_gen;
+
+	bf_parallel_run(0, count, PRINT_INSN_GRAIN, render_insn_chunk,
+			print_insn_chunk, &info);
+	free(info.insns);
+}
+
+void print_all_bf_insn(struct bin_file * bf, FILE * stream)
+{
+	print_insns(bf, stream, FALSE);
+}
+
+void print_all_bf_insn_semantic_gen(struct bin_file * bf, FILE * stream)
+{
+	print_insns(bf, stream, TRUE);
 }
@@ -0,0 +1,1051 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "diff.h"
+
+#include <inttypes.h>
+#include <libiberty.h>
+
+#include "basic_blk.h"
+#include "insn.h"
+#include "parallel.h"
+
+#define BF_DIFF_THRESHOLD 0.5
+
+/*
+ * A feature held by more functions than this is too common to narrow down
+ * the candidates and is only used for scoring.
+ */
+#define BF_DIFF_MAX_POSTING 32
+
+/*
+ * The number of rarest features of a function probed in the inverted index.
+ */
+#define BF_DIFF_MAX_PROBES 16
+
+/*
+ * Call graph neighbours are only paired up for functions with at most this
+ * many callers or callees, otherwise utility functions called from
+ * everywhere would make the propagation quadratic.
+ */
+#define BF_DIFF_MAX_NEIGHBOURS 64
+
+/*
+ * Features are tagged in their top bits so that a trigram never equals a
+ * constant.
+ */
+#define FEATURE_TRIGRAM	 (0ULL << 62)
+#define FEATURE_CONSTANT (1ULL << 62)
+#define FEATURE_MASK	 ((1ULL << 62) - 1)
+
+/*
+ * The signals of one function.
+ */
+struct FUNC_FEATURES {
+	struct bf_func *   func;
+	uint64_t	   fingerprint;
+	unsigned int	   num_bbs;
+	unsigned int	   num_insns;
+	unsigned int	   num_edges;
+	uint64_t *	   features;
+	size_t		   num_features;
+	bfd_vma *	   callee_vmas;
+	size_t *	   callees;
+	size_t		   num_callees;
+	size_t *	   callers;
+	size_t		   num_callers;
+	long		   match;
+	double		   similarity;
+	enum bf_match_kind kind;
+};
+
+struct DIFF_SIDE {
+	struct bin_file *      bf;
+	struct bf_func **      funcs;
+	size_t		       count;
+	struct FUNC_FEATURES * feats;
+	bfd_vma		       start;
+	bfd_vma		       end;
+};
+
+struct DIFF_STATE {
+	struct DIFF_SIDE side[2];
+	double		 threshold;
+	size_t *	 worklist;
+	size_t		 num_work;
+	size_t		 work_capacity;
+};
+
+/*
+ * State of the feature extraction of one function.
+ */
+struct EXTRACT {
+	struct DIFF_SIDE *     side;
+	struct FUNC_FEATURES * ff;
+	size_t		       capacity;
+	size_t		       callee_capacity;
+};
+
+static inline uint64_t diff_mix(uint64_t h, uint64_t v)
+{
+	h ^= v;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 32);
+}
+
+static void add_alloc_range(bfd * abfd, asection * s, void * param)
+{
+	struct DIFF_SIDE * side	 = param;
+	bfd_vma		   start = bfd_get_section_vma(abfd, s);
+	bfd_vma		   end	 = start + bfd_section_size(abfd, s);
+
+	if((bfd_get_section_flags(abfd, s) & SEC_ALLOC) && start != end) {
+		side->start = start < side->start ? start : side->start;
+		side->end   = end > side->end ? end : side->end;
+	}
+}
+
+static void add_feature(struct EXTRACT * ex, uint64_t feature)
+{
+	struct FUNC_FEATURES * ff = ex->ff;
+
+	if(ff->num_features == ex->capacity) {
+		ex->capacity = ex->capacity ? ex->capacity * 2 : 64;
+		ff->features = xrealloc(ff->features, ex->capacity *
+				sizeof(uint64_t));
+	}
+
+	ff->features[ff->num_features++] = feature;
+}
+
+static void add_callee(struct EXTRACT * ex, bfd_vma vma)
+{
+	struct FUNC_FEATURES * ff = ex->ff;
+
+	if(ff->num_callees == ex->callee_capacity) {
+		ex->callee_capacity = ex->callee_capacity ?
+				ex->callee_capacity * 2 : 8;
+		ff->callee_vmas	    = xrealloc(ff->callee_vmas,
+				ex->callee_capacity * sizeof(bfd_vma));
+	}
+
+	ff->callee_vmas[ff->num_callees++] = vma;
+}
+
+/*
+ * Constants which look like addresses change whenever code or data moves.
+ */
+static void add_constant(struct EXTRACT * ex, struct insn_operand * op)
+{
+	uint64_t imm = op->operand_info.imm;
+
+	if(op->tag == OP_IMM && !(imm >= ex->side->start &&
+			imm < ex->side->end)) {
+		add_feature(ex, FEATURE_CONSTANT | (diff_mix(FEATURE_CONSTANT,
+				imm) & FEATURE_MASK));
+	}
+}
+
+/*
+ * Each instruction is reduced to its mnemonics and operand classes. Every run
+ * of three such tokens within a block is a feature. Runs do not cross blocks
+ * so that reordering the blocks of a function does not change its features.
+ */
+static void extract_bb(struct bin_file * bf, struct bf_basic_blk * bb,
+		void * param)
+{
+	struct EXTRACT *       ex     = param;
+	struct FUNC_FEATURES * ff     = ex->ff;
+	unsigned int	       length = bf_get_bb_length(bb);
+	uint64_t	       prev[2] = {0, 0};
+	struct bf_insn *       last   = NULL;
+
+	ff->num_bbs++;
+
+	for(unsigned int i = 0; i < length; i++) {
+		struct bf_insn * insn  = bf_get_bb_insn(bb, i);
+		uint64_t	 token = 0xCBF29CE484222325ULL;
+
+		token = diff_mix(token, insn->mnemonic);
+		token = diff_mix(token, insn->secondary_mnemonic);
+		token = diff_mix(token, insn->operand1.tag);
+		token = diff_mix(token, insn->operand2.tag);
+		token = diff_mix(token, insn->operand3.tag);
+
+		add_feature(ex, FEATURE_TRIGRAM | (diff_mix(diff_mix(prev[0],
+				prev[1]), token) & FEATURE_MASK));
+		add_constant(ex, &insn->operand1);
+		add_constant(ex, &insn->operand2);
+		add_constant(ex, &insn->operand3);
+
+		prev[0] = prev[1];
+		prev[1] = token;
+		last	= insn;
+		ff->num_insns++;
+	}
+
+	if(last != NULL && calls_subroutine(last->mnemonic)) {
+		if(bb->target2 != NULL) {
+			add_callee(ex, bb->target2->vma);
+		}
+
+		ff->num_edges += bb->target != NULL;
+	} else {
+		ff->num_edges += (bb->target != NULL) + (bb->target2 != NULL);
+	}
+}
+
+static int cmp_feature(const void * elem1, const void * elem2)
+{
+	uint64_t f1 = *(const uint64_t *)elem1;
+	uint64_t f2 = *(const uint64_t *)elem2;
+
+	return f1 < f2 ? -1 : f1 > f2;
+}
+
+static void * extract_funcs(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct DIFF_SIDE * side = ctx->param;
+
+	for(size_t i = first; i < last; i++) {
+		struct FUNC_FEATURES * ff = &side->feats[i];
+		struct EXTRACT	       ex = {side, ff, 0, 0};
+		size_t		       n  = 0;
+
+		ff->func	= side->funcs[i];
+		ff->fingerprint = bf_get_func_fingerprint(side->bf, ff->func);
+		ff->match	= -1;
+		bf_enum_func_basic_blk(side->bf, ff->func, extract_bb, &ex);
+
+		/*
+		 * The features are a set.
+		 */
+		qsort(ff->features, ff->num_features, sizeof(uint64_t),
+				cmp_feature);
+
+		for(size_t j = 0; j < ff->num_features; j++) {
+			if(n == 0 || ff->features[j] != ff->features[n - 1]) {
+				ff->features[n++] = ff->features[j];
+			}
+		}
+
+		ff->num_features = n;
+	}
+
+	return NULL;
+}
+
+static long find_func_index(struct DIFF_SIDE * side, bfd_vma vma)
+{
+	size_t lo = 0;
+	size_t hi = side->count;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(side->funcs[mid]->vma < vma) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo < side->count && side->funcs[lo]->vma == vma ? (long)lo : -1;
+}
+
+static bool contains_index(size_t * list, size_t count, size_t index)
+{
+	for(size_t i = 0; i < count; i++) {
+		if(list[i] == index) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * Resolves the callee VMAs to functions, keeping the first call to each in
+ * call order, and inverts them into the caller lists.
+ */
+static void build_call_graph(struct DIFF_SIDE * side)
+{
+	size_t * fill;
+
+	for(size_t i = 0; i < side->count; i++) {
+		struct FUNC_FEATURES * ff = &side->feats[i];
+		size_t		       n  = 0;
+
+		ff->callees = xmalloc((ff->num_callees + 1) * sizeof(size_t));
+
+		for(size_t j = 0; j < ff->num_callees; j++) {
+			long callee = find_func_index(side,
+					ff->callee_vmas[j]);
+
+			if(callee >= 0 && !contains_index(ff->callees, n,
+					callee)) {
+				ff->callees[n++] = callee;
+				side->feats[callee].num_callers++;
+			}
+		}
+
+		ff->num_callees = n;
+		free(ff->callee_vmas);
+		ff->callee_vmas = NULL;
+	}
+
+	fill = xcalloc(side->count + 1, sizeof(size_t));
+
+	for(size_t i = 0; i < side->count; i++) {
+		side->feats[i].callers = xmalloc((side->feats[i].num_callers +
+				1) * sizeof(size_t));
+	}
+
+	for(size_t i = 0; i < side->count; i++) {
+		struct FUNC_FEATURES * ff = &side->feats[i];
+
+		for(size_t j = 0; j < ff->num_callees; j++) {
+			size_t callee = ff->callees[j];
+
+			side->feats[callee].callers[fill[callee]++] = i;
+		}
+	}
+
+	free(fill);
+}
+
+static void init_side(struct DIFF_SIDE * side, struct bin_file * bf,
+		unsigned int num_threads)
+{
+	side->bf    = bf;
+	side->start = (bfd_vma)-1;
+	side->end   = 0;
+	side->funcs = bf_collect_funcs(bf, &side->count);
+	side->feats = xcalloc(side->count + 1, sizeof(struct FUNC_FEATURES));
+
+	bfd_map_over_sections(bf->abfd, add_alloc_range, side);
+	bf_parallel_run(num_threads, side->count, 16, extract_funcs, NULL,
+			side);
+	build_call_graph(side);
+}
+
+static void close_side(struct DIFF_SIDE * side)
+{
+	for(size_t i = 0; i < side->count; i++) {
+		free(side->feats[i].features);
+		free(side->feats[i].callees);
+		free(side->feats[i].callers);
+	}
+
+	free(side->feats);
+	free(side->funcs);
+}
+
+static double jaccard(struct FUNC_FEATURES * ff, struct FUNC_FEATURES * ff2)
+{
+	size_t i      = 0;
+	size_t j      = 0;
+	size_t common = 0;
+	size_t total  = ff->num_features + ff2->num_features;
+
+	if(total == 0) {
+		return 1;
+	}
+
+	while(i < ff->num_features && j < ff2->num_features) {
+		if(ff->features[i] < ff2->features[j]) {
+			i++;
+		} else if(ff->features[i] > ff2->features[j]) {
+			j++;
+		} else {
+			common++;
+			i++;
+			j++;
+		}
+	}
+
+	return (double)common / (total - common);
+}
+
+static double ratio(unsigned int a, unsigned int b)
+{
+	if(a == b) {
+		return 1;
+	}
+
+	return a < b ? (double)a / b : (double)b / a;
+}
+
+/*
+ * Counts the neighbours of one function whose match is a neighbour of the
+ * other.
+ */
+static size_t count_matched_neighbours(size_t * list, size_t count,
+		struct FUNC_FEATURES * feats, size_t * list2, size_t count2)
+{
+	size_t matched = 0;
+
+	for(size_t i = 0; i < count; i++) {
+		long match = feats[list[i]].match;
+
+		if(match >= 0 && contains_index(list2, count2, match)) {
+			matched++;
+		}
+	}
+
+	return matched;
+}
+
+/*
+ * Combines the signals of a pair into a similarity. Only identical
+ * fingerprints score 1.
+ */
+static double score_pair(struct DIFF_STATE * state, size_t i, size_t j)
+{
+	struct FUNC_FEATURES * ff  = &state->side[0].feats[i];
+	struct FUNC_FEATURES * ff2 = &state->side[1].feats[j];
+	double		       size, features, score;
+	size_t		       neighbours;
+
+	if(ff->fingerprint == ff2->fingerprint) {
+		return 1;
+	}
+
+	size	 = (ratio(ff->num_insns, ff2->num_insns) +
+			ratio(ff->num_bbs, ff2->num_bbs) +
+			ratio(ff->num_edges, ff2->num_edges)) / 3;
+	features = jaccard(ff, ff2);
+
+	neighbours = ff->num_callees > ff2->num_callees ? ff->num_callees :
+			ff2->num_callees;
+	neighbours += ff->num_callers > ff2->num_callers ? ff->num_callers :
+			ff2->num_callers;
+
+	if(neighbours == 0 || neighbours > 2 * BF_DIFF_MAX_NEIGHBOURS) {
+		score = 0.7 * features + 0.3 * size;
+	} else {
+		size_t matched = count_matched_neighbours(ff->callees,
+				ff->num_callees, state->side[0].feats,
+				ff2->callees, ff2->num_callees) +
+				count_matched_neighbours(ff->callers,
+				ff->num_callers, state->side[0].feats,
+				ff2->callers, ff2->num_callers);
+
+		score = 0.5 * features + 0.2 * size + 0.3 * matched /
+				neighbours;
+	}
+
+	return score < 0.99 ? score : 0.99;
+}
+
+static void add_match(struct DIFF_STATE * state, size_t i, size_t j,
+		double similarity, enum bf_match_kind kind)
+{
+	struct FUNC_FEATURES * ff = &state->side[0].feats[i];
+
+	ff->match			= j;
+	ff->similarity			= similarity;
+	ff->kind			= kind;
+	state->side[1].feats[j].match	= i;
+
+	if(state->num_work == state->work_capacity) {
+		state->work_capacity = state->work_capacity ?
+				state->work_capacity * 2 : 64;
+		state->worklist	     = xrealloc(state->worklist,
+				state->work_capacity * sizeof(size_t));
+	}
+
+	state->worklist[state->num_work++] = i;
+}
+
+static void match_names(struct DIFF_STATE * state)
+{
+	struct DIFF_SIDE * side = &state->side[0];
+
+	for(size_t i = 0; i < side->count; i++) {
+		struct bf_func * func = side->feats[i].func;
+		struct symbol *	 sym  = bf_get_func_sym(side->bf, func);
+		struct bf_func * func2;
+		long		 j;
+
+		if(sym == NULL || sym->name == NULL) {
+			continue;
+		}
+
+		func2 = bf_get_func_from_name(state->side[1].bf, sym->name);
+		j     = func2 != NULL ? find_func_index(&state->side[1],
+				func2->vma) : -1;
+
+		if(j >= 0 && state->side[1].feats[j].match < 0) {
+			add_match(state, i, j, score_pair(state, i, j),
+					BF_MATCH_NAME);
+		}
+	}
+}
+
+struct FP_ENTRY {
+	uint64_t fingerprint;
+	size_t	 index;
+};
+
+static int cmp_fp_entry(const void * elem1, const void * elem2)
+{
+	const struct FP_ENTRY * e1 = elem1;
+	const struct FP_ENTRY * e2 = elem2;
+
+	if(e1->fingerprint != e2->fingerprint) {
+		return e1->fingerprint < e2->fingerprint ? -1 : 1;
+	}
+
+	return e1->index < e2->index ? -1 : e1->index > e2->index;
+}
+
+static struct FP_ENTRY * sort_unmatched_fps(struct DIFF_SIDE * side,
+		size_t * count)
+{
+	struct FP_ENTRY * entries = xmalloc((side->count + 1) *
+			sizeof(struct FP_ENTRY));
+
+	*count = 0;
+
+	for(size_t i = 0; i < side->count; i++) {
+		struct FUNC_FEATURES * ff = &side->feats[i];
+
+		if(ff->match < 0) {
+			entries[*count].fingerprint = ff->fingerprint;
+			entries[*count].index	    = i;
+			(*count)++;
+		}
+	}
+
+	qsort(entries, *count, sizeof(struct FP_ENTRY), cmp_fp_entry);
+	return entries;
+}
+
+static size_t fp_run_end(struct FP_ENTRY * entries, size_t count, size_t i)
+{
+	size_t end = i + 1;
+
+	while(end < count && entries[end].fingerprint ==
+			entries[i].fingerprint) {
+		end++;
+	}
+
+	return end;
+}
+
+/*
+ * Pairs up the fingerprints which occur exactly once on both sides.
+ */
+static void match_fingerprints(struct DIFF_STATE * state)
+{
+	size_t		  count, count2;
+	struct FP_ENTRY * entries  = sort_unmatched_fps(&state->side[0],
+			&count);
+	struct FP_ENTRY * entries2 = sort_unmatched_fps(&state->side[1],
+			&count2);
+	size_t		  i	   = 0;
+	size_t		  j	   = 0;
+
+	while(i < count && j < count2) {
+		size_t end  = fp_run_end(entries, count, i);
+		size_t end2 = fp_run_end(entries2, count2, j);
+
+		if(entries[i].fingerprint < entries2[j].fingerprint) {
+			i = end;
+		} else if(entries[i].fingerprint > entries2[j].fingerprint) {
+			j = end2;
+		} else {
+			if(end - i == 1 && end2 - j == 1) {
+				add_match(state, entries[i].index,
+						entries2[j].index, 1,
+						BF_MATCH_FINGERPRINT);
+			}
+
+			i = end;
+			j = end2;
+		}
+	}
+
+	free(entries);
+	free(entries2);
+}
+
+/*
+ * Pairs each unmatched function of one list with the best scoring unmatched
+ * function of the other list.
+ */
+static void match_neighbours(struct DIFF_STATE * state, size_t * list,
+		size_t count, size_t * list2, size_t count2)
+{
+	if(count > BF_DIFF_MAX_NEIGHBOURS || count2 > BF_DIFF_MAX_NEIGHBOURS) {
+		return;
+	}
+
+	for(size_t k = 0; k < count; k++) {
+		size_t i    = list[k];
+		long   best = -1;
+		double best_score = state->threshold;
+
+		if(state->side[0].feats[i].match >= 0) {
+			continue;
+		}
+
+		for(size_t l = 0; l < count2; l++) {
+			size_t j = list2[l];
+			double score;
+
+			if(state->side[1].feats[j].match >= 0) {
+				continue;
+			}
+
+			score = score_pair(state, i, j);
+
+			if(score >= best_score) {
+				best	   = j;
+				best_score = score;
+			}
+		}
+
+		if(best >= 0) {
+			add_match(state, i, best, best_score,
+					BF_MATCH_CALL_GRAPH);
+		}
+	}
+}
+
+/*
+ * Spreads matches along the call graph until no more can be made.
+ */
+static void propagate_matches(struct DIFF_STATE * state)
+{
+	while(state->num_work > 0) {
+		size_t		       i   = state->worklist[--state->num_work];
+		struct FUNC_FEATURES * ff  = &state->side[0].feats[i];
+		struct FUNC_FEATURES * ff2 = &state->side[1].feats[ff->match];
+
+		match_neighbours(state, ff->callees, ff->num_callees,
+				ff2->callees, ff2->num_callees);
+		match_neighbours(state, ff->callers, ff->num_callers,
+				ff2->callers, ff2->num_callers);
+	}
+}
+
+/*
+ * Inverted index from the features of the unmatched functions of the second
+ * binary to those functions.
+ */
+struct POSTING {
+	uint64_t feature;
+	size_t	 index;
+};
+
+struct FUZZY_PASS {
+	struct DIFF_STATE * state;
+	struct POSTING *    postings;
+	size_t		    num_postings;
+	size_t *	    pending;
+	long *		    best;
+	double *	    best_score;
+};
+
+static int cmp_posting(const void * elem1, const void * elem2)
+{
+	const struct POSTING * p1 = elem1;
+	const struct POSTING * p2 = elem2;
+
+	if(p1->feature != p2->feature) {
+		return p1->feature < p2->feature ? -1 : 1;
+	}
+
+	return p1->index < p2->index ? -1 : p1->index > p2->index;
+}
+
+static void build_postings(struct FUZZY_PASS * pass)
+{
+	struct DIFF_SIDE * side = &pass->state->side[1];
+	size_t		   n	= 0;
+
+	for(size_t i = 0; i < side->count; i++) {
+		if(side->feats[i].match < 0) {
+			n += side->feats[i].num_features;
+		}
+	}
+
+	pass->postings	   = xmalloc((n + 1) * sizeof(struct POSTING));
+	pass->num_postings = 0;
+
+	for(size_t i = 0; i < side->count; i++) {
+		struct FUNC_FEATURES * ff = &side->feats[i];
+
+		if(ff->match >= 0) {
+			continue;
+		}
+
+		for(size_t j = 0; j < ff->num_features; j++) {
+			pass->postings[pass->num_postings].feature =
+					ff->features[j];
+			pass->postings[pass->num_postings].index = i;
+			pass->num_postings++;
+		}
+	}
+
+	qsort(pass->postings, pass->num_postings, sizeof(struct POSTING),
+			cmp_posting);
+}
+
+/*
+ * Gets the range of postings holding a feature.
+ */
+static size_t find_postings(struct FUZZY_PASS * pass, uint64_t feature,
+		size_t * end)
+{
+	size_t lo = 0;
+	size_t hi = pass->num_postings;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(pass->postings[mid].feature < feature) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	*end = lo;
+
+	while(*end < pass->num_postings && pass->postings[*end].feature ==
+			feature && *end - lo <= BF_DIFF_MAX_POSTING) {
+		(*end)++;
+	}
+
+	return lo;
+}
+
+struct PROBE {
+	size_t first;
+	size_t length;
+};
+
+static int cmp_probe(const void * elem1, const void * elem2)
+{
+	const struct PROBE * p1 = elem1;
+	const struct PROBE * p2 = elem2;
+
+	if(p1->length != p2->length) {
+		return p1->length < p2->length ? -1 : 1;
+	}
+
+	return p1->first < p2->first ? -1 : p1->first > p2->first;
+}
+
+/*
+ * Scores one unmatched function of the first binary against every function
+ * sharing one of its rarest features.
+ */
+static void find_best_candidate(struct FUZZY_PASS * pass, size_t i)
+{
+	struct DIFF_STATE *    state = pass->state;
+	struct FUNC_FEATURES * ff    = &state->side[0].feats[i];
+	struct PROBE *	       probes;
+	size_t		       num_probes = 0;
+	size_t		       candidates[BF_DIFF_MAX_PROBES *
+			(BF_DIFF_MAX_POSTING + 1)];
+	size_t		       num_candidates = 0;
+
+	pass->best[i]	    = -1;
+	pass->best_score[i] = state->threshold;
+	probes		    = xmalloc((ff->num_features + 1) *
+			sizeof(struct PROBE));
+
+	for(size_t k = 0; k < ff->num_features; k++) {
+		size_t end;
+		size_t first = find_postings(pass, ff->features[k], &end);
+
+		if(end > first && end - first <= BF_DIFF_MAX_POSTING) {
+			probes[num_probes].first  = first;
+			probes[num_probes].length = end - first;
+			num_probes++;
+		}
+	}
+
+	qsort(probes, num_probes, sizeof(struct PROBE), cmp_probe);
+
+	for(size_t k = 0; k < num_probes && k < BF_DIFF_MAX_PROBES; k++) {
+		for(size_t l = 0; l < probes[k].length; l++) {
+			size_t j = pass->postings[probes[k].first + l].index;
+
+			if(!contains_index(candidates, num_candidates, j)) {
+				candidates[num_candidates++] = j;
+			}
+		}
+	}
+
+	free(probes);
+
+	for(size_t k = 0; k < num_candidates; k++) {
+		size_t j     = candidates[k];
+		double score;
+
+		if(ratio(ff->num_insns, state->side[1].feats[j].num_insns) <
+				0.5) {
+			continue;
+		}
+
+		score = score_pair(state, i, j);
+
+		if(score > pass->best_score[i] ||
+				(score == pass->best_score[i] &&
+				(pass->best[i] < 0 ||
+				(long)j < pass->best[i]))) {
+			pass->best[i]	    = j;
+			pass->best_score[i] = score;
+		}
+	}
+}
+
+static void * score_candidates(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct FUZZY_PASS * pass = ctx->param;
+
+	for(size_t k = first; k < last; k++) {
+		find_best_candidate(pass, pass->pending[k]);
+	}
+
+	return NULL;
+}
+
+struct PROPOSAL {
+	double score;
+	size_t index;
+	size_t index2;
+};
+
+static int cmp_proposal(const void * elem1, const void * elem2)
+{
+	const struct PROPOSAL * p1 = elem1;
+	const struct PROPOSAL * p2 = elem2;
+
+	if(p1->score != p2->score) {
+		return p1->score > p2->score ? -1 : 1;
+	}
+
+	return p1->index < p2->index ? -1 : p1->index > p2->index;
+}
+
+/*
+ * Every unmatched function proposes its best candidate in parallel. The
+ * proposals are then accepted greedily, best first, as long as neither side
+ * has been taken.
+ */
+static void match_fuzzy(struct DIFF_STATE * state, unsigned int num_threads)
+{
+	struct DIFF_SIDE * side	     = &state->side[0];
+	struct FUZZY_PASS  pass	     = {state};
+	struct PROPOSAL *  proposals;
+	size_t		   num_pending = 0;
+	size_t		   num_proposals = 0;
+
+	build_postings(&pass);
+	pass.pending	= xmalloc((side->count + 1) * sizeof(size_t));
+	pass.best	= xmalloc((side->count + 1) * sizeof(long));
+	pass.best_score = xmalloc((side->count + 1) * sizeof(double));
+
+	for(size_t i = 0; i < side->count; i++) {
+		if(side->feats[i].match < 0) {
+			pass.pending[num_pending++] = i;
+		}
+	}
+
+	bf_parallel_run(num_threads, num_pending, 16, score_candidates, NULL,
+			&pass);
+
+	proposals = xmalloc((num_pending + 1) * sizeof(struct PROPOSAL));
+
+	for(size_t k = 0; k < num_pending; k++) {
+		size_t i = pass.pending[k];
+
+		if(pass.best[i] >= 0) {
+			proposals[num_proposals].score	= pass.best_score[i];
+			proposals[num_proposals].index	= i;
+			proposals[num_proposals].index2 = pass.best[i];
+			num_proposals++;
+		}
+	}
+
+	qsort(proposals, num_proposals, sizeof(struct PROPOSAL),
+			cmp_proposal);
+
+	for(size_t k = 0; k < num_proposals; k++) {
+		if(state->side[1].feats[proposals[k].index2].match < 0) {
+			add_match(state, proposals[k].index,
+					proposals[k].index2,
+					proposals[k].score, BF_MATCH_FUZZY);
+		}
+	}
+
+	free(proposals);
+	free(pass.pending);
+	free(pass.best);
+	free(pass.best_score);
+	free(pass.postings);
+}
+
+static struct bf_func ** collect_unmatched(struct DIFF_SIDE * side,
+		size_t * count)
+{
+	struct bf_func ** funcs = xmalloc((side->count + 1) *
+			sizeof(struct bf_func *));
+
+	*count = 0;
+
+	for(size_t i = 0; i < side->count; i++) {
+		if(side->feats[i].match < 0) {
+			funcs[(*count)++] = side->feats[i].func;
+		}
+	}
+
+	return funcs;
+}
+
+struct bf_diff * bf_diff_bins(struct bin_file * bf, struct bin_file * bf2,
+		unsigned int num_threads, double threshold)
+{
+	struct bf_diff *  diff	= xmalloc(sizeof(struct bf_diff));
+	struct DIFF_STATE state = {{{0}}};
+
+	state.threshold = threshold > 0 ? threshold : BF_DIFF_THRESHOLD;
+	init_side(&state.side[0], bf, num_threads);
+	init_side(&state.side[1], bf2, num_threads);
+
+	match_names(&state);
+	match_fingerprints(&state);
+	propagate_matches(&state);
+
+	/*
+	 * Fingerprints which were ambiguous at first may have become unique
+	 * through the call graph matches.
+	 */
+	match_fingerprints(&state);
+	propagate_matches(&state);
+	match_fuzzy(&state, num_threads);
+	propagate_matches(&state);
+
+	diff->bf	  = bf;
+	diff->bf2	  = bf2;
+	diff->num_matches = 0;
+	diff->matches	  = xmalloc((state.side[0].count + 1) *
+			sizeof(struct bf_func_match));
+
+	for(size_t i = 0; i < state.side[0].count; i++) {
+		struct FUNC_FEATURES * ff = &state.side[0].feats[i];
+
+		if(ff->match >= 0) {
+			struct bf_func_match * match =
+					&diff->matches[diff->num_matches++];
+
+			match->func	  = ff->func;
+			match->func2	  = state.side[1].feats[ff->match].func;
+			match->similarity = ff->similarity;
+			match->kind	  = ff->kind;
+		}
+	}
+
+	diff->removed = collect_unmatched(&state.side[0], &diff->num_removed);
+	diff->added   = collect_unmatched(&state.side[1], &diff->num_added);
+
+	close_side(&state.side[0]);
+	close_side(&state.side[1]);
+	free(state.worklist);
+	return diff;
+}
+
+struct bf_func_match * bf_get_func_match(struct bf_diff * diff,
+		struct bf_func * func)
+{
+	size_t lo = 0;
+	size_t hi = diff->num_matches;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(diff->matches[mid].func->vma < func->vma) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo < diff->num_matches && diff->matches[lo].func == func ?
+			&diff->matches[lo] : NULL;
+}
+
+static void print_func_name(FILE * stream, struct bin_file * bf,
+		struct bf_func * func)
+{
+	struct symbol * sym = bf_get_func_sym(bf, func);
+
+	if(sym != NULL && sym->name != NULL) {
+		fprintf(stream, "%s", symbol_demangled_name(sym));
+	} else {
+		fprintf(stream, "0x%" PRIx64, (uint64_t)func->vma);
+	}
+}
+
+void bf_print_diff(struct bf_diff * diff, FILE * stream, bool all)
+{
+	static const char * kinds[] = {"name", "fingerprint", "call-graph",
+			"fuzzy"};
+
+	for(size_t i = 0; i < diff->num_matches; i++) {
+		struct bf_func_match * match = &diff->matches[i];
+
+		if(match->similarity == 1 && !all) {
+			continue;
+		}
+
+		fprintf(stream, "%c %.3f %-11s ", match->similarity == 1 ? '=' :
+				'~', match->similarity, kinds[match->kind]);
+		print_func_name(stream, diff->bf, match->func);
+		fprintf(stream, " -> ");
+		print_func_name(stream, diff->bf2, match->func2);
+		fprintf(stream, "\n");
+	}
+
+	for(size_t i = 0; i < diff->num_removed; i++) {
+		fprintf(stream, "%-20s", "-");
+		print_func_name(stream, diff->bf, diff->removed[i]);
+		fprintf(stream, "\n");
+	}
+
+	for(size_t i = 0; i < diff->num_added; i++) {
+		fprintf(stream, "%-20s", "+");
+		print_func_name(stream, diff->bf2, diff->added[i]);
+		fprintf(stream, "\n");
+	}
+}
+
+void bf_close_diff(struct bf_diff * diff)
+{
+	free(diff->matches);
+	free(diff->removed);
+	free(diff->added);
+	free(diff);
+}
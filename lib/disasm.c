@@ -22,16 +22,20 @@
 #include "basic_blk.h"
 #include "mem_manager.h"
 #include "symbol.h"
+#include "incremental.h"
+#include "xref_index.h"
+#include "insn_index.h"
 
 /*
  * Forward reference.
  */
-static struct bf_basic_blk * disasm_block(struct bin_file * bf, bfd_vma vma);
+static struct bf_basic_blk * disasm_block(struct disasm_context * context,
+		bfd_vma vma);
 
-static void update_insn_info(struct bin_file * bf, struct bf_insn * insn,
-		char * str)
+static void update_insn_info(struct disasm_context * context,
+		struct bf_insn * insn, char * str)
 {
-	if(!bf->disasm_config.insn_info_valid) {
+	if(!context->info.insn_info_valid) {
 		/*
 		 * We come in here if we are analysing the mnemonic part.
 		 * In x86 there are never two targets for branching so we
@@ -39,8 +43,8 @@ static void update_insn_info(struct bin_file * bf, struct bf_insn * insn,
 		 * has been checked yet.
 		 */
 
-		bf->disasm_config.insn_info_valid = TRUE;
-		bf->disasm_config.target2	  = 0;
+		context->info.insn_info_valid = TRUE;
+		context->info.target2	      = 0;
 
 		/*
 		 * We use dis_condjsr to represent instructions which end flow
@@ -48,26 +52,26 @@ static void update_insn_info(struct bin_file * bf, struct bf_insn * insn,
 		 */
 
 		if(breaks_flow(insn->mnemonic)) {
-			bf->disasm_config.insn_type = dis_branch;
+			context->info.insn_type = dis_branch;
 		} else if(branches_flow(insn->mnemonic)) {
-			bf->disasm_config.insn_type = dis_condbranch;
+			context->info.insn_type = dis_condbranch;
 		} else if(calls_subroutine(insn->mnemonic)) {
-			bf->disasm_config.insn_type = dis_jsr;
+			context->info.insn_type = dis_jsr;
 		} else if(ends_flow(insn->mnemonic)) {
-			bf->disasm_config.insn_type = dis_condjsr;
+			context->info.insn_type = dis_condjsr;
 		} else {
-			bf->disasm_config.insn_type = dis_nonbranch;
+			context->info.insn_type = dis_nonbranch;
 		}
 	} else {
-		if(bf->disasm_config.target2 == 0) {
-			bf->disasm_config.target2 = 1;
+		if(context->info.target2 == 0) {
+			context->info.target2 = 1;
 
-			switch(bf->disasm_config.insn_type) {
+			switch(context->info.insn_type) {
 			case dis_branch:
 			case dis_condbranch:
 			case dis_jsr:
 				if(insn->operand1.tag == OP_VAL) {
-					bf->disasm_config.target =
+					context->info.target =
 							insn->operand1
 							.operand_info.val;
 				}
@@ -281,62 +285,146 @@ int binary_file_fprintf(void * stream, const char * format, ...)
 	char str[256] = {0};
 	int rv;
 
-	struct bin_file * bf   = stream;
-	va_list		     args;
+	struct disasm_context * context = stream;
+	va_list			args;
 
 	va_start(args, format);
 	rv = vsnprintf(str, ARRAY_SIZE(str) - 1, format, args);
 	va_end(args);
 
-	bf_add_insn_part(bf->context.insn, str);
+	bf_add_insn_part(context->bf, context->insn, str);
 
 	strip_trailing_spaces(str, ARRAY_SIZE(str));
 	
-	if(bf->context.part_counter == 0 && strcmp(str, "data32") == 0) {
-		bf_set_is_data(bf->context.insn, TRUE);
+	if(context->part_counter == 0 && strcmp(str, "data32") == 0) {
+		bf_set_is_data(context->insn, TRUE);
 	}
 
 	/*
-	 * parse_insn_info uses the bf->context.part_types_expected to keep a
+	 * parse_insn_info uses the context->part_types_expected to keep a
 	 * state machine of expected part types
 	 * (e.g. mnemonics, operands, etc.).
 	 */
-	if(!bf->context.insn->is_data) {
-		if(!parse_insn_info(&bf->context, str)) {
+	if(!context->insn->is_data) {
+		if(!parse_insn_info(context, str)) {
 			printf("parse_insn_info returned FALSE for 0x%lX. "\
 					"The str was %s. The current "\
 					"instruction is:\n\t",
-					bf->context.insn->vma, str);
-			bf_print_insn(bf->context.insn);
+					context->insn->vma, str);
+			bf_print_insn(context->insn);
 			printf("\n\n");
 		}
 	}
 
-	update_insn_info(bf, bf->context.insn, str);
-	bf->context.part_counter++;
+	update_insn_info(context, context->insn, str);
+	context->part_counter++;
 	return rv;
 }
 
-static unsigned int disasm_single_insn(struct bin_file * bf, bfd_vma vma)
+/*
+ * Every disassembly gets its own copy of the libopcodes configuration whose
+ * stream points back at the context, so concurrent callers never share
+ * decoder state.
+ */
+static void init_disasm_context(struct disasm_context * context,
+		struct bin_file * bf)
+{
+	context->bf		     = bf;
+	context->info		     = bf->disasm_config;
+	context->info.stream	     = context;
+	context->insn		     = NULL;
+	context->part_counter	     = 0;
+	context->part_types_expected = insn_part_mnemonic;
+}
+
+static unsigned int disasm_single_insn(struct disasm_context * context,
+		struct bf_mem_block * mem, bfd_vma vma)
+{
+	/*
+	 * The buffer is set for each instruction since a recursive call may
+	 * have pointed the context at another section.
+	 */
+	context->info.buffer	      = mem->buffer;
+	context->info.section	      = mem->section;
+	context->info.buffer_length   = mem->buffer_length;
+	context->info.buffer_vma      = mem->buffer_vma;
+	context->info.insn_info_valid = 0;
+	context->info.target	      = 0;
+
+	context->part_counter	     = 0;
+	context->part_types_expected = insn_part_mnemonic;
+	return context->bf->disassembler(vma, &context->info);
+}
+
+/*
+ * Copies an instruction of the previous version into context->insn. The flow
+ * information is derived from the copied mnemonic and operands the same way
+ * update_insn_info() derives it from the first two parts while decoding.
+ */
+static unsigned int reuse_insn(struct disasm_context * context,
+		struct bf_insn * old)
 {
-	bf->disasm_config.insn_info_valid = 0;
-	bf->disasm_config.target	  = 0;
+	struct bf_insn *      insn = context->insn;
+	struct bf_insn_part * part;
+
+	list_for_each_entry(part, &old->part_list, list) {
+		bf_add_insn_part(context->bf, insn, part->str);
+	}
+
+	insn->is_data		 = old->is_data;
+	insn->mnemonic		 = old->mnemonic;
+	insn->secondary_mnemonic = old->secondary_mnemonic;
+	insn->operand1		 = old->operand1;
+	insn->operand2		 = old->operand2;
+	insn->operand3		 = old->operand3;
+	insn->extra_info	 = old->extra_info;
+
+	context->info.insn_info_valid = 0;
+	context->info.target	      = 0;
+	update_insn_info(context, insn, NULL);
+	update_insn_info(context, insn, NULL);
+	return old->size;
+}
+
+static unsigned int decode_insn(struct disasm_context * context,
+		struct bf_mem_block * mem, bfd_vma vma)
+{
+	struct bf_reuse_map * reuse = context->bf->reuse;
+
+	if(reuse != NULL) {
+		struct bf_insn * old = bf_find_reusable_insn(reuse, mem, vma);
+
+		if(old != NULL) {
+			__atomic_fetch_add(&reuse->stats.reused_insns, 1,
+					__ATOMIC_RELAXED);
+			return reuse_insn(context, old);
+		}
 
-	bf->context.part_counter	= 0;
-	bf->context.part_types_expected = insn_part_mnemonic;
-	return bf->disassembler(vma, &bf->disasm_config);
+		__atomic_fetch_add(&reuse->stats.decoded_insns, 1,
+				__ATOMIC_RELAXED);
+	}
+
+	return disasm_single_insn(context, mem, vma);
 }
 
+/*
+ * Safe without bf->cflow_lock. If several threads add the same function
+ * the first one wins and the others drop their copies.
+ */
 static struct bf_func * add_new_func(struct bin_file * bf,
 		struct bf_basic_blk * bb, bfd_vma vma)
 {
-	if(bf_exists_func(bf, vma)) {
-		return bf_get_func(bf, vma);
-	} else {
-		struct bf_func * func = bf_init_func(bf, bb, vma);
-		bf_add_func(bf, func);
-		return func;
+	struct bf_func * func = bf_get_func(bf, vma);
+
+	if(func == NULL) {
+		struct bf_func * new_func = bf_init_func(bf, bb, vma);
+
+		if((func = bf_add_func(bf, new_func)) != new_func) {
+			bf_close_func(new_func);
+		}
 	}
+
+	return func;
 }
 
 static bfd_vma is_indirect_detour(struct bin_file * bf,
@@ -369,151 +457,207 @@ static bfd_vma is_indirect_detour(struct bin_file * bf,
 	return 0;
 }
 
+/*
+ * Splits the block holding the instruction at vma. The new block takes over
+ * the successors of the old one, which falls through to it. Must be called
+ * with bf->cflow_lock held.
+ */
 static struct bf_basic_blk * split_block(struct bin_file * bf, bfd_vma vma)
 {
-	struct bf_basic_blk * bb     = bf_split_blk(bf,
+	struct bf_basic_blk * bb = bf_split_blk(bf,
 			bf_get_insn(bf, vma)->bb, vma);
-	struct bf_insn *      insn   =
-			bb->insn_vec[vec_size(bb->insn_vec) - 1];
-	int		      size;
-	bfd_vma		      target;
-
-	/*
-	 * Use a dummy instruction as the context to prevent a real one being
-	 * modified.
-	 */
-	bf->context.insn = bf_init_insn(bb, vma);
-	size = disasm_single_insn(bf, insn->vma);
-	bf_close_insn(bf->context.insn);
-
-	/*
-	 * Overriding the default instruction decoder to check for indirect
-	 * branching.
-	 */
-	if(bf->disasm_config.target == 0) {
-		if((bf->disasm_config.target =
-				is_indirect_detour(bf, bb)) != 0) {
-			bf->disasm_config.insn_type = dis_branch;
-		}
-	}
-
-	target = bf->disasm_config.target;
 
 	bf_add_bb(bf, bb);
+	return bb;
+}
 
-	if(bf->disasm_config.insn_type != dis_branch) {
-		bf_add_next_basic_blk(bb, disasm_block(bf, insn->vma + size));
-	}
+/*
+ * Adds bb2 as a successor of bb. Must be called with bf->cflow_lock held.
+ */
+static void link_blocks(struct bin_file * bf, struct bf_basic_blk * bb,
+		struct bf_basic_blk * bb2)
+{
+	bf_add_next_basic_blk(bb, bb2);
+	__atomic_fetch_add(&bf->cfg_generation, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&bf->analysis_dirty, TRUE, __ATOMIC_RELAXED);
+}
 
-	if(target) {
-		bf_add_next_basic_blk(bb, disasm_block(bf, target));
-	}
+/*
+ * Links the block ending with prev to the block starting at vma, which is
+ * created by splitting if vma is inside an existing block. Must be called
+ * with bf->cflow_lock held.
+ */
+static void link_existing(struct bin_file * bf, struct bf_insn * prev,
+		bfd_vma vma)
+{
+	struct bf_basic_blk * bb_next = bf_exists_bb(bf, vma) ?
+			bf_get_bb(bf, vma) : split_block(bf, vma);
 
-	return bb;
+	link_blocks(bf, prev->bb, bb_next);
 }
 
-static struct bf_basic_blk * disasm_block(struct bin_file * bf, bfd_vma vma)
+static struct bf_basic_blk * disasm_block(struct disasm_context * context,
+		bfd_vma vma)
 {
-	struct bf_mem_block * mem = load_section_for_vma(bf, vma);
-	struct bf_basic_blk *    bb;
+	struct bin_file *     bf   = context->bf;
+	struct bf_basic_blk * bb   = bf_get_bb(bf, vma);
+	struct bf_mem_block * mem;
+	struct bf_insn *      prev = NULL;
+	bool		      done = FALSE;
+
+	/*
+	 * Blocks are never removed, so a block found without the lock can be
+	 * returned straight away.
+	 */
+	if(bb != NULL) {
+		return bb;
+	}
+
+	mem = load_section_for_vma(bf, vma);
 
 	if(!mem) {
 		puts("Failed to load section");
 		return NULL;
-	} else {
-		bf->disasm_config.buffer	= mem->buffer;
-		bf->disasm_config.section     	= mem->section;
-		bf->disasm_config.buffer_length	= mem->buffer_length;
-		bf->disasm_config.buffer_vma	= mem->buffer_vma;
 	}
 
+	pthread_mutex_lock(&bf->cflow_lock);
+
 	if(bf_exists_bb(bf, vma)) {
-		return bf_get_bb(bf, vma);
+		bb = bf_get_bb(bf, vma);
+		pthread_mutex_unlock(&bf->cflow_lock);
+		return bb;
 	} else if(bf_exists_insn(bf, vma)) {
-		return split_block(bf, vma);
+		bb = split_block(bf, vma);
+		pthread_mutex_unlock(&bf->cflow_lock);
+		return bb;
 	} else {
 		bb = bf_init_basic_blk(bf, vma);
 		bf_add_bb(bf, bb);
 	}
 
-	bf->disasm_config.insn_type = dis_noninsn;
-
-	while(bf->disasm_config.insn_type != dis_condjsr) {
-		int size;
-
-		if(bf_exists_insn(bf, vma)) {
-			if(!bf_exists_bb(bf, vma)) {
-				printf("The current basic block (0x%lX) is \
-						overlapping to the \
-						instruction at 0x%lX \
-						which has already been \
-						disassembled but is not \
-						the start of an existing \
-						basic block", bb->vma, vma);
-			} else {
-				struct bf_basic_blk * bb_next =
-						bf_get_bb(bf, vma);
-				bf_add_next_basic_blk(bb, bb_next);
-				return bb;
-			}
-		}
+	pthread_mutex_unlock(&bf->cflow_lock);
 
-		bf->context.insn = bf_init_insn(bb, vma);
-		bf_add_insn(bf, bf->context.insn);
-		bf_add_insn_to_bb(bb, bf->context.insn);
+	while(!done) {
+		struct bf_insn *   insn = bf_init_insn(bb, vma);
+		enum dis_insn_type insn_type;
+		bfd_vma		   branch_vma;
+		int		   size;
 
-		bf->context.insn->size = size = disasm_single_insn(bf, vma);
+		/*
+		 * The instruction is decoded privately and only published
+		 * once complete.
+		 */
+		context->insn = insn;
+		insn->size    = size = decode_insn(context, mem, vma);
 
 		if(size == -1 || size == 0) {
 			puts("Something went wrong");
+			bf_close_insn(insn);
 			return NULL;
 		}
 
 		// printf("Disassembled %d bytes at 0x%lX\n\n", size, vma);
 
-		if(bf->disasm_config.insn_type == dis_condbranch ||
-				bf->disasm_config.insn_type == dis_jsr ||
-				bf->disasm_config.insn_type == dis_branch) {
-			enum dis_insn_type insn_type   =
-					bf->disasm_config.insn_type;
-			bfd_vma		   branch_vma  =
-					bf->disasm_config.target;
+		insn_type  = context->info.insn_type;
+		branch_vma = context->info.target;
 
+		pthread_mutex_lock(&bf->cflow_lock);
+
+		/*
+		 * Another thread, or a recursive call, may have reached vma
+		 * while the instruction was being decoded.
+		 */
+		if(prev != NULL && (bf_exists_bb(bf, vma) ||
+				bf_exists_insn(bf, vma))) {
+			link_existing(bf, prev, vma);
+			pthread_mutex_unlock(&bf->cflow_lock);
+			bf_close_insn(insn);
+			return bb;
+		}
+
+		/*
+		 * prev->bb rather than bb, since a recursive call may have
+		 * split the block being built.
+		 */
+		insn->bb = prev != NULL ? prev->bb : bb;
+		bf_add_insn(bf, insn);
+		bf_add_insn_to_bb(insn->bb, insn);
+		prev = insn;
+
+		if(bf->xref_index != NULL) {
+			bf_add_insn_xrefs(bf->xref_index, insn);
+		}
+
+		if(bf->insn_index != NULL) {
+			bf_index_insn(bf->insn_index, insn);
+		}
+
+		pthread_mutex_unlock(&bf->cflow_lock);
+
+		if(insn_type == dis_condbranch || insn_type == dis_jsr ||
+				insn_type == dis_branch) {
 			if(insn_type != dis_branch) {
 				struct bf_basic_blk * bb_next =
-						disasm_block(bf,
+						disasm_block(context,
 						vma + size);
-				bf_add_next_basic_blk(bb, bb_next);
+
+				if(bb_next != NULL) {
+					pthread_mutex_lock(&bf->cflow_lock);
+					link_blocks(bf, insn->bb, bb_next);
+					pthread_mutex_unlock(
+							&bf->cflow_lock);
+				}
 			}
 
 			if(branch_vma != 0) {
 				struct bf_basic_blk * bb_branch =
-						disasm_block(bf,
+						disasm_block(context,
 						branch_vma);
-				bf_add_next_basic_blk(bb, bb_branch);
-
-				if(insn_type == dis_jsr) {
-					/*
-					 * Putting the intialisation of bf_func
-					 * here means that we will never detect
-					 * the first basic block as a function,
-					 * only subsequent call targets.
-					 */
-					add_new_func(bf, bb_branch, branch_vma);
+
+				if(bb_branch != NULL) {
+					pthread_mutex_lock(&bf->cflow_lock);
+					link_blocks(bf, insn->bb, bb_branch);
+					pthread_mutex_unlock(
+							&bf->cflow_lock);
+
+					if(insn_type == dis_jsr) {
+						/*
+						 * Putting the intialisation
+						 * of bf_func here means that
+						 * we will never detect the
+						 * first basic block as a
+						 * function, only subsequent
+						 * call targets.
+						 */
+						add_new_func(bf, bb_branch,
+								branch_vma);
+					}
 				}
 			}
 
-			bf->disasm_config.insn_type = dis_condjsr;
+			done = TRUE;
+		} else if(insn_type == dis_condjsr) {
+			done = TRUE;
 		}
 
 		vma += size;
 	}
 
 	bfd_vma detour_target;
-	if((detour_target = is_indirect_detour(bf, bb)) != 0) {
+
+	pthread_mutex_lock(&bf->cflow_lock);
+	detour_target = is_indirect_detour(bf, prev->bb);
+	pthread_mutex_unlock(&bf->cflow_lock);
+
+	if(detour_target != 0) {
 		struct bf_basic_blk * bb_detour =
-				disasm_block(bf, detour_target);
-		bf_add_next_basic_blk(bb, bb_detour);
+				disasm_block(context, detour_target);
+
+		if(bb_detour != NULL) {
+			pthread_mutex_lock(&bf->cflow_lock);
+			link_blocks(bf, prev->bb, bb_detour);
+			pthread_mutex_unlock(&bf->cflow_lock);
+		}
 	}
 
 	return bb;
@@ -522,9 +666,13 @@ static struct bf_basic_blk * disasm_block(struct bin_file * bf, bfd_vma vma)
 struct bf_basic_blk * disasm_generate_cflow(struct bin_file * bf,
 		bfd_vma vma, bool is_function)
 {
-	struct bf_basic_blk * bb = disasm_block(bf, vma);
+	struct disasm_context context;
+	struct bf_basic_blk * bb;
+
+	init_disasm_context(&context, bf);
+	bb = disasm_block(&context, vma);
 
-	if(is_function) {
+	if(is_function && bb != NULL) {
 		add_new_func(bf, bb, vma);
 	}
 
@@ -0,0 +1,203 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "extent.h"
+
+#include <stdlib.h>
+#include <libiberty.h>
+
+void bf_init_extent_index(struct bf_extent_index * index)
+{
+	index->starts	= NULL;
+	index->extents	= NULL;
+	index->parents	= NULL;
+	index->count	= 0;
+	index->capacity = 0;
+}
+
+void bf_add_extent(struct bf_extent_index * index, bfd_vma start,
+		bfd_vma end, void * obj)
+{
+	if(index->count == index->capacity) {
+		index->capacity = index->capacity ? index->capacity * 2 : 64;
+		index->extents	= xrealloc(index->extents,
+				index->capacity * sizeof(struct bf_extent));
+	}
+
+	index->extents[index->count].start = start;
+	index->extents[index->count].end   = end;
+	index->extents[index->count].obj   = obj;
+	index->count++;
+}
+
+/*
+ * Extents starting at the same VMA are ordered longest first, so that an
+ * enclosing extent always comes before the extents nested in it.
+ */
+static int cmp_extent(const void * elem1, const void * elem2)
+{
+	const struct bf_extent * e1 = elem1;
+	const struct bf_extent * e2 = elem2;
+
+	if(e1->start != e2->start) {
+		return e1->start < e2->start ? -1 : 1;
+	} else if(e1->end != e2->end) {
+		return e1->end > e2->end ? -1 : 1;
+	} else {
+		return 0;
+	}
+}
+
+static void add_code_section(bfd * abfd, asection * s, void * param)
+{
+	struct bf_extent_index * sections = param;
+
+	if(bfd_get_section_flags(abfd, s) & SEC_CODE) {
+		bf_add_extent(sections, bfd_get_section_vma(abfd, s),
+				bfd_get_section_vma(abfd, s) +
+				bfd_section_size(abfd, s), s);
+	}
+}
+
+void bf_add_code_sections(struct bf_extent_index * index, bfd * abfd)
+{
+	bfd_map_over_sections(abfd, add_code_section, index);
+	bf_sort_extent_index(index);
+}
+
+void bf_sort_extent_index(struct bf_extent_index * index)
+{
+	qsort(index->extents, index->count, sizeof(struct bf_extent),
+			cmp_extent);
+
+	free(index->starts);
+	index->starts = xmalloc((index->count + 1) * sizeof(bfd_vma));
+
+	free(index->parents);
+	index->parents = xmalloc((index->count + 1) * sizeof(long));
+
+	for(size_t i = 0; i < index->count; i++) {
+		long parent = (long)i - 1;
+
+		/*
+		 * The preceding extents which still contain the start of this
+		 * one form a chain through parents. Those which end before it
+		 * are skipped for good, so building the chains is linear.
+		 */
+		while(parent >= 0 && index->extents[parent].end <=
+				index->extents[i].start) {
+			parent = index->parents[parent];
+		}
+
+		index->starts[i]  = index->extents[i].start;
+		index->parents[i] = parent;
+	}
+}
+
+/*
+ * Falls back from the last extent starting at or before vma to the
+ * innermost extent enclosing it which still contains vma.
+ */
+static long enclosing_extent(struct bf_extent_index * index, long pos,
+		bfd_vma vma)
+{
+	while(pos >= 0 && vma >= index->extents[pos].end) {
+		pos = index->parents[pos];
+	}
+
+	return pos;
+}
+
+long bf_lower_extent(struct bf_extent_index * index, bfd_vma vma)
+{
+	const bfd_vma * base = index->starts;
+	size_t		n    = index->count;
+
+	if(n == 0) {
+		return -1;
+	}
+
+	/*
+	 * Branchless lower bound. The conditional is compiled to a cmov so
+	 * the loop runs a fixed number of iterations without mispredicts.
+	 */
+	while(n > 1) {
+		size_t half = n / 2;
+		base	    = (base[half] <= vma) ? base + half : base;
+		n	   -= half;
+	}
+
+	return (*base <= vma) ? base - index->starts : -1;
+}
+
+struct bf_extent * bf_find_extent(struct bf_extent_index * index,
+		bfd_vma vma)
+{
+	long pos = enclosing_extent(index, bf_lower_extent(index, vma), vma);
+
+	if(pos < 0) {
+		return NULL;
+	}
+
+	return &index->extents[pos];
+}
+
+size_t bf_find_extents(struct bf_extent_index * index,
+		const bfd_vma * vmas, size_t count, long * positions)
+{
+	size_t found  = 0;
+	bool   sorted = TRUE;
+
+	for(size_t i = 1; i < count && sorted; i++) {
+		sorted = vmas[i - 1] <= vmas[i];
+	}
+
+	if(sorted && count > 0) {
+		/*
+		 * Sorted input (e.g. pre-sorted samples) is resolved by a
+		 * single merge walk over the extents.
+		 */
+		long pos = bf_lower_extent(index, vmas[0]);
+
+		for(size_t i = 0; i < count; i++) {
+			while(pos + 1 < (long)index->count &&
+					index->starts[pos + 1] <= vmas[i]) {
+				pos++;
+			}
+
+			positions[i] = enclosing_extent(index, pos, vmas[i]);
+			found	    += positions[i] >= 0;
+		}
+	} else {
+		for(size_t i = 0; i < count; i++) {
+			long pos = bf_lower_extent(index, vmas[i]);
+
+			positions[i] = enclosing_extent(index, pos, vmas[i]);
+			found	    += positions[i] >= 0;
+		}
+	}
+
+	return found;
+}
+
+void bf_close_extent_index(struct bf_extent_index * index)
+{
+	free(index->starts);
+	free(index->extents);
+	free(index->parents);
+	bf_init_extent_index(index);
+}
@@ -0,0 +1,239 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flow_graph.h"
+
+#include <libiberty.h>
+
+#include "insn.h"
+
+uint32_t bf_get_flow_graph_id(struct bf_flow_graph * graph,
+		struct bf_basic_blk * bb)
+{
+	if(bb == NULL || bb->entry.id >= graph->num_blocks ||
+			graph->blocks[bb->entry.id] != bb) {
+		return BF_NO_BLOCK;
+	}
+
+	return bb->entry.id;
+}
+
+/*
+ * Infers the kind of an edge from the last instruction of its source. A call
+ * block holds the return site in target and the callee in target2, a
+ * conditional branch holds the next block in target and the branch target in
+ * target2.
+ */
+static enum bf_edge_kind get_edge_kind(struct bf_basic_blk * bb,
+		struct bf_basic_blk * succ, int slot)
+{
+	unsigned int	 length = bf_get_bb_length(bb);
+	struct bf_insn * last	= length ? bf_get_bb_insn(bb, length - 1) :
+			NULL;
+	bool		 next;
+
+	if(last == NULL) {
+		return BF_EDGE_FALLTHROUGH;
+	}
+
+	next = succ->vma == last->vma + last->size;
+
+	if(calls_subroutine(last->mnemonic)) {
+		return slot == 0 && next ? BF_EDGE_FALLTHROUGH : BF_EDGE_CALL;
+	} else if(breaks_flow(last->mnemonic) || ends_flow(last->mnemonic)) {
+		return BF_EDGE_BRANCH;
+	}
+
+	return slot == 0 && next ? BF_EDGE_FALLTHROUGH : BF_EDGE_BRANCH;
+}
+
+static void build_edges(struct bf_flow_graph * graph)
+{
+	uint32_t   n	     = graph->num_blocks;
+	uint32_t   num_edges = 0;
+	uint32_t * fill;
+
+	graph->succ_offsets = xrealloc(graph->succ_offsets, (n + 1) *
+			sizeof(uint32_t));
+	graph->pred_offsets = xrealloc(graph->pred_offsets, (n + 1) *
+			sizeof(uint32_t));
+	memset(graph->pred_offsets, 0, (n + 1) * sizeof(uint32_t));
+
+	for(uint32_t id = 0; id < n; id++) {
+		struct bf_basic_blk * bb = graph->blocks[id];
+
+		graph->succ_offsets[id] = num_edges;
+
+		if(bb != NULL) {
+			num_edges += (bb->target != NULL) +
+					(bb->target2 != NULL);
+		}
+	}
+
+	graph->succ_offsets[n] = num_edges;
+	graph->num_edges       = num_edges;
+	graph->succs	       = xrealloc(graph->succs, (num_edges + 1) *
+			sizeof(uint32_t));
+	graph->succ_kinds      = xrealloc(graph->succ_kinds, num_edges + 1);
+	graph->preds	       = xrealloc(graph->preds, (num_edges + 1) *
+			sizeof(uint32_t));
+	graph->pred_kinds      = xrealloc(graph->pred_kinds, num_edges + 1);
+
+	for(uint32_t id = 0; id < n; id++) {
+		struct bf_basic_blk * bb      = graph->blocks[id];
+		struct bf_basic_blk * succ[2] = {bb ? bb->target : NULL,
+				bb ? bb->target2 : NULL};
+		uint32_t	      edge    = graph->succ_offsets[id];
+
+		for(int slot = 0; slot < 2; slot++) {
+			uint32_t succ_id;
+
+			if(succ[slot] == NULL) {
+				continue;
+			}
+
+			/*
+			 * Every block reachable from a discovered block has
+			 * been discovered too.
+			 */
+			succ_id			= succ[slot]->entry.id;
+			graph->succs[edge]	= succ_id;
+			graph->succ_kinds[edge] = get_edge_kind(bb, succ[slot],
+					slot);
+			graph->pred_offsets[succ_id + 1]++;
+			edge++;
+		}
+	}
+
+	for(uint32_t id = 0; id < n; id++) {
+		graph->pred_offsets[id + 1] += graph->pred_offsets[id];
+	}
+
+	fill = xmalloc((n + 1) * sizeof(uint32_t));
+	memcpy(fill, graph->pred_offsets, (n + 1) * sizeof(uint32_t));
+
+	/*
+	 * Filling in id order leaves the predecessors of every block sorted by
+	 * id.
+	 */
+	for(uint32_t id = 0; id < n; id++) {
+		uint32_t edge;
+
+		bf_for_each_succ_edge(edge, graph, id) {
+			uint32_t pos = fill[graph->succs[edge]]++;
+
+			graph->preds[pos]      = id;
+			graph->pred_kinds[pos] = graph->succ_kinds[edge];
+		}
+	}
+
+	free(fill);
+}
+
+/*
+ * Adds the blocks discovered since the last update and rebuilds the edges.
+ * New blocks have higher ids than the ones already in the graph.
+ */
+static void sync_graph(struct bf_flow_graph * graph)
+{
+	uint32_t n;
+
+	graph->generation = __atomic_load_n(&graph->bf->cfg_generation,
+			__ATOMIC_RELAXED);
+	n		  = bf_get_num_basic_blks(graph->bf);
+	graph->blocks	  = xrealloc(graph->blocks, (n + 1) *
+			sizeof(struct bf_basic_blk *));
+
+	for(uint32_t id = graph->num_blocks; id < n; id++) {
+		graph->blocks[id] = bf_get_bb_by_id(graph->bf, id);
+	}
+
+	graph->num_blocks = n;
+	build_edges(graph);
+}
+
+struct bf_flow_graph * bf_init_flow_graph(struct bin_file * bf)
+{
+	struct bf_flow_graph * graph = xcalloc(1,
+			sizeof(struct bf_flow_graph));
+
+	graph->bf = bf;
+	sync_graph(graph);
+	return graph;
+}
+
+bool bf_update_flow_graph(struct bf_flow_graph * graph)
+{
+	if(__atomic_load_n(&graph->bf->cfg_generation, __ATOMIC_RELAXED) ==
+			graph->generation) {
+		return FALSE;
+	}
+
+	sync_graph(graph);
+	return TRUE;
+}
+
+struct COLLECT_IDS {
+	struct bf_flow_graph * graph;
+	uint32_t *	       ids;
+	uint32_t	       count;
+	uint32_t	       capacity;
+};
+
+static void collect_id(struct bin_file * bf, struct bf_basic_blk * bb,
+		void * param)
+{
+	struct COLLECT_IDS * collect = param;
+	uint32_t	     id	     = bf_get_flow_graph_id(collect->graph,
+			bb);
+
+	if(id == BF_NO_BLOCK) {
+		return;
+	}
+
+	if(collect->count == collect->capacity) {
+		collect->capacity = collect->capacity ? collect->capacity * 2 :
+				16;
+		collect->ids	  = xrealloc(collect->ids, collect->capacity *
+				sizeof(uint32_t));
+	}
+
+	collect->ids[collect->count++] = id;
+}
+
+uint32_t * bf_collect_func_block_ids(struct bf_flow_graph * graph,
+		struct bf_func * func, uint32_t * count)
+{
+	struct COLLECT_IDS collect = {graph, NULL, 0, 0};
+
+	bf_enum_func_basic_blk(graph->bf, func, collect_id, &collect);
+
+	*count = collect.count;
+	return collect.ids;
+}
+
+void bf_close_flow_graph(struct bf_flow_graph * graph)
+{
+	free(graph->blocks);
+	free(graph->succ_offsets);
+	free(graph->succs);
+	free(graph->succ_kinds);
+	free(graph->pred_offsets);
+	free(graph->preds);
+	free(graph->pred_kinds);
+	free(graph);
+}
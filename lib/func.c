@@ -17,78 +17,109 @@
 
 #include "func.h"
 
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "basic_blk.h"
+#include "insn.h"
+#include "func_flow.h"
+
 struct bf_func * bf_init_func(struct bin_file * bf,
 		struct bf_basic_blk * bb, bfd_vma vma)
 {
 	struct bf_func * func = xmalloc(sizeof(struct bf_func));
 	func->bb	      = bb;
 	func->vma	      = vma;
-	func->sym	      = rb_search_symbol(&bf->sym_table, (void *)vma);
+	func->sym	      = NULL;
+	func->sym_resolved    = FALSE;
+
+	func->fingerprint	     = 0;
+	func->fingerprint_generation = 0;
+	func->flow		     = NULL;
 	return func;
 }
 
 void bf_close_func(struct bf_func * func)
 {
 	if(func != NULL) {
+		bf_close_func_flow(func->flow);
 		free(func);
 	}
 }
 
-void bf_add_func(struct bin_file * bf, struct bf_func * func)
+struct bf_func * bf_add_func(struct bin_file * bf, struct bf_func * func)
 {
-	assert(!bf_exists_func(bf, func->vma));
+	struct bf_addr_node * node = bf_addr_map_insert(&bf->func_table,
+			&func->entry, func->vma);
+
+	if(node == &func->entry) {
+		__atomic_store_n(&bf->analysis_dirty, TRUE, __ATOMIC_RELAXED);
+	}
 
-	htable_add(&bf->func_table, &func->entry, &func->vma,
-			sizeof(func->vma));
+	return bf_addr_map_entry(node, struct bf_func, entry);
 }
 
 struct bf_func * bf_get_func(struct bin_file * bf, bfd_vma vma)
 {
-	return hash_find_entry(&bf->func_table, &vma, sizeof(vma),
-			struct bf_func, entry);
-}
+	struct bf_addr_node * node = bf_addr_map_find(&bf->func_table, vma);
 
-struct BF_FUNC_INFO {
-	struct bf_func * func;
-	char *		 name;
-};
+	return node ? bf_addr_map_entry(node, struct bf_func, entry) : NULL;
+}
 
-static void func_from_name(struct bin_file * bf, struct bf_func * func,
-		void * param)
+/*
+ * Resolved the same way as bf_get_bb_sym().
+ */
+struct symbol * bf_get_func_sym(struct bin_file * bf, struct bf_func * func)
 {
-	struct BF_FUNC_INFO * info = param;
-
-	if(func->sym != NULL) {
-		if(strcmp(func->sym->name, info->name) == 0) {
-			info->func = func;
-		}
+	if(!__atomic_load_n(&func->sym_resolved, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&func->sym, rb_search_symbol(&bf->sym_table,
+				(void *)func->vma), __ATOMIC_RELAXED);
+		__atomic_store_n(&func->sym_resolved, TRUE, __ATOMIC_RELEASE);
 	}
+
+	return __atomic_load_n(&func->sym, __ATOMIC_RELAXED);
 }
 
 struct bf_func * bf_get_func_from_name(struct bin_file * bf, char * name)
 {
-	struct BF_FUNC_INFO info;
-	info.name = name;
-	info.func = NULL;
+	struct symbol * sym = symbol_find(&bf->sym_table, name);
 
-	bf_enum_func(bf, func_from_name, &info);
-	return info.func;
+	if(sym == NULL) {
+		sym = symbol_find_demangled(&bf->sym_table, name);
+	}
+
+	if(sym == NULL || sym->address == 0) {
+		return NULL;
+	}
+
+	return bf_get_func(bf, sym->address);
 }
 
 bool bf_exists_func(struct bin_file * bf, bfd_vma vma)
 {
-	return htable_find(&bf->func_table, &vma, sizeof(vma));
+	return bf_addr_map_find(&bf->func_table, vma) != NULL;
+}
+
+struct bf_func * bf_get_func_by_id(struct bin_file * bf, uint32_t id)
+{
+	struct bf_addr_node * node = bf_addr_map_get(&bf->func_table, id);
+
+	return node ? bf_addr_map_entry(node, struct bf_func, entry) : NULL;
+}
+
+uint32_t bf_get_num_funcs(struct bin_file * bf)
+{
+	return __atomic_load_n(&bf->func_table.num_ids, __ATOMIC_RELAXED);
 }
 
 void bf_close_func_table(struct bin_file * bf)
 {
-	struct htable_entry * cur_entry;
-	struct htable_entry * n;
+	struct bf_addr_node * cur_entry;
+	struct bf_addr_node * n;
 	struct bf_func *      func;
 
-	htable_for_each_entry_safe(func, cur_entry, n, &bf->func_table,
+	bf_addr_map_for_each_entry_safe(func, cur_entry, n, &bf->func_table,
 			entry) {
-		htable_del_entry(&bf->func_table, cur_entry);
 		bf_close_func(func);
 	}
 }
@@ -97,10 +128,347 @@ void bf_enum_func(struct bin_file * bf,
 		void (*handler)(struct bin_file *, struct bf_func *,
 		void *), void * param)
 {
-	struct htable_entry * cur_entry;
+	struct bf_addr_node * cur_entry;
 	struct bf_func *      func;
 
-	htable_for_each_entry(func, cur_entry, &bf->func_table, entry) {
+	bf_addr_map_for_each_entry(func, cur_entry, &bf->func_table, entry) {
 		handler(bf, func, param);
 	}
 }
+
+/*
+ * Edge codes hashed for successors which are not blocks of the function.
+ */
+#define FP_EDGE_NONE	 0
+#define FP_EDGE_CALL	 1
+#define FP_EDGE_EXTERNAL 2
+#define FP_EDGE_FIRST	 3
+
+/*
+ * The blocks of a bf_func in depth first order. The open addressing set maps
+ * each block to its position in the order.
+ */
+struct FUNC_WALK {
+	struct bin_file *      bf;
+	struct bf_func *       func;
+	struct bf_basic_blk ** order;
+	size_t		       count;
+	struct bf_basic_blk ** slots;
+	size_t *	       positions;
+	size_t		       num_slots;
+};
+
+static size_t hash_bb(struct FUNC_WALK * walk, struct bf_basic_blk * bb)
+{
+	return ((uintptr_t)bb >> 4) * 0x9E3779B97F4A7C15ULL &
+			(walk->num_slots - 1);
+}
+
+static long find_walk_pos(struct FUNC_WALK * walk, struct bf_basic_blk * bb)
+{
+	for(size_t i = hash_bb(walk, bb); walk->slots[i] != NULL;
+			i = (i + 1) & (walk->num_slots - 1)) {
+		if(walk->slots[i] == bb) {
+			return walk->positions[i];
+		}
+	}
+
+	return -1;
+}
+
+static void insert_walk_slot(struct FUNC_WALK * walk,
+		struct bf_basic_blk * bb, size_t pos)
+{
+	size_t i = hash_bb(walk, bb);
+
+	while(walk->slots[i] != NULL) {
+		i = (i + 1) & (walk->num_slots - 1);
+	}
+
+	walk->slots[i]	   = bb;
+	walk->positions[i] = pos;
+}
+
+static void add_walk_bb(struct FUNC_WALK * walk, struct bf_basic_blk * bb)
+{
+	/*
+	 * Keep the set at most half full. The order array grows along with it.
+	 */
+	if((walk->count + 1) * 2 > walk->num_slots) {
+		size_t num_slots = walk->num_slots ? walk->num_slots * 2 : 64;
+
+		free(walk->slots);
+		free(walk->positions);
+		walk->num_slots = num_slots;
+		walk->slots	= xcalloc(num_slots,
+				sizeof(struct bf_basic_blk *));
+		walk->positions = xmalloc(num_slots * sizeof(size_t));
+		walk->order	= xrealloc(walk->order, num_slots / 2 *
+				sizeof(struct bf_basic_blk *));
+
+		for(size_t i = 0; i < walk->count; i++) {
+			insert_walk_slot(walk, walk->order[i], i);
+		}
+	}
+
+	insert_walk_slot(walk, bb, walk->count);
+	walk->order[walk->count++] = bb;
+}
+
+/*
+ * Classifies the successors of a block. A successor is a block of the
+ * function unless it is reached through a call or is the start of another
+ * bf_func.
+ */
+static void get_walk_succs(struct FUNC_WALK * walk, struct bf_basic_blk * bb,
+		struct bf_basic_blk * succs[2], int codes[2])
+{
+	unsigned int	 length = bf_get_bb_length(bb);
+	struct bf_insn * last	= length ? bf_get_bb_insn(bb, length - 1) :
+			NULL;
+
+	succs[0] = bb->target;
+	succs[1] = bb->target2;
+
+	for(int i = 0; i < 2; i++) {
+		codes[i] = FP_EDGE_FIRST;
+
+		if(succs[i] == NULL) {
+			codes[i] = FP_EDGE_NONE;
+		} else if(i == 1 && last != NULL &&
+				calls_subroutine(last->mnemonic)) {
+			codes[i] = FP_EDGE_CALL;
+		} else if(succs[i] != walk->func->bb &&
+				bf_exists_func(walk->bf, succs[i]->vma)) {
+			codes[i] = FP_EDGE_EXTERNAL;
+		}
+
+		if(codes[i] != FP_EDGE_FIRST) {
+			succs[i] = NULL;
+		}
+	}
+}
+
+static void init_func_walk(struct FUNC_WALK * walk, struct bin_file * bf,
+		struct bf_func * func)
+{
+	struct bf_basic_blk ** stack;
+	size_t		       depth	= 0;
+	size_t		       capacity = 64;
+
+	walk->bf	= bf;
+	walk->func	= func;
+	walk->order	= NULL;
+	walk->count	= 0;
+	walk->slots	= NULL;
+	walk->positions = NULL;
+	walk->num_slots = 0;
+
+	if(func->bb == NULL) {
+		return;
+	}
+
+	stack	   = xmalloc(capacity * sizeof(struct bf_basic_blk *));
+	stack[depth++] = func->bb;
+
+	while(depth > 0) {
+		struct bf_basic_blk * bb = stack[--depth];
+		struct bf_basic_blk * succs[2];
+		int		      codes[2];
+
+		if(walk->count > 0 && find_walk_pos(walk, bb) >= 0) {
+			continue;
+		}
+
+		add_walk_bb(walk, bb);
+		get_walk_succs(walk, bb, succs, codes);
+
+		if(depth + 2 > capacity) {
+			capacity *= 2;
+			stack	  = xrealloc(stack, capacity *
+					sizeof(struct bf_basic_blk *));
+		}
+
+		/*
+		 * target2 is pushed first so that target is visited first.
+		 */
+		for(int i = 1; i >= 0; i--) {
+			if(succs[i] != NULL) {
+				stack[depth++] = succs[i];
+			}
+		}
+	}
+
+	free(stack);
+}
+
+static void close_func_walk(struct FUNC_WALK * walk)
+{
+	free(walk->order);
+	free(walk->slots);
+	free(walk->positions);
+}
+
+void bf_enum_func_basic_blk(struct bin_file * bf, struct bf_func * func,
+		void (*handler)(struct bin_file *, struct bf_basic_blk *,
+		void *), void * param)
+{
+	struct FUNC_WALK walk;
+
+	init_func_walk(&walk, bf, func);
+
+	for(size_t i = 0; i < walk.count; i++) {
+		handler(bf, walk.order[i], param);
+	}
+
+	close_func_walk(&walk);
+}
+
+/*
+ * The range of VMAs covered by the allocated sections of a bin_file.
+ */
+struct FP_RANGE {
+	bfd_vma start;
+	bfd_vma end;
+};
+
+static void add_fp_range(bfd * abfd, asection * s, void * param)
+{
+	struct FP_RANGE * range = param;
+	bfd_vma		  start = bfd_get_section_vma(abfd, s);
+	bfd_vma		  end	= start + bfd_section_size(abfd, s);
+
+	if((bfd_get_section_flags(abfd, s) & SEC_ALLOC) && start != end) {
+		range->start = start < range->start ? start : range->start;
+		range->end   = end > range->end ? end : range->end;
+	}
+}
+
+static inline uint64_t fp_mix(uint64_t h, uint64_t v)
+{
+	h ^= v;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 32);
+}
+
+static inline bool fp_is_addr(struct FP_RANGE * range, uint64_t v)
+{
+	return v >= range->start && v < range->end;
+}
+
+static uint64_t fp_mix_operand(uint64_t h, struct insn_operand * op,
+		struct FP_RANGE * range)
+{
+	struct array_index * arr;
+
+	h = fp_mix(h, op->tag);
+
+	switch(op->tag) {
+	case OP_IMM:
+		if(!fp_is_addr(range, op->operand_info.imm)) {
+			h = fp_mix(h, op->operand_info.imm);
+		}
+		break;
+	case OP_REG:
+		h = fp_mix(h, op->operand_info.reg);
+		break;
+	case OP_REG_PTR:
+		h = fp_mix(h, op->operand_info.reg_ptr);
+		break;
+	case OP_INDEX:
+	case OP_INDEX_PTR:
+		arr = op->tag == OP_INDEX ? &op->operand_info.arr_index :
+				&op->operand_info.arr_index_ptr;
+		h   = fp_mix(h, arr->tag);
+
+		if(arr->tag == ARR_BASE_REG) {
+			h = fp_mix(h, arr->arr_info.base_reg);
+		} else {
+			h = fp_mix(h, arr->arr_info.parts.base_address);
+			h = fp_mix(h, arr->arr_info.parts.counter);
+			h = fp_mix(h, arr->arr_info.parts.array_member_size);
+		}
+
+		/*
+		 * RIP-relative displacements change whenever the code moves.
+		 */
+		if(arr->is_offset_valid && !fp_is_addr(range, arr->offset) &&
+				!(arr->tag == ARR_BASE_REG &&
+				(arr->arr_info.base_reg == rip_reg ||
+				arr->arr_info.base_reg == rip_paren_reg))) {
+			h = fp_mix(h, arr->offset);
+			h = fp_mix(h, arr->is_offset_negative);
+		}
+		break;
+	case OP_INDEX_INTO_ES:
+		h = fp_mix(h, op->operand_info.index_into_es);
+		break;
+	case OP_INDEX_INTO_DS:
+		h = fp_mix(h, op->operand_info.index_into_ds);
+		break;
+	default:
+		/*
+		 * Branch targets, absolute addresses and segment offsets.
+		 */
+		break;
+	}
+
+	return h;
+}
+
+uint64_t bf_get_func_fingerprint(struct bin_file * bf, struct bf_func * func)
+{
+	struct FUNC_WALK walk;
+	struct FP_RANGE	 range	    = {(bfd_vma)-1, 0};
+	uint64_t	 h	    = 0xCBF29CE484222325ULL;
+	unsigned long	 generation = __atomic_load_n(&bf->cfg_generation,
+			__ATOMIC_RELAXED) + 1;
+
+	if(__atomic_load_n(&func->fingerprint_generation, __ATOMIC_ACQUIRE) ==
+			generation) {
+		return func->fingerprint;
+	}
+
+	bfd_map_over_sections(bf->abfd, add_fp_range, &range);
+	init_func_walk(&walk, bf, func);
+	h = fp_mix(h, walk.count);
+
+	for(size_t i = 0; i < walk.count; i++) {
+		struct bf_basic_blk * bb     = walk.order[i];
+		unsigned int	      length = bf_get_bb_length(bb);
+		struct bf_basic_blk * succs[2];
+		int		      codes[2];
+
+		h = fp_mix(h, length);
+
+		for(unsigned int j = 0; j < length; j++) {
+			struct bf_insn * insn = bf_get_bb_insn(bb, j);
+
+			h = fp_mix(h, insn->is_data);
+			h = fp_mix(h, insn->mnemonic);
+			h = fp_mix(h, insn->secondary_mnemonic);
+			h = fp_mix_operand(h, &insn->operand1, &range);
+			h = fp_mix_operand(h, &insn->operand2, &range);
+			h = fp_mix_operand(h, &insn->operand3, &range);
+		}
+
+		get_walk_succs(&walk, bb, succs, codes);
+
+		for(int k = 0; k < 2; k++) {
+			h = fp_mix(h, succs[k] != NULL ? FP_EDGE_FIRST +
+					find_walk_pos(&walk, succs[k]) :
+					codes[k]);
+		}
+	}
+
+	close_func_walk(&walk);
+
+	/*
+	 * Racing threads compute the same value, so whichever store lands
+	 * last is fine.
+	 */
+	func->fingerprint = h;
+	__atomic_store_n(&func->fingerprint_generation, generation,
+			__ATOMIC_RELEASE);
+	return h;
+}
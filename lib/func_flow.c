@@ -0,0 +1,589 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "func_flow.h"
+
+#include <libiberty.h>
+
+#include "insn.h"
+#include "parallel.h"
+
+/*
+ * Marks the immediate dominator of a block which has not been reached yet.
+ */
+#define UNDEFINED (BF_NO_BLOCK - 1)
+
+static int cmp_lookup(const void * a, const void * b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+uint32_t bf_get_func_flow_index(struct bf_func_flow * flow,
+		struct bf_basic_blk * bb)
+{
+	size_t lo = 0;
+	size_t hi = flow->num_blocks;
+
+	if(bb == NULL) {
+		return BF_NO_BLOCK;
+	}
+
+	while(lo < hi) {
+		size_t	 mid = lo + (hi - lo) / 2;
+		uint32_t id  = flow->lookup[mid] >> 32;
+
+		if(id < bb->entry.id) {
+			lo = mid + 1;
+		} else if(id > bb->entry.id) {
+			hi = mid;
+		} else {
+			return (uint32_t)flow->lookup[mid];
+		}
+	}
+
+	return BF_NO_BLOCK;
+}
+
+struct COLLECT_BLOCKS {
+	struct bf_func_flow * flow;
+	uint32_t	      capacity;
+};
+
+static void collect_block(struct bin_file * bf, struct bf_basic_blk * bb,
+		void * param)
+{
+	struct COLLECT_BLOCKS * collect = param;
+	struct bf_func_flow *	flow	= collect->flow;
+
+	if(flow->num_blocks == collect->capacity) {
+		collect->capacity = collect->capacity ? collect->capacity * 2 :
+				16;
+		flow->blocks	  = xrealloc(flow->blocks, collect->capacity *
+				sizeof(struct bf_basic_blk *));
+	}
+
+	flow->blocks[flow->num_blocks++] = bb;
+}
+
+/*
+ * Gets the successors of a block within the function. The callee of a call
+ * is not one, and neither is any block bf_enum_func_basic_blk() did not
+ * visit.
+ */
+static int get_succs(struct bf_func_flow * flow, uint32_t index,
+		uint32_t succs[2])
+{
+	struct bf_basic_blk * bb     = flow->blocks[index];
+	unsigned int	      length = bf_get_bb_length(bb);
+	struct bf_insn *      last   = length ? bf_get_bb_insn(bb, length - 1) :
+			NULL;
+	int		      count  = 0;
+
+	if(bb->target != NULL) {
+		succs[count] = bf_get_func_flow_index(flow, bb->target);
+		count	    += succs[count] != BF_NO_BLOCK;
+	}
+
+	if(bb->target2 != NULL && (last == NULL ||
+			!calls_subroutine(last->mnemonic))) {
+		succs[count] = bf_get_func_flow_index(flow, bb->target2);
+		count	    += succs[count] != BF_NO_BLOCK;
+	}
+
+	return count;
+}
+
+static void build_edges(struct bf_func_flow * flow)
+{
+	uint32_t   n	     = flow->num_blocks;
+	uint32_t   num_edges = 0;
+	uint32_t * fill;
+
+	flow->succ_offsets = xmalloc((n + 1) * sizeof(uint32_t));
+	flow->pred_offsets = xcalloc(n + 1, sizeof(uint32_t));
+	flow->succs	   = xmalloc((2 * n + 1) * sizeof(uint32_t));
+
+	for(uint32_t i = 0; i < n; i++) {
+		int count;
+
+		flow->succ_offsets[i] = num_edges;
+		count		      = get_succs(flow, i,
+				&flow->succs[num_edges]);
+
+		for(int k = 0; k < count; k++) {
+			flow->pred_offsets[flow->succs[num_edges + k] + 1]++;
+		}
+
+		num_edges += count;
+	}
+
+	flow->succ_offsets[n] = num_edges;
+
+	for(uint32_t i = 0; i < n; i++) {
+		flow->pred_offsets[i + 1] += flow->pred_offsets[i];
+	}
+
+	flow->preds = xmalloc((num_edges + 1) * sizeof(uint32_t));
+	fill	    = xmalloc((n + 1) * sizeof(uint32_t));
+	memcpy(fill, flow->pred_offsets, (n + 1) * sizeof(uint32_t));
+
+	for(uint32_t i = 0; i < n; i++) {
+		for(uint32_t e = flow->succ_offsets[i];
+				e < flow->succ_offsets[i + 1]; e++) {
+			flow->preds[fill[flow->succs[e]]++] = i;
+		}
+	}
+
+	free(fill);
+}
+
+/*
+ * Numbers the nodes reachable from root in reverse post-order with an
+ * explicit stack, since functions can be too deep for recursion. Returns the
+ * number of nodes reached. Nodes which are not reached get BF_NO_BLOCK in
+ * rpo_index.
+ */
+static uint32_t number_rpo(uint32_t n, uint32_t root, uint32_t * offsets,
+		uint32_t * edges, uint32_t * rpo, uint32_t * rpo_index)
+{
+	uint32_t * stack = xmalloc(n * sizeof(uint32_t));
+	uint32_t * next	 = xmalloc(n * sizeof(uint32_t));
+	uint32_t   depth = 0;
+	uint32_t   count = 0;
+
+	for(uint32_t i = 0; i < n; i++) {
+		rpo_index[i] = BF_NO_BLOCK;
+	}
+
+	/*
+	 * Nodes on the stack or finished are marked with UNDEFINED until
+	 * they get their final number.
+	 */
+	stack[depth++]	= root;
+	next[root]	= offsets[root];
+	rpo_index[root] = UNDEFINED;
+
+	while(depth > 0) {
+		uint32_t node = stack[depth - 1];
+
+		if(next[node] < offsets[node + 1]) {
+			uint32_t succ = edges[next[node]++];
+
+			if(rpo_index[succ] == BF_NO_BLOCK) {
+				rpo_index[succ] = UNDEFINED;
+				next[succ]	= offsets[succ];
+				stack[depth++]	= succ;
+			}
+		} else {
+			/*
+			 * Post-order, filled in from the back.
+			 */
+			depth--;
+			rpo[n - 1 - count++] = node;
+		}
+	}
+
+	/*
+	 * Move the numbered nodes to the front.
+	 */
+	memmove(rpo, rpo + n - count, count * sizeof(uint32_t));
+
+	for(uint32_t i = 0; i < count; i++) {
+		rpo_index[rpo[i]] = i;
+	}
+
+	free(stack);
+	free(next);
+	return count;
+}
+
+static uint32_t intersect(uint32_t * idom, uint32_t * rpo_index, uint32_t a,
+		uint32_t b)
+{
+	while(a != b) {
+		while(rpo_index[a] > rpo_index[b]) {
+			a = idom[a];
+		}
+
+		while(rpo_index[b] > rpo_index[a]) {
+			b = idom[b];
+		}
+	}
+
+	return a;
+}
+
+/*
+ * The iterative algorithm of Cooper, Harvey and Kennedy. Nodes which were not
+ * reached keep BF_NO_BLOCK, the root gets itself.
+ */
+static void compute_idoms(uint32_t n, uint32_t * rpo, uint32_t count,
+		uint32_t * rpo_index, uint32_t * pred_offsets,
+		uint32_t * preds, uint32_t * idom)
+{
+	bool changed = TRUE;
+
+	for(uint32_t i = 0; i < n; i++) {
+		idom[i] = rpo_index[i] == BF_NO_BLOCK ? BF_NO_BLOCK : UNDEFINED;
+	}
+
+	idom[rpo[0]] = rpo[0];
+
+	while(changed) {
+		changed = FALSE;
+
+		for(uint32_t i = 1; i < count; i++) {
+			uint32_t node	  = rpo[i];
+			uint32_t new_idom = UNDEFINED;
+
+			for(uint32_t e = pred_offsets[node];
+					e < pred_offsets[node + 1]; e++) {
+				uint32_t pred = preds[e];
+
+				if(idom[pred] == UNDEFINED ||
+						idom[pred] == BF_NO_BLOCK) {
+					continue;
+				}
+
+				new_idom = new_idom == UNDEFINED ? pred :
+						intersect(idom, rpo_index,
+						pred, new_idom);
+			}
+
+			if(idom[node] != new_idom) {
+				idom[node] = new_idom;
+				changed	   = TRUE;
+			}
+		}
+	}
+}
+
+static void compute_dominators(struct bf_func_flow * flow)
+{
+	uint32_t n = flow->num_blocks;
+
+	flow->rpo	= xmalloc(n * sizeof(uint32_t));
+	flow->rpo_index = xmalloc(n * sizeof(uint32_t));
+	flow->idom	= xmalloc(n * sizeof(uint32_t));
+
+	/*
+	 * Every block was reached from the entry by bf_enum_func_basic_blk().
+	 */
+	number_rpo(n, 0, flow->succ_offsets, flow->succs, flow->rpo,
+			flow->rpo_index);
+	compute_idoms(n, flow->rpo, n, flow->rpo_index, flow->pred_offsets,
+			flow->preds, flow->idom);
+	flow->idom[0] = BF_NO_BLOCK;
+}
+
+/*
+ * Runs the same algorithm on the reversed graph. Node n is the virtual exit,
+ * whose predecessors in the reversed graph are the blocks without
+ * successors.
+ */
+static void compute_post_dominators(struct bf_func_flow * flow)
+{
+	uint32_t   n		= flow->num_blocks;
+	uint32_t * offsets	= xmalloc((n + 2) * sizeof(uint32_t));
+	uint32_t * edges	= xmalloc((flow->succ_offsets[n] + n + 1) *
+			sizeof(uint32_t));
+	uint32_t * pred_offsets = xmalloc((n + 2) * sizeof(uint32_t));
+	uint32_t * preds	= xmalloc((flow->succ_offsets[n] + n + 1) *
+			sizeof(uint32_t));
+	uint32_t * rpo		= xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t * rpo_index	= xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t * pidom	= xmalloc((n + 1) * sizeof(uint32_t));
+	uint32_t   num_edges	= 0;
+	uint32_t   num_preds	= 0;
+	uint32_t   count;
+
+	/*
+	 * The successors in the reversed graph are the predecessors and
+	 * vice versa.
+	 */
+	for(uint32_t i = 0; i < n; i++) {
+		offsets[i]	= num_edges;
+		pred_offsets[i] = num_preds;
+
+		for(uint32_t e = flow->pred_offsets[i];
+				e < flow->pred_offsets[i + 1]; e++) {
+			edges[num_edges++] = flow->preds[e];
+		}
+
+		for(uint32_t e = flow->succ_offsets[i];
+				e < flow->succ_offsets[i + 1]; e++) {
+			preds[num_preds++] = flow->succs[e];
+		}
+
+		if(flow->succ_offsets[i] == flow->succ_offsets[i + 1]) {
+			preds[num_preds++] = n;
+		}
+	}
+
+	offsets[n]	= num_edges;
+	pred_offsets[n] = num_preds;
+
+	for(uint32_t i = 0; i < n; i++) {
+		if(flow->succ_offsets[i] == flow->succ_offsets[i + 1]) {
+			edges[num_edges++] = i;
+		}
+	}
+
+	offsets[n + 1]	    = num_edges;
+	pred_offsets[n + 1] = num_preds;
+
+	count = number_rpo(n + 1, n, offsets, edges, rpo, rpo_index);
+	compute_idoms(n + 1, rpo, count, rpo_index, pred_offsets, preds,
+			pidom);
+
+	flow->ipdom = xmalloc(n * sizeof(uint32_t));
+
+	for(uint32_t i = 0; i < n; i++) {
+		flow->ipdom[i] = pidom[i] == n ? BF_NO_BLOCK : pidom[i];
+	}
+
+	free(offsets);
+	free(edges);
+	free(pred_offsets);
+	free(preds);
+	free(rpo);
+	free(rpo_index);
+	free(pidom);
+}
+
+bool bf_dominates(struct bf_func_flow * flow, uint32_t dom, uint32_t index)
+{
+	/*
+	 * Dominators come before the blocks they dominate in reverse
+	 * post-order, so the walk up the tree can stop early.
+	 */
+	while(index != BF_NO_BLOCK &&
+			flow->rpo_index[index] > flow->rpo_index[dom]) {
+		index = flow->idom[index];
+	}
+
+	return index == dom;
+}
+
+/*
+ * Finds the natural loops. Headers are visited in reverse post-order, so
+ * enclosing loops, whose headers dominate the nested headers, are found
+ * first. The innermost loop found so far holding a new header is therefore
+ * its parent.
+ */
+static void find_loops(struct bf_func_flow * flow)
+{
+	uint32_t   n		  = flow->num_blocks;
+	uint32_t * mark		  = xmalloc(n * sizeof(uint32_t));
+	uint32_t * body		  = xmalloc(n * sizeof(uint32_t));
+	uint32_t * stack	  = xmalloc(n * sizeof(uint32_t));
+	uint32_t   loops_capacity = 0;
+	uint32_t   blocks_size	  = 0;
+
+	flow->block_loop = xmalloc(n * sizeof(uint32_t));
+
+	for(uint32_t i = 0; i < n; i++) {
+		flow->block_loop[i] = BF_NO_BLOCK;
+		mark[i]		    = BF_NO_BLOCK;
+	}
+
+	for(uint32_t r = 0; r < n; r++) {
+		uint32_t	 header = flow->rpo[r];
+		uint32_t	 id	= flow->num_loops;
+		uint32_t	 count	= 0;
+		struct bf_loop * loop	= NULL;
+
+		for(uint32_t e = flow->pred_offsets[header];
+				e < flow->pred_offsets[header + 1]; e++) {
+			uint32_t pred = flow->preds[e];
+			uint32_t top  = 0;
+
+			if(!bf_dominates(flow, header, pred)) {
+				continue;
+			}
+
+			if(loop == NULL) {
+				if(id == loops_capacity) {
+					loops_capacity = loops_capacity ?
+							loops_capacity * 2 : 4;
+					flow->loops    = xrealloc(flow->loops,
+							loops_capacity *
+							sizeof(struct bf_loop));
+				}
+
+				loop		     = &flow->loops[id];
+				loop->header	     = header;
+				loop->parent	     = flow->block_loop[header];
+				loop->depth	     = 1;
+				loop->num_back_edges = 0;
+				loop->first_block    = blocks_size;
+
+				if(loop->parent != BF_NO_BLOCK) {
+					loop->depth += flow->loops[
+							loop->parent].depth;
+				}
+
+				mark[header]  = id;
+				body[count++] = header;
+				flow->num_loops++;
+			}
+
+			loop->num_back_edges++;
+
+			/*
+			 * Walk backwards from the source of the back edge up
+			 * to the header.
+			 */
+			if(mark[pred] != id) {
+				mark[pred]    = id;
+				body[count++] = pred;
+				stack[top++]  = pred;
+			}
+
+			while(top > 0) {
+				uint32_t node = stack[--top];
+
+				uint32_t end = flow->pred_offsets[node + 1];
+
+				for(uint32_t f = flow->pred_offsets[node];
+						f < end; f++) {
+					uint32_t p = flow->preds[f];
+
+					if(mark[p] != id) {
+						mark[p]	      = id;
+						body[count++] = p;
+						stack[top++]  = p;
+					}
+				}
+			}
+		}
+
+		if(loop == NULL) {
+			continue;
+		}
+
+		loop->num_blocks  = count;
+		flow->loop_blocks = xrealloc(flow->loop_blocks, (blocks_size +
+				count) * sizeof(uint32_t));
+		memcpy(flow->loop_blocks + blocks_size, body, count *
+				sizeof(uint32_t));
+		blocks_size += count;
+
+		for(uint32_t i = 0; i < count; i++) {
+			flow->block_loop[body[i]] = id;
+		}
+	}
+
+	free(mark);
+	free(body);
+	free(stack);
+}
+
+static struct bf_func_flow * compute_func_flow(struct bin_file * bf,
+		struct bf_func * func, unsigned long generation)
+{
+	struct bf_func_flow * flow    = xcalloc(1,
+			sizeof(struct bf_func_flow));
+	struct COLLECT_BLOCKS collect = {flow, 0};
+
+	flow->func	 = func;
+	flow->generation = generation;
+	bf_enum_func_basic_blk(bf, func, collect_block, &collect);
+
+	flow->lookup = xmalloc((flow->num_blocks + 1) * sizeof(uint64_t));
+
+	for(uint32_t i = 0; i < flow->num_blocks; i++) {
+		flow->lookup[i] = (uint64_t)flow->blocks[i]->entry.id << 32 | i;
+	}
+
+	qsort(flow->lookup, flow->num_blocks, sizeof(uint64_t), cmp_lookup);
+	build_edges(flow);
+
+	if(flow->num_blocks > 0) {
+		compute_dominators(flow);
+		compute_post_dominators(flow);
+		find_loops(flow);
+	}
+
+	return flow;
+}
+
+struct bf_func_flow * bf_get_func_flow(struct bin_file * bf,
+		struct bf_func * func)
+{
+	unsigned long	      generation = __atomic_load_n(&bf->cfg_generation,
+			__ATOMIC_RELAXED);
+	struct bf_func_flow * cur	 = __atomic_load_n(&func->flow,
+			__ATOMIC_ACQUIRE);
+	struct bf_func_flow * flow;
+
+	if(cur != NULL && cur->generation == generation) {
+		return cur;
+	}
+
+	flow = compute_func_flow(bf, func, generation);
+
+	/*
+	 * A racing thread computed the same result, keep whichever was
+	 * installed first.
+	 */
+	if(!__atomic_compare_exchange_n(&func->flow, &cur, flow, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		bf_close_func_flow(flow);
+		return cur;
+	}
+
+	bf_close_func_flow(cur);
+	return flow;
+}
+
+static void * analyse_func_flow(struct bf_task_ctx * ctx,
+		struct bf_func * func)
+{
+	bf_get_func_flow(ctx->param, func);
+	return NULL;
+}
+
+void bf_analyse_func_flows(struct bin_file * bf, unsigned int num_threads)
+{
+	bf_parallel_enum_func(bf, num_threads, analyse_func_flow, NULL, bf);
+}
+
+void bf_close_func_flow(struct bf_func_flow * flow)
+{
+	if(flow == NULL) {
+		return;
+	}
+
+	free(flow->blocks);
+	free(flow->succ_offsets);
+	free(flow->succs);
+	free(flow->pred_offsets);
+	free(flow->preds);
+	free(flow->rpo);
+	free(flow->rpo_index);
+	free(flow->idom);
+	free(flow->ipdom);
+	free(flow->loops);
+	free(flow->loop_blocks);
+	free(flow->block_loop);
+	free(flow->lookup);
+	free(flow);
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incremental.h"
+
+#include <string.h>
+
+#include "func.h"
+#include "parallel.h"
+
+/*
+ * Whether an instruction decodes to the same text wherever it is placed.
+ * libopcodes prints the absolute target of PC-relative operands, either as
+ * the operand itself (branches and calls) or as a comment, which is what
+ * bf_insn.extra_info is parsed from.
+ */
+static bool is_position_independent(struct bf_insn * insn)
+{
+	struct insn_operand * ops[] = {&insn->operand1, &insn->operand2,
+			&insn->operand3};
+
+	if(insn->extra_info != 0) {
+		return FALSE;
+	}
+
+	for(int i = 0; i < 3; i++) {
+		if(ops[i]->tag == OP_VAL || ops[i]->tag == OP_INDEX_INTO_CS) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+struct bf_insn * bf_find_reusable_insn(struct bf_reuse_map * map,
+		struct bf_mem_block * mem, bfd_vma vma)
+{
+	struct bf_extent *    func = bf_find_extent(&map->funcs, vma);
+	struct symbol *	      old_sym;
+	struct bf_insn *      old;
+	struct bf_mem_block * old_mem;
+	bfd_vma		      old_vma;
+
+	if(func == NULL) {
+		return NULL;
+	}
+
+	old_sym = func->obj;
+	old_vma = old_sym->address + (vma - func->start);
+	old	= bf_get_insn(map->old_bf, old_vma);
+
+	if(old == NULL || old->size <= 0 || old->is_data) {
+		return NULL;
+	} else if(old_vma != vma && !is_position_independent(old)) {
+		return NULL;
+	} else if(vma + old->size > mem->buffer_vma + mem->buffer_length) {
+		return NULL;
+	}
+
+	old_mem = load_section_for_vma(map->old_bf, old_vma);
+
+	if(old_mem == NULL || old_vma + old->size >
+			old_mem->buffer_vma + old_mem->buffer_length) {
+		return NULL;
+	}
+
+	/*
+	 * The bytes decide. Matching the function only picks the candidate.
+	 */
+	if(memcmp(mem->buffer + (vma - mem->buffer_vma),
+			old_mem->buffer + (old_vma - old_mem->buffer_vma),
+			old->size) != 0) {
+		return NULL;
+	}
+
+	return old;
+}
+
+static bool is_func_sym(struct symbol * sym)
+{
+	return sym != NULL && (sym->type & SYMBOL_FUNCTION) &&
+			sym->address != 0;
+}
+
+/*
+ * Pairs each function symbol of bf with the symbol of the same name in the
+ * previous version, provided that function has been analysed there.
+ */
+static void match_funcs(struct bf_reuse_map * map, struct bin_file * bf)
+{
+	struct symbol * sym;
+
+	for_each_symbol(sym, &bf->sym_table) {
+		struct symbol * old_sym;
+
+		if(!is_func_sym(sym) || sym->size == 0) {
+			continue;
+		}
+
+		old_sym = symbol_find(&map->old_bf->sym_table, sym->name);
+
+		if(!is_func_sym(old_sym) ||
+				!bf_exists_func(map->old_bf, old_sym->address)) {
+			continue;
+		}
+
+		bf_add_extent(&map->funcs, sym->address,
+				sym->address + sym->size, old_sym);
+		map->stats.matched_funcs++;
+	}
+
+	bf_sort_extent_index(&map->funcs);
+}
+
+void bf_disasm_incremental(struct bin_file * bf, struct bin_file * old_bf,
+		unsigned int num_threads, struct bf_reuse_stats * stats)
+{
+	struct bf_reuse_map map;
+
+	map.old_bf = old_bf;
+	memset(&map.stats, 0, sizeof(map.stats));
+	bf_init_extent_index(&map.funcs);
+	match_funcs(&map, bf);
+
+	bf->reuse = &map;
+	disasm_all_func_sym_parallel(bf, num_threads);
+	disasm_bin_file_entry(bf);
+	bf->reuse = NULL;
+
+	if(stats != NULL) {
+		*stats = map.stats;
+	}
+
+	bf_close_extent_index(&map.funcs);
+}
@@ -34,10 +34,10 @@ struct bf_insn * bf_init_insn(struct bf_basic_blk * bb, bfd_vma vma)
 	return insn;
 }
 
-void bf_add_insn_part(struct bf_insn * insn, char * str)
+void bf_add_insn_part(struct bin_file * bf, struct bf_insn * insn, char * str)
 {
 	struct bf_insn_part * part = xmalloc(sizeof(struct bf_insn_part));
-	part->str		   = xstrdup(str);
+	part->str		   = (char *)bf_strpool_intern(bf->strpool, str);
 
 	INIT_LIST_HEAD(&part->list);
 	list_add_tail(&part->list, &insn->part_list);
@@ -216,7 +216,6 @@ void bf_close_insn(struct bf_insn * insn)
 
 		list_for_each_entry_safe(pos, n, &insn->part_list, list) {
 			list_del(&pos->list);
-			free(pos->str);
 			free(pos);
 		}
 
@@ -224,46 +223,62 @@ void bf_close_insn(struct bf_insn * insn)
 	}
 }
 
-void bf_add_insn(struct bin_file * bf, struct bf_insn * insn)
+struct bf_insn * bf_add_insn(struct bin_file * bf, struct bf_insn * insn)
 {
-	assert(!bf_exists_insn(bf, insn->vma));
+	struct bf_addr_node * node = bf_addr_map_insert(&bf->insn_table,
+			&insn->entry, insn->vma);
 
-	htable_add(&bf->insn_table, &insn->entry, &insn->vma,
-			sizeof(insn->vma));
+	if(node == &insn->entry) {
+		__atomic_store_n(&bf->analysis_dirty, TRUE, __ATOMIC_RELAXED);
+	}
+
+	return bf_addr_map_entry(node, struct bf_insn, entry);
 }
 
 struct bf_insn * bf_get_insn(struct bin_file * bf, bfd_vma vma)
 {
-	return hash_find_entry(&bf->insn_table, &vma, sizeof(vma),
-			struct bf_insn, entry);
+	struct bf_addr_node * node = bf_addr_map_find(&bf->insn_table, vma);
+
+	return node ? bf_addr_map_entry(node, struct bf_insn, entry) : NULL;
 }
 
 bool bf_exists_insn(struct bin_file * bf, bfd_vma vma)
 {
-	return htable_find(&bf->insn_table, &vma, sizeof(vma)) != NULL;
+	return bf_addr_map_find(&bf->insn_table, vma) != NULL;
+}
+
+struct bf_insn * bf_get_insn_by_id(struct bin_file * bf, uint32_t id)
+{
+	struct bf_addr_node * node = bf_addr_map_get(&bf->insn_table, id);
+
+	return node ? bf_addr_map_entry(node, struct bf_insn, entry) : NULL;
+}
+
+uint32_t bf_get_num_insns(struct bin_file * bf)
+{
+	return __atomic_load_n(&bf->insn_table.num_ids, __ATOMIC_RELAXED);
 }
 
 void bf_close_insn_table(struct bin_file * bf)
 {
-	struct htable_entry * cur_entry;
-	struct htable_entry * n;
+	struct bf_addr_node * cur_entry;
+	struct bf_addr_node * n;
 	struct bf_insn *      insn;
 
-	htable_for_each_entry_safe(insn, cur_entry, n, &bf->insn_table,
+	bf_addr_map_for_each_entry_safe(insn, cur_entry, n, &bf->insn_table,
 			entry) {
-		htable_del_entry(&bf->insn_table, cur_entry);
 		bf_close_insn(insn);
-	}	
+	}
 }
 
 void bf_enum_insn(struct bin_file * bf,
 		void (*handler)(struct bin_file *, struct bf_insn *,
 		void *), void * param)
 {
-	struct htable_entry * cur_entry;
+	struct bf_addr_node * cur_entry;
 	struct bf_insn *      insn;
 
-	htable_for_each_entry(insn, cur_entry, &bf->insn_table, entry) {
+	bf_addr_map_for_each_entry(insn, cur_entry, &bf->insn_table, entry) {
 		handler(bf, insn, param);
 	}
 }
@@ -0,0 +1,280 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "insn_index.h"
+
+#include <libiberty.h>
+
+/*
+ * The highest operand_type, see insn_decoder.h.
+ */
+#define MAX_OPERAND_TAG OP_INDEX_INTO_GS
+
+static size_t hash_key(enum insn_mnemonic mnemonic, enum operand_type tag)
+{
+	uint64_t h = (uint64_t)mnemonic ^ ((uint64_t)tag << 59);
+
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 32);
+}
+
+/*
+ * Finds the slot of a key, which is empty if the key is not in the table.
+ */
+static struct bf_insn_posting * find_slot(struct bf_insn_posting * postings,
+		size_t num_slots, enum insn_mnemonic mnemonic,
+		enum operand_type tag)
+{
+	size_t i = hash_key(mnemonic, tag) & (num_slots - 1);
+
+	while(postings[i].count != 0 && (postings[i].mnemonic != mnemonic ||
+			postings[i].tag != tag)) {
+		i = (i + 1) & (num_slots - 1);
+	}
+
+	return &postings[i];
+}
+
+/*
+ * Doubles the table once it is half full, so probe sequences stay short.
+ */
+static void grow_table(struct bf_insn_index * index)
+{
+	struct bf_insn_posting * old	   = index->postings;
+	size_t			 old_slots = index->num_slots;
+
+	index->num_slots = old_slots ? old_slots * 2 : 64;
+	index->postings	 = xcalloc(index->num_slots,
+			sizeof(struct bf_insn_posting));
+
+	for(size_t i = 0; i < old_slots; i++) {
+		if(old[i].count != 0) {
+			*find_slot(index->postings, index->num_slots,
+					old[i].mnemonic, old[i].tag) = old[i];
+		}
+	}
+
+	free(old);
+}
+
+void bf_index_insn(struct bf_insn_index * index, struct bf_insn * insn)
+{
+	struct bf_insn_posting * posting;
+
+	if(insn->is_data) {
+		return;
+	}
+
+	if((index->num_postings + 1) * 2 > index->num_slots) {
+		grow_table(index);
+	}
+
+	posting = find_slot(index->postings, index->num_slots, insn->mnemonic,
+			insn->operand1.tag);
+
+	if(posting->count == 0) {
+		posting->mnemonic = insn->mnemonic;
+		posting->tag	  = insn->operand1.tag;
+		index->num_postings++;
+	}
+
+	if(posting->count == posting->capacity) {
+		posting->capacity = posting->capacity ? posting->capacity * 2 :
+				16;
+		posting->ids	  = xrealloc(posting->ids, posting->capacity *
+				sizeof(uint32_t));
+	}
+
+	/*
+	 * Threads index their instructions in no particular order, so the ids
+	 * only stay sorted as long as they keep growing.
+	 */
+	if(posting->sorted == posting->count && (posting->count == 0 ||
+			posting->ids[posting->count - 1] < insn->entry.id)) {
+		posting->sorted++;
+	}
+
+	posting->ids[posting->count++] = insn->entry.id;
+	index->num_insns++;
+}
+
+static void free_postings(struct bf_insn_index * index)
+{
+	for(size_t i = 0; i < index->num_slots; i++) {
+		free(index->postings[i].ids);
+	}
+
+	free(index->postings);
+	index->postings	    = NULL;
+	index->num_slots    = 0;
+	index->num_postings = 0;
+	index->num_insns    = 0;
+}
+
+struct bf_insn_index * bf_init_insn_index(struct bin_file * bf)
+{
+	struct bf_insn_index * index;
+
+	if(bf->insn_index != NULL) {
+		return bf->insn_index;
+	}
+
+	index	       = xcalloc(1, sizeof(struct bf_insn_index));
+	index->bf      = bf;
+	bf_rebuild_insn_index(index);
+	bf->insn_index = index;
+	return index;
+}
+
+void bf_rebuild_insn_index(struct bf_insn_index * index)
+{
+	uint32_t num_ids = bf_get_num_insns(index->bf);
+
+	free_postings(index);
+
+	/*
+	 * Walking the ids leaves every posting list sorted.
+	 */
+	for(uint32_t id = 0; id < num_ids; id++) {
+		struct bf_insn * insn = bf_get_insn_by_id(index->bf, id);
+
+		if(insn != NULL) {
+			bf_index_insn(index, insn);
+		}
+	}
+}
+
+static int cmp_id(const void * elem1, const void * elem2)
+{
+	uint32_t id1 = *(const uint32_t *)elem1;
+	uint32_t id2 = *(const uint32_t *)elem2;
+
+	return id1 < id2 ? -1 : id1 > id2;
+}
+
+/*
+ * Finds a posting list and sorts it if ids were appended out of order. Must
+ * be called with bin_file.cflow_lock held.
+ */
+static struct bf_insn_posting * get_posting(struct bf_insn_index * index,
+		enum insn_mnemonic mnemonic, enum operand_type tag)
+{
+	struct bf_insn_posting * posting;
+
+	if(index->num_slots == 0) {
+		return NULL;
+	}
+
+	posting = find_slot(index->postings, index->num_slots, mnemonic, tag);
+
+	if(posting->sorted != posting->count) {
+		qsort(posting->ids, posting->count, sizeof(uint32_t), cmp_id);
+		posting->sorted = posting->count;
+	}
+
+	return posting;
+}
+
+size_t bf_get_insn_ids(struct bf_insn_index * index,
+		enum insn_mnemonic mnemonic, enum operand_type tag,
+		uint32_t ** ids)
+{
+	struct bf_insn_posting * posting;
+	size_t			 count = 0;
+
+	pthread_mutex_lock(&index->bf->cflow_lock);
+	posting = get_posting(index, mnemonic, tag);
+	*ids	= NULL;
+
+	if(posting != NULL) {
+		*ids  = posting->ids;
+		count = posting->count;
+	}
+
+	pthread_mutex_unlock(&index->bf->cflow_lock);
+	return count;
+}
+
+size_t bf_count_insns(struct bf_insn_index * index,
+		enum insn_mnemonic mnemonic, int tag)
+{
+	int    first = tag == BF_ANY_OPERAND ? 0 : tag;
+	int    last  = tag == BF_ANY_OPERAND ? MAX_OPERAND_TAG : tag;
+	size_t count = 0;
+
+	pthread_mutex_lock(&index->bf->cflow_lock);
+
+	if(index->num_slots != 0) {
+		for(int t = first; t <= last; t++) {
+			count += find_slot(index->postings, index->num_slots,
+					mnemonic, t)->count;
+		}
+	}
+
+	pthread_mutex_unlock(&index->bf->cflow_lock);
+	return count;
+}
+
+void bf_enum_indexed_insn(struct bf_insn_index * index,
+		enum insn_mnemonic mnemonic, int tag,
+		void (*handler)(struct bin_file *, struct bf_insn *, void *),
+		void * param)
+{
+	int	   first = tag == BF_ANY_OPERAND ? 0 : tag;
+	int	   last	 = tag == BF_ANY_OPERAND ? MAX_OPERAND_TAG : tag;
+	uint32_t * ids	 = NULL;
+	size_t	   count = 0;
+
+	/*
+	 * The ids are copied so the handler runs without the lock and may
+	 * disassemble, which adds to the posting lists.
+	 */
+	pthread_mutex_lock(&index->bf->cflow_lock);
+
+	for(int t = first; t <= last; t++) {
+		struct bf_insn_posting * posting = get_posting(index, mnemonic,
+				t);
+
+		if(posting == NULL || posting->count == 0) {
+			continue;
+		}
+
+		ids = xrealloc(ids, (count + posting->count) *
+				sizeof(uint32_t));
+		memcpy(ids + count, posting->ids, posting->count *
+				sizeof(uint32_t));
+		count += posting->count;
+	}
+
+	pthread_mutex_unlock(&index->bf->cflow_lock);
+
+	for(size_t i = 0; i < count; i++) {
+		handler(index->bf, bf_get_insn_by_id(index->bf, ids[i]), param);
+	}
+
+	free(ids);
+}
+
+void bf_close_insn_index(struct bf_insn_index * index)
+{
+	if(index->bf->insn_index == index) {
+		index->bf->insn_index = NULL;
+	}
+
+	free_postings(index);
+	free(index);
+}
@@ -0,0 +1,593 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "insn_pattern.h"
+
+#include <ctype.h>
+#include <libiberty.h>
+
+/*
+ * The operand classes of the pattern language.
+ */
+static const struct {
+	const char *	  name;
+	enum operand_type tag;
+} operand_classes[] = {
+	{"val",	     OP_VAL},
+	{"imm",	     OP_IMM},
+	{"addr",     OP_ADDR_PTR},
+	{"reg",	     OP_REG},
+	{"regptr",   OP_REG_PTR},
+	{"index",    OP_INDEX},
+	{"indexptr", OP_INDEX_PTR},
+	{"fs",	     OP_INDEX_INTO_FS},
+	{"gs",	     OP_INDEX_INTO_GS}
+};
+
+struct bf_pattern_set * bf_init_pattern_set(void)
+{
+	return xcalloc(1, sizeof(struct bf_pattern_set));
+}
+
+static const char * skip_space(const char * str)
+{
+	while(isspace((unsigned char)*str)) {
+		str++;
+	}
+
+	return str;
+}
+
+/*
+ * Reads a word, i.e. everything up to a space or one of the separators.
+ */
+static size_t get_word(const char * str)
+{
+	size_t len = 0;
+
+	while(str[len] != '\0' && !isspace((unsigned char)str[len]) &&
+			strchr(";,|=:", str[len]) == NULL) {
+		len++;
+	}
+
+	return len;
+}
+
+/*
+ * Packs a register name the way set_operand_info() does.
+ */
+static uint64_t get_reg(const char * str, size_t len)
+{
+	uint64_t reg = 0;
+
+	memcpy(&reg, str, len < sizeof(uint64_t) ? len : sizeof(uint64_t));
+	return reg;
+}
+
+static const char * parse_operand(const char * str,
+		struct bf_pattern_operand * op)
+{
+	size_t len = get_word(str);
+
+	op->capture = -1;
+
+	if(len == 0) {
+		return NULL;
+	} else if(len == 1 && str[0] == '_') {
+		op->tag = 0;
+	} else if(str[0] == '%') {
+		op->tag	      = OP_REG;
+		op->has_value = TRUE;
+		op->value     = get_reg(str, len);
+	} else if(str[0] == '*' && len > 1 && str[1] == '%') {
+		op->tag	      = OP_REG_PTR;
+		op->has_value = TRUE;
+		op->value     = get_reg(str + 1, len - 1);
+	} else {
+		size_t i;
+
+		for(i = 0; i < ARRAY_SIZE(operand_classes); i++) {
+			if(strlen(operand_classes[i].name) == len &&
+					strncmp(operand_classes[i].name, str,
+					len) == 0) {
+				break;
+			}
+		}
+
+		if(i == ARRAY_SIZE(operand_classes)) {
+			return NULL;
+		}
+
+		op->tag = operand_classes[i].tag;
+	}
+
+	str = skip_space(str + len);
+
+	if(*str == '=') {
+		char * end;
+
+		if(op->has_value || op->tag == 0 || op->tag == OP_REG ||
+				op->tag == OP_REG_PTR || op->tag == OP_INDEX ||
+				op->tag == OP_INDEX_PTR) {
+			return NULL;
+		}
+
+		op->has_value = TRUE;
+		op->value     = strtoull(skip_space(str + 1), &end, 0);
+
+		if(end == skip_space(str + 1)) {
+			return NULL;
+		}
+
+		str = skip_space(end);
+	}
+
+	if(*str == ':') {
+		char * end;
+		long   capture = strtol(skip_space(str + 1), &end, 10);
+
+		if(end == skip_space(str + 1) || capture < 0 ||
+				capture >= BF_MAX_CAPTURES) {
+			return NULL;
+		}
+
+		op->capture = capture;
+		str	    = skip_space(end);
+	}
+
+	return str;
+}
+
+/*
+ * Reads a mnemonic, converting it like bf_set_insn_mnemonic() does.
+ */
+static const char * parse_mnemonic(const char * str,
+		enum insn_mnemonic * mnemonic)
+{
+	size_t	       len = get_word(str);
+	char	       name[len + 1];
+	struct bf_insn key;
+
+	if(len == 0) {
+		return NULL;
+	}
+
+	memcpy(name, str, len);
+	name[len] = '\0';
+	memset(&key, 0, sizeof(key));
+	bf_set_insn_mnemonic(&key, name);
+
+	*mnemonic = key.mnemonic;
+	return skip_space(str + len);
+}
+
+static const char * parse_insn(const char * str,
+		struct bf_pattern_step * step)
+{
+	if(*str == '*') {
+		str = skip_space(str + 1);
+	} else {
+		for(;;) {
+			if(step->num_mnemonics == BF_MAX_ALTERNATIVES) {
+				return NULL;
+			}
+
+			str = parse_mnemonic(str, &step->mnemonics[
+					step->num_mnemonics++]);
+
+			if(str == NULL || *str != '|') {
+				break;
+			}
+
+			str = skip_space(str + 1);
+		}
+
+		if(str == NULL) {
+			return NULL;
+		}
+	}
+
+	for(int i = 0; *str != ';' && *str != '\0'; i++) {
+		if(i == 3 || (i > 0 && *str++ != ',')) {
+			return NULL;
+		}
+
+		str = parse_operand(skip_space(str), &step->operands[i]);
+
+		if(str == NULL) {
+			return NULL;
+		}
+	}
+
+	return str;
+}
+
+static uint32_t add_step(struct bf_pattern_set * set, int pattern,
+		enum bf_pattern_step_kind kind)
+{
+	struct bf_pattern_step * step;
+
+	set->steps = xrealloc(set->steps, (set->num_steps + 1) *
+			sizeof(struct bf_pattern_step));
+	step	   = &set->steps[set->num_steps];
+
+	memset(step, 0, sizeof(struct bf_pattern_step));
+	step->kind    = kind;
+	step->pattern = pattern;
+
+	for(int i = 0; i < 3; i++) {
+		step->operands[i].capture = -1;
+	}
+
+	return set->num_steps++;
+}
+
+static int cmp_start(const void * a, const void * b)
+{
+	const struct bf_pattern_start * x = a;
+	const struct bf_pattern_start * y = b;
+
+	if(x->mnemonic != y->mnemonic) {
+		return x->mnemonic < y->mnemonic ? -1 : 1;
+	}
+
+	return x->state < y->state ? -1 : x->state > y->state;
+}
+
+/*
+ * Registers the first state of a pattern under each of its mnemonics.
+ */
+static void add_start(struct bf_pattern_set * set, uint32_t state)
+{
+	struct bf_pattern_step * step = &set->steps[state];
+
+	if(step->num_mnemonics == 0) {
+		set->any_starts = xrealloc(set->any_starts,
+				(set->num_any_starts + 1) * sizeof(uint32_t));
+		set->any_starts[set->num_any_starts++] = state;
+		return;
+	}
+
+	set->starts = xrealloc(set->starts, (set->num_starts +
+			step->num_mnemonics) * sizeof(struct bf_pattern_start));
+
+	for(int i = 0; i < step->num_mnemonics; i++) {
+		set->starts[set->num_starts].mnemonic = step->mnemonics[i];
+		set->starts[set->num_starts].state    = state;
+		set->num_starts++;
+	}
+
+	qsort(set->starts, set->num_starts, sizeof(struct bf_pattern_start),
+			cmp_start);
+}
+
+int bf_add_pattern(struct bf_pattern_set * set, const char * pattern,
+		void * param)
+{
+	int	 id	   = set->num_patterns;
+	uint32_t first	   = set->num_steps;
+	bool	 after_gap = FALSE;
+
+	pattern = skip_space(pattern);
+
+	while(*pattern != '\0') {
+		if(strncmp(pattern, "...", 3) == 0) {
+			/*
+			 * Leading gaps are implied since matches may start
+			 * anywhere, and consecutive gaps are one gap.
+			 */
+			if(set->num_steps > first && !after_gap) {
+				add_step(set, id, BF_STEP_GAP);
+			}
+
+			after_gap = TRUE;
+			pattern	  = skip_space(pattern + 3);
+		} else {
+			uint32_t state = add_step(set, id, BF_STEP_INSN);
+
+			pattern	  = parse_insn(pattern, &set->steps[state]);
+			after_gap = FALSE;
+
+			if(pattern == NULL) {
+				set->num_steps = first;
+				return -1;
+			}
+		}
+
+		if(*pattern == ';') {
+			pattern = skip_space(pattern + 1);
+		} else if(*pattern != '\0') {
+			set->num_steps = first;
+			return -1;
+		}
+	}
+
+	/*
+	 * A trailing gap would only delay the match.
+	 */
+	if(after_gap && set->num_steps > first) {
+		set->num_steps--;
+	}
+
+	if(set->num_steps == first) {
+		return -1;
+	}
+
+	add_step(set, id, BF_STEP_ACCEPT);
+	add_start(set, first);
+
+	set->first_steps = xrealloc(set->first_steps, (id + 1) *
+			sizeof(uint32_t));
+	set->params	 = xrealloc(set->params, (id + 1) * sizeof(void *));
+	set->first_steps[id] = first;
+	set->params[id]	     = param;
+	return set->num_patterns++;
+}
+
+void bf_close_pattern_set(struct bf_pattern_set * set)
+{
+	free(set->params);
+	free(set->steps);
+	free(set->first_steps);
+	free(set->starts);
+	free(set->any_starts);
+	free(set);
+}
+
+struct bf_pattern_matcher * bf_init_pattern_matcher(
+		struct bf_pattern_set * set,
+		void (*handler)(struct bf_pattern_match *, void *),
+		void * param)
+{
+	struct bf_pattern_matcher * matcher = xcalloc(1,
+			sizeof(struct bf_pattern_matcher));
+
+	matcher->set	 = set;
+	matcher->handler = handler;
+	matcher->param	 = param;
+	matcher->threads = xmalloc((set->num_steps + 1) *
+			sizeof(struct bf_pattern_thread));
+	matcher->next	 = xmalloc((set->num_steps + 1) *
+			sizeof(struct bf_pattern_thread));
+	matcher->stamps	 = xcalloc(set->num_steps + 1, sizeof(uint64_t));
+	return matcher;
+}
+
+static uint64_t get_operand_value(struct insn_operand * op)
+{
+	switch(op->tag) {
+	case OP_VAL:
+		return op->operand_info.val;
+	case OP_IMM:
+		return op->operand_info.imm;
+	case OP_ADDR_PTR:
+		return op->operand_info.addr_ptr;
+	case OP_REG:
+		return op->operand_info.reg;
+	case OP_REG_PTR:
+		return op->operand_info.reg_ptr;
+	case OP_INDEX_INTO_FS:
+		return op->operand_info.index_into_fs;
+	case OP_INDEX_INTO_GS:
+		return op->operand_info.index_into_gs;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Tests an instruction against a BF_STEP_INSN state and records the
+ * captures of the thread if it matches.
+ */
+static bool match_step(struct bf_pattern_step * step, struct bf_insn * insn,
+		struct bf_pattern_thread * thread)
+{
+	struct insn_operand * ops[3] = {&insn->operand1, &insn->operand2,
+			&insn->operand3};
+	int		      i;
+
+	for(i = 0; i < step->num_mnemonics; i++) {
+		if(step->mnemonics[i] == insn->mnemonic) {
+			break;
+		}
+	}
+
+	if(step->num_mnemonics > 0 && i == step->num_mnemonics) {
+		return FALSE;
+	}
+
+	for(i = 0; i < 3; i++) {
+		struct bf_pattern_operand * op = &step->operands[i];
+
+		if(op->tag != 0 && (op->tag != (int)ops[i]->tag ||
+				(op->has_value && op->value !=
+				get_operand_value(ops[i])))) {
+			return FALSE;
+		}
+	}
+
+	for(i = 0; i < 3; i++) {
+		int capture = step->operands[i].capture;
+
+		if(capture >= 0) {
+			thread->captures[capture].insn	  = insn;
+			thread->captures[capture].operand = ops[i];
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Moves a thread into a state for the next instruction. Reaching the
+ * accepting state reports the match and entering a gap also enters the
+ * state after it.
+ */
+static void add_thread(struct bf_pattern_matcher * matcher,
+		struct bf_pattern_thread * thread, uint32_t state,
+		struct bf_insn * insn)
+{
+	struct bf_pattern_step * step = &matcher->set->steps[state];
+
+	if(matcher->stamps[state] == matcher->count) {
+		return;
+	}
+
+	matcher->stamps[state] = matcher->count;
+
+	if(step->kind == BF_STEP_ACCEPT) {
+		struct bf_pattern_match match;
+
+		match.pattern = step->pattern;
+		match.param   = matcher->set->params[step->pattern];
+		match.first   = thread->first;
+		match.last    = insn;
+		memcpy(match.captures, thread->captures,
+				sizeof(match.captures));
+
+		matcher->num_matches++;
+		matcher->handler(&match, matcher->param);
+		return;
+	}
+
+	matcher->next[matcher->num_next]       = *thread;
+	matcher->next[matcher->num_next].state = state;
+	matcher->num_next++;
+
+	if(step->kind == BF_STEP_GAP) {
+		add_thread(matcher, thread, state + 1, insn);
+	}
+}
+
+/*
+ * Advances a thread in state over insn.
+ */
+static void step_thread(struct bf_pattern_matcher * matcher,
+		struct bf_pattern_thread * thread, struct bf_insn * insn)
+{
+	struct bf_pattern_step * step = &matcher->set->steps[thread->state];
+
+	if(step->kind == BF_STEP_GAP) {
+		add_thread(matcher, thread, thread->state, insn);
+	} else if(match_step(step, insn, thread)) {
+		add_thread(matcher, thread, thread->state + 1, insn);
+	}
+}
+
+static void start_thread(struct bf_pattern_matcher * matcher,
+		uint32_t state, struct bf_insn * insn)
+{
+	struct bf_pattern_thread thread;
+
+	memset(&thread, 0, sizeof(thread));
+	thread.state = state;
+	thread.first = insn;
+	step_thread(matcher, &thread, insn);
+}
+
+/*
+ * Finds the first entry of starts for a mnemonic.
+ */
+static size_t find_start(struct bf_pattern_set * set,
+		enum insn_mnemonic mnemonic)
+{
+	size_t low  = 0;
+	size_t high = set->num_starts;
+
+	while(low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if(set->starts[mid].mnemonic < mnemonic) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+void bf_feed_pattern_matcher(struct bf_pattern_matcher * matcher,
+		struct bf_insn * insn)
+{
+	struct bf_pattern_set *	   set = matcher->set;
+	struct bf_pattern_thread * swap;
+
+	matcher->count++;
+	matcher->num_next = 0;
+
+	/*
+	 * Older threads go first so they win the states they share with
+	 * younger ones.
+	 */
+	for(uint32_t i = 0; i < matcher->num_threads; i++) {
+		step_thread(matcher, &matcher->threads[i], insn);
+	}
+
+	for(size_t i = find_start(set, insn->mnemonic); i < set->num_starts &&
+			set->starts[i].mnemonic == insn->mnemonic; i++) {
+		start_thread(matcher, set->starts[i].state, insn);
+	}
+
+	for(size_t i = 0; i < set->num_any_starts; i++) {
+		start_thread(matcher, set->any_starts[i], insn);
+	}
+
+	swap		     = matcher->threads;
+	matcher->threads     = matcher->next;
+	matcher->next	     = swap;
+	matcher->num_threads = matcher->num_next;
+}
+
+void bf_reset_pattern_matcher(struct bf_pattern_matcher * matcher)
+{
+	matcher->num_threads = 0;
+}
+
+void bf_close_pattern_matcher(struct bf_pattern_matcher * matcher)
+{
+	free(matcher->threads);
+	free(matcher->next);
+	free(matcher->stamps);
+	free(matcher);
+}
+
+void bf_match_patterns_bb(struct bf_pattern_matcher * matcher,
+		struct bf_basic_blk * bb)
+{
+	unsigned int length = bf_get_bb_length(bb);
+
+	bf_reset_pattern_matcher(matcher);
+
+	for(unsigned int i = 0; i < length; i++) {
+		bf_feed_pattern_matcher(matcher, bf_get_bb_insn(bb, i));
+	}
+
+	bf_reset_pattern_matcher(matcher);
+}
+
+static void match_bb(struct bin_file * bf, struct bf_basic_blk * bb,
+		void * param)
+{
+	bf_match_patterns_bb(param, bb);
+}
+
+void bf_match_patterns_func(struct bf_pattern_matcher * matcher,
+		struct bin_file * bf, struct bf_func * func)
+{
+	bf_enum_func_basic_blk(bf, func, match_bb, matcher);
+}
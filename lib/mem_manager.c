@@ -74,28 +74,40 @@ static asection * section_from_vma(struct bin_file * bf,
 struct bf_mem_block * load_section_for_vma(struct bin_file * bf,
 		bfd_vma vma)
 {
-	asection * s	      = section_from_vma(bf, vma);
-	bfd_vma	   buffer_vma = bfd_get_section_vma(s->owner, s);
+	asection *	      s = section_from_vma(bf, vma);
+	bfd_vma		      buffer_vma;
+	struct htable_entry * entry;
+	struct bf_mem_block * mem;
+
+	if(s == NULL) {
+		return NULL;
+	}
 
-	struct htable_entry * entry = htable_find(&bf->mem_table,
-			&buffer_vma, sizeof(buffer_vma));
+	buffer_vma = bfd_get_section_vma(s->owner, s);
+
+	/*
+	 * Sections are only unloaded when the bin_file is closed, so a block
+	 * can be used after the lock is dropped.
+	 */
+	pthread_mutex_lock(&bf->mem_lock);
+	entry = htable_find(&bf->mem_table, &buffer_vma, sizeof(buffer_vma));
 
 	if(entry != NULL) {
-		return hash_entry(entry, struct bf_mem_block, entry);
+		mem = hash_entry(entry, struct bf_mem_block, entry);
 	} else {
-		struct bf_mem_block * mem = load_section(s);
+		mem = load_section(s);
 
 		if(!mem) {
 			printf("Failed to load section: 0x%lX\n", vma);
-			return NULL;
 		} else {
 			htable_add(&bf->mem_table, &mem->entry,
 					&mem->buffer_vma,
 					sizeof(mem->buffer_vma));
 		}
-
-		return mem;
 	}
+
+	pthread_mutex_unlock(&bf->mem_lock);
+	return mem;
 }
 
 void unload_all_sections(struct bin_file * bf)
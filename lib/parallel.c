@@ -0,0 +1,487 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parallel.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libiberty.h>
+
+#define BF_ARENA_CHUNK_SIZE (64 * 1024)
+
+/*
+ * Returned by steal_task() when it lost a race and should be retried.
+ */
+#define TASK_EMPTY (SIZE_MAX)
+#define TASK_ABORT (SIZE_MAX - 1)
+
+void * bf_arena_alloc(struct bf_arena * arena, size_t size)
+{
+	struct bf_arena_chunk * chunk = arena->chunks;
+	void *			mem;
+
+	size = (size + 15) & ~(size_t)15;
+
+	if(chunk == NULL || chunk->size - chunk->used < size) {
+		size_t chunk_size = size > BF_ARENA_CHUNK_SIZE ?
+				size : BF_ARENA_CHUNK_SIZE;
+
+		chunk	      = xmalloc(sizeof(struct bf_arena_chunk) +
+				chunk_size);
+		chunk->next   = arena->chunks;
+		chunk->used   = 0;
+		chunk->size   = chunk_size;
+		arena->chunks = chunk;
+	}
+
+	mem	     = chunk->data + chunk->used;
+	chunk->used += size;
+	return mem;
+}
+
+char * bf_arena_strdup(struct bf_arena * arena, const char * str)
+{
+	size_t len  = strlen(str) + 1;
+	char * copy = bf_arena_alloc(arena, len);
+
+	memcpy(copy, str, len);
+	return copy;
+}
+
+static void close_arena(struct bf_arena * arena)
+{
+	while(arena->chunks != NULL) {
+		struct bf_arena_chunk * next = arena->chunks->next;
+
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+}
+
+unsigned int bf_get_num_workers(unsigned int num_threads)
+{
+	if(num_threads == 0) {
+		char * env = getenv("LIBBF_THREADS");
+		long   cpus;
+
+		if(env != NULL && atoi(env) > 0) {
+			return atoi(env);
+		}
+
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		return cpus > 0 ? cpus : 1;
+	}
+
+	return num_threads;
+}
+
+/*
+ * A Chase-Lev deque of task indices. All tasks are pushed before the
+ * workers start, so the buffer never has to grow: the owner only takes from
+ * the bottom and thieves steal from the top.
+ */
+struct BF_DEQUE {
+	int64_t	 top;
+	int64_t	 bottom;
+	size_t * tasks;
+
+	/*
+	 * Keep the indices of different deques on different cache lines.
+	 */
+	char	 pad[64 - 2 * sizeof(int64_t) - sizeof(size_t *)];
+};
+
+static size_t take_task(struct BF_DEQUE * deque)
+{
+	int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	int64_t t;
+	size_t	task = TASK_EMPTY;
+
+	__atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+	if(t <= b) {
+		task = deque->tasks[b];
+
+		if(t == b) {
+			/*
+			 * The last task. Race the thieves for it.
+			 */
+			if(!__atomic_compare_exchange_n(&deque->top, &t, t + 1,
+					false, __ATOMIC_SEQ_CST,
+					__ATOMIC_RELAXED)) {
+				task = TASK_EMPTY;
+			}
+
+			__atomic_store_n(&deque->bottom, b + 1,
+					__ATOMIC_RELAXED);
+		}
+	} else {
+		__atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+
+	return task;
+}
+
+static size_t steal_task(struct BF_DEQUE * deque)
+{
+	int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	int64_t b;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+	if(t < b) {
+		size_t task = deque->tasks[t];
+
+		if(!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			return TASK_ABORT;
+		}
+
+		return task;
+	}
+
+	return TASK_EMPTY;
+}
+
+struct BF_PARALLEL_RUN {
+	unsigned int	    num_workers;
+	size_t		    count;
+	size_t		    grain;
+	void *		    (*map)(struct bf_task_ctx *, size_t, size_t);
+	void *		    param;
+	struct BF_DEQUE *   deques;
+	struct bf_arena *   arenas;
+	void **		    results;
+};
+
+struct BF_WORKER {
+	struct BF_PARALLEL_RUN * run;
+	unsigned int		 index;
+	pthread_t		 thread;
+	bool			 started;
+};
+
+static void run_task(struct BF_PARALLEL_RUN * run, struct bf_task_ctx * ctx,
+		size_t task)
+{
+	size_t first = task * run->grain;
+	size_t last  = first + run->grain;
+
+	if(last > run->count) {
+		last = run->count;
+	}
+
+	run->results[task] = run->map(ctx, first, last);
+}
+
+/*
+ * Tries every other deque once, starting at a pseudo-random victim.
+ * Returns TASK_EMPTY only if all of them were seen empty, which means the
+ * pass is over since no tasks are added once it has started.
+ */
+static size_t steal_any(struct BF_PARALLEL_RUN * run, unsigned int self,
+		uint32_t * seed)
+{
+	unsigned int n = run->num_workers;
+	bool	     retry;
+
+	do {
+		unsigned int start;
+
+		*seed ^= *seed << 13;
+		*seed ^= *seed >> 17;
+		*seed ^= *seed << 5;
+		start  = *seed % n;
+		retry  = FALSE;
+
+		for(unsigned int i = 0; i < n; i++) {
+			unsigned int victim = (start + i) % n;
+			size_t	     task;
+
+			if(victim == self) {
+				continue;
+			}
+
+			task = steal_task(&run->deques[victim]);
+
+			if(task == TASK_ABORT) {
+				retry = TRUE;
+			} else if(task != TASK_EMPTY) {
+				return task;
+			}
+		}
+	} while(retry);
+
+	return TASK_EMPTY;
+}
+
+static void * worker_main(void * param)
+{
+	struct BF_WORKER *	 worker = param;
+	struct BF_PARALLEL_RUN * run	= worker->run;
+	struct bf_task_ctx	 ctx;
+	uint32_t		 seed	= worker->index * 2654435761U + 1;
+	size_t			 task;
+
+	ctx.worker = worker->index;
+	ctx.arena  = &run->arenas[worker->index];
+	ctx.param  = run->param;
+
+	for(;;) {
+		task = take_task(&run->deques[worker->index]);
+
+		if(task == TASK_EMPTY) {
+			task = steal_any(run, worker->index, &seed);
+		}
+
+		if(task == TASK_EMPTY) {
+			break;
+		}
+
+		run_task(run, &ctx, task);
+	}
+
+	return NULL;
+}
+
+void bf_parallel_run(unsigned int num_threads, size_t count,
+		size_t grain, void * (*map)(struct bf_task_ctx *, size_t,
+		size_t), void (*reduce)(size_t, size_t, void *, void *),
+		void * param)
+{
+	struct BF_PARALLEL_RUN run;
+	struct BF_WORKER *     workers;
+	size_t		       num_tasks;
+
+	if(grain == 0) {
+		grain = 1;
+	}
+
+	num_tasks	= (count + grain - 1) / grain;
+	run.num_workers = bf_get_num_workers(num_threads);
+	run.count	= count;
+	run.grain	= grain;
+	run.map		= map;
+	run.param	= param;
+	run.results	= xcalloc(num_tasks + 1, sizeof(void *));
+
+	if(run.num_workers > num_tasks) {
+		run.num_workers = num_tasks ? num_tasks : 1;
+	}
+
+	run.deques = xcalloc(run.num_workers, sizeof(struct BF_DEQUE));
+	run.arenas = xcalloc(run.num_workers, sizeof(struct bf_arena));
+	workers	   = xcalloc(run.num_workers, sizeof(struct BF_WORKER));
+
+	/*
+	 * Each worker starts with a contiguous share of the tasks. They are
+	 * pushed in reverse so the owner takes them in ascending order, while
+	 * thieves take them from the far end.
+	 */
+	for(unsigned int w = 0; w < run.num_workers; w++) {
+		struct BF_DEQUE * deque = &run.deques[w];
+		size_t		  first = num_tasks * w / run.num_workers;
+		size_t		  last	= num_tasks * (w + 1) / run.num_workers;
+
+		deque->tasks  = xmalloc((last - first + 1) * sizeof(size_t));
+		deque->top    = 0;
+		deque->bottom = last - first;
+
+		for(size_t t = first; t < last; t++) {
+			deque->tasks[last - 1 - t] = t;
+		}
+
+		workers[w].run	 = &run;
+		workers[w].index = w;
+	}
+
+	/*
+	 * The calling thread is worker 0. If a thread can not be created the
+	 * tasks in its deque are stolen by the workers which did start.
+	 */
+	for(unsigned int w = 1; w < run.num_workers; w++) {
+		workers[w].started = pthread_create(&workers[w].thread, NULL,
+				worker_main, &workers[w]) == 0;
+	}
+
+	worker_main(&workers[0]);
+
+	for(unsigned int w = 1; w < run.num_workers; w++) {
+		if(workers[w].started) {
+			pthread_join(workers[w].thread, NULL);
+		}
+	}
+
+	if(reduce != NULL) {
+		for(size_t t = 0; t < num_tasks; t++) {
+			size_t first = t * grain;
+			size_t last  = first + grain > count ? count :
+					first + grain;
+
+			reduce(first, last, run.results[t], param);
+		}
+	}
+
+	for(unsigned int w = 0; w < run.num_workers; w++) {
+		close_arena(&run.arenas[w]);
+		free(run.deques[w].tasks);
+	}
+
+	free(run.arenas);
+	free(run.deques);
+	free(run.results);
+	free(workers);
+}
+
+static int cmp_vma_ptr(const void * elem1, const void * elem2)
+{
+	/*
+	 * The first member of bf_insn, bf_basic_blk and bf_func is the VMA.
+	 */
+	bfd_vma v1 = **(bfd_vma * const *)elem1;
+	bfd_vma v2 = **(bfd_vma * const *)elem2;
+
+	return v1 < v2 ? -1 : v1 > v2;
+}
+
+static void ** collect(struct bf_addr_map * map, size_t offset,
+		size_t * count)
+{
+	struct bf_addr_node * cur;
+	size_t		      n	       = 0;
+	size_t		      capacity = map->count + 1;
+	void **		      objs     = xmalloc(capacity * sizeof(void *));
+
+	for(cur = __atomic_load_n(&map->head, __ATOMIC_ACQUIRE); cur != NULL;
+			cur = cur->next) {
+		if(n == capacity) {
+			capacity *= 2;
+			objs	  = xrealloc(objs, capacity * sizeof(void *));
+		}
+
+		objs[n++] = (char *)cur - offset;
+	}
+
+	qsort(objs, n, sizeof(void *), cmp_vma_ptr);
+	*count = n;
+	return objs;
+}
+
+struct bf_insn ** bf_collect_insns(struct bin_file * bf, size_t * count)
+{
+	return (struct bf_insn **)collect(&bf->insn_table,
+			offsetof(struct bf_insn, entry), count);
+}
+
+struct bf_basic_blk ** bf_collect_basic_blks(struct bin_file * bf,
+		size_t * count)
+{
+	return (struct bf_basic_blk **)collect(&bf->bb_table,
+			offsetof(struct bf_basic_blk, entry), count);
+}
+
+struct bf_func ** bf_collect_funcs(struct bin_file * bf, size_t * count)
+{
+	return (struct bf_func **)collect(&bf->func_table,
+			offsetof(struct bf_func, entry), count);
+}
+
+/*
+ * Adapts the per-object callbacks to bf_parallel_run(). Each kind of object
+ * has its own adapters so the callbacks are called through their own type.
+ */
+struct BF_ENUM_PASS {
+	void ** objs;
+	void *	param;
+	void *	(*func_map)(struct bf_task_ctx *, struct bf_func *);
+	void	(*func_reduce)(struct bf_func *, void *, void *);
+	void *	(*bb_map)(struct bf_task_ctx *, struct bf_basic_blk *);
+	void	(*bb_reduce)(struct bf_basic_blk *, void *, void *);
+};
+
+static void * enum_func_map(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct BF_ENUM_PASS * pass = ctx->param;
+	struct bf_task_ctx    user = *ctx;
+
+	user.param = pass->param;
+	return pass->func_map(&user, pass->objs[first]);
+}
+
+static void enum_func_reduce(size_t first, size_t last, void * result,
+		void * param)
+{
+	struct BF_ENUM_PASS * pass = param;
+
+	pass->func_reduce(pass->objs[first], result, pass->param);
+}
+
+static void * enum_bb_map(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct BF_ENUM_PASS * pass = ctx->param;
+	struct bf_task_ctx    user = *ctx;
+
+	user.param = pass->param;
+	return pass->bb_map(&user, pass->objs[first]);
+}
+
+static void enum_bb_reduce(size_t first, size_t last, void * result,
+		void * param)
+{
+	struct BF_ENUM_PASS * pass = param;
+
+	pass->bb_reduce(pass->objs[first], result, pass->param);
+}
+
+void bf_parallel_enum_func(struct bin_file * bf, unsigned int num_threads,
+		void * (*map)(struct bf_task_ctx *, struct bf_func *),
+		void (*reduce)(struct bf_func *, void *, void *),
+		void * param)
+{
+	struct BF_ENUM_PASS pass = {NULL, param, map, reduce, NULL, NULL};
+	size_t		    count;
+
+	pass.objs = collect(&bf->func_table, offsetof(struct bf_func, entry),
+			&count);
+	bf_parallel_run(num_threads, count, 1, enum_func_map,
+			reduce ? enum_func_reduce : NULL, &pass);
+	free(pass.objs);
+}
+
+void bf_parallel_enum_basic_blk(struct bin_file * bf,
+		unsigned int num_threads,
+		void * (*map)(struct bf_task_ctx *, struct bf_basic_blk *),
+		void (*reduce)(struct bf_basic_blk *, void *, void *),
+		void * param)
+{
+	struct BF_ENUM_PASS pass = {NULL, param, NULL, NULL, map, reduce};
+	size_t		    count;
+
+	pass.objs = collect(&bf->bb_table,
+			offsetof(struct bf_basic_blk, entry), &count);
+	bf_parallel_run(num_threads, count, 1, enum_bb_map,
+			reduce ? enum_bb_reduce : NULL, &pass);
+	free(pass.objs);
+}
@@ -0,0 +1,577 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sample.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+
+/*
+ * Samples are attributed in batches of this size so that the lookups run
+ * back to back over the extent arrays while they are hot in the cache.
+ */
+#define BF_SAMPLE_BATCH 65536
+
+/*
+ * perf script never prints more than a handful of fields per line, anything
+ * past this is part of a symbol name and can be ignored.
+ */
+#define BF_SAMPLE_MAX_TOKENS 64
+
+/*
+ * Functions do not have a size so each one is assumed to extend up to the
+ * next discovered function or the end of its section, whichever comes first.
+ */
+static void build_func_index(struct bf_sample_profile * profile)
+{
+	struct bf_extent_index sections;
+	struct bf_extent_index * index = &profile->func_index;
+	struct bin_file *	 bf    = profile->bf;
+	struct bf_func *	 func;
+
+	bf_init_extent_index(&sections);
+	bf_add_code_sections(&sections, bf->abfd);
+
+	bf_for_each_func(func, bf) {
+		bf_add_extent(index, func->vma, func->vma, func);
+	}
+
+	bf_sort_extent_index(index);
+
+	for(size_t i = 0; i < index->count; i++) {
+		struct bf_extent * section = bf_find_extent(&sections,
+				index->starts[i]);
+		bfd_vma		   end	   = section != NULL ? section->end :
+				index->starts[i] + 1;
+
+		if(i + 1 < index->count && index->starts[i + 1] < end) {
+			end = index->starts[i + 1];
+		}
+
+		index->extents[i].end = end;
+	}
+
+	bf_close_extent_index(&sections);
+}
+
+static void build_bb_index(struct bf_sample_profile * profile)
+{
+	struct bf_basic_blk * bb;
+
+	bf_for_each_basic_blk(bb, profile->bf) {
+		unsigned int size = bf_get_bb_size(bb);
+
+		if(size != 0) {
+			bf_add_extent(&profile->bb_index, bb->vma,
+					bb->vma + size, bb);
+		}
+	}
+
+	bf_sort_extent_index(&profile->bb_index);
+}
+
+struct bf_sample_profile * bf_init_sample_profile(struct bin_file * bf)
+{
+	struct bf_sample_profile * profile =
+			xmalloc(sizeof(struct bf_sample_profile));
+
+	profile->bf	     = bf;
+	profile->bias	     = 0;
+	profile->has_bias    = FALSE;
+	profile->total	     = 0;
+	profile->unresolved  = 0;
+	profile->num_pending = 0;
+	profile->pending     = xmalloc(BF_SAMPLE_BATCH * sizeof(bfd_vma));
+	profile->positions   = xmalloc(BF_SAMPLE_BATCH * sizeof(long));
+
+	bf_init_extent_index(&profile->bb_index);
+	bf_init_extent_index(&profile->func_index);
+	build_bb_index(profile);
+	build_func_index(profile);
+
+	profile->bb_hits   = xcalloc(profile->bb_index.count + 1,
+			sizeof(uint64_t));
+	profile->func_hits = xcalloc(profile->func_index.count + 1,
+			sizeof(uint64_t));
+	return profile;
+}
+
+void bf_set_sample_bias(struct bf_sample_profile * profile, bfd_vma bias)
+{
+	profile->bias	  = bias;
+	profile->has_bias = TRUE;
+}
+
+static void lowest_alloc_vma(bfd * abfd, asection * s, void * param)
+{
+	bfd_vma * lowest = param;
+
+	if((bfd_get_section_flags(abfd, s) & SEC_ALLOC) &&
+			bfd_get_section_vma(abfd, s) < *lowest) {
+		*lowest = bfd_get_section_vma(abfd, s);
+	}
+}
+
+void bf_set_sample_load_base(struct bf_sample_profile * profile,
+		bfd_vma load_base)
+{
+	bfd_vma link_base = (bfd_vma)-1;
+
+	bfd_map_over_sections(profile->bf->abfd, lowest_alloc_vma, &link_base);
+
+	/*
+	 * The first page of the image is mapped at load_base, so the link
+	 * time address of that page is the lowest section rounded down.
+	 */
+	if(link_base == (bfd_vma)-1) {
+		link_base = 0;
+	}
+
+	bf_set_sample_bias(profile, load_base - (link_base & ~(bfd_vma)0xfff));
+}
+
+void bf_attribute_samples(struct bf_sample_profile * profile)
+{
+	size_t n = profile->num_pending;
+
+	for(size_t i = 0; i < n; i++) {
+		profile->pending[i] -= profile->bias;
+	}
+
+	bf_find_extents(&profile->bb_index, profile->pending, n,
+			profile->positions);
+
+	for(size_t i = 0; i < n; i++) {
+		if(profile->positions[i] >= 0) {
+			profile->bb_hits[profile->positions[i]]++;
+		} else {
+			profile->unresolved++;
+		}
+	}
+
+	bf_find_extents(&profile->func_index, profile->pending, n,
+			profile->positions);
+
+	for(size_t i = 0; i < n; i++) {
+		if(profile->positions[i] >= 0) {
+			profile->func_hits[profile->positions[i]]++;
+		}
+	}
+
+	profile->total	     += n;
+	profile->num_pending  = 0;
+}
+
+void bf_add_sample(struct bf_sample_profile * profile, bfd_vma addr)
+{
+	profile->pending[profile->num_pending++] = addr;
+
+	if(profile->num_pending == BF_SAMPLE_BATCH) {
+		bf_attribute_samples(profile);
+	}
+}
+
+struct BF_SECTION_OFFSET {
+	bfd_vma offset;
+	bfd_vma vma;
+	bfd_vma best;
+	bool	found;
+};
+
+/*
+ * Finds the VMA mapped from a file offset. Mappings are page aligned so the
+ * offset usually lies a little before the first section of the segment.
+ */
+static void offset_in_section(bfd * abfd, asection * s, void * param)
+{
+	struct BF_SECTION_OFFSET * req = param;
+	bfd_vma			   pos = s->filepos;
+
+	if(!(bfd_get_section_flags(abfd, s) & SEC_LOAD)) {
+		return;
+	}
+
+	if(req->offset >= pos &&
+			req->offset < pos + bfd_section_size(abfd, s)) {
+		req->vma   = bfd_get_section_vma(abfd, s) + req->offset - pos;
+		req->best  = 0;
+		req->found = TRUE;
+	} else if(pos > req->offset && pos - req->offset < req->best) {
+		req->vma   = bfd_get_section_vma(abfd, s) - (pos - req->offset);
+		req->best  = pos - req->offset;
+		req->found = TRUE;
+	}
+}
+
+static const char * path_basename(const char * path, size_t len)
+{
+	for(size_t i = len; i > 0; i--) {
+		if(path[i - 1] == '/') {
+			return path + i;
+		}
+	}
+
+	return path;
+}
+
+/*
+ * Returns whether the DSO path (which need not be NUL terminated) refers to
+ * the target of the profile.
+ */
+static bool is_target_dso(struct bf_sample_profile * profile,
+		const char * path, size_t len)
+{
+	const char * target	= bfd_get_filename(profile->bf->abfd);
+	const char * target_base = path_basename(target, strlen(target));
+	const char * base	 = path_basename(path, len);
+	size_t	     base_len	 = len - (base - path);
+
+	return strlen(target_base) == base_len &&
+			strncmp(base, target_base, base_len) == 0;
+}
+
+/*
+ * Handles lines such as:
+ *	PERF_RECORD_MMAP2 1/1: [0x55d0c8a00000(0x1000) @ 0x1000 fd:01 1 0]:
+ *			r-xp /usr/bin/target
+ */
+static void parse_mmap_event(struct bf_sample_profile * profile, char * line,
+		char ** tokens, size_t * lens, int num_tokens)
+{
+	struct BF_SECTION_OFFSET req;
+	bfd_vma			 start;
+	char *			 p = strchr(line, '[');
+
+	if(profile->has_bias || num_tokens < 2 || p == NULL ||
+			!(bfd_get_file_flags(profile->bf->abfd) & DYNAMIC)) {
+		return;
+	}
+
+	if(!is_target_dso(profile, tokens[num_tokens - 1],
+			lens[num_tokens - 1]) ||
+			memchr(tokens[num_tokens - 2], 'x',
+			lens[num_tokens - 2]) == NULL) {
+		return;
+	}
+
+	start = strtoull(p + 1, &p, 16);
+	p     = strchr(p, '@');
+
+	if(p == NULL) {
+		return;
+	}
+
+	req.offset = strtoull(p + 1, NULL, 0);
+	req.best   = (bfd_vma)-1;
+	req.found  = FALSE;
+	bfd_map_over_sections(profile->bf->abfd, offset_in_section, &req);
+
+	if(req.found) {
+		bf_set_sample_bias(profile, start - req.vma);
+	}
+}
+
+static bool parse_hex(const char * str, size_t len, bfd_vma * vma)
+{
+	bfd_vma val = 0;
+
+	if(len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+		str += 2;
+		len -= 2;
+	}
+
+	if(len == 0 || len > 16) {
+		return FALSE;
+	}
+
+	for(size_t i = 0; i < len; i++) {
+		int c = str[i];
+
+		if(c >= '0' && c <= '9') {
+			val = (val << 4) | (c - '0');
+		} else if(c >= 'a' && c <= 'f') {
+			val = (val << 4) | (c - 'a' + 10);
+		} else if(c >= 'A' && c <= 'F') {
+			val = (val << 4) | (c - 'A' + 10);
+		} else {
+			return FALSE;
+		}
+	}
+
+	*vma = val;
+	return TRUE;
+}
+
+static int tokenize(char * line, char ** tokens, size_t * lens)
+{
+	int num_tokens = 0;
+
+	while(*line != '\0' && num_tokens < BF_SAMPLE_MAX_TOKENS) {
+		while(isspace((unsigned char)*line)) {
+			line++;
+		}
+
+		if(*line == '\0') {
+			break;
+		}
+
+		tokens[num_tokens] = line;
+
+		while(*line != '\0' && !isspace((unsigned char)*line)) {
+			line++;
+		}
+
+		lens[num_tokens] = line - tokens[num_tokens];
+		num_tokens++;
+	}
+
+	return num_tokens;
+}
+
+/*
+ * Returns whether a sample line should be counted, judging by its trailing
+ * "(dso)" field if it has one.
+ */
+static bool sample_in_target(struct bf_sample_profile * profile,
+		char ** tokens, size_t * lens, int num_tokens, int ip_token)
+{
+	char * dso = tokens[num_tokens - 1];
+	size_t len = lens[num_tokens - 1];
+
+	if(num_tokens - 1 == ip_token || len < 2 || dso[0] != '(' ||
+			dso[len - 1] != ')') {
+		return TRUE;
+	}
+
+	return is_target_dso(profile, dso + 1, len - 2);
+}
+
+enum perf_script_state {
+	PERF_SCRIPT_SAMPLE,
+	PERF_SCRIPT_CHAIN_LEAF,
+	PERF_SCRIPT_CHAIN_REST
+};
+
+size_t bf_load_perf_script(struct bf_sample_profile * profile, FILE * stream)
+{
+	enum perf_script_state state = PERF_SCRIPT_SAMPLE;
+	char *		       line  = NULL;
+	size_t		       size  = 0;
+	size_t		       count = 0;
+	char *		       tokens[BF_SAMPLE_MAX_TOKENS];
+	size_t		       lens[BF_SAMPLE_MAX_TOKENS];
+
+	while(getline(&line, &size, stream) != -1) {
+		int	num_tokens = tokenize(line, tokens, lens);
+		int	ip_token   = 0;
+		bfd_vma addr;
+
+		/*
+		 * Blank lines separate samples in callchain dumps.
+		 */
+		if(num_tokens == 0) {
+			state = PERF_SCRIPT_SAMPLE;
+			continue;
+		}
+
+		if(state == PERF_SCRIPT_CHAIN_REST) {
+			continue;
+		}
+
+		if(strstr(tokens[0], "PERF_RECORD_MMAP") != NULL) {
+			parse_mmap_event(profile, line, tokens, lens,
+					num_tokens);
+			continue;
+		}
+
+		if(state == PERF_SCRIPT_SAMPLE) {
+			/*
+			 * The address follows the event name, which is the
+			 * last field terminated by a colon. Lines without
+			 * such a field come from perf script -F ip.
+			 */
+			for(int i = 0; i < num_tokens; i++) {
+				if(tokens[i][lens[i] - 1] == ':') {
+					ip_token = i + 1;
+				}
+			}
+
+			/*
+			 * A header with nothing after the event is followed
+			 * by its callchain, leaf first.
+			 */
+			if(ip_token == num_tokens) {
+				state = PERF_SCRIPT_CHAIN_LEAF;
+				continue;
+			}
+		} else {
+			state = PERF_SCRIPT_CHAIN_REST;
+		}
+
+		if(parse_hex(tokens[ip_token], lens[ip_token], &addr) &&
+				sample_in_target(profile, tokens, lens,
+				num_tokens, ip_token)) {
+			bf_add_sample(profile, addr);
+			count++;
+		}
+	}
+
+	free(line);
+	bf_attribute_samples(profile);
+	return count;
+}
+
+struct bf_func * bf_get_sample_func(struct bf_sample_profile * profile,
+		bfd_vma vma)
+{
+	struct bf_extent * extent = bf_find_extent(&profile->func_index, vma);
+	return extent != NULL ? extent->obj : NULL;
+}
+
+struct bf_basic_blk * bf_get_sample_bb(struct bf_sample_profile * profile,
+		bfd_vma vma)
+{
+	struct bf_extent * extent = bf_find_extent(&profile->bb_index, vma);
+	return extent != NULL ? extent->obj : NULL;
+}
+
+struct BF_SAMPLE_HIT {
+	uint64_t hits;
+	size_t	 pos;
+};
+
+static int cmp_hit(const void * elem1, const void * elem2)
+{
+	const struct BF_SAMPLE_HIT * h1 = elem1;
+	const struct BF_SAMPLE_HIT * h2 = elem2;
+
+	if(h1->hits != h2->hits) {
+		return h1->hits > h2->hits ? -1 : 1;
+	}
+
+	return h1->pos < h2->pos ? -1 : (h1->pos > h2->pos);
+}
+
+/*
+ * Returns the positions of all extents with hits, hottest first.
+ */
+static size_t sort_hits(uint64_t * hits, size_t count,
+		struct BF_SAMPLE_HIT ** sorted)
+{
+	size_t num = 0;
+
+	*sorted = xmalloc((count + 1) * sizeof(struct BF_SAMPLE_HIT));
+
+	for(size_t i = 0; i < count; i++) {
+		if(hits[i] != 0) {
+			(*sorted)[num].hits = hits[i];
+			(*sorted)[num].pos  = i;
+			num++;
+		}
+	}
+
+	qsort(*sorted, num, sizeof(struct BF_SAMPLE_HIT), cmp_hit);
+	return num;
+}
+
+void bf_enum_func_hits(struct bf_sample_profile * profile,
+		void (*handler)(struct bf_sample_profile *, struct bf_func *,
+		uint64_t, void *), void * param)
+{
+	struct BF_SAMPLE_HIT * sorted;
+	size_t		       num = sort_hits(profile->func_hits,
+			profile->func_index.count, &sorted);
+
+	for(size_t i = 0; i < num; i++) {
+		handler(profile, profile->func_index.extents[sorted[i].pos].obj,
+				sorted[i].hits, param);
+	}
+
+	free(sorted);
+}
+
+void bf_enum_bb_hits(struct bf_sample_profile * profile,
+		void (*handler)(struct bf_sample_profile *,
+		struct bf_basic_blk *, uint64_t, void *), void * param)
+{
+	struct BF_SAMPLE_HIT * sorted;
+	size_t		       num = sort_hits(profile->bb_hits,
+			profile->bb_index.count, &sorted);
+
+	for(size_t i = 0; i < num; i++) {
+		handler(profile, profile->bb_index.extents[sorted[i].pos].obj,
+				sorted[i].hits, param);
+	}
+
+	free(sorted);
+}
+
+static double percent(struct bf_sample_profile * profile, uint64_t hits)
+{
+	return profile->total ? 100.0 * hits / profile->total : 0.0;
+}
+
+static void print_func_hit(struct bf_sample_profile * profile,
+		struct bf_func * func, uint64_t hits, void * param)
+{
+	struct symbol * sym = bf_get_func_sym(profile->bf, func);
+
+	fprintf(param, "%12" PRIu64 " %6.2f%% 0x%lX %s\n", hits,
+			percent(profile, hits), func->vma,
+			sym ? symbol_demangled_name(sym) : "");
+}
+
+void bf_print_func_hits(struct bf_sample_profile * profile, FILE * stream)
+{
+	bf_enum_func_hits(profile, print_func_hit, stream);
+}
+
+static void print_bb_hit(struct bf_sample_profile * profile,
+		struct bf_basic_blk * bb, uint64_t hits, void * param)
+{
+	struct bf_func * func = bf_get_sample_func(profile, bb->vma);
+	struct symbol *	 sym  = func ? bf_get_func_sym(profile->bf, func) :
+			NULL;
+
+	fprintf(param, "%12" PRIu64 " %6.2f%% 0x%lX", hits,
+			percent(profile, hits), bb->vma);
+
+	if(sym != NULL) {
+		fprintf(param, " %s+0x%lX", symbol_demangled_name(sym),
+				bb->vma - func->vma);
+	}
+
+	fprintf(param, "\n");
+}
+
+void bf_print_bb_hits(struct bf_sample_profile * profile, FILE * stream)
+{
+	bf_enum_bb_hits(profile, print_bb_hit, stream);
+}
+
+void bf_close_sample_profile(struct bf_sample_profile * profile)
+{
+	if(profile != NULL) {
+		bf_close_extent_index(&profile->bb_index);
+		bf_close_extent_index(&profile->func_index);
+		free(profile->bb_hits);
+		free(profile->func_hits);
+		free(profile->pending);
+		free(profile->positions);
+		free(profile);
+	}
+}
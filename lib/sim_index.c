@@ -0,0 +1,813 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sim_index.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include "basic_blk.h"
+#include "cache.h"
+#include "insn.h"
+#include "parallel.h"
+
+#define BF_SIM_MAGIC   "LIBBFLSH"
+#define BF_SIM_VERSION 1
+#define BF_SIM_NO_NAME ((uint64_t)-1)
+
+/*
+ * Functions with fewer distinct trigrams than this (e.g. thunks and
+ * wrappers) look alike everywhere and are not indexed.
+ */
+#define BF_SIM_MIN_TRIGRAMS 8
+
+/*
+ * Once a flush would leave more segments than this, all of them are merged
+ * into one.
+ */
+#define BF_SIM_MAX_SEGMENTS 8
+
+/*
+ * A function as stored in the records file. Strings are offsets into the
+ * strings file.
+ */
+struct BF_SIM_RECORD {
+	struct bf_minhash sig;
+	uint64_t	  vma;
+	uint64_t	  binary;
+	uint64_t	  name;
+};
+
+/*
+ * Header of a segment file. The segment covers every record and string
+ * written before it, so the newest segment tells how much of the data files
+ * is committed.
+ */
+struct BF_SIM_HEADER {
+	char	 magic[8];
+	uint32_t version;
+	uint32_t bands;
+	uint64_t num_keys;
+	uint64_t num_records;
+	uint64_t strings_size;
+	uint64_t checksum;
+};
+
+struct BF_SIM_KEY {
+	uint64_t key;
+	uint64_t record;
+};
+
+struct bf_sim_segment {
+	unsigned int	     generation;
+	void *		     map;
+	size_t		     map_size;
+	struct BF_SIM_KEY *  keys;
+	uint64_t	     num_keys;
+	struct BF_SIM_HEADER header;
+};
+
+static inline uint64_t sim_mix(uint64_t h, uint64_t v)
+{
+	h ^= v;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 32);
+}
+
+/*
+ * The trigrams of a function, see bf_get_func_minhash().
+ */
+struct TRIGRAMS {
+	uint64_t * values;
+	size_t	   count;
+	size_t	   capacity;
+};
+
+static void add_bb_trigrams(struct bin_file * bf, struct bf_basic_blk * bb,
+		void * param)
+{
+	struct TRIGRAMS * trigrams = param;
+	unsigned int	  length   = bf_get_bb_length(bb);
+	uint64_t	  prev[2]  = {0, 0};
+
+	for(unsigned int i = 0; i < length; i++) {
+		struct bf_insn * insn  = bf_get_bb_insn(bb, i);
+		uint64_t	 token = 0xCBF29CE484222325ULL;
+
+		token = sim_mix(token, insn->mnemonic);
+		token = sim_mix(token, insn->secondary_mnemonic);
+		token = sim_mix(token, insn->operand1.tag);
+		token = sim_mix(token, insn->operand2.tag);
+		token = sim_mix(token, insn->operand3.tag);
+
+		if(trigrams->count == trigrams->capacity) {
+			trigrams->capacity = trigrams->capacity ?
+					trigrams->capacity * 2 : 64;
+			trigrams->values   = xrealloc(trigrams->values,
+					trigrams->capacity * sizeof(uint64_t));
+		}
+
+		trigrams->values[trigrams->count++] = sim_mix(sim_mix(prev[0],
+				prev[1]), token);
+		prev[0] = prev[1];
+		prev[1] = token;
+	}
+}
+
+static int cmp_u64(const void * elem1, const void * elem2)
+{
+	uint64_t v1 = *(const uint64_t *)elem1;
+	uint64_t v2 = *(const uint64_t *)elem2;
+
+	return v1 < v2 ? -1 : v1 > v2;
+}
+
+bool bf_get_func_minhash(struct bin_file * bf, struct bf_func * func,
+		struct bf_minhash * sig)
+{
+	struct TRIGRAMS trigrams = {NULL, 0, 0};
+	size_t		n	 = 0;
+
+	bf_enum_func_basic_blk(bf, func, add_bb_trigrams, &trigrams);
+	qsort(trigrams.values, trigrams.count, sizeof(uint64_t), cmp_u64);
+
+	for(size_t i = 0; i < trigrams.count; i++) {
+		if(n == 0 || trigrams.values[i] != trigrams.values[n - 1]) {
+			trigrams.values[n++] = trigrams.values[i];
+		}
+	}
+
+	/*
+	 * Each hash function is the mixer keyed by a different seed.
+	 */
+	for(int k = 0; k < BF_MINHASH_SIZE; k++) {
+		uint64_t seed = sim_mix(0x8A5CD789635D2DFFULL, k + 1);
+		uint32_t min  = UINT32_MAX;
+
+		for(size_t i = 0; i < n; i++) {
+			uint32_t h = (uint32_t)sim_mix(seed, trigrams.values[i]);
+
+			min = h < min ? h : min;
+		}
+
+		sig->values[k] = min;
+	}
+
+	free(trigrams.values);
+	return n >= BF_SIM_MIN_TRIGRAMS;
+}
+
+double bf_compare_minhash(struct bf_minhash * sig, struct bf_minhash * sig2)
+{
+	int equal = 0;
+
+	for(int k = 0; k < BF_MINHASH_SIZE; k++) {
+		equal += sig->values[k] == sig2->values[k];
+	}
+
+	return (double)equal / BF_MINHASH_SIZE;
+}
+
+static uint64_t get_band_key(struct bf_minhash * sig, int band)
+{
+	uint64_t key = sim_mix(0xCBF29CE484222325ULL, band);
+
+	for(int r = 0; r < BF_LSH_ROWS; r++) {
+		key = sim_mix(key, sig->values[band * BF_LSH_ROWS + r]);
+	}
+
+	return key;
+}
+
+static char * get_index_path(struct bf_sim_index * index, const char * name)
+{
+	char * path = xmalloc(strlen(index->dir) + strlen(name) + 2);
+
+	sprintf(path, "%s/%s", index->dir, name);
+	return path;
+}
+
+static char * get_segment_path(struct bf_sim_index * index,
+		unsigned int generation)
+{
+	char name[32];
+
+	sprintf(name, "bands.%08u", generation);
+	return get_index_path(index, name);
+}
+
+/*
+ * Maps a segment file and checks that it is complete.
+ */
+static bool map_segment(struct bf_sim_index * index,
+		struct bf_sim_segment * segment)
+{
+	char *		       path = get_segment_path(index,
+			segment->generation);
+	struct BF_SIM_HEADER * header;
+
+	segment->map = bf_map_cache_file(path, &segment->map_size);
+	free(path);
+
+	if(segment->map == NULL) {
+		return FALSE;
+	}
+
+	header = segment->map;
+
+	if(segment->map_size < sizeof(struct BF_SIM_HEADER) ||
+			memcmp(header->magic, BF_SIM_MAGIC,
+			sizeof(header->magic)) != 0 ||
+			header->version != BF_SIM_VERSION ||
+			header->bands != BF_LSH_BANDS ||
+			segment->map_size != sizeof(struct BF_SIM_HEADER) +
+			header->num_keys * sizeof(struct BF_SIM_KEY) ||
+			header->checksum != bf_cache_checksum(header + 1,
+			segment->map_size - sizeof(struct BF_SIM_HEADER))) {
+		bf_unmap_cache_file(segment->map, segment->map_size);
+		segment->map = NULL;
+		return FALSE;
+	}
+
+	segment->header	  = *header;
+	segment->keys	  = (struct BF_SIM_KEY *)(header + 1);
+	segment->num_keys = header->num_keys;
+	return TRUE;
+}
+
+static int cmp_segment(const void * elem1, const void * elem2)
+{
+	const struct bf_sim_segment * s1 = elem1;
+	const struct bf_sim_segment * s2 = elem2;
+
+	return s1->generation < s2->generation ? -1 :
+			s1->generation > s2->generation;
+}
+
+static void unmap_index(struct bf_sim_index * index)
+{
+	for(size_t i = 0; i < index->num_segments; i++) {
+		bf_unmap_cache_file(index->segments[i].map,
+				index->segments[i].map_size);
+	}
+
+	free(index->segments);
+	bf_unmap_cache_file(index->records, index->records_map_size);
+	bf_unmap_cache_file(index->strings, index->strings_map_size);
+	index->segments		= NULL;
+	index->num_segments	= 0;
+	index->records		= NULL;
+	index->records_map_size = 0;
+	index->strings		= NULL;
+	index->strings_map_size = 0;
+	index->num_records	= 0;
+	index->strings_size	= 0;
+}
+
+/*
+ * Brings a data file to its committed size. Anything past it was appended by
+ * a flush which did not get to write its segment.
+ */
+static bool truncate_data_file(struct bf_sim_index * index, const char * name,
+		size_t size)
+{
+	char * path = get_index_path(index, name);
+	int    fd   = open(path, O_WRONLY | O_CREAT, 0644);
+	bool   ok   = fd != -1 && ftruncate(fd, size) == 0;
+
+	if(fd != -1) {
+		close(fd);
+	}
+
+	free(path);
+	return ok;
+}
+
+static void * map_data_file(struct bf_sim_index * index, const char * name,
+		size_t committed, size_t * map_size)
+{
+	char * path = get_index_path(index, name);
+	void * map;
+
+	*map_size = 0;
+
+	if(committed == 0) {
+		free(path);
+		return NULL;
+	}
+
+	map = bf_map_cache_file(path, map_size);
+	free(path);
+
+	if(map != NULL && *map_size < committed) {
+		bf_unmap_cache_file(map, *map_size);
+		*map_size = 0;
+		return NULL;
+	}
+
+	return map;
+}
+
+/*
+ * Maps the valid segments and the committed part of the data files.
+ */
+static bool map_index(struct bf_sim_index * index)
+{
+	DIR *		d	 = opendir(index->dir);
+	struct dirent * entry;
+	size_t		capacity = 0;
+
+	if(d == NULL) {
+		return FALSE;
+	}
+
+	while((entry = readdir(d)) != NULL) {
+		struct bf_sim_segment segment = {0};
+		char		      tail;
+
+		if(sscanf(entry->d_name, "bands.%u%c", &segment.generation,
+				&tail) != 1) {
+			continue;
+		}
+
+		if(!map_segment(index, &segment)) {
+			if(index->writable) {
+				char * path = get_segment_path(index,
+						segment.generation);
+
+				unlink(path);
+				free(path);
+			}
+
+			continue;
+		}
+
+		if(index->num_segments == capacity) {
+			capacity	= capacity ? capacity * 2 : 8;
+			index->segments = xrealloc(index->segments, capacity *
+					sizeof(struct bf_sim_segment));
+		}
+
+		index->segments[index->num_segments++] = segment;
+	}
+
+	closedir(d);
+
+	if(index->num_segments > 0) {
+		struct BF_SIM_HEADER * newest;
+
+		qsort(index->segments, index->num_segments,
+				sizeof(struct bf_sim_segment), cmp_segment);
+		newest = &index->segments[index->num_segments - 1].header;
+		index->num_records  = newest->num_records;
+		index->strings_size = newest->strings_size;
+	}
+
+	if(index->writable && (!truncate_data_file(index, "records",
+			index->num_records * sizeof(struct BF_SIM_RECORD)) ||
+			!truncate_data_file(index, "strings",
+			index->strings_size))) {
+		return FALSE;
+	}
+
+	index->records = map_data_file(index, "records", index->num_records *
+			sizeof(struct BF_SIM_RECORD), &index->records_map_size);
+	index->strings = map_data_file(index, "strings", index->strings_size,
+			&index->strings_map_size);
+
+	return (index->num_records == 0 || index->records != NULL) &&
+			(index->strings_size == 0 || index->strings != NULL);
+}
+
+/*
+ * Waits until no other writer has the index open. Opening for writing
+ * truncates the data files to their committed size, which would destroy the
+ * appends of a writer in the middle of a flush, and two writers would both
+ * number their segments after the same newest one.
+ */
+static bool lock_index(struct bf_sim_index * index)
+{
+	char * path = get_index_path(index, "lock");
+
+	index->lock_fd = open(path, O_RDWR | O_CREAT, 0644);
+	free(path);
+
+	return index->lock_fd != -1 && flock(index->lock_fd, LOCK_EX) == 0;
+}
+
+struct bf_sim_index * bf_open_sim_index(const char * dir, bool writable)
+{
+	struct bf_sim_index * index = xcalloc(1, sizeof(struct bf_sim_index));
+
+	index->dir	= xstrdup(dir);
+	index->writable = writable;
+	index->lock_fd	= -1;
+
+	if(writable && ((mkdir(dir, 0755) != 0 && errno != EEXIST) ||
+			!lock_index(index))) {
+		index->writable = FALSE;
+		bf_close_sim_index(index);
+		return NULL;
+	}
+
+	if(!map_index(index)) {
+		index->writable = FALSE;
+		bf_close_sim_index(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+static uint64_t add_pending_string(struct bf_sim_index * index,
+		const char * str)
+{
+	size_t	 length = strlen(str) + 1;
+	uint64_t offset = index->strings_size + index->pending_strings_size;
+
+	while(index->pending_strings_size + length >
+			index->pending_strings_capacity) {
+		index->pending_strings_capacity =
+				index->pending_strings_capacity ?
+				index->pending_strings_capacity * 2 : 4096;
+		index->pending_strings = xrealloc(index->pending_strings,
+				index->pending_strings_capacity);
+	}
+
+	memcpy(index->pending_strings + index->pending_strings_size, str,
+			length);
+	index->pending_strings_size += length;
+	return offset;
+}
+
+struct SIG_PASS {
+	struct bin_file *   bf;
+	struct bf_func **   funcs;
+	struct bf_minhash * sigs;
+	bool *		    valid;
+};
+
+static void * compute_sigs(struct bf_task_ctx * ctx, size_t first,
+		size_t last)
+{
+	struct SIG_PASS * pass = ctx->param;
+
+	for(size_t i = first; i < last; i++) {
+		pass->valid[i] = bf_get_func_minhash(pass->bf, pass->funcs[i],
+				&pass->sigs[i]);
+	}
+
+	return NULL;
+}
+
+size_t bf_add_to_sim_index(struct bf_sim_index * index, struct bin_file * bf,
+		const char * path, unsigned int num_threads)
+{
+	struct SIG_PASS pass = {bf};
+	size_t		count;
+	size_t		added = 0;
+	uint64_t	binary;
+
+	if(!index->writable) {
+		return 0;
+	}
+
+	pass.funcs = bf_collect_funcs(bf, &count);
+	pass.sigs  = xmalloc((count + 1) * sizeof(struct bf_minhash));
+	pass.valid = xmalloc((count + 1) * sizeof(bool));
+	bf_parallel_run(num_threads, count, 16, compute_sigs, NULL, &pass);
+
+	binary = add_pending_string(index, path);
+
+	for(size_t i = 0; i < count; i++) {
+		struct BF_SIM_RECORD * record;
+		struct symbol *	       sym = bf_get_func_sym(bf,
+				pass.funcs[i]);
+
+		if(!pass.valid[i]) {
+			continue;
+		}
+
+		if(index->num_pending == index->pending_capacity) {
+			index->pending_capacity = index->pending_capacity ?
+					index->pending_capacity * 2 : 1024;
+			index->pending		= xrealloc(index->pending,
+					index->pending_capacity *
+					sizeof(struct BF_SIM_RECORD));
+		}
+
+		record	       = (struct BF_SIM_RECORD *)index->pending +
+				index->num_pending++;
+		record->sig    = pass.sigs[i];
+		record->vma    = pass.funcs[i]->vma;
+		record->binary = binary;
+		record->name   = sym != NULL && sym->name != NULL ?
+				add_pending_string(index, sym->name) :
+				BF_SIM_NO_NAME;
+		added++;
+	}
+
+	free(pass.funcs);
+	free(pass.sigs);
+	free(pass.valid);
+	return added;
+}
+
+static bool append_data_file(struct bf_sim_index * index, const char * name,
+		const void * data, size_t size)
+{
+	char *	     path = get_index_path(index, name);
+	int	     fd	  = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	const char * pos  = data;
+
+	free(path);
+
+	if(fd == -1) {
+		return FALSE;
+	}
+
+	while(size > 0) {
+		ssize_t written = write(fd, pos, size);
+
+		if(written <= 0) {
+			close(fd);
+			return FALSE;
+		}
+
+		pos  += written;
+		size -= written;
+	}
+
+	/*
+	 * The data has to be on disk before the segment committing it is.
+	 */
+	if(fsync(fd) != 0) {
+		close(fd);
+		return FALSE;
+	}
+
+	return close(fd) == 0;
+}
+
+static int cmp_sim_key(const void * elem1, const void * elem2)
+{
+	const struct BF_SIM_KEY * k1 = elem1;
+	const struct BF_SIM_KEY * k2 = elem2;
+
+	if(k1->key != k2->key) {
+		return k1->key < k2->key ? -1 : 1;
+	}
+
+	return k1->record < k2->record ? -1 : k1->record > k2->record;
+}
+
+bool bf_flush_sim_index(struct bf_sim_index * index)
+{
+	struct BF_SIM_RECORD * pending = index->pending;
+	bool		       merge   = index->num_segments + 1 >
+			BF_SIM_MAX_SEGMENTS;
+	unsigned int	       generation = index->num_segments > 0 ?
+			index->segments[index->num_segments - 1].generation +
+			1 : 0;
+	struct BF_SIM_HEADER * header;
+	struct BF_SIM_KEY *    keys;
+	uint64_t	       num_keys = 0;
+	size_t		       size;
+	char *		       buf;
+	char *		       path;
+	bool		       ok;
+
+	if(!index->writable || index->num_pending == 0) {
+		return index->writable;
+	}
+
+	/*
+	 * A failed flush may have appended part of the pending data, which has
+	 * to go or the records and strings would land after it.
+	 */
+	if(!truncate_data_file(index, "records", index->num_records *
+			sizeof(struct BF_SIM_RECORD)) ||
+			!truncate_data_file(index, "strings",
+			index->strings_size) ||
+			!append_data_file(index, "records", pending,
+			index->num_pending * sizeof(struct BF_SIM_RECORD)) ||
+			!append_data_file(index, "strings",
+			index->pending_strings, index->pending_strings_size)) {
+		return FALSE;
+	}
+
+	num_keys = index->num_pending * BF_LSH_BANDS;
+
+	if(merge) {
+		for(size_t i = 0; i < index->num_segments; i++) {
+			num_keys += index->segments[i].num_keys;
+		}
+	}
+
+	size   = sizeof(struct BF_SIM_HEADER) + num_keys *
+			sizeof(struct BF_SIM_KEY);
+	buf    = xmalloc(size);
+	header = (struct BF_SIM_HEADER *)buf;
+	keys   = (struct BF_SIM_KEY *)(header + 1);
+	num_keys = 0;
+
+	for(size_t i = 0; i < index->num_pending; i++) {
+		for(int band = 0; band < BF_LSH_BANDS; band++) {
+			keys[num_keys].key    = get_band_key(&pending[i].sig,
+					band);
+			keys[num_keys].record = index->num_records + i;
+			num_keys++;
+		}
+	}
+
+	if(merge) {
+		for(size_t i = 0; i < index->num_segments; i++) {
+			memcpy(keys + num_keys, index->segments[i].keys,
+					index->segments[i].num_keys *
+					sizeof(struct BF_SIM_KEY));
+			num_keys += index->segments[i].num_keys;
+		}
+	}
+
+	qsort(keys, num_keys, sizeof(struct BF_SIM_KEY), cmp_sim_key);
+
+	memcpy(header->magic, BF_SIM_MAGIC, sizeof(header->magic));
+	header->version	     = BF_SIM_VERSION;
+	header->bands	     = BF_LSH_BANDS;
+	header->num_keys     = num_keys;
+	header->num_records  = index->num_records + index->num_pending;
+	header->strings_size = index->strings_size +
+			index->pending_strings_size;
+	header->checksum     = bf_cache_checksum(keys, size -
+			sizeof(struct BF_SIM_HEADER));
+
+	path = get_segment_path(index, generation);
+	ok   = bf_write_cache_file(path, buf, size);
+	free(path);
+	free(buf);
+
+	if(!ok) {
+		return FALSE;
+	}
+
+	/*
+	 * The merged segment covers the old ones, which can go now that it is
+	 * in place.
+	 */
+	if(merge) {
+		for(size_t i = 0; i < index->num_segments; i++) {
+			path = get_segment_path(index,
+					index->segments[i].generation);
+			unlink(path);
+			free(path);
+		}
+	}
+
+	index->num_pending	    = 0;
+	index->pending_strings_size = 0;
+	unmap_index(index);
+	return map_index(index);
+}
+
+/*
+ * Gets the first key of a segment not less than key.
+ */
+static uint64_t find_sim_key(struct bf_sim_segment * segment, uint64_t key)
+{
+	uint64_t lo = 0;
+	uint64_t hi = segment->num_keys;
+
+	while(lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		if(segment->keys[mid].key < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int cmp_sim_match(const void * elem1, const void * elem2)
+{
+	const struct bf_sim_match * m1 = elem1;
+	const struct bf_sim_match * m2 = elem2;
+
+	if(m1->similarity != m2->similarity) {
+		return m1->similarity > m2->similarity ? -1 : 1;
+	}
+
+	return m1->vma < m2->vma ? -1 : m1->vma > m2->vma;
+}
+
+size_t bf_query_sim_index(struct bf_sim_index * index,
+		struct bf_minhash * sig, double min_similarity,
+		struct bf_sim_match * matches, size_t max_matches)
+{
+	struct BF_SIM_RECORD * records	  = index->records;
+	uint64_t *	       candidates = NULL;
+	size_t		       count	  = 0;
+	size_t		       capacity	  = 0;
+	struct bf_sim_match *  found;
+	size_t		       num_found  = 0;
+	size_t		       n	  = 0;
+
+	for(int band = 0; band < BF_LSH_BANDS; band++) {
+		uint64_t key = get_band_key(sig, band);
+
+		for(size_t s = 0; s < index->num_segments; s++) {
+			struct bf_sim_segment * segment = &index->segments[s];
+
+			for(uint64_t i = find_sim_key(segment, key);
+					i < segment->num_keys &&
+					segment->keys[i].key == key; i++) {
+				if(count == capacity) {
+					capacity   = capacity ? capacity * 2 :
+							256;
+					candidates = xrealloc(candidates,
+							capacity *
+							sizeof(uint64_t));
+				}
+
+				candidates[count++] = segment->keys[i].record;
+			}
+		}
+	}
+
+	qsort(candidates, count, sizeof(uint64_t), cmp_u64);
+	found = xmalloc((count + 1) * sizeof(struct bf_sim_match));
+
+	for(size_t i = 0; i < count; i++) {
+		struct BF_SIM_RECORD * record;
+		double		       similarity;
+
+		if((n > 0 && candidates[i] == candidates[n - 1]) ||
+				candidates[i] >= index->num_records) {
+			continue;
+		}
+
+		candidates[n++] = candidates[i];
+		record		= &records[candidates[i]];
+		similarity	= bf_compare_minhash(sig, &record->sig);
+
+		if(similarity < min_similarity ||
+				record->binary >= index->strings_size) {
+			continue;
+		}
+
+		found[num_found].binary	    = index->strings + record->binary;
+		found[num_found].name	    = record->name < index->strings_size ?
+				index->strings + record->name : NULL;
+		found[num_found].vma	    = record->vma;
+		found[num_found].similarity = similarity;
+		num_found++;
+	}
+
+	qsort(found, num_found, sizeof(struct bf_sim_match), cmp_sim_match);
+	num_found = num_found < max_matches ? num_found : max_matches;
+	memcpy(matches, found, num_found * sizeof(struct bf_sim_match));
+
+	free(found);
+	free(candidates);
+	return num_found;
+}
+
+void bf_close_sim_index(struct bf_sim_index * index)
+{
+	bf_flush_sim_index(index);
+	unmap_index(index);
+	free(index->pending);
+	free(index->pending_strings);
+	free(index->dir);
+
+	/*
+	 * Closing the descriptor releases the lock.
+	 */
+	if(index->lock_fd != -1) {
+		close(index->lock_fd);
+	}
+
+	free(index);
+}
@@ -0,0 +1,567 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+#include "basic_blk.h"
+#include "func.h"
+#include "insn.h"
+#include "symbol.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <libiberty.h>
+
+/*
+ * Growable buffer the strings of a snapshot are appended to while it is
+ * being built.
+ */
+struct BF_SNAPSHOT_STRINGS {
+	char * buf;
+	size_t size;
+	size_t capacity;
+	bool   overflow;
+};
+
+/*
+ * Makes room for len more bytes. Strings are referred to by uint32_t offsets
+ * with BF_SNAPSHOT_NONE reserved, so the buffer can not grow past it.
+ */
+static bool reserve_string(struct BF_SNAPSHOT_STRINGS * strings, size_t len)
+{
+	if(len > BF_SNAPSHOT_NONE - strings->size) {
+		strings->overflow = TRUE;
+		return FALSE;
+	}
+
+	if(strings->size + len > strings->capacity) {
+		strings->capacity = (strings->size + len) * 2;
+		strings->buf	  = xrealloc(strings->buf, strings->capacity);
+	}
+
+	return TRUE;
+}
+
+static uint32_t add_string(struct BF_SNAPSHOT_STRINGS * strings,
+		const char * str)
+{
+	size_t	 len	= strlen(str) + 1;
+	uint32_t offset = strings->size;
+
+	if(!reserve_string(strings, len)) {
+		return BF_SNAPSHOT_NONE;
+	}
+
+	memcpy(strings->buf + strings->size, str, len);
+	strings->size += len;
+	return offset;
+}
+
+static uint32_t add_insn_text(struct BF_SNAPSHOT_STRINGS * strings,
+		struct bf_insn * insn)
+{
+	struct bf_insn_part * part;
+	uint32_t	      offset = strings->size;
+	size_t		      total  = 1;
+
+	list_for_each_entry(part, &insn->part_list, list) {
+		total += strlen(part->str);
+	}
+
+	if(!reserve_string(strings, total)) {
+		return BF_SNAPSHOT_NONE;
+	}
+
+	list_for_each_entry(part, &insn->part_list, list) {
+		size_t len = strlen(part->str);
+
+		memcpy(strings->buf + strings->size, part->str, len);
+		strings->size += len;
+	}
+
+	strings->buf[strings->size++] = '\0';
+	return offset;
+}
+
+static int cmp_vma_ptr(const void * elem1, const void * elem2)
+{
+	/*
+	 * The first member of bf_insn, bf_basic_blk and bf_func is the VMA.
+	 */
+	bfd_vma v1 = **(bfd_vma * const *)elem1;
+	bfd_vma v2 = **(bfd_vma * const *)elem2;
+
+	return v1 < v2 ? -1 : v1 > v2;
+}
+
+/*
+ * Returns the position of the object starting at vma in an array of object
+ * pointers sorted by VMA.
+ */
+static uint32_t find_ptr_index(void ** sorted, size_t count, bfd_vma vma)
+{
+	size_t lo = 0;
+	size_t hi = count;
+
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(*(bfd_vma *)sorted[mid] < vma) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo < count && *(bfd_vma *)sorted[lo] == vma ? lo :
+			BF_SNAPSHOT_NONE;
+}
+
+static void add_ptr(void *** vec, size_t * count, size_t * capacity,
+		void * ptr)
+{
+	if(*count == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 1024;
+		*vec	  = xrealloc(*vec, *capacity * sizeof(void *));
+	}
+
+	(*vec)[(*count)++] = ptr;
+}
+
+static void freeze_insns(struct bf_snapshot * snap,
+		struct BF_SNAPSHOT_STRINGS * strings, struct bf_insn ** insns)
+{
+	snap->insns = xmalloc(snap->num_insns *
+			sizeof(struct bf_snapshot_insn) + 1);
+
+	for(uint32_t i = 0; i < snap->num_insns; i++) {
+		struct bf_snapshot_insn * rec  = &snap->insns[i];
+		struct bf_insn *	  insn = insns[i];
+
+		rec->vma		= insn->vma;
+		rec->extra_info		= insn->extra_info;
+		rec->mnemonic		= insn->mnemonic;
+		rec->secondary_mnemonic = insn->secondary_mnemonic;
+		rec->operands[0]	= insn->operand1;
+		rec->operands[1]	= insn->operand2;
+		rec->operands[2]	= insn->operand3;
+		rec->size		= insn->size;
+		rec->is_data		= insn->is_data;
+		rec->bb			= BF_SNAPSHOT_NONE;
+		rec->text		= add_insn_text(strings, insn);
+	}
+}
+
+static void freeze_bbs(struct bin_file * bf, struct bf_snapshot * snap,
+		struct BF_SNAPSHOT_STRINGS * strings, struct bf_insn ** insns,
+		struct bf_basic_blk ** bbs)
+{
+	size_t num_bb_insns = 0;
+	size_t pos	    = 0;
+
+	for(uint32_t i = 0; i < snap->num_bbs; i++) {
+		num_bb_insns += bf_get_bb_length(bbs[i]);
+	}
+
+	snap->bbs      = xmalloc(snap->num_bbs *
+			sizeof(struct bf_snapshot_bb) + 1);
+	snap->bb_insns = xmalloc(num_bb_insns * sizeof(uint32_t) + 1);
+
+	for(uint32_t i = 0; i < snap->num_bbs; i++) {
+		struct bf_snapshot_bb * rec = &snap->bbs[i];
+		struct bf_basic_blk *	bb  = bbs[i];
+		struct symbol *		sym = bf_get_bb_sym(bf, bb);
+		unsigned int		len = bf_get_bb_length(bb);
+
+		rec->vma	= bb->vma;
+		rec->first_insn = pos;
+		rec->num_insns	= 0;
+		rec->target	= bb->target ? find_ptr_index((void **)bbs,
+				snap->num_bbs, bb->target->vma) :
+				BF_SNAPSHOT_NONE;
+		rec->target2	= bb->target2 ? find_ptr_index((void **)bbs,
+				snap->num_bbs, bb->target2->vma) :
+				BF_SNAPSHOT_NONE;
+		rec->name	= sym ? add_string(strings, sym->name) :
+				BF_SNAPSHOT_NONE;
+
+		for(unsigned int j = 0; j < len; j++) {
+			uint32_t idx = find_ptr_index((void **)insns,
+					snap->num_insns, bb->insn_vec[j]->vma);
+
+			if(idx == BF_SNAPSHOT_NONE) {
+				continue;
+			}
+
+			snap->insns[idx].bb   = i;
+			snap->bb_insns[pos++] = idx;
+			rec->num_insns++;
+		}
+	}
+}
+
+/*
+ * Builds the successor and predecessor lists in CSR form from the target
+ * indices of the frozen blocks.
+ */
+static void freeze_edges(struct bf_snapshot * snap)
+{
+	uint32_t   num_bbs = snap->num_bbs;
+	uint32_t * fill;
+
+	snap->succ_offsets = xcalloc(num_bbs + 1, sizeof(uint32_t));
+	snap->pred_offsets = xcalloc(num_bbs + 1, sizeof(uint32_t));
+
+	for(uint32_t i = 0; i < num_bbs; i++) {
+		struct bf_snapshot_bb * bb = &snap->bbs[i];
+
+		if(bb->target != BF_SNAPSHOT_NONE) {
+			snap->succ_offsets[i + 1]++;
+			snap->pred_offsets[bb->target + 1]++;
+		}
+
+		if(bb->target2 != BF_SNAPSHOT_NONE &&
+				bb->target2 != bb->target) {
+			snap->succ_offsets[i + 1]++;
+			snap->pred_offsets[bb->target2 + 1]++;
+		}
+	}
+
+	for(uint32_t i = 0; i < num_bbs; i++) {
+		snap->succ_offsets[i + 1] += snap->succ_offsets[i];
+		snap->pred_offsets[i + 1] += snap->pred_offsets[i];
+	}
+
+	snap->succs = xmalloc(snap->succ_offsets[num_bbs] * sizeof(uint32_t) +
+			1);
+	snap->preds = xmalloc(snap->pred_offsets[num_bbs] * sizeof(uint32_t) +
+			1);
+	fill	    = xmalloc((num_bbs + 1) * sizeof(uint32_t));
+	memcpy(fill, snap->pred_offsets, (num_bbs + 1) * sizeof(uint32_t));
+
+	for(uint32_t i = 0; i < num_bbs; i++) {
+		struct bf_snapshot_bb * bb  = &snap->bbs[i];
+		uint32_t		pos = snap->succ_offsets[i];
+
+		if(bb->target != BF_SNAPSHOT_NONE) {
+			snap->succs[pos++]	      = bb->target;
+			snap->preds[fill[bb->target]++] = i;
+		}
+
+		if(bb->target2 != BF_SNAPSHOT_NONE &&
+				bb->target2 != bb->target) {
+			snap->succs[pos++]		 = bb->target2;
+			snap->preds[fill[bb->target2]++] = i;
+		}
+	}
+
+	free(fill);
+}
+
+/*
+ * qsort has no context argument, so the names are compared through the
+ * snapshot being built. It is thread local, so different bin_files can be
+ * frozen by different threads at the same time.
+ */
+static __thread const struct bf_snapshot * sort_snap;
+
+static int cmp_func_name(const void * elem1, const void * elem2)
+{
+	const struct bf_snapshot_func * f1 =
+			&sort_snap->funcs[*(const uint32_t *)elem1];
+	const struct bf_snapshot_func * f2 =
+			&sort_snap->funcs[*(const uint32_t *)elem2];
+
+	return strcmp(sort_snap->strings + f1->name,
+			sort_snap->strings + f2->name);
+}
+
+static void freeze_funcs(struct bin_file * bf, struct bf_snapshot * snap,
+		struct BF_SNAPSHOT_STRINGS * strings,
+		struct bf_basic_blk ** bbs, struct bf_func ** funcs)
+{
+	snap->funcs	      = xmalloc(snap->num_funcs *
+			sizeof(struct bf_snapshot_func) + 1);
+	snap->funcs_by_name = xmalloc(snap->num_funcs * sizeof(uint32_t) + 1);
+	snap->num_named_funcs = 0;
+
+	for(uint32_t i = 0; i < snap->num_funcs; i++) {
+		struct bf_snapshot_func * rec  = &snap->funcs[i];
+		struct bf_func *	  func = funcs[i];
+		struct symbol *		  sym  = bf_get_func_sym(bf, func);
+
+		rec->vma  = func->vma;
+		rec->bb	  = func->bb ? find_ptr_index((void **)bbs,
+				snap->num_bbs, func->bb->vma) :
+				BF_SNAPSHOT_NONE;
+		rec->name = sym ? add_string(strings, sym->name) :
+				BF_SNAPSHOT_NONE;
+
+		if(rec->name != BF_SNAPSHOT_NONE) {
+			snap->funcs_by_name[snap->num_named_funcs++] = i;
+		}
+	}
+}
+
+struct bf_snapshot * bf_freeze_bin_file(struct bin_file * bf)
+{
+	struct bf_snapshot *	   snap = xcalloc(1, sizeof(struct bf_snapshot));
+	struct BF_SNAPSHOT_STRINGS strings = {NULL, 0, 0, FALSE};
+	void **			   insns = NULL;
+	void **			   bbs	 = NULL;
+	void **			   funcs = NULL;
+	size_t			   num_insns = 0, num_bbs = 0, num_funcs = 0;
+	size_t			   cap_insns = 0, cap_bbs = 0, cap_funcs = 0;
+
+	{
+		struct bf_insn * insn;
+
+		bf_for_each_insn(insn, bf) {
+			add_ptr(&insns, &num_insns, &cap_insns, insn);
+		}
+	}
+
+	{
+		struct bf_basic_blk * bb;
+
+		bf_for_each_basic_blk(bb, bf) {
+			add_ptr(&bbs, &num_bbs, &cap_bbs, bb);
+		}
+	}
+
+	{
+		struct bf_func * func;
+
+		bf_for_each_func(func, bf) {
+			add_ptr(&funcs, &num_funcs, &cap_funcs, func);
+		}
+	}
+
+	/*
+	 * Objects are referred to by uint32_t indices with BF_SNAPSHOT_NONE
+	 * reserved.
+	 */
+	if(num_insns >= BF_SNAPSHOT_NONE || num_bbs >= BF_SNAPSHOT_NONE ||
+			num_funcs >= BF_SNAPSHOT_NONE) {
+		free(insns);
+		free(bbs);
+		free(funcs);
+		free(snap);
+		return NULL;
+	}
+
+	qsort(insns, num_insns, sizeof(void *), cmp_vma_ptr);
+	qsort(bbs, num_bbs, sizeof(void *), cmp_vma_ptr);
+	qsort(funcs, num_funcs, sizeof(void *), cmp_vma_ptr);
+
+	snap->refcount	= 1;
+	snap->bitiness	= bf->bitiness;
+	snap->num_insns = num_insns;
+	snap->num_bbs	= num_bbs;
+	snap->num_funcs = num_funcs;
+
+	freeze_insns(snap, &strings, (struct bf_insn **)insns);
+	freeze_bbs(bf, snap, &strings, (struct bf_insn **)insns,
+			(struct bf_basic_blk **)bbs);
+	freeze_edges(snap);
+	freeze_funcs(bf, snap, &strings, (struct bf_basic_blk **)bbs,
+			(struct bf_func **)funcs);
+
+	snap->strings	   = strings.buf ? strings.buf : xcalloc(1, 1);
+	snap->strings_size = strings.size;
+
+	free(insns);
+	free(bbs);
+	free(funcs);
+
+	if(strings.overflow) {
+		bf_snapshot_put(snap);
+		return NULL;
+	}
+
+	sort_snap = snap;
+	qsort(snap->funcs_by_name, snap->num_named_funcs, sizeof(uint32_t),
+			cmp_func_name);
+	sort_snap = NULL;
+
+	/*
+	 * Publish the fully built snapshot. Readers handed the pointer by
+	 * another thread after this see all of the stores above.
+	 */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return snap;
+}
+
+struct bf_snapshot * bf_snapshot_get(struct bf_snapshot * snap)
+{
+	__atomic_add_fetch(&snap->refcount, 1, __ATOMIC_RELAXED);
+	return snap;
+}
+
+void bf_snapshot_put(struct bf_snapshot * snap)
+{
+	if(snap == NULL ||
+			__atomic_sub_fetch(&snap->refcount, 1, __ATOMIC_ACQ_REL)
+			!= 0) {
+		return;
+	}
+
+	free(snap->insns);
+	free(snap->bbs);
+	free(snap->funcs);
+	free(snap->bb_insns);
+	free(snap->succ_offsets);
+	free(snap->succs);
+	free(snap->pred_offsets);
+	free(snap->preds);
+	free(snap->funcs_by_name);
+	free(snap->strings);
+	free(snap);
+}
+
+/*
+ * Lower bound over an array of records whose first member is a VMA.
+ */
+static uint32_t lower_vma(const void * base, size_t stride, uint32_t count,
+		bfd_vma vma)
+{
+	uint32_t lo = 0;
+	uint32_t hi = count;
+
+	while(lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(*(const bfd_vma *)((const char *)base + mid * stride) < vma) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+const struct bf_snapshot_insn * bf_snapshot_get_insn(
+		const struct bf_snapshot * snap, bfd_vma vma)
+{
+	uint32_t pos = lower_vma(snap->insns, sizeof(struct bf_snapshot_insn),
+			snap->num_insns, vma);
+
+	if(pos < snap->num_insns && snap->insns[pos].vma == vma) {
+		return &snap->insns[pos];
+	}
+
+	return NULL;
+}
+
+uint32_t bf_snapshot_get_bb(const struct bf_snapshot * snap, bfd_vma vma)
+{
+	uint32_t pos = lower_vma(snap->bbs, sizeof(struct bf_snapshot_bb),
+			snap->num_bbs, vma);
+
+	if(pos < snap->num_bbs && snap->bbs[pos].vma == vma) {
+		return pos;
+	}
+
+	return BF_SNAPSHOT_NONE;
+}
+
+uint32_t bf_snapshot_find_bb(const struct bf_snapshot * snap, bfd_vma vma)
+{
+	uint32_t pos = lower_vma(snap->insns, sizeof(struct bf_snapshot_insn),
+			snap->num_insns, vma);
+
+	/*
+	 * vma either starts an instruction or lies inside the previous one.
+	 */
+	if(pos == snap->num_insns || snap->insns[pos].vma != vma) {
+		if(pos == 0) {
+			return BF_SNAPSHOT_NONE;
+		}
+
+		pos--;
+
+		if(vma >= snap->insns[pos].vma + snap->insns[pos].size) {
+			return BF_SNAPSHOT_NONE;
+		}
+	}
+
+	return snap->insns[pos].bb;
+}
+
+const struct bf_snapshot_func * bf_snapshot_get_func(
+		const struct bf_snapshot * snap, bfd_vma vma)
+{
+	uint32_t pos = lower_vma(snap->funcs, sizeof(struct bf_snapshot_func),
+			snap->num_funcs, vma);
+
+	if(pos < snap->num_funcs && snap->funcs[pos].vma == vma) {
+		return &snap->funcs[pos];
+	}
+
+	return NULL;
+}
+
+const struct bf_snapshot_func * bf_snapshot_get_func_from_name(
+		const struct bf_snapshot * snap, const char * name)
+{
+	uint32_t lo = 0;
+	uint32_t hi = snap->num_named_funcs;
+
+	while(lo < hi) {
+		uint32_t			mid  = lo + (hi - lo) / 2;
+		const struct bf_snapshot_func * func =
+				&snap->funcs[snap->funcs_by_name[mid]];
+		int				cmp  = strcmp(snap->strings +
+				func->name, name);
+
+		if(cmp == 0) {
+			return func;
+		} else if(cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return NULL;
+}
+
+const uint32_t * bf_snapshot_bb_succs(const struct bf_snapshot * snap,
+		uint32_t bb, uint32_t * count)
+{
+	*count = snap->succ_offsets[bb + 1] - snap->succ_offsets[bb];
+	return snap->succs + snap->succ_offsets[bb];
+}
+
+const uint32_t * bf_snapshot_bb_preds(const struct bf_snapshot * snap,
+		uint32_t bb, uint32_t * count)
+{
+	*count = snap->pred_offsets[bb + 1] - snap->pred_offsets[bb];
+	return snap->preds + snap->pred_offsets[bb];
+}
+
+const char * bf_snapshot_insn_text(const struct bf_snapshot * snap,
+		const struct bf_snapshot_insn * insn)
+{
+	return snap->strings + insn->text;
+}
+
+const char * bf_snapshot_string(const struct bf_snapshot * snap,
+		uint32_t offset)
+{
+	return offset == BF_SNAPSHOT_NONE ? NULL : snap->strings + offset;
+}
@@ -0,0 +1,262 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "strpool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <libiberty.h>
+#include <libkern/jhash.h>
+
+#define BF_STRPOOL_CHUNK_SIZE	  (64 * 1024)
+#define BF_STRPOOL_INITIAL_SLOTS  1024
+
+static struct bf_strpool_table * alloc_table(size_t capacity)
+{
+	struct bf_strpool_table * table = xcalloc(1,
+			sizeof(struct bf_strpool_table) +
+			capacity * sizeof(const char *));
+
+	table->prev	= NULL;
+	table->capacity = capacity;
+	table->hashes	= xcalloc(capacity, sizeof(uint32_t));
+	return table;
+}
+
+struct bf_strpool * bf_init_strpool(void)
+{
+	struct bf_strpool * pool = xmalloc(sizeof(struct bf_strpool));
+
+	pool->chunks = NULL;
+	pool->table  = alloc_table(BF_STRPOOL_INITIAL_SLOTS);
+	pool->count  = 0;
+	pool->bytes  = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	return pool;
+}
+
+/*
+ * Searches the current table without taking the lock. A slot is only
+ * published once its hash and string are in place and is never cleared, so
+ * NULL is returned solely for strings which are not interned yet or which
+ * are being interned by another thread.
+ */
+static const char * lookup(struct bf_strpool * pool, const char * str,
+		size_t len, uint32_t hash)
+{
+	struct bf_strpool_table * table = __atomic_load_n(&pool->table,
+			__ATOMIC_ACQUIRE);
+	size_t			  mask	= table->capacity - 1;
+	size_t			  pos	= hash & mask;
+	const char *		  slot;
+
+	while((slot = __atomic_load_n(&table->slots[pos],
+			__ATOMIC_ACQUIRE)) != NULL) {
+		if(table->hashes[pos] == hash &&
+				strncmp(slot, str, len) == 0 &&
+				slot[len] == '\0') {
+			return slot;
+		}
+
+		pos = (pos + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the slot holding str, or the empty slot it would be stored in.
+ * The lock must be held.
+ */
+static size_t find_slot(struct bf_strpool_table * table, const char * str,
+		size_t len, uint32_t hash)
+{
+	size_t mask = table->capacity - 1;
+	size_t pos  = hash & mask;
+
+	while(table->slots[pos] != NULL) {
+		if(table->hashes[pos] == hash &&
+				strncmp(table->slots[pos], str, len) == 0 &&
+				table->slots[pos][len] == '\0') {
+			break;
+		}
+
+		pos = (pos + 1) & mask;
+	}
+
+	return pos;
+}
+
+/*
+ * Doubles the number of slots. The strings themselves do not move and the
+ * old table is kept for readers which may still be searching it.
+ */
+static void grow_slots(struct bf_strpool * pool)
+{
+	struct bf_strpool_table * old	= pool->table;
+	struct bf_strpool_table * table = alloc_table(old->capacity * 2);
+	size_t			  mask	= table->capacity - 1;
+
+	for(size_t i = 0; i < old->capacity; i++) {
+		if(old->slots[i] != NULL) {
+			size_t pos = old->hashes[i] & mask;
+
+			while(table->slots[pos] != NULL) {
+				pos = (pos + 1) & mask;
+			}
+
+			table->slots[pos]  = old->slots[i];
+			table->hashes[pos] = old->hashes[i];
+		}
+	}
+
+	table->prev = old;
+	__atomic_store_n(&pool->table, table, __ATOMIC_RELEASE);
+}
+
+static char * arena_alloc(struct bf_strpool * pool, size_t size)
+{
+	struct bf_strpool_chunk * chunk = pool->chunks;
+	char *			  mem;
+
+	if(chunk == NULL || chunk->size - chunk->used < size) {
+		size_t chunk_size = size > BF_STRPOOL_CHUNK_SIZE ?
+				size : BF_STRPOOL_CHUNK_SIZE;
+
+		chunk	    = xmalloc(sizeof(struct bf_strpool_chunk) +
+				chunk_size);
+		chunk->next = pool->chunks;
+		chunk->used = 0;
+		chunk->size = chunk_size;
+		pool->chunks = chunk;
+	}
+
+	mem	     = chunk->data + chunk->used;
+	chunk->used += size;
+	return mem;
+}
+
+/*
+ * Stores a new string in an empty slot.
+ */
+static void insert_slot(struct bf_strpool * pool, size_t pos,
+		const char * str, uint32_t hash)
+{
+	struct bf_strpool_table * table = pool->table;
+
+	table->hashes[pos] = hash;
+	__atomic_store_n(&table->slots[pos], str, __ATOMIC_RELEASE);
+
+	/*
+	 * Keep the load factor at or below one half so probe sequences stay
+	 * short.
+	 */
+	if(++pool->count * 2 > table->capacity) {
+		grow_slots(pool);
+	}
+}
+
+const char * bf_strpool_intern_len(struct bf_strpool * pool,
+		const char * str, size_t len)
+{
+	uint32_t     hash     = jhash(str, len, 0);
+	const char * interned = lookup(pool, str, len, hash);
+	size_t	     pos;
+	char *	     copy;
+
+	if(interned != NULL) {
+		return interned;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pos = find_slot(pool->table, str, len, hash);
+
+	if(pool->table->slots[pos] != NULL) {
+		copy = (char *)pool->table->slots[pos];
+	} else {
+		copy = arena_alloc(pool, len + 1);
+		memcpy(copy, str, len);
+		copy[len] = '\0';
+
+		pool->bytes += len + 1;
+		insert_slot(pool, pos, copy, hash);
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	return copy;
+}
+
+const char * bf_strpool_intern_ref(struct bf_strpool * pool,
+		const char * str)
+{
+	size_t	     len      = strlen(str);
+	uint32_t     hash     = jhash(str, len, 0);
+	const char * interned = lookup(pool, str, len, hash);
+	size_t	     pos;
+
+	if(interned != NULL) {
+		return interned;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pos = find_slot(pool->table, str, len, hash);
+
+	if(pool->table->slots[pos] != NULL) {
+		interned = pool->table->slots[pos];
+	} else {
+		interned = str;
+		insert_slot(pool, pos, str, hash);
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	return interned;
+}
+
+const char * bf_strpool_intern(struct bf_strpool * pool, const char * str)
+{
+	return bf_strpool_intern_len(pool, str, strlen(str));
+}
+
+const char * bf_strpool_find(struct bf_strpool * pool, const char * str)
+{
+	size_t len = strlen(str);
+
+	return lookup(pool, str, len, jhash(str, len, 0));
+}
+
+void bf_close_strpool(struct bf_strpool * pool)
+{
+	if(pool != NULL) {
+		while(pool->chunks != NULL) {
+			struct bf_strpool_chunk * next = pool->chunks->next;
+
+			free(pool->chunks);
+			pool->chunks = next;
+		}
+
+		while(pool->table != NULL) {
+			struct bf_strpool_table * prev = pool->table->prev;
+
+			free(pool->table->hashes);
+			free(pool->table);
+			pool->table = prev;
+		}
+
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+	}
+}
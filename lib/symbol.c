@@ -15,35 +15,185 @@
  * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "symbol.h"
 #include "binary_file.h"
+#include "cache.h"
+
+#ifdef HAVE_DEMANGLE_H
+#include <demangle.h>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <gelf.h>
 
 struct symbol *symbol_find(struct symbol_table *table, const char *name) {
   struct hlist_head *head;
   struct hlist_node *node;
   struct symbol *s;
+  const char *interned;
+  uint32_t hash;
+
+  symbol_table_ensure(table);
+
+  /* names which were never interned can not belong to any symbol */
+  if (!(interned = bf_strpool_find(table->strpool, name)))
+    return NULL;
 
-  head = &table->symbol_hash[symbol_hashfn(name)];
+  hash = symbol_hashfn(interned);
+  head = symbol_bucket(table, hash);
   hlist_for_each_entry(s, node, head, symbol_hash) {
-    if (strcmp(s->name, name) == 0)
+    if (s->name == interned)
       return s;
   }
 
   return NULL;
 }
 
+/**
+ * Doubles the number of buckets and redistributes the symbols using their
+ * cached name hashes.
+ */
+static void symbol_table_grow(struct symbol_table *table) {
+  struct hlist_head *old = table->symbol_hash;
+  unsigned int old_size = table->symbol_hash_size;
+
+  table->symbol_hash_size = old_size * 2;
+  table->symbol_hash = malloc(sizeof(struct hlist_head) * table->symbol_hash_size);
+  for (unsigned int i = 0; i < table->symbol_hash_size; i++)
+    INIT_HLIST_HEAD(&table->symbol_hash[i]);
+
+  for (unsigned int i = 0; i < old_size; i++) {
+    while (old[i].first) {
+      struct symbol *s = symbolhash_entry(old[i].first);
+
+      hlist_del(&s->symbol_hash);
+      hlist_add_head(&s->symbol_hash, symbol_bucket(table, s->name_hash));
+    }
+  }
+
+  free(old);
+}
+
 void symbol_add(struct symbol_table *table, struct symbol *sym) {
   struct hlist_head *head;
   struct hlist_node *node;
   struct symbol *s;
 
-  head = &table->symbol_hash[symbol_hashfn(sym->name)];
+  sym->name = (char *)bf_strpool_intern(table->strpool, sym->name);
+  sym->name_hash = symbol_hashfn(sym->name);
+
+  head = symbol_bucket(table, sym->name_hash);
   hlist_for_each_entry(s, node, head, symbol_hash) {
-    if (strcmp(s->name, sym->name) == 0)
+    if (s->name == sym->name)
       return;
   }
 
   hlist_add_head(&sym->symbol_hash, head);
+  table->extents_valid = false;
+  table->demangled_valid = false;
+
+  if (++table->symbol_count > table->symbol_hash_size)
+    symbol_table_grow(table);
+}
+
+const char *symbol_demangled_name(struct symbol *sym) {
+  char *demangled = __atomic_load_n(&sym->demangled, __ATOMIC_ACQUIRE);
+  char *expected = NULL;
+
+  if (demangled)
+    return demangled;
+
+#ifdef HAVE_DEMANGLE_H
+  {
+    bfd *abfd = sym->asymbol ? bfd_asymbol_bfd(sym->asymbol) : NULL;
+
+    demangled = bfd_demangle(abfd, sym->name, DMGL_ANSI | DMGL_PARAMS);
+  }
+#endif
+  if (!demangled)
+    demangled = sym->name;
+
+  /* another thread may have demangled the name meanwhile, keep its copy */
+  if (!__atomic_compare_exchange_n(&sym->demangled, &expected, demangled,
+                                   false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    if (demangled != sym->name)
+      free(demangled);
+    demangled = expected;
+  }
+
+  return demangled;
+}
+
+/**
+ * Demangles every symbol and indexes them by demangled name. The index is
+ * kept at a load factor of at most one half.
+ */
+static void symbol_table_build_demangled(struct symbol_table *table) {
+  struct symbol *sym;
+  size_t size = 16, mask;
+
+  while (size < table->symbol_count * 2)
+    size *= 2;
+  mask = size - 1;
+
+  free(table->demangled_index);
+  table->demangled_index = calloc(size, sizeof(struct symbol *));
+  table->demangled_index_size = size;
+
+  for_each_symbol(sym, table) {
+    const char *name = symbol_demangled_name(sym);
+    size_t pos = symbol_hashfn(name) & mask;
+
+    while (table->demangled_index[pos])
+      pos = (pos + 1) & mask;
+    table->demangled_index[pos] = sym;
+  }
+}
+
+/**
+ * Runs one of the lazy index builds under the table lock. The flag is
+ * checked again once the lock is held since another thread may have built
+ * the index while this one was waiting.
+ */
+static void symbol_table_build_once(struct symbol_table *table, bool *valid,
+                                    void (*build)(struct symbol_table *)) {
+  if (__atomic_load_n(valid, __ATOMIC_ACQUIRE))
+    return;
+
+  pthread_mutex_lock(&table->lock);
+  if (!*valid) {
+    build(table);
+    __atomic_store_n(valid, true, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&table->lock);
+}
+
+struct symbol *symbol_find_demangled(struct symbol_table *table,
+                                     const char *name) {
+  struct symbol *found = NULL;
+  size_t pos, mask;
+
+  symbol_table_ensure(table);
+  symbol_table_build_once(table, &table->demangled_valid,
+                          symbol_table_build_demangled);
+
+  mask = table->demangled_index_size - 1;
+  for (pos = symbol_hashfn(name) & mask; table->demangled_index[pos];
+       pos = (pos + 1) & mask) {
+    struct symbol *sym = table->demangled_index[pos];
+
+    /* several symbols can demangle to the same name, prefer the lowest */
+    if (strcmp(sym->demangled, name) == 0 &&
+        (!found || sym->address < found->address))
+      found = sym;
+  }
+
+  return found;
 }
 
 #define rb_entry_symbol(node) rb_entry((node), struct symbol, rb_symbol)
@@ -56,9 +206,12 @@ void symbol_add(struct symbol_table *table, struct symbol *sym) {
  * discovered at that address.
  */
 struct symbol *rb_search_symbol(struct symbol_table *table, void *addr) {
-  struct rb_node *n = table->rb_symbol.rb_node;
+  struct rb_node *n;
   struct symbol *symbol;
 
+  symbol_table_ensure(table);
+  n = table->rb_symbol.rb_node;
+
   while (n) {
     symbol = rb_entry_symbol(n);
 
@@ -76,10 +229,13 @@ struct symbol *rb_search_symbol(struct symbol_table *table, void *addr) {
  * Returns a pointer pointing to the first target whose address does not compare less than @p addr
  */
 struct symbol *rb_lower_bound_symbol(struct symbol_table *table, void *addr) {
-  struct rb_node *n = table->rb_symbol.rb_node;
+  struct rb_node *n;
   struct rb_node *parent = NULL;
   struct symbol *symbol;
 
+  symbol_table_ensure(table);
+  n = table->rb_symbol.rb_node;
+
   while (n) {
     symbol = rb_entry_symbol(n);
 
@@ -96,10 +252,13 @@ struct symbol *rb_lower_bound_symbol(struct symbol_table *table, void *addr) {
  * Returns an iterator pointing to the first target whose address compares greater than @p addr
  */
 struct symbol *rb_upper_bound_symbol(struct symbol_table *table, void *addr) {
-  struct rb_node *n = table->rb_symbol.rb_node;
+  struct rb_node *n;
   struct rb_node *parent = NULL;
   struct symbol *symbol;
 
+  symbol_table_ensure(table);
+  n = table->rb_symbol.rb_node;
+
   while (n) {
     symbol = rb_entry_symbol(n);
 
@@ -143,8 +302,144 @@ out:
   return ret;
 }
 
-void symbol_table_init(struct symbol_table *table) {
+/**
+ * Gets every symbol of the table, whether it is reachable through the address
+ * tree, the name hash or both. A symbol whose name was taken by another one
+ * is only in the tree, and one whose address was taken only in the hash, so
+ * neither walk alone sees them all.
+ */
+static struct symbol **symbol_table_collect(struct symbol_table *table,
+                                            size_t *count) {
+  struct symbol **syms = NULL, *sym;
+  struct rb_node *node;
+  size_t n = 0, capacity = 0;
+
+  for (node = rb_first(&table->rb_symbol); node; node = rb_next(node)) {
+    if (n == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      syms = realloc(syms, capacity * sizeof(struct symbol *));
+    }
+    syms[n++] = rb_entry_symbol(node);
+  }
+
+  for_each_symbol(sym, table) {
+    if (rb_search_symbol(table, (void *)sym->address) == sym)
+      continue;
+
+    if (n == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      syms = realloc(syms, capacity * sizeof(struct symbol *));
+    }
+    syms[n++] = sym;
+  }
+
+  *count = n;
+  return syms;
+}
+
+/**
+ * Rebuilds the sorted extents of all sized, non-debugging symbols. Where
+ * several symbols start at the same address only the longest one is kept.
+ */
+static void symbol_table_build_extents(struct symbol_table *table) {
+  struct bf_extent_index *index = &table->extents;
+  struct symbol **syms;
+  size_t count, n = 0;
+
+  bf_close_extent_index(index);
+
+  syms = symbol_table_collect(table, &count);
+  for (size_t i = 0; i < count; i++) {
+    struct symbol *sym = syms[i];
+
+    if (sym->address == 0 || sym->size == 0 ||
+        (sym->type & (SYMBOL_DEBUGGING | SYMBOL_RELOCATION)))
+      continue;
+    bf_add_extent(index, sym->address, sym->address + sym->size, sym);
+  }
+  free(syms);
+
+  bf_sort_extent_index(index);
+
+  /* the longest symbol sorts first among those sharing an address */
+  for (size_t i = 0; i < index->count; i++) {
+    if (n > 0 && index->starts[n - 1] == index->starts[i])
+      continue;
+    index->starts[n] = index->starts[i];
+    index->extents[n++] = index->extents[i];
+  }
+  index->count = n;
+
+  /* sort again to link the remaining symbols to their enclosing ones */
+  bf_sort_extent_index(index);
+}
+
+struct symbol *symbol_lookup_address(struct symbol_table *table, bfd_vma addr,
+                                     bfd_vma *offset) {
+  struct bf_extent *extent;
+
+  symbol_table_ensure(table);
+  symbol_table_build_once(table, &table->extents_valid,
+                          symbol_table_build_extents);
+
+  extent = bf_find_extent(&table->extents, addr);
+  if (!extent)
+    return NULL;
+
+  if (offset)
+    *offset = addr - extent->start;
+  return extent->obj;
+}
+
+size_t symbol_lookup_addresses(struct symbol_table *table,
+                               const bfd_vma *addrs, size_t count,
+                               struct symbol **syms, bfd_vma *offsets) {
+  long *positions = malloc((count + 1) * sizeof(long));
+  size_t found;
+
+  symbol_table_ensure(table);
+  symbol_table_build_once(table, &table->extents_valid,
+                          symbol_table_build_extents);
+
+  found = bf_find_extents(&table->extents, addrs, count, positions);
+
+  for (size_t i = 0; i < count; i++) {
+    struct bf_extent *extent =
+        positions[i] >= 0 ? &table->extents.extents[positions[i]] : NULL;
+
+    syms[i] = extent ? extent->obj : NULL;
+    if (offsets)
+      offsets[i] = extent ? addrs[i] - extent->start : 0;
+  }
+
+  free(positions);
+  return found;
+}
+
+void symbol_table_init(struct symbol_table *table, bfd *abfd,
+                       struct bf_strpool *strpool) {
+  pthread_mutexattr_t attr;
+
+  /* recursive, loading adds symbols through the public functions */
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&table->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  table->abfd = abfd;
+  table->loaded = false;
+  table->loading = false;
+  table->cache_map = NULL;
+  table->cache_size = 0;
+  table->strpool = strpool;
+  bf_init_extent_index(&table->extents);
+  table->extents_valid = false;
+  table->demangled_index = NULL;
+  table->demangled_index_size = 0;
+  table->demangled_valid = false;
   table->rb_symbol = RB_ROOT;
+  table->symbol_hash_size = symbolhash_size;
+  table->symbol_count = 0;
   table->symbol_hash = malloc(sizeof(struct hlist_head) * symbolhash_size);
   for (int i = 0; i < symbolhash_size; i++)
     INIT_HLIST_HEAD(&table->symbol_hash[i]);
@@ -154,7 +449,11 @@ void symbol_table_destroy(struct symbol_table *table) {
   if (!table)
     return;
 
+  bf_close_extent_index(&table->extents);
+  free(table->demangled_index);
   free(table->symbol_hash);
+  bf_unmap_cache_file(table->cache_map, table->cache_size);
+  pthread_mutex_destroy(&table->lock);
 }
 
 struct bfd_context {
@@ -269,19 +568,15 @@ static void dump_symbols(bfd *abfd, struct bfd_context *ctx, struct symbol_table
         bfd_symbol_info(*asym, &info);
 
         struct symbol *symbol = malloc(sizeof(struct symbol));
-#ifdef HAVE_DEMANGLE_H
-        symbol->name = bfd_demangle(abfd, bfd_asymbol_name(*asym), DMGL_ANSI | DMGL_PARAMS);
-#else
-        symbol->name = (char *)bfd_asymbol_name(*asym);
-#endif
-        if (!symbol->name) {
-          symbol->name = strdup(info.name);
-        } else {
-          symbol->name = strdup(symbol->name);
-	}
+        /* demangling is deferred to symbol_demangled_name() */
+        symbol->name = (char *)bf_strpool_intern(table->strpool, info.name);
+        symbol->demangled = NULL;
         symbol->address = bfd_asymbol_value(*asym);
+        symbol->size = 0;
+        symbol->section = (*asym)->section->name;
         symbol->type = type;
         symbol->asymbol = *asym; // TODO: leaky abstraction
+        symbol->plt_type = PLT_NONE;
 
         INIT_HLIST_NODE(&symbol->symbol_hash);
         rb_init_node(&symbol->rb_symbol);
@@ -302,10 +597,17 @@ static void dump_reloc_set(struct symbol_table *table, bfd *abfd, asection *sec,
     if (rel->sym_ptr_ptr && *rel->sym_ptr_ptr) {
       struct symbol *symbol = malloc(sizeof(struct symbol));
 
-      symbol->name = strdup((*(rel->sym_ptr_ptr))->name);
+      symbol->name = (char *)bf_strpool_intern(table->strpool, (*(rel->sym_ptr_ptr))->name);
+      symbol->demangled = NULL;
       symbol->address = rel->address;
+      symbol->size = bfd_arch_bits_per_address(abfd) / 8;
       symbol->section = (*(rel->sym_ptr_ptr))->section->name;
-      symbol->type = SYMBOL_DYNAMIC;
+      symbol->type = SYMBOL_DYNAMIC | SYMBOL_RELOCATION;
+      symbol->asymbol = NULL;
+      symbol->plt_type = PLT_NONE;
+
+      INIT_HLIST_NODE(&symbol->symbol_hash);
+      rb_init_node(&symbol->rb_symbol);
 
       symbol_add(table, symbol);
       rb_insert_symbol(table, (void *)symbol->address, &symbol->rb_symbol);
@@ -394,6 +696,149 @@ static int dump_bfd(bfd *abfd, struct symbol_table *table, enum target_type type
   return 0;
 }
 
+struct elf_size {
+  bfd_vma address;
+  size_t size;
+};
+
+static int compare_elf_size(const void *a, const void *b) {
+  const struct elf_size *x = a, *y = b;
+
+  if (x->address != y->address)
+    return x->address < y->address ? -1 : 1;
+  return x->size > y->size ? -1 : x->size < y->size;
+}
+
+static int compare_elf_address(const void *a, const void *b) {
+  const struct elf_size *x = a, *y = b;
+
+  return x->address < y->address ? -1 : x->address > y->address;
+}
+
+/**
+ * Reads the st_size of every sized symbol in .symtab and .dynsym, sorted by
+ * address. Only the largest size is kept for each address.
+ */
+static size_t read_elf_sizes(const char *path, struct elf_size **sizes) {
+  Elf_Scn *scn = NULL;
+  Elf *elf;
+  size_t count = 0, capacity = 0, n = 0;
+  int fd;
+
+  *sizes = NULL;
+
+  if (elf_version(EV_CURRENT) == EV_NONE)
+    return 0;
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return 0;
+  if ((elf = elf_begin(fd, ELF_C_READ, NULL)) == NULL) {
+    close(fd);
+    return 0;
+  }
+
+  while ((scn = elf_nextscn(elf, scn)) != NULL) {
+    GElf_Shdr shdr;
+    Elf_Data *data;
+
+    if (gelf_getshdr(scn, &shdr) == NULL || shdr.sh_entsize == 0 ||
+        (shdr.sh_type != SHT_SYMTAB && shdr.sh_type != SHT_DYNSYM))
+      continue;
+    if ((data = elf_getdata(scn, NULL)) == NULL)
+      continue;
+
+    for (size_t i = 0; i < shdr.sh_size / shdr.sh_entsize; i++) {
+      GElf_Sym sym;
+
+      if (gelf_getsym(data, i, &sym) == NULL || sym.st_value == 0 ||
+          sym.st_size == 0)
+        continue;
+
+      if (count == capacity) {
+        capacity = capacity ? capacity * 2 : 256;
+        *sizes = realloc(*sizes, capacity * sizeof(struct elf_size));
+      }
+      (*sizes)[count].address = sym.st_value;
+      (*sizes)[count].size = sym.st_size;
+      count++;
+    }
+  }
+
+  elf_end(elf);
+  close(fd);
+
+  qsort(*sizes, count, sizeof(struct elf_size), compare_elf_size);
+  for (size_t i = 0; i < count; i++) {
+    if (n == 0 || (*sizes)[n - 1].address != (*sizes)[i].address)
+      (*sizes)[n++] = (*sizes)[i];
+  }
+
+  return n;
+}
+
+static int compare_symbol_address(const void *a, const void *b) {
+  const struct symbol *x = *(struct symbol * const *)a;
+  const struct symbol *y = *(struct symbol * const *)b;
+
+  return x->address < y->address ? -1 : x->address > y->address;
+}
+
+/**
+ * Fills in the size of every symbol, from the ELF symbol tables where
+ * available, otherwise as the distance to the next symbol or the end of the
+ * symbol's section.
+ */
+static void fill_symbol_sizes(bfd *abfd, struct symbol_table *table) {
+  struct elf_size *sizes = NULL;
+  struct symbol **syms;
+  size_t nsizes = 0, count = 0, total;
+
+  if (bfd_get_flavour(abfd) == bfd_target_elf_flavour)
+    nsizes = read_elf_sizes(bfd_get_filename(abfd), &sizes);
+
+  syms = symbol_table_collect(table, &total);
+  for (size_t i = 0; i < total; i++) {
+    if (syms[i]->asymbol != NULL && syms[i]->address != 0)
+      syms[count++] = syms[i];
+  }
+
+  qsort(syms, count, sizeof(struct symbol *), compare_symbol_address);
+
+  for (size_t i = 0, next = 0; i < count; i++) {
+    struct elf_size key = { .address = syms[i]->address }, *found;
+    asection *section = syms[i]->asymbol->section;
+    bfd_vma start, end;
+
+    found = nsizes ? bsearch(&key, sizes, nsizes, sizeof(struct elf_size),
+                             compare_elf_address) : NULL;
+    if (found) {
+      syms[i]->size = found->size;
+      continue;
+    }
+
+    if (section == NULL || bfd_is_abs_section(section) ||
+        bfd_is_und_section(section) || bfd_is_com_section(section))
+      continue;
+
+    start = bfd_get_section_vma(abfd, section);
+    end = start + bfd_section_size(abfd, section);
+    if (syms[i]->address < start || syms[i]->address >= end)
+      continue;
+
+    if (next <= i)
+      next = i + 1;
+    while (next < count && syms[next]->address == syms[i]->address)
+      next++;
+    if (next < count && syms[next]->address < end)
+      end = syms[next]->address;
+
+    syms[i]->size = end - syms[i]->address;
+  }
+
+  free(syms);
+  free(sizes);
+  table->extents_valid = false;
+}
+
 static int display_bfd(bfd *abfd, struct symbol_table *table, enum target_type type) {
   if (bfd_check_format(abfd, bfd_object)) {
     dump_bfd(abfd, table, type);
@@ -417,35 +862,28 @@ static int display_bfd(bfd *abfd, struct symbol_table *table, enum target_type t
 }
 
 /**
- * @internal
- * @brief Load the symbol table in bin_file.
- * @param bf The bin_file to load symbols for.
- * @details This takes care of the initial load of symbols and the copying of
- * them into our own structures.
+ * Reads the symbols through BFD.
  */
-int load_sym_table(struct bin_file *file) {
-  if (!file)
-    return -1;
-
+static int symbol_table_load_bfd(struct symbol_table *table) {
   /* Decompress sections unless dumping the section contents.  */
   //if (!dump_section_contents)
   //  file->flags |= BFD_DECOMPRESS;
 
   /* if the file is an archive, process all of its elements */
-  if (bfd_check_format(file->abfd, bfd_archive)) {
+  if (bfd_check_format(table->abfd, bfd_archive)) {
     bfd *last_arfile = NULL;
     bfd *arfile      = NULL;
 
     while(1) {
       bfd_set_error(bfd_error_no_error);
 
-      arfile = bfd_openr_next_archived_file(file->abfd, arfile);
+      arfile = bfd_openr_next_archived_file(table->abfd, arfile);
       if (arfile == NULL) {
         if (bfd_get_error() != bfd_error_no_more_archived_files)
           return -1;
         break;
       }
-      display_bfd(arfile, &file->sym_table, TARGET_STATIC); // TODO: pass as parameter
+      display_bfd(arfile, table, TARGET_STATIC); // TODO: pass as parameter
 
       if (last_arfile != NULL)
         bfd_close(last_arfile);
@@ -455,12 +893,271 @@ int load_sym_table(struct bin_file *file) {
     if (last_arfile != NULL)
       bfd_close(last_arfile);
   } else {
-    display_bfd(file->abfd, &file->sym_table, TARGET_STATIC); // TODO: pass as parameter
+    display_bfd(table->abfd, table, TARGET_STATIC); // TODO: pass as parameter
+    fill_symbol_sizes(table->abfd, table);
   }
 
   return 0;
 }
 
+/*
+ * The symbol cache file holds a header, an array of entries and the NUL
+ * terminated strings the entries refer to by offset. The entries of the
+ * address tree come first, sorted by address, followed by the symbols which
+ * are only indexed by name.
+ */
+#define SYMBOL_CACHE_MAGIC "LIBBFSYM"
+#define SYMBOL_CACHE_VERSION 2
+
+/*
+ * Where a symbol is linked. A symbol whose name was already taken is only in
+ * the address tree, e.g. a relocation named after the symbol it refers to,
+ * and one whose address was already taken is only in the name hash.
+ */
+#define SYMBOL_CACHE_HASH 0x1
+#define SYMBOL_CACHE_TREE 0x2
+
+/* the number of distinct section names looked up before storing */
+#define SYMBOL_CACHE_SECTIONS 64
+
+struct symbol_cache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  uint64_t strings_size;
+  uint64_t checksum;
+};
+
+struct symbol_cache_entry {
+  uint64_t address;
+  uint64_t size;
+  uint32_t name;
+  uint32_t section;
+  uint32_t type;
+  uint16_t plt_type;
+  uint16_t links;
+};
+
+/**
+ * Builds the symbols from a mapped cache file. The names are interned by
+ * reference so the mapping is kept until the table is destroyed.
+ */
+static bool symbol_table_load_cache(struct symbol_table *table, const char *path) {
+  const struct symbol_cache_header *header;
+  const struct symbol_cache_entry *entries;
+  const char *strings;
+  size_t size;
+  void *map = bf_map_cache_file(path, &size);
+
+  if (!map)
+    return false;
+
+  header = map;
+  entries = (const struct symbol_cache_entry *)(header + 1);
+  strings = (const char *)(entries + (size >= sizeof(*header) ? header->count : 0));
+
+  if (size < sizeof(*header) ||
+      memcmp(header->magic, SYMBOL_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SYMBOL_CACHE_VERSION ||
+      size != sizeof(*header) + header->count * sizeof(*entries) + header->strings_size ||
+      header->strings_size == 0 || strings[header->strings_size - 1] != '\0' ||
+      header->checksum != bf_cache_checksum(entries, size - sizeof(*header))) {
+    bf_unmap_cache_file(map, size);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < header->count; i++) {
+    const struct symbol_cache_entry *e = &entries[i];
+    struct symbol *symbol;
+
+    if (e->name >= header->strings_size || e->section >= header->strings_size ||
+        !(e->links & (SYMBOL_CACHE_HASH | SYMBOL_CACHE_TREE)))
+      continue;
+
+    symbol = malloc(sizeof(struct symbol));
+    symbol->name = (char *)bf_strpool_intern_ref(table->strpool, strings + e->name);
+    symbol->demangled = NULL;
+    symbol->address = e->address;
+    symbol->size = e->size;
+    symbol->section = strings + e->section;
+    symbol->type = e->type;
+    symbol->asymbol = NULL;
+    symbol->plt_type = e->plt_type;
+
+    INIT_HLIST_NODE(&symbol->symbol_hash);
+    rb_init_node(&symbol->rb_symbol);
+
+    if (e->links & SYMBOL_CACHE_HASH)
+      symbol_add(table, symbol);
+    else
+      symbol->name_hash = symbol_hashfn(symbol->name);
+    if (e->links & SYMBOL_CACHE_TREE)
+      rb_insert_symbol(table, (void *)symbol->address, &symbol->rb_symbol);
+  }
+
+  table->cache_map = map;
+  table->cache_size = size;
+  return true;
+}
+
+/**
+ * Appends a string to the cache string blob and returns its offset.
+ */
+static uint32_t symbol_cache_string(char **strings, size_t *size, size_t *capacity,
+                                    const char *str) {
+  size_t len = strlen(str) + 1;
+  uint32_t offset = *size;
+
+  if (*size + len > *capacity) {
+    *capacity = (*size + len) * 2;
+    *strings = realloc(*strings, *capacity);
+  }
+  memcpy(*strings + *size, str, len);
+  *size += len;
+  return offset;
+}
+
+/**
+ * Fills in the cache entry of a symbol. Section names are shared by many
+ * symbols so the most common ones are stored once.
+ */
+static void symbol_cache_entry(struct symbol_cache_entry *e, struct symbol *sym,
+                               unsigned int links, char **strings, size_t *size,
+                               size_t *capacity, const char **sections,
+                               uint32_t *section_offsets, size_t *nsections) {
+  size_t s;
+
+  e->address = sym->address;
+  e->size = sym->size;
+  e->type = sym->type;
+  e->plt_type = sym->plt_type;
+  e->links = links;
+  e->name = symbol_cache_string(strings, size, capacity, sym->name);
+  e->section = 0;
+
+  if (!sym->section)
+    return;
+
+  for (s = 0; s < *nsections && sections[s] != sym->section; s++)
+    ;
+  if (s < *nsections) {
+    e->section = section_offsets[s];
+  } else {
+    e->section = symbol_cache_string(strings, size, capacity, sym->section);
+    if (*nsections < SYMBOL_CACHE_SECTIONS) {
+      sections[*nsections] = sym->section;
+      section_offsets[(*nsections)++] = e->section;
+    }
+  }
+}
+
+static void symbol_table_store_cache(struct symbol_table *table, const char *path) {
+  struct symbol_cache_header *header;
+  struct symbol_cache_entry *entries = NULL;
+  struct symbol *sym;
+  struct rb_node *node;
+  const char *sections[SYMBOL_CACHE_SECTIONS];
+  uint32_t section_offsets[SYMBOL_CACHE_SECTIONS];
+  size_t nsections = 0, strings_size = 0, strings_capacity = 4096, n = 0, size;
+  size_t capacity = 0;
+  char *strings = malloc(strings_capacity), *buf;
+
+  symbol_cache_string(&strings, &strings_size, &strings_capacity, "");
+
+  /* every symbol reachable through the tree, the name hash or both */
+  for (node = rb_first(&table->rb_symbol); node; node = rb_next(node)) {
+    sym = rb_entry_symbol(node);
+
+    if (n == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      entries = realloc(entries, capacity * sizeof(*entries));
+    }
+    symbol_cache_entry(&entries[n++], sym, SYMBOL_CACHE_TREE |
+                       (symbol_find(table, sym->name) == sym ? SYMBOL_CACHE_HASH : 0),
+                       &strings, &strings_size, &strings_capacity, sections,
+                       section_offsets, &nsections);
+  }
+
+  for_each_symbol(sym, table) {
+    if (rb_search_symbol(table, (void *)sym->address) == sym)
+      continue;
+
+    if (n == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      entries = realloc(entries, capacity * sizeof(*entries));
+    }
+    symbol_cache_entry(&entries[n++], sym, SYMBOL_CACHE_HASH, &strings,
+                       &strings_size, &strings_capacity, sections,
+                       section_offsets, &nsections);
+  }
+
+  if (strings_size > UINT32_MAX || n > UINT32_MAX)
+    goto out;
+
+  size = sizeof(*header) + n * sizeof(*entries) + strings_size;
+  buf = malloc(size);
+  header = (struct symbol_cache_header *)buf;
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, SYMBOL_CACHE_MAGIC, sizeof(header->magic));
+  header->version = SYMBOL_CACHE_VERSION;
+  header->count = n;
+  header->strings_size = strings_size;
+  if (n)
+    memcpy(buf + sizeof(*header), entries, n * sizeof(*entries));
+  memcpy(buf + sizeof(*header) + n * sizeof(*entries), strings, strings_size);
+  header->checksum = bf_cache_checksum(buf + sizeof(*header), size - sizeof(*header));
+
+  bf_write_cache_file(path, buf, size);
+  free(buf);
+
+out:
+  free(entries);
+  free(strings);
+}
+
+void symbol_table_ensure(struct symbol_table *table) {
+  char *path;
+
+  if (__atomic_load_n(&table->loaded, __ATOMIC_ACQUIRE) || !table->abfd)
+    return;
+
+  pthread_mutex_lock(&table->lock);
+
+  /* loading adds symbols through the public functions, which end up here */
+  if (table->loaded || table->loading)
+    goto out;
+  table->loading = true;
+
+  path = bf_get_cache_path(table->abfd, "sym");
+  if (!path || !symbol_table_load_cache(table, path)) {
+    symbol_table_load_bfd(table);
+    if (path)
+      symbol_table_store_cache(table, path);
+  }
+  free(path);
+
+  table->loading = false;
+  __atomic_store_n(&table->loaded, true, __ATOMIC_RELEASE);
+out:
+  pthread_mutex_unlock(&table->lock);
+}
+
+/**
+ * @internal
+ * @brief Load the symbol table in bin_file.
+ * @param bf The bin_file to load symbols for.
+ * @details This takes care of the initial load of symbols and the copying of
+ * them into our own structures. It is not needed before querying symbols
+ * since every query loads them on demand.
+ */
+int load_sym_table(struct bin_file *file) {
+  if (!file)
+    return -1;
+
+  symbol_table_ensure(&file->sym_table);
+  return 0;
+}
+
 /**
  * @internal
  * @brief Releases memory for all currently discovered symbols.
@@ -468,12 +1165,34 @@ int load_sym_table(struct bin_file *file) {
  */
 void close_sym_table(struct bin_file * bf)
 {
-  struct symbol *sym;
+  struct symbol_table *table = &bf->sym_table;
+  struct rb_node *node;
+
+  for (unsigned int i = 0; i < table->symbol_hash_size; i++) {
+    while (table->symbol_hash[i].first) {
+      struct symbol *sym = symbolhash_entry(table->symbol_hash[i].first);
+
+      hlist_del(&sym->symbol_hash);
+      if (sym->demangled != sym->name)
+        free(sym->demangled);
+      /* symbols sharing an address with another were never linked */
+      if (rb_search_symbol(table, (void *)sym->address) == sym)
+        rb_erase(&sym->rb_symbol, &table->rb_symbol);
+      free(sym);
+    }
+  }
+
+  /* what is left are the symbols whose name was taken by another */
+  while ((node = rb_first(&table->rb_symbol))) {
+    struct symbol *sym = rb_entry_symbol(node);
 
-  for_each_symbol(sym, &bf->sym_table) {
-    hlist_del(&sym->symbol_hash);
-    rb_erase(&sym->rb_symbol, &bf->sym_table.rb_symbol);
-    free(sym->name);
+    rb_erase(node, &table->rb_symbol);
+    if (sym->demangled != sym->name)
+      free(sym->demangled);
     free(sym);
   }
+
+  table->symbol_count = 0;
+  table->extents_valid = false;
+  table->demangled_valid = false;
 }
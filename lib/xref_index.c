@@ -0,0 +1,427 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xref_index.h"
+
+#include <libiberty.h>
+
+#include "parallel.h"
+
+/*
+ * Instructions are scanned for references in chunks of this many.
+ */
+#define XREF_GRAIN 4096
+
+/*
+ * An instruction has at most three operands and an extra_info.
+ */
+#define MAX_INSN_XREFS 4
+
+/*
+ * The references of a chunk of instructions, handed from the workers to
+ * append_chunk().
+ */
+struct XREF_CHUNK {
+	struct bf_xref * xrefs;
+	size_t		 count;
+	size_t		 capacity;
+};
+
+static void add_xrefs(struct bf_xref ** xrefs, size_t * count,
+		size_t * capacity, struct bf_xref * add, size_t num_add)
+{
+	if(num_add == 0) {
+		return;
+	}
+
+	if(*count + num_add > *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 64;
+
+		if(*capacity < *count + num_add) {
+			*capacity = *count + num_add;
+		}
+
+		*xrefs = xrealloc(*xrefs, *capacity * sizeof(struct bf_xref));
+	}
+
+	memcpy(*xrefs + *count, add, num_add * sizeof(struct bf_xref));
+	*count += num_add;
+}
+
+static bool in_sections(struct bf_xref_index * index, bfd_vma vma)
+{
+	return vma >= index->start && vma < index->end;
+}
+
+/*
+ * Gets the address an operand refers to, if any.
+ */
+static bool get_operand_target(struct bf_xref_index * index,
+		struct bf_insn * insn, struct insn_operand * op,
+		bfd_vma * target, enum bf_xref_kind * kind)
+{
+	struct array_index * arr = &op->operand_info.arr_index;
+
+	switch(op->tag) {
+	case OP_VAL:
+		*target = op->operand_info.val;
+
+		if(calls_subroutine(insn->mnemonic)) {
+			*kind = BF_XREF_CALL;
+		} else if(breaks_flow(insn->mnemonic) ||
+				branches_flow(insn->mnemonic)) {
+			*kind = BF_XREF_BRANCH;
+		} else {
+			*kind = BF_XREF_DATA;
+		}
+
+		return TRUE;
+	case OP_IMM:
+		*target = op->operand_info.imm;
+		*kind	= BF_XREF_IMM;
+		return in_sections(index, *target);
+	case OP_ADDR_PTR:
+		*target = op->operand_info.addr_ptr;
+		*kind	= BF_XREF_DATA;
+		return TRUE;
+	case OP_INDEX:
+	case OP_INDEX_PTR:
+		/*
+		 * arr_index_ptr has the same layout as arr_index.
+		 */
+		if(!arr->is_offset_valid) {
+			return FALSE;
+		}
+
+		*kind = BF_XREF_DATA;
+
+		if(arr->tag == ARR_BASE_REG &&
+				arr->arr_info.base_reg == rip_paren_reg) {
+			*target = insn->vma + insn->size;
+			*target = arr->is_offset_negative ?
+					*target - arr->offset :
+					*target + arr->offset;
+			return TRUE;
+		}
+
+		*target = arr->offset;
+		return !arr->is_offset_negative && in_sections(index, *target);
+	default:
+		return FALSE;
+	}
+}
+
+static int add_target(struct bf_insn * insn, struct bf_xref * xrefs,
+		int count, bfd_vma target, enum bf_xref_kind kind)
+{
+	/*
+	 * extra_info usually repeats the address of an operand.
+	 */
+	for(int i = 0; i < count; i++) {
+		if(xrefs[i].target == target) {
+			return count;
+		}
+	}
+
+	xrefs[count].target = target;
+	xrefs[count].from   = insn->vma;
+	xrefs[count].insn   = insn->entry.id;
+	xrefs[count].kind   = kind;
+	return count + 1;
+}
+
+static int get_insn_xrefs(struct bf_xref_index * index, struct bf_insn * insn,
+		struct bf_xref * xrefs)
+{
+	struct insn_operand * ops[3] = {&insn->operand1, &insn->operand2,
+			&insn->operand3};
+	int		      count  = 0;
+
+	if(insn->is_data) {
+		return 0;
+	}
+
+	for(int i = 0; i < 3; i++) {
+		enum bf_xref_kind kind;
+		bfd_vma		  target;
+
+		if(get_operand_target(index, insn, ops[i], &target, &kind)) {
+			count = add_target(insn, xrefs, count, target, kind);
+		}
+	}
+
+	if(insn->extra_info != 0) {
+		count = add_target(insn, xrefs, count, insn->extra_info,
+				BF_XREF_DATA);
+	}
+
+	return count;
+}
+
+static int cmp_xref(const void * a, const void * b)
+{
+	const struct bf_xref * x = a;
+	const struct bf_xref * y = b;
+
+	if(x->target != y->target) {
+		return x->target < y->target ? -1 : 1;
+	} else if(x->from != y->from) {
+		return x->from < y->from ? -1 : 1;
+	}
+
+	return (int)x->kind - (int)y->kind;
+}
+
+static void * scan_insns(struct bf_task_ctx * ctx, size_t first, size_t last)
+{
+	struct bf_xref_index * index = ctx->param;
+	struct XREF_CHUNK *    chunk = xcalloc(1, sizeof(struct XREF_CHUNK));
+
+	for(size_t id = first; id < last; id++) {
+		struct bf_insn * insn = bf_get_insn_by_id(index->bf, id);
+		struct bf_xref	 xrefs[MAX_INSN_XREFS];
+
+		if(insn != NULL) {
+			add_xrefs(&chunk->xrefs, &chunk->count,
+					&chunk->capacity, xrefs,
+					get_insn_xrefs(index, insn, xrefs));
+		}
+	}
+
+	return chunk;
+}
+
+static void append_chunk(size_t first, size_t last, void * result,
+		void * param)
+{
+	struct bf_xref_index * index = param;
+	struct XREF_CHUNK *    chunk = result;
+
+	add_xrefs(&index->xrefs, &index->num_xrefs, &index->capacity,
+			chunk->xrefs, chunk->count);
+	free(chunk->xrefs);
+	free(chunk);
+}
+
+/*
+ * Adds a reference from every relocated slot whose symbol is defined in the
+ * binary. Relocations are only kept in the address tree of the symbol table
+ * since their names usually clash with the symbols they refer to.
+ */
+static void add_reloc_xrefs(struct bf_xref_index * index)
+{
+	struct symbol_table * table = &index->bf->sym_table;
+
+	symbol_table_ensure(table);
+
+	for(struct rb_node * node = rb_first(&table->rb_symbol); node != NULL;
+			node = rb_next(node)) {
+		struct symbol * sym = rb_entry(node, struct symbol, rb_symbol);
+		struct symbol * def;
+		struct bf_xref	xref;
+
+		if(!(sym->type & SYMBOL_RELOCATION)) {
+			continue;
+		}
+
+		def = symbol_find(table, sym->name);
+
+		if(def == NULL || def == sym || def->address == 0 ||
+				(def->type & SYMBOL_RELOCATION)) {
+			continue;
+		}
+
+		xref.target = def->address;
+		xref.from   = sym->address;
+		xref.insn   = BF_NO_INSN;
+		xref.kind   = BF_XREF_RELOC;
+		add_xrefs(&index->xrefs, &index->num_xrefs, &index->capacity,
+				&xref, 1);
+	}
+}
+
+static void add_alloc_range(bfd * abfd, asection * s, void * param)
+{
+	struct bf_xref_index * index = param;
+	bfd_vma		       start = bfd_get_section_vma(abfd, s);
+	bfd_vma		       end   = start + bfd_section_size(abfd, s);
+
+	if((bfd_get_section_flags(abfd, s) & SEC_ALLOC) && start != end) {
+		index->start = start < index->start ? start : index->start;
+		index->end   = end > index->end ? end : index->end;
+	}
+}
+
+struct bf_xref_index * bf_init_xref_index(struct bin_file * bf,
+		unsigned int num_threads)
+{
+	struct bf_xref_index * index;
+
+	if(bf->xref_index != NULL) {
+		return bf->xref_index;
+	}
+
+	index	     = xcalloc(1, sizeof(struct bf_xref_index));
+	index->bf    = bf;
+	index->start = (bfd_vma)-1;
+	index->end   = 0;
+
+	bfd_map_over_sections(bf->abfd, add_alloc_range, index);
+	bf_rebuild_xref_index(index, num_threads);
+	bf->xref_index = index;
+	return index;
+}
+
+void bf_rebuild_xref_index(struct bf_xref_index * index,
+		unsigned int num_threads)
+{
+	index->num_xrefs   = 0;
+	index->num_pending = 0;
+
+	bf_parallel_run(num_threads, bf_get_num_insns(index->bf), XREF_GRAIN,
+			scan_insns, append_chunk, index);
+	add_reloc_xrefs(index);
+
+	qsort(index->xrefs, index->num_xrefs, sizeof(struct bf_xref),
+			cmp_xref);
+}
+
+void bf_add_insn_xrefs(struct bf_xref_index * index, struct bf_insn * insn)
+{
+	struct bf_xref xrefs[MAX_INSN_XREFS];
+
+	add_xrefs(&index->pending, &index->num_pending,
+			&index->pending_capacity, xrefs,
+			get_insn_xrefs(index, insn, xrefs));
+}
+
+/*
+ * Sorts the pending references and merges them into xrefs from the back,
+ * so the existing references are moved at most once.
+ */
+static void merge_pending(struct bf_xref_index * index)
+{
+	size_t i = index->num_xrefs;
+	size_t j = index->num_pending;
+	size_t k = index->num_xrefs + index->num_pending;
+
+	qsort(index->pending, index->num_pending, sizeof(struct bf_xref),
+			cmp_xref);
+
+	if(k > index->capacity) {
+		index->capacity = k > index->capacity * 2 ? k :
+				index->capacity * 2;
+		index->xrefs	= xrealloc(index->xrefs, index->capacity *
+				sizeof(struct bf_xref));
+	}
+
+	while(j > 0) {
+		if(i > 0 && cmp_xref(&index->xrefs[i - 1],
+				&index->pending[j - 1]) > 0) {
+			index->xrefs[--k] = index->xrefs[--i];
+		} else {
+			index->xrefs[--k] = index->pending[--j];
+		}
+	}
+
+	index->num_xrefs  += index->num_pending;
+	index->num_pending = 0;
+}
+
+/*
+ * Finds the first reference whose target is not below vma.
+ */
+static size_t lower_bound(struct bf_xref_index * index, bfd_vma vma)
+{
+	size_t low  = 0;
+	size_t high = index->num_xrefs;
+
+	while(low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if(index->xrefs[mid].target < vma) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+/*
+ * The disassembler appends to pending under bin_file.cflow_lock, so the
+ * merge and the search that follows it take the same lock.
+ */
+size_t bf_get_xrefs(struct bf_xref_index * index, bfd_vma start,
+		bfd_vma end, struct bf_xref ** xrefs)
+{
+	size_t first;
+	size_t count;
+
+	pthread_mutex_lock(&index->bf->cflow_lock);
+
+	if(index->num_pending > 0) {
+		merge_pending(index);
+	}
+
+	first  = lower_bound(index, start);
+	count  = end > start ? lower_bound(index, end) - first : 0;
+	*xrefs = index->xrefs + first;
+
+	pthread_mutex_unlock(&index->bf->cflow_lock);
+	return count;
+}
+
+size_t bf_get_xrefs_to(struct bf_xref_index * index, bfd_vma vma,
+		struct bf_xref ** xrefs)
+{
+	size_t first;
+	size_t count = 0;
+
+	pthread_mutex_lock(&index->bf->cflow_lock);
+
+	if(index->num_pending > 0) {
+		merge_pending(index);
+	}
+
+	/*
+	 * vma + 1 would wrap for the very last address.
+	 */
+	first = lower_bound(index, vma);
+
+	while(first + count < index->num_xrefs &&
+			index->xrefs[first + count].target == vma) {
+		count++;
+	}
+
+	*xrefs = index->xrefs + first;
+
+	pthread_mutex_unlock(&index->bf->cflow_lock);
+	return count;
+}
+
+void bf_close_xref_index(struct bf_xref_index * index)
+{
+	if(index->bf->xref_index == index) {
+		index->bf->xref_index = NULL;
+	}
+
+	free(index->xrefs);
+	free(index->pending);
+	free(index);
+}
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <basic_blk.h>
+#include <func.h>
+#include <insn.h>
+#include <addr_map.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 8
+#define NUM_KEYS    100000
+
+void fail(char * msg, bfd_vma vma)
+{
+	fprintf(stderr, "%s at 0x%lX\n", msg, (unsigned long)vma);
+	xexit(-1);
+}
+
+struct race_info {
+	struct bf_addr_map *   map;
+	struct bf_addr_node *  nodes;
+	struct bf_addr_node ** winners;
+};
+
+/*
+ * Every thread tries to insert its own node for every key.
+ */
+void * race_insert(void * param)
+{
+	struct race_info * info = param;
+
+	for(size_t i = 0; i < NUM_KEYS; i++) {
+		/*
+		 * Spread the keys like instruction addresses.
+		 */
+		bfd_vma key = 0x400000 + i * 3;
+
+		info->winners[i] = bf_addr_map_insert(info->map,
+				&info->nodes[i], key);
+	}
+
+	return NULL;
+}
+
+/*
+ * Checks that exactly one node wins each key when threads race.
+ */
+void test_race(void)
+{
+	struct bf_addr_map    map;
+	struct race_info      info[NUM_THREADS];
+	pthread_t	      threads[NUM_THREADS];
+	struct bf_addr_node * node;
+	struct bf_addr_node * cur;
+	size_t		      visited = 0;
+
+	bf_init_addr_map(&map);
+
+	for(int t = 0; t < NUM_THREADS; t++) {
+		info[t].map	= &map;
+		info[t].nodes	= xcalloc(NUM_KEYS,
+				sizeof(struct bf_addr_node));
+		info[t].winners = xcalloc(NUM_KEYS,
+				sizeof(struct bf_addr_node *));
+		pthread_create(&threads[t], NULL, race_insert, &info[t]);
+	}
+
+	for(int t = 0; t < NUM_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+	}
+
+	if(map.count != NUM_KEYS) {
+		fail("Wrong number of winners", map.count);
+	}
+
+	for(size_t i = 0; i < NUM_KEYS; i++) {
+		bfd_vma		      key    = 0x400000 + i * 3;
+		struct bf_addr_node * winner = bf_addr_map_find(&map, key);
+
+		if(winner == NULL || winner->key != key) {
+			fail("Key not found", key);
+		}
+
+		for(int t = 0; t < NUM_THREADS; t++) {
+			if(info[t].winners[i] != winner) {
+				fail("Threads disagree about the winner", key);
+			}
+		}
+	}
+
+	if(bf_addr_map_find(&map, 0x400001) != NULL) {
+		fail("Found a key which was never inserted", 0x400001);
+	}
+
+	bf_addr_map_for_each_entry(node, cur, &map, key) {
+		visited++;
+	}
+
+	if(visited != NUM_KEYS) {
+		fail("Iteration visited the wrong number of nodes", visited);
+	}
+
+	/*
+	 * Every winner is reachable through its id. Only the ids drawn by
+	 * losers are unused.
+	 */
+	visited = 0;
+
+	for(uint32_t id = 0; id < map.num_ids; id++) {
+		node = bf_addr_map_get(&map, id);
+
+		if(node == NULL) {
+			continue;
+		}
+
+		if(node->id != id ||
+				bf_addr_map_find(&map, node->key) != node) {
+			fail("Id maps to the wrong node", id);
+		}
+
+		visited++;
+	}
+
+	if(visited != NUM_KEYS) {
+		fail("Ids reach the wrong number of nodes", visited);
+	}
+
+	if(bf_addr_map_get(&map, map.num_ids) != NULL) {
+		fail("Found an id which was never handed out", map.num_ids);
+	}
+
+	bf_close_addr_map(&map);
+
+	for(int t = 0; t < NUM_THREADS; t++) {
+		free(info[t].nodes);
+		free(info[t].winners);
+	}
+}
+
+struct disasm_info {
+	struct bin_file * bf;
+	int		  index;
+};
+
+/*
+ * Each thread disassembles every function, starting at a different one so
+ * the threads keep running into each other.
+ */
+void * disasm_share(void * param)
+{
+	struct disasm_info * info = param;
+	struct symbol *	     sym;
+	int		     pass;
+
+	for(pass = 0; pass < 2; pass++) {
+		int n = 0;
+
+		for_each_symbol(sym, &info->bf->sym_table) {
+			if((sym->type & SYMBOL_FUNCTION) && sym->address != 0 &&
+					(n++ % NUM_THREADS == info->index) ==
+					(pass == 0)) {
+				disasm_bin_file_sym(info->bf, sym, TRUE);
+			}
+		}
+	}
+
+	disasm_bin_file_entry(info->bf);
+	return NULL;
+}
+
+unsigned int count_insns(struct bin_file * bf)
+{
+	struct bf_insn * insn;
+	unsigned int	 count = 0;
+
+	bf_for_each_insn(insn, bf) {
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Checks that disassembling from several threads finds the same
+ * instructions and blocks as doing it from one.
+ */
+void test_parallel_disasm(char * target_path)
+{
+	struct bin_file *  serial   = load_bin_file(target_path, NULL);
+	struct bin_file *  parallel = load_bin_file(target_path, NULL);
+	struct disasm_info info[NUM_THREADS];
+	pthread_t	   threads[NUM_THREADS];
+
+	disasm_all_func_sym(serial);
+	disasm_bin_file_entry(serial);
+
+	for(int t = 0; t < NUM_THREADS; t++) {
+		info[t].bf    = parallel;
+		info[t].index = t;
+		pthread_create(&threads[t], NULL, disasm_share, &info[t]);
+	}
+
+	for(int t = 0; t < NUM_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+	}
+
+	if(count_insns(serial) != count_insns(parallel)) {
+		fail("Instruction count differs", 0);
+	}
+
+	{
+		struct bf_insn * insn;
+
+		bf_for_each_insn(insn, serial) {
+			struct bf_insn * insn2 = bf_get_insn(parallel,
+					insn->vma);
+
+			if(insn2 == NULL || insn2->size != insn->size ||
+					insn2->mnemonic != insn->mnemonic ||
+					insn2->bb->vma != insn->bb->vma) {
+				fail("Instruction differs", insn->vma);
+			}
+		}
+	}
+
+	{
+		struct bf_basic_blk * bb;
+
+		bf_for_each_basic_blk(bb, serial) {
+			struct bf_basic_blk * bb2 = bf_get_bb(parallel,
+					bb->vma);
+
+			if(bb2 == NULL || bf_get_bb_length(bb2) !=
+					bf_get_bb_length(bb)) {
+				fail("Basic block differs", bb->vma);
+			}
+
+			if(bf_get_bb_by_id(parallel, bb2->entry.id) != bb2) {
+				fail("Basic block id differs", bb->vma);
+			}
+		}
+	}
+
+	{
+		struct bf_func * func;
+
+		bf_for_each_func(func, serial) {
+			if(!bf_exists_func(parallel, func->vma)) {
+				fail("Function missing", func->vma);
+			}
+		}
+	}
+
+	close_bin_file(serial);
+	close_bin_file(parallel);
+}
+
+int main(int argc, char *argv[])
+{
+	char target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	test_race();
+	test_parallel_disasm(target_path);
+	return EXIT_SUCCESS;
+}
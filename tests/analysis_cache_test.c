@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <basic_blk.h>
+#include <func.h>
+#include <insn.h>
+#include <cache.h>
+#include <analysis_cache.h>
+
+#include "test_target.h"
+
+/*
+ * Points the cache at an empty folder.
+ */
+void create_fresh_cache_folder(char * bitiness)
+{
+	char folder[PATH_MAX];
+	char cmd[PATH_MAX + 16];
+
+	snprintf(folder, sizeof(folder), "%s/tests-cache-output%s",
+			getenv("TEST_BUILD_DIR"), bitiness);
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", folder);
+
+	if(system(cmd)) {
+		perror("Problem creating fresh cache folder.");
+		xexit(-1);
+	}
+
+	bf_enable_cache(folder);
+}
+
+void fail(char * msg, bfd_vma vma)
+{
+	fprintf(stderr, "%s at 0x%lX\n", msg, (unsigned long)vma);
+	xexit(-1);
+}
+
+unsigned int count_insns(struct bin_file * bf)
+{
+	struct bf_insn * insn;
+	unsigned int	 count = 0;
+
+	bf_for_each_insn(insn, bf) {
+		count++;
+	}
+
+	return count;
+}
+
+bool same_parts(struct bf_insn * insn1, struct bf_insn * insn2)
+{
+	struct list_head * p1 = insn1->part_list.next;
+	struct list_head * p2 = insn2->part_list.next;
+
+	while(p1 != &insn1->part_list && p2 != &insn2->part_list) {
+		struct bf_insn_part * part1 = list_entry(p1,
+				struct bf_insn_part, list);
+		struct bf_insn_part * part2 = list_entry(p2,
+				struct bf_insn_part, list);
+
+		if(strcmp(part1->str, part2->str) != 0) {
+			return FALSE;
+		}
+
+		p1 = p1->next;
+		p2 = p2->next;
+	}
+
+	return p1 == &insn1->part_list && p2 == &insn2->part_list;
+}
+
+/*
+ * Checks that every object of the analysed bin_file was restored with the
+ * same contents and links.
+ */
+void compare_analysis(struct bin_file * bf, struct bin_file * restored)
+{
+	struct bf_insn *      insn;
+	struct bf_basic_blk * bb;
+	struct bf_func *      func;
+
+	if(count_insns(bf) != count_insns(restored)) {
+		fail("Instruction count differs", 0);
+	}
+
+	{
+		bf_for_each_insn(insn, bf) {
+			struct bf_insn * insn2 = bf_get_insn(restored,
+					insn->vma);
+
+			if(insn2 == NULL || insn2->size != insn->size ||
+					insn2->mnemonic != insn->mnemonic ||
+					insn2->extra_info != insn->extra_info ||
+					insn2->bb->vma != insn->bb->vma ||
+					!same_parts(insn, insn2)) {
+				fail("Instruction differs", insn->vma);
+			}
+		}
+	}
+
+	{
+		bf_for_each_basic_blk(bb, bf) {
+			struct bf_basic_blk * bb2 = bf_get_bb(restored,
+					bb->vma);
+
+			if(bb2 == NULL ||
+					bf_get_bb_length(bb2) !=
+					bf_get_bb_length(bb) ||
+					!bb->target != !bb2->target ||
+					!bb->target2 != !bb2->target2 ||
+					(bb->target && bb->target->vma !=
+					bb2->target->vma) ||
+					(bb->target2 && bb->target2->vma !=
+					bb2->target2->vma)) {
+				fail("Basic block differs", bb->vma);
+			}
+		}
+	}
+
+	{
+		bf_for_each_func(func, bf) {
+			if(!bf_exists_func(restored, func->vma)) {
+				fail("Function missing", func->vma);
+			}
+		}
+	}
+}
+
+/*
+ * Flips a byte in the middle of the cache file.
+ */
+void corrupt_cache(struct bin_file * bf)
+{
+	char * path = bf_get_cache_path(bf->abfd, "cfg");
+	int    fd   = open(path, O_RDWR);
+	off_t  size = lseek(fd, 0, SEEK_END);
+	char   c;
+
+	pread(fd, &c, 1, size / 2);
+	c ^= 0xFF;
+	pwrite(fd, &c, 1, size / 2);
+	close(fd);
+	free(path);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	struct bin_file * restored;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	create_fresh_cache_folder(argv[1]);
+
+	bf = load_bin_file(target_path, NULL);
+
+	if(count_insns(bf) != 0) {
+		fail("Analysis restored from an empty cache", 0);
+	}
+
+	disasm_bin_file_entry(bf);
+	disasm_all_func_sym(bf);
+
+	if(!bf_save_analysis(bf)) {
+		fail("Unable to write the analysis cache", 0);
+	}
+
+	restored = load_bin_file(target_path, NULL);
+	compare_analysis(bf, restored);
+	close_bin_file(restored);
+
+	corrupt_cache(bf);
+	restored = load_bin_file(target_path, NULL);
+
+	if(count_insns(restored) != 0) {
+		fail("Analysis restored from a corrupt cache", 0);
+	}
+
+	close_bin_file(restored);
+	printf("Restored %u instructions\n", count_insns(bf));
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
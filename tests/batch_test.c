@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <batch.h>
+
+#include "test_target.h"
+
+#define NUM_WORKERS 4
+
+/*
+ * What each binary of the batch is expected to end with.
+ */
+enum BINARY {
+	BINARY_OK,
+	BINARY_CRASH,
+	BINARY_GARBAGE,
+	BINARY_REJECT,
+	BINARY_OK_AGAIN,
+	NUM_BINARIES
+};
+
+static const enum bf_batch_status expected[NUM_BINARIES] = {
+	BF_BATCH_OK,
+	BF_BATCH_CRASHED,
+	BF_BATCH_LOAD_FAILED,
+	BF_BATCH_ANALYSE_FAILED,
+	BF_BATCH_OK
+};
+
+struct BATCH_TEST {
+	char * paths[NUM_BINARIES];
+	char   marker[PATH_MAX];
+	int    seen[NUM_BINARIES];
+};
+
+void fail(char * msg, const char * path)
+{
+	fprintf(stderr, "%s: %s\n", msg, path ? path : "(null)");
+	xexit(-1);
+}
+
+/*
+ * Runs in the workers. The marker file exists while a binary is being
+ * analysed, so finding it already there means two analyses overlap.
+ */
+bool analyse(struct bin_file * bf, FILE * out, void * param)
+{
+	struct BATCH_TEST * test = param;
+	const char *	    path = bfd_get_filename(bf->abfd);
+	int		    fd;
+
+	if(strcmp(path, test->paths[BINARY_CRASH]) == 0) {
+		abort();
+	}
+
+	fd = open(test->marker, O_CREAT | O_EXCL | O_WRONLY, 0600);
+
+	if(fd == -1 && errno == EEXIST) {
+		fprintf(out, "overlap\n");
+	}
+
+	usleep(100000);
+
+	if(fd != -1) {
+		close(fd);
+		unlink(test->marker);
+	}
+
+	fprintf(out, "analysed %s\n", path);
+	return strcmp(path, test->paths[BINARY_REJECT]) != 0;
+}
+
+void handle_result(struct bf_batch_result * result, void * param)
+{
+	struct BATCH_TEST * test = param;
+
+	if(result->index >= NUM_BINARIES ||
+			result->path != test->paths[result->index]) {
+		fail("Result for an unknown binary", result->path);
+	}
+
+	test->seen[result->index]++;
+
+	if(result->status != expected[result->index]) {
+		fail("Wrong status", result->path);
+	}
+
+	if(result->output[result->output_len] != '\0' ||
+			strstr(result->output, "overlap") != NULL) {
+		fail("Binaries analysed at once over the budget",
+				result->path);
+	}
+
+	if(result->status == BF_BATCH_OK && (result->num_insns == 0 ||
+			result->num_funcs == 0 ||
+			strstr(result->output, "analysed") == NULL)) {
+		fail("Binary not analysed", result->path);
+	}
+}
+
+/*
+ * Runs the batch and checks every binary is reported exactly once.
+ */
+void run_batch(struct BATCH_TEST * test, unsigned int num_workers,
+		size_t mem_budget)
+{
+	struct bf_batch_options options;
+	size_t			num_ok;
+
+	bf_init_batch_options(&options);
+	options.num_workers = num_workers;
+	options.mem_budget  = mem_budget;
+	options.analyse	    = analyse;
+	options.param	    = test;
+
+	memset(test->seen, 0, sizeof(test->seen));
+	num_ok = bf_run_batch(test->paths, NUM_BINARIES, &options,
+			handle_result, test);
+
+	for(int i = 0; i < NUM_BINARIES; i++) {
+		if(test->seen[i] != 1) {
+			fail("Binary not reported exactly once",
+					test->paths[i]);
+		}
+	}
+
+	if(num_ok != 2) {
+		fail("Wrong number of analysed binaries", NULL);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct BATCH_TEST test;
+	char		  target_path[PATH_MAX]  = {0};
+	char		  target_path2[PATH_MAX] = {0};
+	char		  reject_path[PATH_MAX]	 = {0};
+	char		  garbage_path[]	 = "/tmp/batch_test_XXXXXX";
+	char		  marker_dir[]		 = "/tmp/batch_test_XXXXXX";
+	int		  fd;
+
+	check_test_args(argc, argv);
+
+	/*
+	 * The same target reached through another path is told apart by
+	 * analyse.
+	 */
+	if(!get_named_target_path(target_path, ARRAY_SIZE(target_path),
+			"detour_target_", argv[1]) ||
+			!get_named_target_path(target_path2,
+			ARRAY_SIZE(target_path2), "detour_target_v2_",
+			argv[1]) || !get_named_target_path(reject_path,
+			ARRAY_SIZE(reject_path), "./detour_target_", argv[1])) {
+		perror("Unable to find detour target.");
+		xexit(-1);
+	}
+
+	fd = mkstemp(garbage_path);
+
+	if(fd == -1 || write(fd, "not an object file\n", 19) != 19 ||
+			mkdtemp(marker_dir) == NULL) {
+		perror("Unable to create temporary files.");
+		xexit(-1);
+	}
+
+	close(fd);
+	snprintf(test.marker, sizeof(test.marker), "%s/running", marker_dir);
+
+	test.paths[BINARY_OK]	    = target_path;
+	test.paths[BINARY_CRASH]    = target_path2;
+	test.paths[BINARY_GARBAGE]  = garbage_path;
+	test.paths[BINARY_REJECT]   = reject_path;
+	test.paths[BINARY_OK_AGAIN] = target_path;
+
+	/*
+	 * A single worker has to be respawned after the crash for the
+	 * remaining binaries to be analysed at all.
+	 */
+	run_batch(&test, 1, 0);
+
+	/*
+	 * Every binary exceeds a one byte budget on its own, so they are
+	 * analysed one at a time despite the workers.
+	 */
+	run_batch(&test, NUM_WORKERS, 1);
+
+	unlink(garbage_path);
+	rmdir(marker_dir);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <byte_scan.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+#define NUM_SIGS    200
+#define MAX_SIG_LEN 10
+#define BUF_SIZE    (256 * 1024)
+
+/*
+ * A signature as the test expects it to be matched.
+ */
+struct SIG {
+	bfd_byte bytes[MAX_SIG_LEN];
+	bfd_byte mask[MAX_SIG_LEN];
+	size_t	 length;
+};
+
+/*
+ * The matches reported by a scan. They have to come sorted by VMA and
+ * signature, and their sequence is hashed so that scans can be compared.
+ */
+struct MATCHES {
+	struct SIG * sigs;
+	size_t *     counts;
+	bfd_vma	     last_vma;
+	int	     last_sig;
+	bool	     sorted;
+	uint64_t     hash;
+};
+
+void fail(char * msg, int sig)
+{
+	fprintf(stderr, "%s: %d\n", msg, sig);
+	xexit(-1);
+}
+
+bool match_at(struct SIG * sig, const bfd_byte * buf)
+{
+	for(size_t i = 0; i < sig->length; i++) {
+		if((buf[i] & sig->mask[i]) != sig->bytes[i]) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Counts the matches of every signature by trying each offset in turn.
+ */
+void count_naive(struct SIG * sigs, int num_sigs, const bfd_byte * buf,
+		size_t size, size_t * counts)
+{
+	for(size_t i = 0; i < size; i++) {
+		for(int s = 0; s < num_sigs; s++) {
+			if(sigs[s].length <= size - i &&
+					match_at(&sigs[s], buf + i)) {
+				counts[s]++;
+			}
+		}
+	}
+}
+
+void record_match(struct bf_byte_match * match, void * param)
+{
+	struct MATCHES * matches = param;
+
+	if(!match_at(&matches->sigs[match->sig], match->data)) {
+		fail("Reported bytes do not match", match->sig);
+	}
+
+	if(match->param != &matches->sigs[match->sig]) {
+		fail("Wrong param", match->sig);
+	}
+
+	if(match->vma < matches->last_vma || (match->vma ==
+			matches->last_vma && match->sig <= matches->last_sig)) {
+		matches->sorted = FALSE;
+	}
+
+	matches->counts[match->sig]++;
+	matches->last_vma = match->vma;
+	matches->last_sig = match->sig;
+	matches->hash	  = (matches->hash ^ match->vma ^
+			((uint64_t)match->sig << 48)) * 0x100000001B3ULL;
+}
+
+void init_matches(struct MATCHES * matches, struct SIG * sigs,
+		int num_sigs)
+{
+	matches->sigs	  = sigs;
+	matches->counts	  = xcalloc(num_sigs, sizeof(size_t));
+	matches->last_vma = 0;
+	matches->last_sig = -1;
+	matches->sorted	  = TRUE;
+	matches->hash	  = 0xCBF29CE484222325ULL;
+}
+
+/*
+ * Adds a signature written as "xx xx ...". It is parsed here as well, so the
+ * expected matches do not depend on the parser under test.
+ */
+void add_sig(struct bf_byte_scanner * scanner, struct SIG * sigs,
+		const char * hex)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	struct SIG * sig = &sigs[scanner->num_sigs];
+
+	sig->length = 0;
+
+	for(const char * pos = hex; *pos != '\0'; pos++) {
+		int nibble = (pos - hex) % 3;
+
+		if(nibble == 2) {
+			continue;
+		}
+
+		if(nibble == 0) {
+			sig->bytes[sig->length] = 0;
+			sig->mask[sig->length++] = 0;
+		}
+
+		sig->bytes[sig->length - 1] <<= 4;
+		sig->mask[sig->length - 1]  <<= 4;
+
+		if(*pos != '?') {
+			sig->bytes[sig->length - 1] |= strchr(digits,
+					tolower((unsigned char)*pos)) - digits;
+			sig->mask[sig->length - 1]  |= 0xf;
+		}
+	}
+
+	if(bf_add_byte_signature(scanner, hex, sig) != sig - sigs) {
+		fail("Rejected good signature", sig - sigs);
+	}
+}
+
+void test_add(void)
+{
+	static const char * const bad[] = {"", " ", "4", "4g", "4 1", "0x12"};
+
+	struct bf_byte_scanner * scanner = bf_init_byte_scanner();
+	bfd_byte		 byte	 = 0x90;
+
+	for(size_t i = 0; i < ARRAY_SIZE(bad); i++) {
+		if(bf_add_byte_signature(scanner, bad[i], NULL) != -1) {
+			fail("Accepted bad signature", (int)i);
+		}
+	}
+
+	if(bf_add_byte_signature_masked(scanner, &byte, NULL, 0, NULL) != -1) {
+		fail("Accepted empty signature", 0);
+	}
+
+	if(scanner->num_sigs != 0 || bf_add_byte_signature_masked(scanner,
+			&byte, NULL, 1, NULL) != 0) {
+		fail("Wrong signature id", scanner->num_sigs);
+	}
+
+	bf_close_byte_scanner(scanner);
+}
+
+/*
+ * Random signatures with wildcard nibbles over a buffer with few distinct
+ * bytes, so that most signatures match somewhere.
+ */
+void test_buffer(void)
+{
+	struct bf_byte_scanner * scanner = bf_init_byte_scanner();
+	struct SIG *		 sigs	 = xcalloc(NUM_SIGS,
+			sizeof(struct SIG));
+	size_t *		 counts	 = xcalloc(NUM_SIGS, sizeof(size_t));
+	bfd_byte *		 buf	 = xmalloc(BUF_SIZE);
+	struct MATCHES		 matches;
+	size_t			 total	 = 0;
+
+	srand(7);
+
+	for(int s = 0; s < NUM_SIGS; s++) {
+		char   hex[3 * MAX_SIG_LEN + 1];
+		char * pos    = hex;
+		int    length = 1 + rand() % MAX_SIG_LEN;
+
+		for(int i = 0; i < length; i++) {
+			int r = rand() % 10;
+
+			*pos++ = r == 0 ? '?' : "01"[rand() % 2];
+			*pos++ = r == 1 ? '?' : "012"[rand() % 3];
+			*pos++ = ' ';
+		}
+
+		*pos = '\0';
+		add_sig(scanner, sigs, hex);
+	}
+
+	for(size_t i = 0; i < BUF_SIZE; i++) {
+		buf[i] = (rand() % 2) << 4 | rand() % 3;
+	}
+
+	init_matches(&matches, sigs, NUM_SIGS);
+	count_naive(sigs, NUM_SIGS, buf, BUF_SIZE, counts);
+
+	if(bf_scan_bytes(scanner, buf, BUF_SIZE, 0x1000, NULL, record_match,
+			&matches) == 0) {
+		fail("No matches", 0);
+	}
+
+	for(int s = 0; s < NUM_SIGS; s++) {
+		if(matches.counts[s] != counts[s]) {
+			fail("Wrong number of matches", s);
+		}
+
+		total += counts[s];
+	}
+
+	printf("Found %zu matches in a buffer\n", total);
+	free(matches.counts);
+	free(counts);
+	free(buf);
+	free(sigs);
+	bf_close_byte_scanner(scanner);
+}
+
+struct NAIVE_SECTIONS {
+	struct SIG * sigs;
+	int	     num_sigs;
+	size_t *     counts;
+	size_t	     max_size;
+};
+
+void count_section(bfd * abfd, asection * s, void * param)
+{
+	struct NAIVE_SECTIONS * naive = param;
+	flagword		want  = SEC_ALLOC | SEC_LOAD |
+			SEC_HAS_CONTENTS;
+	size_t			size  = bfd_section_size(abfd, s);
+	bfd_byte *		buf;
+
+	if((bfd_get_section_flags(abfd, s) & want) != want || size == 0) {
+		return;
+	}
+
+	buf = xmalloc(size);
+
+	if(!bfd_get_section_contents(abfd, s, buf, 0, size)) {
+		fail("Unable to read section", 0);
+	}
+
+	count_naive(naive->sigs, naive->num_sigs, buf, size, naive->counts);
+	naive->max_size = size > naive->max_size ? size : naive->max_size;
+	free(buf);
+}
+
+/*
+ * scan_blob makes .data span several chunks, and the zero signatures
+ * match across every chunk boundary inside it.
+ */
+void test_sections(struct bin_file * bf)
+{
+	static const char * const hex[] = {"00 00 00 00 00 00 00 00",
+			"00 ?? 00 ?0", "01 00 00", "55", "c3",
+			"?? ?? 00 00 00 00"};
+
+	struct bf_byte_scanner * scanner = bf_init_byte_scanner();
+	int			 num_sigs = ARRAY_SIZE(hex);
+	struct SIG *		 sigs	 = xcalloc(num_sigs,
+			sizeof(struct SIG));
+	struct NAIVE_SECTIONS	 naive	 = {sigs, num_sigs, NULL, 0};
+	struct MATCHES		 matches;
+	struct MATCHES		 matches2;
+	size_t			 count;
+
+	for(int s = 0; s < num_sigs; s++) {
+		add_sig(scanner, sigs, hex[s]);
+	}
+
+	naive.counts = xcalloc(num_sigs, sizeof(size_t));
+	bfd_map_over_sections(bf->abfd, count_section, &naive);
+
+	if(naive.max_size <= 2 * 1024 * 1024) {
+		fail("No section spans several chunks", 0);
+	}
+
+	init_matches(&matches, sigs, num_sigs);
+	count = bf_scan_sections(scanner, bf, 1, record_match, &matches);
+
+	init_matches(&matches2, sigs, num_sigs);
+
+	if(bf_scan_sections(scanner, bf, NUM_THREADS, record_match,
+			&matches2) != count) {
+		fail("Parallel scan differs", 0);
+	}
+
+	if(!matches.sorted || !matches2.sorted) {
+		fail("Matches not sorted", 0);
+	}
+
+	for(int s = 0; s < num_sigs; s++) {
+		if(matches.counts[s] != naive.counts[s]) {
+			fail("Wrong number of matches", s);
+		}
+	}
+
+	if(matches.hash != matches2.hash) {
+		fail("Parallel scan differs", 0);
+	}
+
+	printf("Found %zu matches in the sections\n", count);
+	free(matches.counts);
+	free(matches2.counts);
+	free(naive.counts);
+	free(sigs);
+	bf_close_byte_scanner(scanner);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	test_add();
+	test_buffer();
+
+	bf = load_bin_file(target_path, NULL);
+	test_sections(bf);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
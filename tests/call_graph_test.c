@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <func.h>
+#include <call_graph.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+
+/*
+ * The direct calls made by the target.
+ */
+static const char * const expected_calls[][2] = {
+	{"main",	  "func1"},
+	{"main",	  "checksum"},
+	{"checksum",	  "count_digits"},
+	{"count_digits",  "count_digits"},
+	{"checksum_pair", "checksum"}
+};
+
+void fail(char * msg, const char * name)
+{
+	fprintf(stderr, "%s: %s\n", msg, name ? name : "(null)");
+	xexit(-1);
+}
+
+uint32_t get_node(struct bf_call_graph * graph, const char * name)
+{
+	struct bf_func * func = bf_get_func_from_name(graph->bf, (char *)name);
+	uint32_t	 node = bf_get_call_graph_node(graph, func);
+
+	if(node == BF_NO_NODE) {
+		fail("Function not in the graph", name);
+	}
+
+	return node;
+}
+
+bool calls(struct bf_call_graph * graph, uint32_t node, uint32_t callee)
+{
+	uint32_t i;
+
+	bf_for_each_callee(i, graph, node) {
+		if(graph->callees[i] == callee) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void test_edges(struct bf_call_graph * graph)
+{
+	uint32_t num_callers = 0;
+
+	for(size_t i = 0; i < ARRAY_SIZE(expected_calls); i++) {
+		if(!calls(graph, get_node(graph, expected_calls[i][0]),
+				get_node(graph, expected_calls[i][1]))) {
+			fail("Missing call from", expected_calls[i][0]);
+		}
+	}
+
+	/*
+	 * Every edge appears once and callers is the transpose of callees.
+	 */
+	for(uint32_t node = 0; node < graph->num_nodes; node++) {
+		uint32_t i, j;
+
+		bf_for_each_callee(i, graph, node) {
+			bool found = FALSE;
+
+			for(j = i + 1; j < graph->callee_offsets[node + 1];
+					j++) {
+				if(graph->callees[j] == graph->callees[i]) {
+					fail("Duplicate edge", NULL);
+				}
+			}
+
+			bf_for_each_caller(j, graph, graph->callees[i]) {
+				found = found || graph->callers[j] == node;
+			}
+
+			if(!found) {
+				fail("Edge missing from the callers", NULL);
+			}
+		}
+
+		num_callers += graph->caller_offsets[node + 1] -
+				graph->caller_offsets[node];
+	}
+
+	if(num_callers != graph->num_edges ||
+			graph->callee_offsets[graph->num_nodes] !=
+			graph->num_edges) {
+		fail("Wrong number of edges", NULL);
+	}
+}
+
+/*
+ * checksum_pair calls checksum twice. Both sites are kept, the edge only
+ * once.
+ */
+void test_sites(struct bf_call_graph * graph)
+{
+	uint32_t node	  = get_node(graph, "checksum_pair");
+	uint32_t checksum = get_node(graph, "checksum");
+	uint32_t sites	  = 0;
+	uint32_t edges	  = 0;
+	uint32_t i;
+
+	bf_for_each_call_site(i, graph, node) {
+		sites += graph->sites[i].index == (int)checksum;
+	}
+
+	bf_for_each_callee(i, graph, node) {
+		edges += graph->callees[i] == checksum;
+	}
+
+	if(sites != 2 || edges != 1) {
+		fail("Repeated call not deduplicated", "checksum_pair");
+	}
+}
+
+void test_sccs(struct bf_call_graph * graph)
+{
+	uint32_t count_digits = get_node(graph, "count_digits");
+	uint32_t num_nodes    = 0;
+
+	if(!bf_is_recursive_node(graph, count_digits)) {
+		fail("Recursion not found", "count_digits");
+	}
+
+	if(bf_is_recursive_node(graph, get_node(graph, "checksum")) ||
+			bf_is_recursive_node(graph, get_node(graph, "main"))) {
+		fail("Recursion found", NULL);
+	}
+
+	/*
+	 * Components are in reverse topological order.
+	 */
+	for(uint32_t node = 0; node < graph->num_nodes; node++) {
+		uint32_t i;
+
+		bf_for_each_callee(i, graph, node) {
+			if(graph->scc[graph->callees[i]] > graph->scc[node]) {
+				fail("Components out of order", NULL);
+			}
+		}
+	}
+
+	for(uint32_t comp = 0; comp < graph->num_sccs; comp++) {
+		uint32_t i;
+
+		bf_for_each_scc_node(i, graph, comp) {
+			if(graph->scc[graph->scc_nodes[i]] != comp) {
+				fail("Node in the wrong component", NULL);
+			}
+		}
+
+		num_nodes += graph->scc_offsets[comp + 1] -
+				graph->scc_offsets[comp];
+	}
+
+	if(num_nodes != graph->num_nodes) {
+		fail("Components do not cover the graph", NULL);
+	}
+
+	if(graph->scc_offsets[graph->scc[count_digits] + 1] -
+			graph->scc_offsets[graph->scc[count_digits]] != 1) {
+		fail("Wrong component size", "count_digits");
+	}
+}
+
+void test_reaches(struct bf_call_graph * graph)
+{
+	uint32_t main_node    = get_node(graph, "main");
+	uint32_t count_digits = get_node(graph, "count_digits");
+	uint32_t func1	      = get_node(graph, "func1");
+
+	if(!bf_call_graph_reaches(graph, main_node, count_digits) ||
+			!bf_call_graph_reaches(graph, count_digits,
+			count_digits)) {
+		fail("Node not reached", "count_digits");
+	}
+
+	if(bf_call_graph_reaches(graph, count_digits, main_node) ||
+			bf_call_graph_reaches(graph, func1, func1) ||
+			bf_call_graph_reaches(graph, func1, count_digits)) {
+		fail("Node reached", NULL);
+	}
+}
+
+/*
+ * func1 calls puts through its PLT stub.
+ */
+void test_imports(struct bf_call_graph * graph)
+{
+	uint32_t node  = get_node(graph, "func1");
+	bool	 found = FALSE;
+	uint32_t i;
+
+	bf_for_each_callee(i, graph, node) {
+		const char * import = graph->imports[graph->callees[i]];
+
+		if(import != NULL && strcmp(import, "puts") == 0) {
+			found = TRUE;
+		}
+	}
+
+	if(!found) {
+		fail("Import not resolved", "puts");
+	}
+}
+
+void compare_graphs(struct bf_call_graph * graph,
+		struct bf_call_graph * graph2)
+{
+	if(graph->num_nodes != graph2->num_nodes ||
+			graph->num_edges != graph2->num_edges ||
+			graph->num_sites != graph2->num_sites ||
+			graph->num_sccs != graph2->num_sccs ||
+			memcmp(graph->callee_offsets, graph2->callee_offsets,
+			(graph->num_nodes + 1) * sizeof(uint32_t)) != 0 ||
+			memcmp(graph->callees, graph2->callees,
+			graph->num_edges * sizeof(uint32_t)) != 0 ||
+			memcmp(graph->scc, graph2->scc,
+			graph->num_nodes * sizeof(uint32_t)) != 0) {
+		fail("Parallel graph differs", NULL);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file *      bf;
+	struct bf_call_graph * graph;
+	struct bf_call_graph * graph2;
+	char		       target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+
+	graph = bf_init_call_graph(bf, 1);
+	test_edges(graph);
+	test_sites(graph);
+	test_sccs(graph);
+	test_reaches(graph);
+	test_imports(graph);
+
+	graph2 = bf_init_call_graph(bf, NUM_THREADS);
+	compare_graphs(graph, graph2);
+
+	printf("Found %u edges and %u components among %u nodes\n",
+			graph->num_edges, graph->num_sccs, graph->num_nodes);
+	bf_close_call_graph(graph);
+	bf_close_call_graph(graph2);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <cache.h>
+#include <basic_blk.h>
+#include <func.h>
+#include <insn.h>
+#include <disasm.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 8
+
+struct DISASM_THREAD {
+	struct bin_file * bf;
+	int		  index;
+	pthread_t	  thread;
+};
+
+void fail(char * msg, bfd_vma vma)
+{
+	fprintf(stderr, "%s at 0x%lX\n", msg, (unsigned long)vma);
+	xexit(-1);
+}
+
+/*
+ * Generates the CFG of every function of the target. Each thread starts at
+ * a different function, so the threads keep running into code another one
+ * is decoding.
+ */
+void * disasm_main(void * param)
+{
+	struct DISASM_THREAD * disasm = param;
+	struct symbol *	       sym;
+
+	for(int pass = 0; pass < 2; pass++) {
+		int n = 0;
+
+		for_each_symbol(sym, &disasm->bf->sym_table) {
+			if((sym->type & SYMBOL_FUNCTION) && sym->address != 0 &&
+					(n++ % NUM_THREADS == disasm->index) ==
+					(pass == 0)) {
+				disasm_generate_cflow(disasm->bf, sym->address,
+						TRUE);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Each decoder prints into its own buffer, so the text of an instruction
+ * must not pick up parts of another one decoded at the same time.
+ */
+bool same_parts(struct bf_insn * insn1, struct bf_insn * insn2)
+{
+	struct list_head * p1 = insn1->part_list.next;
+	struct list_head * p2 = insn2->part_list.next;
+
+	while(p1 != &insn1->part_list && p2 != &insn2->part_list) {
+		struct bf_insn_part * part1 = list_entry(p1,
+				struct bf_insn_part, list);
+		struct bf_insn_part * part2 = list_entry(p2,
+				struct bf_insn_part, list);
+
+		if(strcmp(part1->str, part2->str) != 0) {
+			return FALSE;
+		}
+
+		p1 = p1->next;
+		p2 = p2->next;
+	}
+
+	return p1 == &insn1->part_list && p2 == &insn2->part_list;
+}
+
+size_t count_insns(struct bin_file * bf)
+{
+	struct bf_insn * insn;
+	size_t		 count = 0;
+
+	bf_for_each_insn(insn, bf) {
+		count++;
+	}
+
+	return count;
+}
+
+void compare_insns(struct bin_file * serial, struct bin_file * bf)
+{
+	struct bf_insn * insn;
+
+	bf_for_each_insn(insn, serial) {
+		struct bf_insn * insn2 = bf_get_insn(bf, insn->vma);
+
+		if(insn2 == NULL || insn2->size != insn->size ||
+				insn2->mnemonic != insn->mnemonic ||
+				insn2->bb == NULL ||
+				insn2->bb->vma != insn->bb->vma ||
+				!same_parts(insn, insn2)) {
+			fail("Instruction differs", insn->vma);
+		}
+	}
+
+	if(count_insns(serial) != count_insns(bf)) {
+		fail("Different number of instructions", 0);
+	}
+}
+
+bool same_target(struct bf_basic_blk * target, struct bf_basic_blk * target2)
+{
+	return target == NULL ? target2 == NULL :
+			target2 != NULL && target->vma == target2->vma;
+}
+
+/*
+ * Blocks split by one thread while another was still building them have to
+ * end up with the same bounds and edges as when decoded one at a time.
+ */
+void compare_bbs(struct bin_file * serial, struct bin_file * bf)
+{
+	struct bf_basic_blk * bb;
+
+	bf_for_each_basic_blk(bb, serial) {
+		struct bf_basic_blk * bb2 = bf_get_bb(bf, bb->vma);
+
+		if(bb2 == NULL ||
+				bf_get_bb_length(bb2) != bf_get_bb_length(bb) ||
+				!same_target(bb->target, bb2->target) ||
+				!same_target(bb->target2, bb2->target2)) {
+			fail("Block differs", bb->vma);
+		}
+	}
+}
+
+void compare_funcs(struct bin_file * serial, struct bin_file * bf)
+{
+	struct bf_func * func;
+
+	bf_for_each_func(func, serial) {
+		if(!bf_exists_func(bf, func->vma)) {
+			fail("Function missing", func->vma);
+		}
+	}
+}
+
+/*
+ * Several threads generating CFGs of one bin_file at once have to find
+ * exactly what a single thread finds.
+ */
+void test_concurrent(char * target_path)
+{
+	struct bin_file *    serial = load_bin_file(target_path, NULL);
+	struct bin_file *    bf	    = load_bin_file(target_path, NULL);
+	struct DISASM_THREAD threads[NUM_THREADS];
+
+	threads[0].bf	 = serial;
+	threads[0].index = 0;
+	disasm_main(&threads[0]);
+
+	for(int i = 0; i < NUM_THREADS; i++) {
+		threads[i].bf	 = bf;
+		threads[i].index = i;
+
+		if(pthread_create(&threads[i].thread, NULL, disasm_main,
+				&threads[i]) != 0) {
+			perror("Unable to start a disassembling thread.");
+			xexit(-1);
+		}
+	}
+
+	for(int i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i].thread, NULL);
+	}
+
+	compare_insns(serial, bf);
+	compare_bbs(serial, bf);
+	compare_funcs(serial, bf);
+
+	printf("Decoded %zu instructions from %d threads\n", count_insns(bf),
+			NUM_THREADS);
+	close_bin_file(serial);
+	close_bin_file(bf);
+}
+
+int main(int argc, char *argv[])
+{
+	char target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	/*
+	 * Decode from scratch even when LIBBF_CACHE_DIR is set.
+	 */
+	bf_disable_cache();
+	test_concurrent(target_path);
+	return EXIT_SUCCESS;
+}
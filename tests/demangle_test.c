@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <func.h>
+#include <symbol.h>
+
+#include "test_target.h"
+
+/*
+ * The raw name of ns::mangled(int) in the target.
+ */
+#define MANGLED_NAME   "_ZN2ns7mangledEi"
+#define DEMANGLED_NAME "ns::mangled(int)"
+
+#define NUM_THREADS 8
+
+struct DEMANGLE_THREAD {
+	struct bin_file * bf;
+	const char *	  name;
+	pthread_t	  thread;
+};
+
+void fail(char * msg, const char * name)
+{
+	fprintf(stderr, "%s: %s\n", msg, name ? name : "(null)");
+	xexit(-1);
+}
+
+/*
+ * Names are demangled on first use only, and the result is kept. Without
+ * demangling support the raw name is used instead.
+ */
+void test_lazy(struct symbol_table * table)
+{
+	struct symbol * sym   = symbol_find(table, MANGLED_NAME);
+	struct symbol * func1 = symbol_find(table, "func1");
+	const char *	name;
+
+	if(sym == NULL || func1 == NULL) {
+		fail("Symbol not found by raw name", MANGLED_NAME);
+	}
+
+	if(sym->demangled != NULL) {
+		fail("Name demangled before it was needed", sym->name);
+	}
+
+	name = symbol_demangled_name(sym);
+
+	if(symbol_demangled_name(sym) != name || sym->demangled != name) {
+		fail("Demangled name not kept", sym->name);
+	}
+
+	if(name != sym->name && strcmp(name, DEMANGLED_NAME) != 0) {
+		fail("Wrong demangled name", name);
+	}
+
+	if(symbol_demangled_name(func1) != func1->name) {
+		fail("Plain name not used as is", func1->name);
+	}
+}
+
+/*
+ * symbol_find() keeps working on raw names while symbol_find_demangled()
+ * takes demangled ones.
+ */
+void test_find(struct symbol_table * table)
+{
+	struct symbol * sym = symbol_find(table, MANGLED_NAME);
+
+	if(strcmp(symbol_demangled_name(sym), DEMANGLED_NAME) == 0) {
+		if(symbol_find_demangled(table, DEMANGLED_NAME) != sym ||
+				symbol_find(table, DEMANGLED_NAME) != NULL) {
+			fail("Wrong symbol for the demangled name",
+					DEMANGLED_NAME);
+		}
+	} else if(symbol_find_demangled(table, MANGLED_NAME) != sym) {
+		fail("Wrong symbol for the raw name", MANGLED_NAME);
+	}
+
+	if(symbol_find_demangled(table, "func1") !=
+			symbol_find(table, "func1") ||
+			symbol_find_demangled(table, "main") !=
+			symbol_find(table, "main")) {
+		fail("Plain name not found", "func1");
+	}
+
+	if(symbol_find_demangled(table, "no_such_function") != NULL) {
+		fail("Found a missing symbol", "no_such_function");
+	}
+}
+
+/*
+ * Functions can be looked up by their raw or their demangled name.
+ */
+void test_func_lookup(struct bin_file * bf)
+{
+	struct symbol *	 sym = symbol_find(&bf->sym_table, MANGLED_NAME);
+	struct bf_func * func;
+
+	disasm_all_func_sym(bf);
+	func = bf_get_func_from_name(bf, MANGLED_NAME);
+
+	if(func == NULL || func->vma != sym->address) {
+		fail("Function not found by raw name", MANGLED_NAME);
+	}
+
+	if(bf_get_func_from_name(bf, (char *)symbol_demangled_name(sym)) !=
+			func) {
+		fail("Function not found by demangled name",
+				symbol_demangled_name(sym));
+	}
+}
+
+/*
+ * Every thread demangles every symbol, racing the others for each name and
+ * for loading the symbols in the first place.
+ */
+void * demangle_main(void * param)
+{
+	struct DEMANGLE_THREAD * demangle = param;
+	struct symbol *		 sym;
+
+	for_each_symbol(sym, &demangle->bf->sym_table) {
+		symbol_demangled_name(sym);
+	}
+
+	demangle->name = symbol_demangled_name(symbol_find(
+			&demangle->bf->sym_table, MANGLED_NAME));
+	return NULL;
+}
+
+/*
+ * All threads have to end up with the one name kept in the symbol.
+ */
+void test_concurrent(char * target_path, const char * expected)
+{
+	struct DEMANGLE_THREAD threads[NUM_THREADS];
+	struct bin_file *      bf = load_bin_file(target_path, NULL);
+
+	for(int i = 0; i < NUM_THREADS; i++) {
+		threads[i].bf = bf;
+
+		if(pthread_create(&threads[i].thread, NULL, demangle_main,
+				&threads[i]) != 0) {
+			perror("Unable to start a demangling thread.");
+			xexit(-1);
+		}
+	}
+
+	for(int i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i].thread, NULL);
+
+		if(threads[i].name != threads[0].name ||
+				strcmp(threads[i].name, expected) != 0) {
+			fail("Threads disagree about the name",
+					threads[i].name);
+		}
+	}
+
+	close_bin_file(bf);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	bf = load_bin_file(target_path, NULL);
+	test_lazy(&bf->sym_table);
+	test_find(&bf->sym_table);
+	test_func_lookup(bf);
+	test_concurrent(target_path, symbol_demangled_name(symbol_find(
+			&bf->sym_table, MANGLED_NAME)));
+
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
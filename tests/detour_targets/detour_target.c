@@ -95,6 +95,12 @@
 		});
 #endif
 
+/*
+ * Gives byte_scan_test a section spanning several scan chunks. The
+ * initializer keeps it out of .bss.
+ */
+unsigned char scan_blob[5 * 512 * 1024] = {1};
+
 /*
  * func1 is invoked by the regular execution of detour_test.
  */
@@ -113,8 +119,96 @@ void func2(void)
 	TRAMPOLINE_BLOCK
 }
 
-int main(void)
+/*
+ * Named like the C++ function ns::mangled(int), so demangle_test has a
+ * mangled symbol.
+ */
+int mangled(int value) __asm__("_ZN2ns7mangledEi");
+
+int mangled(int value)
+{
+	return value * 2;
+}
+
+/*
+ * The second version of the target renames count_digits, changes a constant
+ * in checksum and adds checksum_twice. It is built as detour_target_v2 for
+ * the tests comparing two versions of a binary.
+ */
+#ifdef DETOUR_TARGET_V2
+	#define count_digits digit_count
+	#define CHECKSUM_FACTOR 33
+#else
+	#define CHECKSUM_FACTOR 31
+#endif
+
+/*
+ * count_digits and checksum are only invoked when the target is given an
+ * argument. They give the analysis tests a recursive function and a function
+ * with a loop and enough instructions to be indexed.
+ */
+int count_digits(unsigned int value)
+{
+	return value < 10 ? 1 : 1 + count_digits(value / 10);
+}
+
+unsigned int checksum(const char * str)
+{
+	unsigned int sum = 0;
+
+	for(; *str != '\0'; str++) {
+		sum = sum * CHECKSUM_FACTOR + (unsigned char)*str;
+
+		if(sum & 0x80000000) {
+			sum ^= 0x5bd1e995;
+		}
+	}
+
+	return sum + count_digits(sum);
+}
+
+/*
+ * Calls checksum twice, so call_graph_test has a repeated call edge.
+ */
+unsigned int checksum_pair(const char * str, const char * str2)
+{
+	return checksum(str) ^ checksum(str2);
+}
+
+#ifdef DETOUR_TARGET_V2
+unsigned int checksum_twice(const char * str)
+{
+	unsigned int sum = checksum(str);
+
+	while(sum > 0xFFFF) {
+		sum = (sum >> 16) ^ (sum & 0xFFFF);
+	}
+
+	return sum;
+}
+#endif
+
+/*
+ * detour_target_util.c has a static function of the same name.
+ */
+static unsigned int scale(unsigned int value)
+{
+	return value << 2;
+}
+
+unsigned int scale_util(unsigned int value);
+
+int main(int argc, char * argv[])
 {
 	func1();
+
+	if(argc > 1) {
+		printf("%u\n", checksum(argv[1]));
+	}
+
+	if(argc > 2) {
+		printf("%u %u\n", scale(argc), scale_util(argc));
+	}
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,14 @@
+/*
+ * A second translation unit of the detour target. It has a static function
+ * named like one in detour_target.c, so the target has two symbols sharing a
+ * name.
+ */
+static unsigned int scale(unsigned int value)
+{
+	return value * 3 + 1;
+}
+
+unsigned int scale_util(unsigned int value)
+{
+	return scale(value);
+}
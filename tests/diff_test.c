@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <func.h>
+#include <diff.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+
+/*
+ * The pairs expected between the two versions of the target. A similarity
+ * of 1 means the functions must be identical, 0 that they must differ.
+ */
+struct EXPECTED_MATCH {
+	const char *	   name;
+	const char *	   name2;
+	enum bf_match_kind kind;
+	int		   similarity;
+};
+
+static const struct EXPECTED_MATCH expected[] = {
+	{"main",	 "main",	BF_MATCH_NAME,	      1},
+	{"func1",	 "func1",	BF_MATCH_NAME,	      1},
+	{"func2",	 "func2",	BF_MATCH_NAME,	      1},
+	{"checksum",	 "checksum",	BF_MATCH_NAME,	      0},
+	{"count_digits", "digit_count", BF_MATCH_FINGERPRINT, 1}
+};
+
+void fail(char * msg, const char * name)
+{
+	fprintf(stderr, "%s: %s\n", msg, name ? name : "(null)");
+	xexit(-1);
+}
+
+void test_expected(struct bf_diff * diff)
+{
+	for(size_t i = 0; i < ARRAY_SIZE(expected); i++) {
+		struct bf_func *       func  = bf_get_func_from_name(diff->bf,
+				(char *)expected[i].name);
+		struct bf_func *       func2 = bf_get_func_from_name(diff->bf2,
+				(char *)expected[i].name2);
+		struct bf_func_match * match;
+
+		if(func == NULL || func2 == NULL) {
+			fail("Function not disassembled", expected[i].name);
+		}
+
+		match = bf_get_func_match(diff, func);
+
+		if(match == NULL || match->func2 != func2) {
+			fail("Wrong match", expected[i].name);
+		}
+
+		if(match->kind != expected[i].kind) {
+			fail("Matched by the wrong signal", expected[i].name);
+		}
+
+		if((match->similarity == 1) != (expected[i].similarity == 1)) {
+			fail("Wrong similarity", expected[i].name);
+		}
+	}
+}
+
+/*
+ * checksum_twice only exists in the second version.
+ */
+void test_added(struct bf_diff * diff)
+{
+	struct bf_func * func = bf_get_func_from_name(diff->bf2,
+			"checksum_twice");
+	bool		 found = FALSE;
+
+	if(func == NULL) {
+		fail("Function not disassembled", "checksum_twice");
+	}
+
+	for(size_t i = 0; i < diff->num_added; i++) {
+		found = found || diff->added[i] == func;
+	}
+
+	if(!found) {
+		fail("Function not added", "checksum_twice");
+	}
+
+	for(size_t i = 0; i < diff->num_matches; i++) {
+		if(diff->matches[i].func2 == func) {
+			fail("Added function was matched", "checksum_twice");
+		}
+	}
+}
+
+void compare_diffs(struct bf_diff * diff, struct bf_diff * diff2)
+{
+	if(diff->num_matches != diff2->num_matches ||
+			diff->num_removed != diff2->num_removed ||
+			diff->num_added != diff2->num_added) {
+		fail("Parallel diff differs", NULL);
+	}
+
+	for(size_t i = 0; i < diff->num_matches; i++) {
+		struct bf_func_match * match  = &diff->matches[i];
+		struct bf_func_match * match2 = &diff2->matches[i];
+
+		if(match->func != match2->func ||
+				match->func2 != match2->func2 ||
+				match->kind != match2->kind ||
+				match->similarity != match2->similarity) {
+			fail("Parallel diff differs", NULL);
+		}
+	}
+
+	if(memcmp(diff->removed, diff2->removed, diff->num_removed *
+			sizeof(struct bf_func *)) != 0 ||
+			memcmp(diff->added, diff2->added, diff->num_added *
+			sizeof(struct bf_func *)) != 0) {
+		fail("Parallel diff differs", NULL);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	struct bin_file * bf2;
+	struct bf_diff *  diff;
+	struct bf_diff *  diff2;
+	char		  target_path[PATH_MAX]  = {0};
+	char		  target_path2[PATH_MAX] = {0};
+
+	check_test_args(argc, argv);
+
+	if(!get_target_path(target_path, ARRAY_SIZE(target_path), argv[1]) ||
+			!get_named_target_path(target_path2,
+			ARRAY_SIZE(target_path2), "detour_target_v2_",
+			argv[1])) {
+		perror("Unable to find detour target.");
+		xexit(-1);
+	}
+
+	bf  = load_bin_file(target_path, NULL);
+	bf2 = load_bin_file(target_path2, NULL);
+	disasm_all_func_sym(bf);
+	disasm_all_func_sym(bf2);
+
+	diff = bf_diff_bins(bf, bf2, 1, 0);
+	test_expected(diff);
+	test_added(diff);
+
+	diff2 = bf_diff_bins(bf, bf2, NUM_THREADS, 0);
+	compare_diffs(diff, diff2);
+
+	printf("Matched %zu functions, %zu removed, %zu added\n",
+			diff->num_matches, diff->num_removed, diff->num_added);
+	bf_close_diff(diff);
+	bf_close_diff(diff2);
+	close_bin_file(bf);
+	close_bin_file(bf2);
+	return EXIT_SUCCESS;
+}
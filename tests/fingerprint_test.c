@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <symbol.h>
+#include <func.h>
+#include <basic_blk.h>
+
+#include "test_target.h"
+
+void fail(char * msg, struct symbol * sym)
+{
+	fprintf(stderr, "%s: %s\n", msg, sym ? sym->name : "(null)");
+	xexit(-1);
+}
+
+struct walk_info {
+	struct bf_func * func;
+	bfd_vma *	 vmas;
+	size_t		 count;
+};
+
+void record_bb(struct bin_file * bf, struct bf_basic_blk * bb, void * param)
+{
+	struct walk_info * info = param;
+
+	if(info->count == 0 && bb != info->func->bb) {
+		fail("Walk does not start at the entry",
+				bf_get_func_sym(bf, info->func));
+	}
+
+	if(info->count > 0 && bf_exists_func(bf, bb->vma)) {
+		fail("Walk entered another function",
+				bf_get_func_sym(bf, info->func));
+	}
+
+	info->vmas = xrealloc(info->vmas, (info->count + 1) *
+			sizeof(bfd_vma));
+	info->vmas[info->count++] = bb->vma;
+}
+
+int cmp_vma(const void * a, const void * b)
+{
+	bfd_vma x = *(const bfd_vma *)a;
+	bfd_vma y = *(const bfd_vma *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Checks that every block of a function is visited exactly once.
+ */
+void test_walk(struct bin_file * bf, struct bf_func * func)
+{
+	struct walk_info info = {func, NULL, 0};
+
+	bf_enum_func_basic_blk(bf, func, record_bb, &info);
+
+	if(info.count == 0) {
+		fail("Walk found no blocks", bf_get_func_sym(bf, func));
+	}
+
+	qsort(info.vmas, info.count, sizeof(bfd_vma), cmp_vma);
+
+	for(size_t i = 1; i < info.count; i++) {
+		if(info.vmas[i] == info.vmas[i - 1]) {
+			fail("Walk visited a block twice",
+					bf_get_func_sym(bf, func));
+		}
+	}
+
+	free(info.vmas);
+}
+
+/*
+ * The same binary disassembled serially and in parallel must give the same
+ * fingerprint for every function.
+ */
+size_t test_fingerprints(struct bin_file * bf, struct bin_file * bf2)
+{
+	struct symbol * sym;
+	size_t		count = 0;
+
+	for_each_symbol(sym, &bf->sym_table) {
+		struct bf_func * func;
+		struct bf_func * func2;
+		uint64_t	 fp;
+
+		if(!(sym->type & SYMBOL_FUNCTION) || sym->address == 0) {
+			continue;
+		}
+
+		func  = bf_get_func(bf, sym->address);
+		func2 = bf_get_func(bf2, sym->address);
+
+		if(func == NULL || func2 == NULL) {
+			fail("Function not disassembled", sym);
+		}
+
+		test_walk(bf, func);
+		fp = bf_get_func_fingerprint(bf, func);
+
+		if(fp != bf_get_func_fingerprint(bf2, func2)) {
+			fail("Fingerprint mismatch", sym);
+		}
+
+		if(fp != bf_get_func_fingerprint(bf, func)) {
+			fail("Cached fingerprint changed", sym);
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	struct bin_file * bf2;
+	struct bf_func *  func1;
+	struct bf_func *  func2;
+	size_t		  count;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	bf  = load_bin_file(target_path, NULL);
+	bf2 = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+	disasm_all_func_sym_parallel(bf2, 4);
+
+	count = test_fingerprints(bf, bf2);
+
+	/*
+	 * func2 carries the trampoline padding, so it must differ from func1.
+	 */
+	func1 = bf_get_func_from_name(bf, "func1");
+	func2 = bf_get_func_from_name(bf, "func2");
+
+	if(func1 == NULL || func2 == NULL) {
+		fail("Unable to locate func1 or func2", NULL);
+	}
+
+	if(bf_get_func_fingerprint(bf, func1) ==
+			bf_get_func_fingerprint(bf, func2)) {
+		fail("func1 and func2 have the same fingerprint",
+				bf_get_func_sym(bf, func1));
+	}
+
+	printf("Fingerprinted %zu functions\n", count);
+	close_bin_file(bf);
+	close_bin_file(bf2);
+	return EXIT_SUCCESS;
+}
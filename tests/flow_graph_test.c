@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <cache.h>
+#include <basic_blk.h>
+#include <func.h>
+#include <symbol.h>
+#include <flow_graph.h>
+
+#include "test_target.h"
+
+void fail(char * msg, uint32_t id)
+{
+	fprintf(stderr, "%s: %u\n", msg, id);
+	xexit(-1);
+}
+
+uint32_t count_succ_edges(struct bf_flow_graph * graph, uint32_t id,
+		uint32_t succ, uint8_t kind)
+{
+	uint32_t count = 0;
+	uint32_t edge;
+
+	bf_for_each_succ_edge(edge, graph, id) {
+		count += graph->succs[edge] == succ &&
+				graph->succ_kinds[edge] == kind;
+	}
+
+	return count;
+}
+
+uint32_t count_pred_edges(struct bf_flow_graph * graph, uint32_t id,
+		uint32_t pred, uint8_t kind)
+{
+	uint32_t count = 0;
+	uint32_t edge;
+
+	bf_for_each_pred_edge(edge, graph, id) {
+		count += graph->preds[edge] == pred &&
+				graph->pred_kinds[edge] == kind;
+	}
+
+	return count;
+}
+
+/*
+ * The successors have to follow the CFG and the predecessors have to be
+ * their transpose, sorted by id.
+ */
+void check_graph(struct bf_flow_graph * graph)
+{
+	uint32_t n = graph->num_blocks;
+
+	if(graph->succ_offsets[0] != 0 || graph->pred_offsets[0] != 0 ||
+			graph->succ_offsets[n] != graph->num_edges ||
+			graph->pred_offsets[n] != graph->num_edges) {
+		fail("Wrong offsets", n);
+	}
+
+	for(uint32_t id = 0; id < n; id++) {
+		struct bf_basic_blk * bb = graph->blocks[id];
+		struct bf_basic_blk * succ[2];
+		uint32_t	      num_succs = 0;
+		uint32_t	      edge;
+
+		if(graph->succ_offsets[id] > graph->succ_offsets[id + 1] ||
+				graph->pred_offsets[id] >
+				graph->pred_offsets[id + 1]) {
+			fail("Offsets not sorted", id);
+		}
+
+		if(bb == NULL) {
+			if(graph->succ_offsets[id] !=
+					graph->succ_offsets[id + 1] ||
+					graph->pred_offsets[id] !=
+					graph->pred_offsets[id + 1]) {
+				fail("Edges of an unused id", id);
+			}
+
+			continue;
+		}
+
+		if(bf_get_flow_graph_id(graph, bb) != id) {
+			fail("Wrong id", id);
+		}
+
+		succ[0] = bb->target;
+		succ[1] = bb->target2;
+
+		for(int slot = 0; slot < 2; slot++) {
+			uint32_t succ_id = bf_get_flow_graph_id(graph,
+					succ[slot]);
+
+			if(succ[slot] == NULL) {
+				continue;
+			}
+
+			edge = graph->succ_offsets[id] + num_succs++;
+
+			if(edge >= graph->succ_offsets[id + 1] ||
+					graph->succs[edge] != succ_id) {
+				fail("Successor does not follow the CFG", id);
+			}
+		}
+
+		if(graph->succ_offsets[id] + num_succs !=
+				graph->succ_offsets[id + 1]) {
+			fail("Wrong number of successors", id);
+		}
+
+		bf_for_each_succ_edge(edge, graph, id) {
+			uint32_t succ_id = graph->succs[edge];
+			uint8_t	 kind	 = graph->succ_kinds[edge];
+
+			if(kind > BF_EDGE_CALL || count_pred_edges(graph,
+					succ_id, id, kind) != count_succ_edges(
+					graph, id, succ_id, kind)) {
+				fail("Edge missing from the predecessors", id);
+			}
+		}
+
+		bf_for_each_pred_edge(edge, graph, id) {
+			if(edge > graph->pred_offsets[id] &&
+					graph->preds[edge - 1] >
+					graph->preds[edge]) {
+				fail("Predecessors not sorted", id);
+			}
+		}
+	}
+}
+
+/*
+ * main calls func1, so the entry of func1 has a call edge from inside main.
+ */
+void test_call(struct bf_flow_graph * graph)
+{
+	struct bin_file * bf	   = graph->bf;
+	struct symbol *	  main_sym = symbol_find(&bf->sym_table, "main");
+	struct bf_func *  func1	   = bf_get_func_from_name(bf, "func1");
+	uint32_t	  id	   = bf_get_flow_graph_id(graph, func1->bb);
+	uint32_t *	  ids;
+	uint32_t	  count;
+	uint32_t	  edge;
+	bool		  found	   = FALSE;
+
+	if(id == BF_NO_BLOCK) {
+		fail("Entry of func1 not in the graph", 0);
+	}
+
+	bf_for_each_pred_edge(edge, graph, id) {
+		struct bf_basic_blk * pred = graph->blocks[graph->preds[edge]];
+
+		if(graph->pred_kinds[edge] == BF_EDGE_CALL &&
+				pred->vma >= main_sym->address &&
+				pred->vma < main_sym->address +
+				main_sym->size) {
+			found = TRUE;
+		}
+	}
+
+	if(!found) {
+		fail("Call from main not found", id);
+	}
+
+	ids = bf_collect_func_block_ids(graph, func1, &count);
+
+	if(count == 0 || ids[0] != id) {
+		fail("Function blocks do not start at the entry", id);
+	}
+
+	free(ids);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file *      bf;
+	struct bf_flow_graph * graph;
+	struct bf_basic_blk ** blocks;
+	uint32_t	       num_blocks;
+	char		       target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	/*
+	 * Start from a single function so the update has blocks to add. A
+	 * restored analysis would already hold all of them.
+	 */
+	bf_disable_cache();
+	bf = load_bin_file(target_path, NULL);
+	disasm_bin_file_sym(bf, symbol_find(&bf->sym_table, "func1"), TRUE);
+	graph = bf_init_flow_graph(bf);
+	check_graph(graph);
+
+	num_blocks = graph->num_blocks;
+	blocks	   = xmalloc((num_blocks + 1) * sizeof(struct bf_basic_blk *));
+	memcpy(blocks, graph->blocks, num_blocks *
+			sizeof(struct bf_basic_blk *));
+
+	disasm_all_func_sym(bf);
+
+	if(!bf_update_flow_graph(graph) || graph->num_blocks <= num_blocks) {
+		fail("Graph not updated", graph->num_blocks);
+	}
+
+	if(memcmp(blocks, graph->blocks, num_blocks *
+			sizeof(struct bf_basic_blk *)) != 0) {
+		fail("Blocks renumbered by the update", num_blocks);
+	}
+
+	check_graph(graph);
+	test_call(graph);
+
+	if(bf_update_flow_graph(graph)) {
+		fail("Graph updated without changes", graph->num_blocks);
+	}
+
+	printf("Found %u edges among %u blocks\n", graph->num_edges,
+			graph->num_blocks);
+	free(blocks);
+	bf_close_flow_graph(graph);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <symbol.h>
+#include <func.h>
+#include <basic_blk.h>
+#include <func_flow.h>
+
+#include "test_target.h"
+
+void fail(char * msg, struct bf_func * func)
+{
+	if(func != NULL) {
+		fprintf(stderr, "%s: 0x%lX\n", msg, func->vma);
+	} else {
+		fprintf(stderr, "%s\n", msg);
+	}
+
+	xexit(-1);
+}
+
+/*
+ * Tests whether index can be reached from the entry without passing through
+ * dom. This is the definition of dominance, checked by brute force.
+ */
+bool reaches_avoiding(struct bf_func_flow * flow, uint32_t dom,
+		uint32_t index)
+{
+	bool *	   seen	 = xcalloc(flow->num_blocks, sizeof(bool));
+	uint32_t * stack = xmalloc(flow->num_blocks * sizeof(uint32_t));
+	uint32_t   depth = 0;
+	bool	   found = FALSE;
+
+	if(dom != 0) {
+		stack[depth++] = 0;
+		seen[0]	       = TRUE;
+	}
+
+	while(depth > 0 && !found) {
+		uint32_t node = stack[--depth];
+
+		found = node == index;
+
+		for(uint32_t e = flow->succ_offsets[node];
+				e < flow->succ_offsets[node + 1]; e++) {
+			uint32_t succ = flow->succs[e];
+
+			if(succ != dom && !seen[succ]) {
+				seen[succ]     = TRUE;
+				stack[depth++] = succ;
+			}
+		}
+	}
+
+	free(seen);
+	free(stack);
+	return found;
+}
+
+/*
+ * Checks the analyses of a function against their definitions.
+ */
+void test_flow(struct bin_file * bf, struct bf_func * func)
+{
+	struct bf_func_flow * flow = bf_get_func_flow(bf, func);
+	uint32_t	      n	   = flow->num_blocks;
+
+	if(flow != bf_get_func_flow(bf, func)) {
+		fail("Result was not cached", func);
+	}
+
+	if(n == 0 || flow->blocks[0] != func->bb || flow->rpo[0] != 0) {
+		fail("Entry is not the first block", func);
+	}
+
+	for(uint32_t i = 0; i < n; i++) {
+		if(bf_get_func_flow_index(flow, flow->blocks[i]) != i) {
+			fail("Block lookup failed", func);
+		}
+
+		if(flow->rpo[flow->rpo_index[i]] != i) {
+			fail("Reverse post-order is not a permutation", func);
+		}
+
+		if(i != 0 && flow->rpo_index[flow->idom[i]] >=
+				flow->rpo_index[i]) {
+			fail("Dominator comes after the block", func);
+		}
+	}
+
+	/*
+	 * Keep the brute force check quadratic in reasonable sizes.
+	 */
+	if(n <= 256) {
+		for(uint32_t dom = 0; dom < n; dom++) {
+			for(uint32_t i = 0; i < n; i++) {
+				bool expected = dom == i ||
+						!reaches_avoiding(flow, dom, i);
+
+				if(bf_dominates(flow, dom, i) != expected) {
+					fail("Dominance differs", func);
+				}
+			}
+		}
+	}
+
+	for(uint32_t l = 0; l < flow->num_loops; l++) {
+		struct bf_loop * loop = &flow->loops[l];
+		uint32_t	 i;
+
+		if(flow->loop_blocks[loop->first_block] != loop->header ||
+				loop->num_back_edges == 0) {
+			fail("Malformed loop", func);
+		}
+
+		if(loop->parent != BF_NO_BLOCK && (loop->parent >= l ||
+				loop->depth != flow->loops[loop->parent].depth +
+				1)) {
+			fail("Malformed loop nest", func);
+		}
+
+		bf_for_each_loop_block(i, flow, loop) {
+			uint32_t index = flow->loop_blocks[i];
+			uint32_t inner = flow->block_loop[index];
+
+			if(!bf_dominates(flow, loop->header, index)) {
+				fail("Header does not dominate its loop", func);
+			}
+
+			/*
+			 * The innermost loop of the block must be nested in
+			 * this one.
+			 */
+			while(inner != BF_NO_BLOCK && inner != l) {
+				inner = flow->loops[inner].parent;
+			}
+
+			if(inner != l) {
+				fail("Block is not nested in its loop", func);
+			}
+		}
+	}
+}
+
+/*
+ * The analyses computed in parallel must match those computed on demand.
+ */
+size_t test_flows(struct bin_file * bf, struct bin_file * bf2,
+		size_t * num_loops)
+{
+	struct symbol * sym;
+	size_t		count = 0;
+
+	bf_analyse_func_flows(bf2, 4);
+
+	for_each_symbol(sym, &bf->sym_table) {
+		struct bf_func *      func;
+		struct bf_func_flow * flow;
+		struct bf_func_flow * flow2;
+
+		if(!(sym->type & SYMBOL_FUNCTION) || sym->address == 0) {
+			continue;
+		}
+
+		func = bf_get_func(bf, sym->address);
+
+		if(func == NULL) {
+			fail("Function not disassembled", NULL);
+		}
+
+		test_flow(bf, func);
+		flow  = bf_get_func_flow(bf, func);
+		flow2 = bf_get_func(bf2, sym->address)->flow;
+
+		if(flow2 == NULL || flow2->num_blocks != flow->num_blocks ||
+				flow2->num_loops != flow->num_loops) {
+			fail("Parallel analysis differs", func);
+		}
+
+		for(uint32_t i = 0; i < flow->num_blocks; i++) {
+			if(flow2->blocks[i]->vma != flow->blocks[i]->vma ||
+					flow2->idom[i] != flow->idom[i] ||
+					flow2->ipdom[i] != flow->ipdom[i]) {
+				fail("Parallel analysis differs", func);
+			}
+		}
+
+		*num_loops += flow->num_loops;
+		count++;
+	}
+
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	struct bin_file * bf2;
+	size_t		  count;
+	size_t		  num_loops		= 0;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	bf  = load_bin_file(target_path, NULL);
+	bf2 = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+	disasm_all_func_sym(bf2);
+
+	count = test_flows(bf, bf2, &num_loops);
+
+	printf("Analysed %zu functions, found %zu loops\n", count, num_loops);
+	close_bin_file(bf);
+	close_bin_file(bf2);
+	return EXIT_SUCCESS;
+}
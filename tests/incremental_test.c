@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <cache.h>
+#include <basic_blk.h>
+#include <func.h>
+#include <insn.h>
+#include <incremental.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+
+void fail(char * msg, bfd_vma vma)
+{
+	fprintf(stderr, "%s at 0x%lX\n", msg, (unsigned long)vma);
+	xexit(-1);
+}
+
+bool same_parts(struct bf_insn * insn1, struct bf_insn * insn2)
+{
+	struct list_head * p1 = insn1->part_list.next;
+	struct list_head * p2 = insn2->part_list.next;
+
+	while(p1 != &insn1->part_list && p2 != &insn2->part_list) {
+		struct bf_insn_part * part1 = list_entry(p1,
+				struct bf_insn_part, list);
+		struct bf_insn_part * part2 = list_entry(p2,
+				struct bf_insn_part, list);
+
+		if(strcmp(part1->str, part2->str) != 0) {
+			return FALSE;
+		}
+
+		p1 = p1->next;
+		p2 = p2->next;
+	}
+
+	return p1 == &insn1->part_list && p2 == &insn2->part_list;
+}
+
+struct bin_file * analyse(char * target_path)
+{
+	struct bin_file * bf = load_bin_file(target_path, NULL);
+
+	disasm_all_func_sym(bf);
+	disasm_bin_file_entry(bf);
+	return bf;
+}
+
+size_t count_insns(struct bin_file * bf)
+{
+	struct bf_insn * insn;
+	size_t		 count = 0;
+
+	bf_for_each_insn(insn, bf) {
+		count++;
+	}
+
+	return count;
+}
+
+void compare_insns(struct bin_file * ref, struct bin_file * bf)
+{
+	struct bf_insn * insn;
+
+	bf_for_each_insn(insn, ref) {
+		struct bf_insn * insn2 = bf_get_insn(bf, insn->vma);
+
+		if(insn2 == NULL || insn2->size != insn->size ||
+				insn2->mnemonic != insn->mnemonic ||
+				insn2->is_data != insn->is_data ||
+				insn2->extra_info != insn->extra_info ||
+				!same_parts(insn, insn2)) {
+			fail("Instruction differs", insn->vma);
+		}
+	}
+
+	if(count_insns(ref) != count_insns(bf)) {
+		fail("Different number of instructions", 0);
+	}
+}
+
+void compare_bbs(struct bin_file * ref, struct bin_file * bf)
+{
+	struct bf_basic_blk * bb;
+
+	bf_for_each_basic_blk(bb, ref) {
+		struct bf_basic_blk * bb2 = bf_get_bb(bf, bb->vma);
+
+		if(bb2 == NULL ||
+				bf_get_bb_length(bb2) != bf_get_bb_length(bb) ||
+				(bb->target == NULL) != (bb2->target == NULL) ||
+				(bb->target2 == NULL) !=
+				(bb2->target2 == NULL)) {
+			fail("Block differs", bb->vma);
+		}
+	}
+}
+
+void compare_funcs(struct bin_file * ref, struct bin_file * bf)
+{
+	struct bf_func * func;
+
+	bf_for_each_func(func, ref) {
+		if(!bf_exists_func(bf, func->vma)) {
+			fail("Function missing", func->vma);
+		}
+	}
+}
+
+/*
+ * The incremental analysis must find exactly what a full analysis finds.
+ */
+void compare_analysis(struct bin_file * ref, struct bin_file * bf)
+{
+	compare_insns(ref, bf);
+	compare_bbs(ref, bf);
+	compare_funcs(ref, bf);
+}
+
+/*
+ * Reused instructions are copies. Nothing may point into the old version.
+ */
+void test_copies(struct bin_file * old_bf, struct bin_file * bf)
+{
+	struct bf_insn * insn;
+
+	bf_for_each_insn(insn, bf) {
+		if(bf_get_insn(old_bf, insn->vma) == insn) {
+			fail("Instruction shared with the old version",
+					insn->vma);
+		}
+	}
+}
+
+/*
+ * Against itself every instruction of a matched function is reused.
+ */
+void test_same(char * target_path, struct bin_file * old_bf)
+{
+	struct bin_file *     bf = load_bin_file(target_path, NULL);
+	struct bf_reuse_stats stats;
+
+	bf_disasm_incremental(bf, old_bf, NUM_THREADS, &stats);
+	compare_analysis(old_bf, bf);
+	test_copies(old_bf, bf);
+
+	if(stats.matched_funcs == 0 || stats.reused_insns == 0 ||
+			stats.reused_insns < stats.decoded_insns) {
+		fail("Too few instructions reused", 0);
+	}
+
+	printf("Same version: %zu functions matched, %zu instructions "\
+			"reused, %zu decoded\n", stats.matched_funcs,
+			stats.reused_insns, stats.decoded_insns);
+	close_bin_file(bf);
+}
+
+/*
+ * checksum changed and checksum_twice is new, so some instructions have to
+ * be decoded while the unchanged functions are still reused.
+ */
+void test_changed(char * target_path2, struct bin_file * old_bf)
+{
+	struct bin_file *     ref = analyse(target_path2);
+	struct bin_file *     bf  = load_bin_file(target_path2, NULL);
+	struct bf_reuse_stats stats;
+
+	bf_disasm_incremental(bf, old_bf, 1, &stats);
+	compare_analysis(ref, bf);
+	test_copies(old_bf, bf);
+
+	if(stats.reused_insns == 0 || stats.decoded_insns == 0) {
+		fail("Changed version not analysed incrementally", 0);
+	}
+
+	printf("New version: %zu functions matched, %zu instructions "\
+			"reused, %zu decoded\n", stats.matched_funcs,
+			stats.reused_insns, stats.decoded_insns);
+	close_bin_file(bf);
+	close_bin_file(ref);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * old_bf;
+	char		  target_path[PATH_MAX]  = {0};
+	char		  target_path2[PATH_MAX] = {0};
+
+	check_test_args(argc, argv);
+
+	if(!get_target_path(target_path, ARRAY_SIZE(target_path), argv[1]) ||
+			!get_named_target_path(target_path2,
+			ARRAY_SIZE(target_path2), "detour_target_v2_",
+			argv[1])) {
+		perror("Unable to find detour target.");
+		xexit(-1);
+	}
+
+	/*
+	 * A restored analysis would not be decoded at all.
+	 */
+	bf_disable_cache();
+	old_bf = analyse(target_path);
+
+	test_same(target_path, old_bf);
+	test_changed(target_path2, old_bf);
+
+	close_bin_file(old_bf);
+	return EXIT_SUCCESS;
+}
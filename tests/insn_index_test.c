@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <cache.h>
+#include <insn.h>
+#include <insn_index.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+
+void fail(char * msg, struct bf_insn * insn)
+{
+	fprintf(stderr, "%s: 0x%lx\n", msg, insn ? (unsigned long)insn->vma :
+			0);
+	xexit(-1);
+}
+
+int cmp_id(const void * a, const void * b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Copies the posting lists with their ids sorted, since the disassembler
+ * threads index the instructions in no particular order.
+ */
+struct bf_insn_posting * copy_postings(struct bf_insn_index * index,
+		size_t * count)
+{
+	struct bf_insn_posting * copy = xcalloc(index->num_postings + 1,
+			sizeof(struct bf_insn_posting));
+
+	*count = 0;
+
+	for(size_t i = 0; i < index->num_slots; i++) {
+		struct bf_insn_posting * posting = &index->postings[i];
+		struct bf_insn_posting * dest;
+
+		if(posting->count == 0) {
+			continue;
+		}
+
+		dest	  = &copy[(*count)++];
+		*dest	  = *posting;
+		dest->ids = xmalloc(posting->count * sizeof(uint32_t));
+		memcpy(dest->ids, posting->ids, posting->count *
+				sizeof(uint32_t));
+		qsort(dest->ids, dest->count, sizeof(uint32_t), cmp_id);
+	}
+
+	return copy;
+}
+
+void close_postings(struct bf_insn_posting * postings, size_t count)
+{
+	for(size_t i = 0; i < count; i++) {
+		free(postings[i].ids);
+	}
+
+	free(postings);
+}
+
+/*
+ * Checks every discovered instruction against the index by brute force.
+ */
+void test_lookup(struct bin_file * bf, struct bf_insn_index * index)
+{
+	uint32_t num_ids = bf_get_num_insns(bf);
+	size_t	 num_code = 0;
+
+	for(uint32_t id = 0; id < num_ids; id++) {
+		struct bf_insn * insn = bf_get_insn_by_id(bf, id);
+		uint32_t *	 ids;
+		size_t		 count;
+		size_t		 same = 0;
+		bool		 found = FALSE;
+
+		if(insn == NULL || insn->is_data) {
+			continue;
+		}
+
+		count = bf_get_insn_ids(index, insn->mnemonic,
+				insn->operand1.tag, &ids);
+
+		for(size_t i = 0; i < count; i++) {
+			found = found || ids[i] == id;
+
+			if(i > 0 && ids[i - 1] >= ids[i]) {
+				fail("Ids out of order", insn);
+			}
+		}
+
+		if(!found) {
+			fail("Instruction not indexed", insn);
+		}
+
+		for(uint32_t id2 = 0; id2 < num_ids; id2++) {
+			struct bf_insn * insn2 = bf_get_insn_by_id(bf, id2);
+
+			same += insn2 != NULL && !insn2->is_data &&
+					insn2->mnemonic == insn->mnemonic;
+		}
+
+		if(bf_count_insns(index, insn->mnemonic, BF_ANY_OPERAND) !=
+				same) {
+			fail("Wrong number of instructions", insn);
+		}
+
+		num_code++;
+	}
+
+	if(index->num_insns != num_code) {
+		fail("Wrong number of indexed instructions", NULL);
+	}
+}
+
+void compare_postings(struct bf_insn_posting * postings, size_t count,
+		struct bf_insn_posting * postings2, size_t count2)
+{
+	if(count != count2) {
+		fail("Different number of posting lists", NULL);
+	}
+
+	for(size_t i = 0; i < count; i++) {
+		struct bf_insn_posting * posting = NULL;
+
+		for(size_t j = 0; j < count2 && posting == NULL; j++) {
+			if(postings2[j].mnemonic == postings[i].mnemonic &&
+					postings2[j].tag == postings[i].tag) {
+				posting = &postings2[j];
+			}
+		}
+
+		if(posting == NULL || posting->count != postings[i].count ||
+				memcmp(posting->ids, postings[i].ids,
+				posting->count * sizeof(uint32_t)) != 0) {
+			fail("Different posting list", NULL);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file *	 bf;
+	struct bf_insn_index *	 index;
+	struct bf_insn_posting * incremental;
+	struct bf_insn_posting * rebuilt;
+	size_t			 count;
+	size_t			 count2;
+	char			 target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	/*
+	 * The index is created first so the disassembler threads feed it.
+	 */
+	bf_disable_cache();
+	bf    = load_bin_file(target_path, NULL);
+	index = bf_init_insn_index(bf);
+	disasm_all_func_sym_parallel(bf, NUM_THREADS);
+
+	test_lookup(bf, index);
+	incremental = copy_postings(index, &count);
+
+	bf_rebuild_insn_index(index);
+	test_lookup(bf, index);
+	rebuilt = copy_postings(index, &count2);
+	compare_postings(incremental, count, rebuilt, count2);
+
+	printf("Indexed %zu instructions in %zu posting lists\n",
+			index->num_insns, count);
+	close_postings(incremental, count);
+	close_postings(rebuilt, count2);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
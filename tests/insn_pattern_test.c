@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <basic_blk.h>
+#include <insn.h>
+#include <insn_pattern.h>
+
+#include "test_target.h"
+
+/*
+ * The patterns of the test, in the order they are added.
+ */
+enum {
+	NOP_RUN,
+	RETURN,
+	PUSH_THEN_RETURN,
+	NUM_PATTERNS
+};
+
+struct MATCH_COUNTS {
+	size_t counts[NUM_PATTERNS];
+};
+
+void fail(char * msg, struct bf_basic_blk * bb)
+{
+	fprintf(stderr, "%s: 0x%lx\n", msg, bb ? (unsigned long)bb->vma : 0);
+	xexit(-1);
+}
+
+bool is_nop(struct bf_insn * insn)
+{
+	return insn->mnemonic == nop_insn;
+}
+
+bool is_return(struct bf_insn * insn)
+{
+	return insn->mnemonic == ret_insn || insn->mnemonic == retq_insn;
+}
+
+bool is_push_reg(struct bf_insn * insn)
+{
+	return (insn->mnemonic == push_insn || insn->mnemonic == pushl_insn ||
+			insn->mnemonic == pushq_insn) &&
+			insn->operand1.tag == OP_REG;
+}
+
+void count_match(struct bf_pattern_match * match, void * param)
+{
+	struct MATCH_COUNTS *	    counts  = param;
+	struct bf_pattern_capture * capture = &match->captures[0];
+
+	if(match->pattern == PUSH_THEN_RETURN &&
+			(!is_push_reg(match->first) ||
+			!is_return(match->last) ||
+			capture->insn != match->first ||
+			capture->operand != &match->first->operand1)) {
+		fail("Bad match", match->first->bb);
+	}
+
+	counts->counts[match->pattern]++;
+}
+
+/*
+ * Counts the matches of each pattern in a block by brute force. Of the
+ * matches of PUSH_THEN_RETURN ending at a return only one is reported.
+ */
+void count_expected(struct bf_basic_blk * bb, struct MATCH_COUNTS * counts)
+{
+	unsigned int length = bf_get_bb_length(bb);
+	bool	     pushed = FALSE;
+
+	for(unsigned int i = 0; i < length; i++) {
+		struct bf_insn * insn = bf_get_bb_insn(bb, i);
+
+		if(i >= 2 && is_nop(insn) &&
+				is_nop(bf_get_bb_insn(bb, i - 1)) &&
+				is_nop(bf_get_bb_insn(bb, i - 2))) {
+			counts->counts[NOP_RUN]++;
+		}
+
+		if(is_return(insn)) {
+			counts->counts[RETURN]++;
+			counts->counts[PUSH_THEN_RETURN] += pushed;
+		}
+
+		pushed = pushed || is_push_reg(insn);
+	}
+}
+
+void test_syntax(void)
+{
+	static const char * const bad[] = {"", "...", "push bogus",
+			"mov imm=", "mov imm:9", "mov reg=1", "a|b|c|d|e",
+			"mov imm, imm, imm, imm", "nop;; nop", "nop nop"};
+
+	struct bf_pattern_set * set = bf_init_pattern_set();
+
+	for(size_t i = 0; i < ARRAY_SIZE(bad); i++) {
+		if(bf_add_pattern(set, bad[i], NULL) != -1) {
+			fprintf(stderr, "Accepted bad pattern: %s\n", bad[i]);
+			xexit(-1);
+		}
+	}
+
+	if(bf_add_pattern(set, "...; nop; ... ; * _, %eax:1; ...", NULL) != 0 ||
+			set->num_steps != 4) {
+		fail("Rejected good pattern", NULL);
+	}
+
+	bf_close_pattern_set(set);
+}
+
+size_t test_matches(struct bin_file * bf, size_t * num_matches)
+{
+	struct bf_pattern_set *	    set = bf_init_pattern_set();
+	struct bf_pattern_matcher * matcher;
+	struct MATCH_COUNTS	    counts;
+	struct bf_basic_blk *	    bb;
+	size_t			    count = 0;
+
+	if(bf_add_pattern(set, "nop; nop; nop", NULL) != NOP_RUN ||
+			bf_add_pattern(set, "ret|retq", NULL) != RETURN ||
+			bf_add_pattern(set, "push|pushl|pushq reg:0; ...; "
+			"ret|retq", NULL) != PUSH_THEN_RETURN) {
+		fail("Rejected good pattern", NULL);
+	}
+
+	matcher = bf_init_pattern_matcher(set, count_match, &counts);
+
+	bf_for_each_basic_blk(bb, bf) {
+		struct MATCH_COUNTS expected;
+
+		memset(&counts, 0, sizeof(counts));
+		memset(&expected, 0, sizeof(expected));
+		bf_match_patterns_bb(matcher, bb);
+		count_expected(bb, &expected);
+
+		if(memcmp(&counts, &expected, sizeof(counts)) != 0) {
+			fail("Wrong number of matches", bb);
+		}
+
+		count++;
+	}
+
+	*num_matches = matcher->num_matches;
+	bf_close_pattern_matcher(matcher);
+	bf_close_pattern_set(set);
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	size_t		  count;
+	size_t		  num_matches;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+
+	test_syntax();
+	count = test_matches(bf, &num_matches);
+
+	printf("Matched %zu blocks, found %zu matches\n", count,
+			num_matches);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <parallel.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+#define NUM_ITEMS   1000
+#define GRAIN	    7
+#define NUM_TASKS   64
+#define SLOW_TASKS  (NUM_TASKS / NUM_THREADS)
+
+/*
+ * The result of one task of test_reduce_order().
+ */
+struct TASK_RESULT {
+	size_t first;
+	size_t last;
+	size_t sum;
+};
+
+struct REDUCE_STATE {
+	size_t next;
+	size_t calls;
+	size_t sum;
+};
+
+struct ENUM_STATE {
+	void **	objs;
+	size_t	count;
+	size_t	next;
+};
+
+void fail(char * msg, size_t index)
+{
+	fprintf(stderr, "%s: %zu\n", msg, index);
+	xexit(-1);
+}
+
+void * sum_map(struct bf_task_ctx * ctx, size_t first, size_t last)
+{
+	struct TASK_RESULT * result = bf_arena_alloc(ctx->arena,
+			sizeof(struct TASK_RESULT));
+
+	result->first = first;
+	result->last  = last;
+	result->sum   = 0;
+
+	for(size_t i = first; i < last; i++) {
+		result->sum += i;
+	}
+
+	return result;
+}
+
+void sum_reduce(size_t first, size_t last, void * result, void * param)
+{
+	struct TASK_RESULT *  task  = result;
+	struct REDUCE_STATE * state = param;
+
+	if(first != state->next || last <= first || last - first > GRAIN ||
+			(last - first < GRAIN && last != NUM_ITEMS)) {
+		fail("Task reduced out of order", first);
+	}
+
+	/*
+	 * The result has to be the one map returned for the same range, still
+	 * intact in the arena of whichever worker ran it.
+	 */
+	if(task->first != first || task->last != last) {
+		fail("Result of another task", first);
+	}
+
+	state->next  = last;
+	state->sum  += task->sum;
+	state->calls++;
+}
+
+/*
+ * However the tasks were scheduled, reduce sees every one of them exactly
+ * once, in order, on the calling thread.
+ */
+void test_reduce_order(void)
+{
+	for(int round = 0; round < 20; round++) {
+		struct REDUCE_STATE state = {0};
+
+		bf_parallel_run(NUM_THREADS, NUM_ITEMS, GRAIN, sum_map,
+				sum_reduce, &state);
+
+		if(state.next != NUM_ITEMS || state.calls !=
+				(NUM_ITEMS + GRAIN - 1) / GRAIN ||
+				state.sum != NUM_ITEMS * (NUM_ITEMS - 1) / 2) {
+			fail("Tasks missing from the reduction", state.calls);
+		}
+	}
+}
+
+void * skewed_map(struct bf_task_ctx * ctx, size_t first, size_t last)
+{
+	unsigned int * workers = ctx->param;
+
+	workers[first] = ctx->worker;
+
+	if(first < SLOW_TASKS) {
+		usleep(20000);
+	}
+
+	return NULL;
+}
+
+/*
+ * The first worker starts out with all the slow tasks. The others run out
+ * of their own quickly and have to steal some of them.
+ */
+void test_stealing(void)
+{
+	unsigned int workers[NUM_TASKS];
+	bool	     ran_slow[NUM_THREADS] = {FALSE};
+	unsigned int num_ran_slow = 0;
+
+	bf_parallel_run(NUM_THREADS, NUM_TASKS, 1, skewed_map, NULL, workers);
+
+	for(size_t i = 0; i < SLOW_TASKS; i++) {
+		if(workers[i] >= NUM_THREADS) {
+			fail("Wrong worker index", i);
+		}
+
+		if(!ran_slow[workers[i]]) {
+			ran_slow[workers[i]] = TRUE;
+			num_ran_slow++;
+		}
+	}
+
+	if(num_ran_slow < 2) {
+		fail("Slow tasks were not stolen", num_ran_slow);
+	}
+}
+
+void * func_map(struct bf_task_ctx * ctx, struct bf_func * func)
+{
+	return func;
+}
+
+void func_reduce(struct bf_func * func, void * result, void * param)
+{
+	struct ENUM_STATE * state = param;
+
+	if(result != func || state->next >= state->count ||
+			state->objs[state->next] != func) {
+		fail("Function reduced out of order", state->next);
+	}
+
+	state->next++;
+}
+
+void * bb_map(struct bf_task_ctx * ctx, struct bf_basic_blk * bb)
+{
+	return bb;
+}
+
+void bb_reduce(struct bf_basic_blk * bb, void * result, void * param)
+{
+	struct ENUM_STATE * state = param;
+
+	if(result != bb || state->next >= state->count ||
+			state->objs[state->next] != bb) {
+		fail("Block reduced out of order", state->next);
+	}
+
+	state->next++;
+}
+
+/*
+ * The per-object passes reduce in VMA order, the order bf_collect_funcs()
+ * and bf_collect_basic_blks() return.
+ */
+void test_enum(struct bin_file * bf)
+{
+	struct ENUM_STATE state = {0};
+
+	state.objs = (void **)bf_collect_funcs(bf, &state.count);
+	bf_parallel_enum_func(bf, NUM_THREADS, func_map, func_reduce, &state);
+
+	if(state.count == 0 || state.next != state.count) {
+		fail("Functions missing from the reduction", state.next);
+	}
+
+	free(state.objs);
+	state.next = 0;
+	state.objs = (void **)bf_collect_basic_blks(bf, &state.count);
+	bf_parallel_enum_basic_blk(bf, NUM_THREADS, bb_map, bb_reduce, &state);
+
+	if(state.count == 0 || state.next != state.count) {
+		fail("Blocks missing from the reduction", state.next);
+	}
+
+	free(state.objs);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	test_reduce_order();
+	test_stealing();
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+	test_enum(bf);
+
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
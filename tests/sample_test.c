@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <func.h>
+#include <basic_blk.h>
+#include <extent.h>
+#include <sample.h>
+
+#include "test_target.h"
+
+/*
+ * The runtime addresses in the scripts are the VMAs shifted by this much.
+ */
+#define BIAS 0x10000000
+
+void fail(char * msg, const char * name)
+{
+	fprintf(stderr, "%s: %s\n", msg, name ? name : "(null)");
+	xexit(-1);
+}
+
+bfd_vma get_vma(struct bin_file * bf, const char * name)
+{
+	struct bf_func * func = bf_get_func_from_name(bf, (char *)name);
+
+	if(func == NULL) {
+		fail("Function not disassembled", name);
+	}
+
+	return func->vma;
+}
+
+uint64_t get_func_hits(struct bf_sample_profile * profile, const char * name)
+{
+	bfd_vma		   vma	  = get_vma(profile->bf, name);
+	struct bf_extent * extent = bf_find_extent(&profile->func_index, vma);
+
+	if(extent == NULL || bf_get_sample_func(profile, vma) !=
+			bf_get_func_from_name(profile->bf, (char *)name)) {
+		fail("Function not in the profile", name);
+	}
+
+	return profile->func_hits[extent - profile->func_index.extents];
+}
+
+/*
+ * An extent nested in another must not hide the rest of the outer one.
+ */
+void test_nested(void)
+{
+	static const bfd_vma vmas[] = {0x0ff, 0x100, 0x145, 0x14f, 0x150,
+			0x15f, 0x170, 0x1ff, 0x200};
+	static const long    expected[] = {-1, 0, 2, 2, 1, 1, 0, 0, -1};
+
+	struct bf_extent_index index;
+	long		       positions[ARRAY_SIZE(vmas)];
+	bfd_vma		       reversed[ARRAY_SIZE(vmas)];
+	size_t		       n = ARRAY_SIZE(vmas);
+
+	bf_init_extent_index(&index);
+	bf_add_extent(&index, 0x140, 0x150, NULL);
+	bf_add_extent(&index, 0x100, 0x200, NULL);
+	bf_add_extent(&index, 0x140, 0x160, NULL);
+	bf_sort_extent_index(&index);
+
+	if(index.extents[0].end != 0x200 || index.extents[1].end != 0x160) {
+		fail("Extents sorted wrongly", NULL);
+	}
+
+	bf_find_extents(&index, vmas, n, positions);
+
+	for(size_t i = 0; i < n; i++) {
+		struct bf_extent * extent = bf_find_extent(&index, vmas[i]);
+
+		if(positions[i] != expected[i] || (extent == NULL ?
+				-1 : extent - index.extents) != expected[i]) {
+			fail("Wrong nested extent", NULL);
+		}
+
+		reversed[n - 1 - i] = vmas[i];
+	}
+
+	bf_find_extents(&index, reversed, n, positions);
+
+	for(size_t i = 0; i < n; i++) {
+		if(positions[n - 1 - i] != expected[i]) {
+			fail("Wrong nested extent", NULL);
+		}
+	}
+
+	bf_close_extent_index(&index);
+}
+
+/*
+ * Writes samples of func1 in the default format, of func2 as printed by
+ * perf script -F ip and of checksum as the leaf of a callchain. Samples of
+ * another DSO and the callers in the chain must be skipped.
+ */
+FILE * write_script(struct bin_file * bf, const char * target_path)
+{
+	FILE * stream = tmpfile();
+	int    i;
+
+	if(stream == NULL) {
+		fail("Unable to create the script", NULL);
+	}
+
+	for(i = 0; i < 3; i++) {
+		fprintf(stream, "detour_target 100 [000] 1.%d: 1 cycles: "\
+				"%lx func1+0x0 (%s)\n", i,
+				(unsigned long)(get_vma(bf, "func1") + BIAS),
+				target_path);
+	}
+
+	fprintf(stream, "detour_target 100 [000] 1.3: 1 cycles: "\
+			"%lx puts+0x0 (/lib/libc.so.6)\n",
+			(unsigned long)(get_vma(bf, "func1") + BIAS));
+
+	for(i = 0; i < 2; i++) {
+		fprintf(stream, "%lx\n",
+				(unsigned long)(get_vma(bf, "func2") + BIAS));
+	}
+
+	fprintf(stream, "detour_target 100 1.4: cycles:\n"\
+			"\t%lx checksum+0x0 (%s)\n\t%lx main+0x0 (%s)\n\n",
+			(unsigned long)(get_vma(bf, "checksum") + BIAS),
+			target_path,
+			(unsigned long)(get_vma(bf, "main") + BIAS),
+			target_path);
+	rewind(stream);
+	return stream;
+}
+
+void test_script(struct bin_file * bf, const char * target_path)
+{
+	struct bf_sample_profile * profile = bf_init_sample_profile(bf);
+	FILE *			   stream  = write_script(bf, target_path);
+
+	bf_set_sample_bias(profile, BIAS);
+
+	if(bf_load_perf_script(profile, stream) != 6 || profile->total != 6 ||
+			profile->unresolved != 0) {
+		fail("Wrong number of samples", NULL);
+	}
+
+	if(get_func_hits(profile, "func1") != 3 ||
+			get_func_hits(profile, "func2") != 2 ||
+			get_func_hits(profile, "checksum") != 1 ||
+			get_func_hits(profile, "main") != 0) {
+		fail("Wrong histogram", NULL);
+	}
+
+	fclose(stream);
+	bf_close_sample_profile(profile);
+
+	/*
+	 * Without the bias the samples fall outside the target.
+	 */
+	profile = bf_init_sample_profile(bf);
+	stream	= write_script(bf, target_path);
+
+	if(bf_load_perf_script(profile, stream) != 6 ||
+			profile->unresolved == 0) {
+		fail("Samples resolved without the bias", NULL);
+	}
+
+	fclose(stream);
+	bf_close_sample_profile(profile);
+}
+
+void lowest_alloc_vma(bfd * abfd, asection * s, void * param)
+{
+	bfd_vma * lowest = param;
+
+	if((bfd_get_section_flags(abfd, s) & SEC_ALLOC) &&
+			bfd_get_section_vma(abfd, s) < *lowest) {
+		*lowest = bfd_get_section_vma(abfd, s);
+	}
+}
+
+/*
+ * The bias is inferred from the load address of the image and, for position
+ * independent targets, from the mapping of the text in the script.
+ */
+void test_bias(struct bin_file * bf, const char * target_path)
+{
+	struct bf_sample_profile * profile = bf_init_sample_profile(bf);
+	asection *		   text	   = bfd_get_section_by_name(bf->abfd,
+			".text");
+	bfd_vma			   lowest  = (bfd_vma)-1;
+	FILE *			   stream;
+
+	bfd_map_over_sections(bf->abfd, lowest_alloc_vma, &lowest);
+	bf_set_sample_load_base(profile, BIAS + (lowest & ~(bfd_vma)0xfff));
+
+	if(!profile->has_bias || profile->bias != BIAS) {
+		fail("Wrong bias from the load base", NULL);
+	}
+
+	bf_close_sample_profile(profile);
+
+	if(text == NULL || !(bfd_get_file_flags(bf->abfd) & DYNAMIC)) {
+		return;
+	}
+
+	profile = bf_init_sample_profile(bf);
+	stream	= tmpfile();
+
+	if(stream == NULL) {
+		fail("Unable to create the script", NULL);
+	}
+
+	fprintf(stream, "detour_target 0 0.0: PERF_RECORD_MMAP2 100/100: "\
+			"[0x%lx(0x1000) @ 0x%lx fd:01 1 0]: r-xp %s\n",
+			(unsigned long)(bfd_get_section_vma(bf->abfd, text) +
+			BIAS), (unsigned long)text->filepos, target_path);
+	fprintf(stream, "%lx\n", (unsigned long)(get_vma(bf, "func1") + BIAS));
+	rewind(stream);
+
+	if(bf_load_perf_script(profile, stream) != 1 || !profile->has_bias ||
+			profile->bias != BIAS ||
+			get_func_hits(profile, "func1") != 1) {
+		fail("Wrong bias from the mapping", NULL);
+	}
+
+	fclose(stream);
+	bf_close_sample_profile(profile);
+}
+
+/*
+ * Every block has to be found from each of its bytes.
+ */
+void test_bbs(struct bin_file * bf)
+{
+	struct bf_sample_profile * profile = bf_init_sample_profile(bf);
+	struct bf_basic_blk *	   bb;
+
+	bf_for_each_basic_blk(bb, bf) {
+		unsigned int size = bf_get_bb_size(bb);
+
+		for(unsigned int i = 0; i < size; i++) {
+			struct bf_basic_blk * found = bf_get_sample_bb(profile,
+					bb->vma + i);
+
+			if(found == NULL || bb->vma + i < found->vma ||
+					bb->vma + i >= found->vma +
+					bf_get_bb_size(found)) {
+				fail("Block not found", NULL);
+			}
+		}
+	}
+
+	bf_close_sample_profile(profile);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	test_nested();
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+
+	test_script(bf, target_path);
+	test_bias(bf, target_path);
+	test_bbs(bf);
+
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
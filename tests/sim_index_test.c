@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <func.h>
+#include <sim_index.h>
+
+#include "test_target.h"
+
+/*
+ * The number of flushes after which the segments must have been merged.
+ */
+#define NUM_FLUSHES 12
+
+void fail(char * msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	xexit(-1);
+}
+
+/*
+ * Gets a path in the index directory.
+ */
+void get_index_file(char * path, size_t size, char * dir, char * name)
+{
+	snprintf(path, size, "%s/%s", dir, name);
+}
+
+off_t get_file_size(char * dir, char * name)
+{
+	char	    path[PATH_MAX];
+	struct stat st;
+
+	get_index_file(path, sizeof(path), dir, name);
+	return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+/*
+ * Appends bytes which no segment commits, as left by an interrupted flush.
+ */
+void append_garbage(char * dir, char * name)
+{
+	char path[PATH_MAX];
+	int  fd;
+
+	get_index_file(path, sizeof(path), dir, name);
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+
+	if(fd == -1 || write(fd, "garbage", 7) != 7) {
+		fail("Unable to append to the index");
+	}
+
+	close(fd);
+}
+
+/*
+ * Cuts the end off the newest segment, as left by a crash while it was
+ * written.
+ */
+void truncate_newest_segment(char * dir)
+{
+	DIR *		d	   = opendir(dir);
+	struct dirent * entry;
+	char		newest[64] = "";
+	char		path[PATH_MAX];
+
+	while(d != NULL && (entry = readdir(d)) != NULL) {
+		if(strncmp(entry->d_name, "bands.", 6) == 0 &&
+				strcmp(entry->d_name, newest) > 0) {
+			snprintf(newest, sizeof(newest), "%s", entry->d_name);
+		}
+	}
+
+	if(d != NULL) {
+		closedir(d);
+	}
+
+	get_index_file(path, sizeof(path), dir, newest);
+
+	if(newest[0] == '\0' || truncate(path, get_file_size(dir, newest) -
+			1) != 0) {
+		fail("Unable to truncate the newest segment");
+	}
+}
+
+/*
+ * Counts the matches of the signature at the VMA of func.
+ */
+size_t count_matches(struct bf_sim_index * index, struct bf_func * func,
+		struct bf_minhash * sig)
+{
+	struct bf_sim_match matches[64];
+	size_t		    count = bf_query_sim_index(index, sig, 1.0, matches,
+			ARRAY_SIZE(matches));
+	size_t		    found = 0;
+
+	for(size_t i = 0; i < count; i++) {
+		if(matches[i].vma == func->vma && matches[i].name != NULL &&
+				strcmp(matches[i].name, "checksum") == 0 &&
+				matches[i].similarity == 1.0) {
+			found++;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * A second writer must not get the lock while the index is open for
+ * writing.
+ */
+void test_lock(char * dir)
+{
+	char  path[PATH_MAX];
+	pid_t pid;
+	int   status;
+
+	get_index_file(path, sizeof(path), dir, "lock");
+	pid = fork();
+
+	if(pid == 0) {
+		int fd = open(path, O_RDWR);
+
+		_exit(fd != -1 && flock(fd, LOCK_EX | LOCK_NB) == 0 ? 1 : 0);
+	}
+
+	if(pid == -1 || waitpid(pid, &status, 0) != pid ||
+			!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fail("The index is not locked while open for writing");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file *     bf;
+	struct bf_func *      func;
+	struct bf_sim_index * index;
+	struct bf_minhash     sig;
+	size_t		      added;
+	size_t		      num_records;
+	off_t		      records_size;
+	off_t		      strings_size;
+	char		      dir[PATH_MAX];
+	char		      cmd[PATH_MAX + 16];
+	char		      target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	snprintf(dir, sizeof(dir), "%s/tests-sim-index%s",
+			getenv("TEST_BUILD_DIR"), argv[1]);
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+
+	if(system(cmd)) {
+		fail("Problem creating fresh index folder.");
+	}
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+	func = bf_get_func_from_name(bf, "checksum");
+
+	if(func == NULL || !bf_get_func_minhash(bf, func, &sig)) {
+		fail("checksum is not indexable");
+	}
+
+	/*
+	 * Add, flush and query from a fresh reader.
+	 */
+	index = bf_open_sim_index(dir, TRUE);
+
+	if(index == NULL) {
+		fail("Unable to create the index");
+	}
+
+	test_lock(dir);
+	added = bf_add_to_sim_index(index, bf, "first", 2);
+
+	if(added == 0 || index->num_records != 0) {
+		fail("Functions added or visible before the flush");
+	}
+
+	if(!bf_flush_sim_index(index) || index->num_records != added) {
+		fail("Flush failed");
+	}
+
+	bf_close_sim_index(index);
+	index = bf_open_sim_index(dir, FALSE);
+
+	if(index == NULL || index->num_records != added ||
+			count_matches(index, func, &sig) != 1) {
+		fail("Reopened index differs");
+	}
+
+	bf_close_sim_index(index);
+
+	/*
+	 * Every flush writes a segment, which are merged once there are too
+	 * many of them.
+	 */
+	index = bf_open_sim_index(dir, TRUE);
+
+	for(int i = 0; i < NUM_FLUSHES; i++) {
+		bf_add_to_sim_index(index, bf, "copy", 2);
+
+		if(!bf_flush_sim_index(index)) {
+			fail("Flush failed");
+		}
+	}
+
+	if(index->num_segments >= NUM_FLUSHES + 1 ||
+			index->num_records != added * (NUM_FLUSHES + 1) ||
+			count_matches(index, func, &sig) != NUM_FLUSHES + 1) {
+		fail("Merged index differs");
+	}
+
+	num_records = index->num_records;
+	bf_close_sim_index(index);
+	records_size = get_file_size(dir, "records");
+	strings_size = get_file_size(dir, "strings");
+
+	/*
+	 * Data past the newest segment and segments which do not check out
+	 * are ignored, and removed by the next writer.
+	 */
+	append_garbage(dir, "records");
+	append_garbage(dir, "strings");
+	append_garbage(dir, "bands.99999999");
+	index = bf_open_sim_index(dir, FALSE);
+
+	if(index == NULL || index->num_records != num_records ||
+			count_matches(index, func, &sig) != NUM_FLUSHES + 1) {
+		fail("Uncommitted data is visible");
+	}
+
+	bf_close_sim_index(index);
+	index = bf_open_sim_index(dir, TRUE);
+
+	if(index == NULL || get_file_size(dir, "records") != records_size ||
+			get_file_size(dir, "strings") != strings_size ||
+			get_file_size(dir, "bands.99999999") != -1) {
+		fail("Uncommitted data was not removed");
+	}
+
+	/*
+	 * The records and strings added after recovery must line up with
+	 * their keys.
+	 */
+	bf_add_to_sim_index(index, bf, "last", 2);
+	bf_close_sim_index(index);
+	index = bf_open_sim_index(dir, FALSE);
+
+	if(index == NULL || count_matches(index, func, &sig) !=
+			NUM_FLUSHES + 2) {
+		fail("Index differs after recovery");
+	}
+
+	bf_close_sim_index(index);
+
+	/*
+	 * Without its newest segment the index falls back to the one before.
+	 */
+	truncate_newest_segment(dir);
+	index = bf_open_sim_index(dir, TRUE);
+
+	if(index == NULL || index->num_records != num_records ||
+			get_file_size(dir, "records") != records_size ||
+			count_matches(index, func, &sig) != NUM_FLUSHES + 1) {
+		fail("Truncated segment was not rolled back");
+	}
+
+	bf_close_sim_index(index);
+	printf("Indexed %zu functions\n", num_records);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <basic_blk.h>
+#include <func.h>
+#include <insn.h>
+#include <snapshot.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+
+struct FREEZE_THREAD {
+	struct bin_file *    bf;
+	struct bf_snapshot * snap;
+	pthread_t	     thread;
+};
+
+void fail(char * msg, bfd_vma vma)
+{
+	fprintf(stderr, "%s at 0x%lX\n", msg, (unsigned long)vma);
+	xexit(-1);
+}
+
+bool same_text(struct bf_insn * insn, const char * text)
+{
+	struct bf_insn_part * part;
+
+	list_for_each_entry(part, &insn->part_list, list) {
+		size_t len = strlen(part->str);
+
+		if(strncmp(text, part->str, len) != 0) {
+			return FALSE;
+		}
+
+		text += len;
+	}
+
+	return *text == '\0';
+}
+
+void test_insns(struct bin_file * bf, struct bf_snapshot * snap)
+{
+	struct bf_insn * insn;
+	uint32_t	 count = 0;
+
+	bf_for_each_insn(insn, bf) {
+		const struct bf_snapshot_insn * rec = bf_snapshot_get_insn(snap,
+				insn->vma);
+
+		if(rec == NULL || rec->size != insn->size ||
+				rec->mnemonic != insn->mnemonic ||
+				rec->is_data != insn->is_data) {
+			fail("Instruction not frozen", insn->vma);
+		}
+
+		if(!same_text(insn, bf_snapshot_insn_text(snap, rec))) {
+			fail("Wrong instruction text", insn->vma);
+		}
+
+		if(rec->bb != BF_SNAPSHOT_NONE && bf_snapshot_find_bb(snap,
+				insn->vma + insn->size - 1) != rec->bb) {
+			fail("Block not found from inside", insn->vma);
+		}
+
+		count++;
+	}
+
+	if(count != snap->num_insns) {
+		fail("Wrong number of instructions", 0);
+	}
+}
+
+/*
+ * The predecessor lists have to be the transpose of the successor lists.
+ */
+void test_edges(struct bf_snapshot * snap, uint32_t bb)
+{
+	const uint32_t * succs;
+	uint32_t	 num_succs;
+
+	succs = bf_snapshot_bb_succs(snap, bb, &num_succs);
+
+	for(uint32_t i = 0; i < num_succs; i++) {
+		const uint32_t * preds;
+		uint32_t	 num_preds;
+		bool		 found = FALSE;
+
+		preds = bf_snapshot_bb_preds(snap, succs[i], &num_preds);
+
+		for(uint32_t j = 0; j < num_preds; j++) {
+			found = found || preds[j] == bb;
+		}
+
+		if(!found) {
+			fail("Edge missing from the predecessors",
+					snap->bbs[bb].vma);
+		}
+	}
+}
+
+unsigned int count_bb_insns(struct bf_basic_blk * bb)
+{
+	struct bf_insn * insn;
+	unsigned int	 count = 0;
+
+	bf_for_each_basic_blk_insn(insn, bb) {
+		count++;
+	}
+
+	return count;
+}
+
+void test_bbs(struct bin_file * bf, struct bf_snapshot * snap)
+{
+	struct bf_basic_blk * bb;
+	uint32_t	      num_succs = 0;
+
+	bf_for_each_basic_blk(bb, bf) {
+		uint32_t		      index = bf_snapshot_get_bb(snap,
+				bb->vma);
+		const struct bf_snapshot_bb * rec;
+
+		if(index == BF_SNAPSHOT_NONE) {
+			fail("Block not frozen", bb->vma);
+		}
+
+		rec = &snap->bbs[index];
+
+		if(rec->num_insns != count_bb_insns(bb)) {
+			fail("Wrong number of block instructions", bb->vma);
+		}
+
+		if((bb->target == NULL) != (rec->target == BF_SNAPSHOT_NONE) ||
+				(bb->target != NULL &&
+				snap->bbs[rec->target].vma !=
+				bb->target->vma)) {
+			fail("Wrong target", bb->vma);
+		}
+
+		if((bb->target2 == NULL) !=
+				(rec->target2 == BF_SNAPSHOT_NONE) ||
+				(bb->target2 != NULL &&
+				snap->bbs[rec->target2].vma !=
+				bb->target2->vma)) {
+			fail("Wrong second target", bb->vma);
+		}
+
+		test_edges(snap, index);
+		num_succs += snap->succ_offsets[index + 1] -
+				snap->succ_offsets[index];
+	}
+
+	if(snap->pred_offsets[snap->num_bbs] != num_succs) {
+		fail("Wrong number of edges", 0);
+	}
+}
+
+void test_funcs(struct bin_file * bf, struct bf_snapshot * snap)
+{
+	static const char * const names[] = {"main", "func1", "func2",
+			"checksum", "count_digits"};
+
+	for(size_t i = 0; i < ARRAY_SIZE(names); i++) {
+		struct bf_func *		func = bf_get_func_from_name(bf,
+				(char *)names[i]);
+		const struct bf_snapshot_func * rec;
+
+		if(func == NULL) {
+			fail("Function not disassembled", 0);
+		}
+
+		rec = bf_snapshot_get_func_from_name(snap, names[i]);
+
+		if(rec == NULL || rec->vma != func->vma ||
+				bf_snapshot_get_func(snap, func->vma) != rec) {
+			fail("Function not frozen", func->vma);
+		}
+
+		if(strcmp(bf_snapshot_string(snap, rec->name), names[i]) != 0) {
+			fail("Wrong function name", func->vma);
+		}
+	}
+
+	if(bf_snapshot_get_func_from_name(snap, "no_such_function") != NULL) {
+		fail("Found a missing function", 0);
+	}
+}
+
+void * freeze_main(void * param)
+{
+	struct FREEZE_THREAD * freeze = param;
+
+	freeze->snap = bf_freeze_bin_file(freeze->bf);
+	return NULL;
+}
+
+void compare_snapshots(struct bf_snapshot * snap, struct bf_snapshot * snap2)
+{
+	if(snap2 == NULL || snap->num_insns != snap2->num_insns ||
+			snap->num_bbs != snap2->num_bbs ||
+			snap->num_funcs != snap2->num_funcs ||
+			snap->num_named_funcs != snap2->num_named_funcs ||
+			snap->strings_size != snap2->strings_size ||
+			memcmp(snap->funcs_by_name, snap2->funcs_by_name,
+			snap->num_named_funcs * sizeof(uint32_t)) != 0 ||
+			memcmp(snap->strings, snap2->strings,
+			snap->strings_size) != 0) {
+		fail("Concurrent snapshot differs", 0);
+	}
+}
+
+/*
+ * Each bin_file is frozen by its own thread, all of them at once.
+ */
+void test_concurrent(char * target_path, struct bf_snapshot * snap)
+{
+	struct FREEZE_THREAD threads[NUM_THREADS];
+
+	for(int i = 0; i < NUM_THREADS; i++) {
+		threads[i].bf = load_bin_file(target_path, NULL);
+		disasm_all_func_sym(threads[i].bf);
+	}
+
+	for(int i = 0; i < NUM_THREADS; i++) {
+		if(pthread_create(&threads[i].thread, NULL, freeze_main,
+				&threads[i]) != 0) {
+			perror("Unable to start a freezing thread.");
+			xexit(-1);
+		}
+	}
+
+	for(int i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i].thread, NULL);
+		compare_snapshots(snap, threads[i].snap);
+		bf_snapshot_put(threads[i].snap);
+		close_bin_file(threads[i].bf);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file *    bf;
+	struct bf_snapshot * snap;
+	bfd_vma		     main_vma;
+	char		     target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+	snap = bf_freeze_bin_file(bf);
+
+	if(snap == NULL) {
+		fail("Unable to freeze", 0);
+	}
+
+	test_insns(bf, snap);
+	test_bbs(bf, snap);
+	test_funcs(bf, snap);
+	test_concurrent(target_path, snap);
+
+	/*
+	 * The snapshot outlives the bin_file and its extra reference.
+	 */
+	main_vma = bf_get_func_from_name(bf, "main")->vma;
+	bf_snapshot_get(snap);
+	close_bin_file(bf);
+	bf_snapshot_put(snap);
+
+	if(bf_snapshot_get_func_from_name(snap, "main") == NULL ||
+			bf_snapshot_get_func_from_name(snap, "main")->vma !=
+			main_vma) {
+		fail("Snapshot changed after closing", main_vma);
+	}
+
+	printf("Froze %u instructions, %u blocks and %u functions\n",
+			snap->num_insns, snap->num_bbs, snap->num_funcs);
+	bf_snapshot_put(snap);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <insn.h>
+#include <symbol.h>
+#include <strpool.h>
+
+#include "test_target.h"
+
+#define NUM_STRINGS 100000
+
+void fail(char * msg, const char * str)
+{
+	fprintf(stderr, "%s: %s\n", msg, str ? str : "(null)");
+	xexit(-1);
+}
+
+/*
+ * Equal strings have to be interned once and come back as the same pointer,
+ * however they were passed in.
+ */
+void test_dedup(void)
+{
+	struct bf_strpool * pool = bf_init_strpool();
+	char		    buf[] = "push %rbp";
+	const char *	    str;
+	const char *	    big;
+	char *		    long_str;
+
+	if(bf_strpool_find(pool, "push %rbp") != NULL) {
+		fail("Found a string which was never interned", buf);
+	}
+
+	str = bf_strpool_intern(pool, buf);
+
+	if(str == buf || strcmp(str, buf) != 0) {
+		fail("String not copied", buf);
+	}
+
+	/*
+	 * The pool must not depend on the caller keeping its copy.
+	 */
+	strcpy(buf, "pop %rbx");
+
+	if(bf_strpool_intern(pool, "push %rbp") != str ||
+			bf_strpool_find(pool, "push %rbp") != str ||
+			strcmp(str, "push %rbp") != 0) {
+		fail("Equal strings interned twice", str);
+	}
+
+	if(bf_strpool_intern_len(pool, "push %rbp, %rsp", 9) != str ||
+			bf_strpool_intern_len(pool, "push", 4) ==
+			bf_strpool_intern(pool, "push %rbp")) {
+		fail("Prefix interned wrongly", str);
+	}
+
+	if(bf_strpool_intern(pool, "") != bf_strpool_intern_len(pool, "x",
+			0) || pool->count != 3) {
+		fail("Empty string interned wrongly", "");
+	}
+
+	/*
+	 * A string larger than a chunk gets one of its own.
+	 */
+	long_str = xmalloc(256 * 1024 + 1);
+	memset(long_str, 'a', 256 * 1024);
+	long_str[256 * 1024] = '\0';
+	big		     = bf_strpool_intern(pool, long_str);
+
+	if(big == long_str || strcmp(big, long_str) != 0 ||
+			bf_strpool_intern(pool, long_str) != big) {
+		fail("Long string interned wrongly", NULL);
+	}
+
+	free(long_str);
+	bf_close_strpool(pool);
+}
+
+/*
+ * Enough strings to grow the table and fill many chunks. Neither may move
+ * a string that was already handed out.
+ */
+void test_growth(void)
+{
+	struct bf_strpool * pool = bf_init_strpool();
+	const char **	    strs = xmalloc(NUM_STRINGS * sizeof(char *));
+	char		    buf[32];
+
+	for(size_t i = 0; i < NUM_STRINGS; i++) {
+		snprintf(buf, sizeof(buf), "string_%zu", i);
+		strs[i] = bf_strpool_intern(pool, buf);
+	}
+
+	if(pool->count != NUM_STRINGS) {
+		fail("Wrong number of strings", NULL);
+	}
+
+	for(size_t i = 0; i < NUM_STRINGS; i++) {
+		snprintf(buf, sizeof(buf), "string_%zu", i);
+
+		if(strcmp(strs[i], buf) != 0 ||
+				bf_strpool_intern(pool, buf) != strs[i] ||
+				bf_strpool_find(pool, buf) != strs[i]) {
+			fail("String moved by growing", buf);
+		}
+	}
+
+	if(pool->count != NUM_STRINGS) {
+		fail("Strings interned twice", NULL);
+	}
+
+	free(strs);
+	bf_close_strpool(pool);
+}
+
+/*
+ * The symbol names and instruction parts of a bin_file all come from its
+ * pool, so equal ones share a pointer.
+ */
+void test_bin_file(struct bin_file * bf)
+{
+	struct symbol *	 sym;
+	struct bf_insn * insn;
+
+	for_each_symbol(sym, &bf->sym_table) {
+		if(bf_strpool_find(bf->strpool, sym->name) != sym->name) {
+			fail("Symbol name not interned", sym->name);
+		}
+	}
+
+	bf_for_each_insn(insn, bf) {
+		struct bf_insn_part * part;
+
+		list_for_each_entry(part, &insn->part_list, list) {
+			if(bf_strpool_find(bf->strpool, part->str) !=
+					part->str) {
+				fail("Instruction part not interned",
+						part->str);
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	test_dedup();
+	test_growth();
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+	test_bin_file(bf);
+
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <symbol.h>
+#include <cache.h>
+
+#include "test_target.h"
+
+/*
+ * Points the cache at an empty folder.
+ */
+void create_fresh_cache_folder(char * bitiness)
+{
+	char folder[PATH_MAX];
+	char cmd[PATH_MAX + 16];
+
+	snprintf(folder, sizeof(folder), "%s/tests-symbol-cache%s",
+			getenv("TEST_BUILD_DIR"), bitiness);
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", folder);
+
+	if(system(cmd)) {
+		perror("Problem creating fresh cache folder.");
+		xexit(-1);
+	}
+
+	bf_enable_cache(folder);
+}
+
+void fail(char * msg, struct symbol * sym)
+{
+	fprintf(stderr, "%s: %s\n", msg, sym ? sym->name : "(null)");
+	xexit(-1);
+}
+
+bool same_symbol(struct symbol * sym, struct symbol * sym2)
+{
+	return sym2 != NULL && sym->address == sym2->address &&
+			sym->size == sym2->size && sym->type == sym2->type &&
+			sym->plt_type == sym2->plt_type &&
+			strcmp(sym->name, sym2->name) == 0 &&
+			!sym->section == !sym2->section &&
+			(!sym->section ||
+			strcmp(sym->section, sym2->section) == 0);
+}
+
+/*
+ * Checks that the cached table indexes the same symbols by address and by
+ * name as the one read through BFD.
+ */
+size_t compare_tables(struct symbol_table * table,
+		struct symbol_table * cached)
+{
+	struct rb_node * node  = rb_first(&table->rb_symbol);
+	struct rb_node * node2 = rb_first(&cached->rb_symbol);
+	struct symbol *	 sym;
+	size_t		 num_relocs = 0;
+
+	for(; node != NULL && node2 != NULL; node = rb_next(node),
+			node2 = rb_next(node2)) {
+		sym = rb_entry(node, struct symbol, rb_symbol);
+
+		if(!same_symbol(sym, rb_entry(node2, struct symbol,
+				rb_symbol))) {
+			fail("Symbol tree differs", sym);
+		}
+
+		if(sym->type & SYMBOL_RELOCATION) {
+			num_relocs++;
+		}
+	}
+
+	if(node != NULL || node2 != NULL) {
+		fail("Symbol tree sizes differ", NULL);
+	}
+
+	if(table->symbol_count != cached->symbol_count) {
+		fail("Symbol counts differ", NULL);
+	}
+
+	for_each_symbol(sym, table) {
+		if(!same_symbol(sym, symbol_find(cached, sym->name))) {
+			fail("Symbol hash differs", sym);
+		}
+	}
+
+	return num_relocs;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	struct bin_file * cached;
+	size_t		  num_relocs;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	create_fresh_cache_folder(argv[1]);
+
+	/*
+	 * The first load reads the symbols through BFD and writes the cache.
+	 */
+	bf = load_bin_file(target_path, NULL);
+	symbol_table_ensure(&bf->sym_table);
+
+	if(bf->sym_table.cache_map != NULL) {
+		fail("Symbols loaded from an empty cache", NULL);
+	}
+
+	cached = load_bin_file(target_path, NULL);
+	symbol_table_ensure(&cached->sym_table);
+
+	if(cached->sym_table.cache_map == NULL) {
+		fail("Symbols not loaded from the cache", NULL);
+	}
+
+	num_relocs = compare_tables(&bf->sym_table, &cached->sym_table);
+
+	if(num_relocs == 0) {
+		fail("No relocation symbols", NULL);
+	}
+
+	printf("Restored %zu symbols, %zu relocations\n",
+			bf->sym_table.symbol_count, num_relocs);
+	close_bin_file(cached);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
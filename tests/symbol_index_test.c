@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <func.h>
+#include <symbol.h>
+#include <strpool.h>
+
+#include "test_target.h"
+
+#define NUM_SYMBOLS 1000
+
+void fail(char * msg, const char * name)
+{
+	fprintf(stderr, "%s: %s\n", msg, name ? name : "(null)");
+	xexit(-1);
+}
+
+/*
+ * Adds enough symbols to a table of its own for the name index to double
+ * several times. The index has to stay a power of two no smaller than the
+ * number of symbols, and every symbol has to be found after each growth.
+ */
+void test_growth(void)
+{
+	static struct symbol symbols[NUM_SYMBOLS];
+	static char	     names[NUM_SYMBOLS][16];
+	struct bf_strpool *  pool = bf_init_strpool();
+	struct symbol_table  table;
+	struct symbol	     dup;
+	struct symbol *	     sym;
+	size_t		     count = 0;
+
+	symbol_table_init(&table, NULL, pool);
+
+	for(size_t i = 0; i < NUM_SYMBOLS; i++) {
+		snprintf(names[i], sizeof(names[i]), "sym_%zu", i);
+		symbols[i].name	   = names[i];
+		symbols[i].address = 0x1000 + i * 0x10;
+		symbol_add(&table, &symbols[i]);
+
+		if(table.symbol_count != i + 1 ||
+				table.symbol_count > table.symbol_hash_size ||
+				(table.symbol_hash_size &
+				(table.symbol_hash_size - 1)) != 0) {
+			fail("Wrong index size", names[i]);
+		}
+
+		if(symbol_find(&table, names[i / 2]) != &symbols[i / 2]) {
+			fail("Symbol lost while growing", names[i / 2]);
+		}
+	}
+
+	if(table.symbol_hash_size <= symbolhash_size) {
+		fail("Index did not grow", NULL);
+	}
+
+	for(size_t i = 0; i < NUM_SYMBOLS; i++) {
+		if(symbol_find(&table, names[i]) != &symbols[i]) {
+			fail("Symbol not found after growing", names[i]);
+		}
+	}
+
+	if(symbol_find(&table, "sym_missing") != NULL) {
+		fail("Found a missing symbol", "sym_missing");
+	}
+
+	/*
+	 * A second symbol with a taken name is not indexed.
+	 */
+	memset(&dup, 0, sizeof(dup));
+	dup.name    = names[7];
+	dup.address = 0x10;
+	symbol_add(&table, &dup);
+
+	if(table.symbol_count != NUM_SYMBOLS ||
+			symbol_find(&table, names[7]) != &symbols[7]) {
+		fail("Duplicate name indexed", names[7]);
+	}
+
+	for_each_symbol(sym, &table) {
+		count++;
+	}
+
+	if(count != NUM_SYMBOLS) {
+		fail("Wrong number of symbols visited", NULL);
+	}
+
+	symbol_table_destroy(&table);
+	bf_close_strpool(pool);
+}
+
+/*
+ * Functions are looked up by name through the index rather than by walking
+ * every bf_func.
+ */
+void test_func_lookup(struct bin_file * bf)
+{
+	static const char * const names[] = {"main", "func1", "func2"};
+
+	for(size_t i = 0; i < ARRAY_SIZE(names); i++) {
+		struct symbol *	 sym  = symbol_find(&bf->sym_table, names[i]);
+		struct bf_func * func = bf_get_func_from_name(bf,
+				(char *)names[i]);
+
+		if(sym == NULL || func == NULL || func->vma != sym->address) {
+			fail("Function not found by name", names[i]);
+		}
+	}
+
+	if(bf_get_func_from_name(bf, "no_such_function") != NULL) {
+		fail("Found a missing function", "no_such_function");
+	}
+
+	if(bf->sym_table.symbol_count > bf->sym_table.symbol_hash_size) {
+		fail("Index of the target too small", NULL);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	test_growth();
+
+	bf = load_bin_file(target_path, NULL);
+	disasm_all_func_sym(bf);
+	test_func_lookup(bf);
+
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <symbol.h>
+
+#include "test_target.h"
+
+void fail(char * msg, struct symbol * sym)
+{
+	fprintf(stderr, "%s: %s\n", msg, sym ? sym->name : "(null)");
+	xexit(-1);
+}
+
+/*
+ * Checks that every function symbol has been given a size and that the
+ * addresses inside it are symbolized back to it.
+ */
+size_t test_single_lookups(struct bin_file * bf, bfd_vma ** addrs)
+{
+	struct symbol * sym;
+	size_t		count = 0;
+
+	*addrs = NULL;
+
+	for_each_symbol(sym, &bf->sym_table) {
+		if((sym->type & SYMBOL_FUNCTION) && sym->address != 0 &&
+				!(sym->type & SYMBOL_RELOCATION)) {
+			struct symbol * found;
+			bfd_vma		offset;
+
+			if(sym->size == 0) {
+				fail("Symbol has no size", sym);
+			}
+
+			found = symbol_lookup_address(&bf->sym_table,
+					sym->address + sym->size - 1, &offset);
+
+			if(found == NULL || found->address != sym->address ||
+					offset != sym->size - 1) {
+				fail("Symbol end not resolved", sym);
+			}
+
+			found = symbol_lookup_address(&bf->sym_table,
+					sym->address + sym->size, NULL);
+
+			if(found != NULL && found->address == sym->address) {
+				fail("Symbol resolved past its end", sym);
+			}
+
+			*addrs = xrealloc(*addrs, (count + 3) *
+					sizeof(bfd_vma));
+			(*addrs)[count++] = sym->address + sym->size / 2;
+			(*addrs)[count++] = sym->address + sym->size;
+			(*addrs)[count++] = sym->address;
+		}
+	}
+
+	if(count == 0) {
+		fail("No function symbols found", NULL);
+	}
+
+	return count;
+}
+
+int cmp_vma(const void * a, const void * b)
+{
+	bfd_vma x = *(const bfd_vma *)a;
+	bfd_vma y = *(const bfd_vma *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Checks that the batch lookup agrees with the single lookups for both
+ * unsorted and sorted input.
+ */
+void test_batch_lookups(struct bin_file * bf, bfd_vma * addrs, size_t count)
+{
+	struct symbol ** syms	 = xmalloc(count * sizeof(struct symbol *));
+	bfd_vma *	 offsets = xmalloc(count * sizeof(bfd_vma));
+
+	for(int pass = 0; pass < 2; pass++) {
+		size_t found = symbol_lookup_addresses(&bf->sym_table, addrs,
+				count, syms, offsets);
+		size_t expected = 0;
+
+		for(size_t i = 0; i < count; i++) {
+			bfd_vma		offset = 0;
+			struct symbol * sym    = symbol_lookup_address(
+					&bf->sym_table, addrs[i], &offset);
+
+			if(sym != syms[i] || (sym && offset != offsets[i])) {
+				fail("Batch lookup mismatch", sym);
+			}
+
+			expected += sym != NULL;
+		}
+
+		if(found != expected) {
+			fail("Batch lookup count mismatch", NULL);
+		}
+
+		qsort(addrs, count, sizeof(bfd_vma), cmp_vma);
+	}
+
+	free(syms);
+	free(offsets);
+}
+
+/*
+ * The target has two static functions named scale. Only one of them can be
+ * in the name index, but both have to get a size and be symbolized.
+ */
+void test_duplicate_names(struct bin_file * bf)
+{
+	struct rb_node * node;
+	int		 count = 0;
+
+	for(node = rb_first(&bf->sym_table.rb_symbol); node != NULL;
+			node = rb_next(node)) {
+		struct symbol * sym = rb_entry(node, struct symbol, rb_symbol);
+
+		if(strcmp(sym->name, "scale") != 0 ||
+				!(sym->type & SYMBOL_FUNCTION)) {
+			continue;
+		}
+
+		if(sym->size == 0) {
+			fail("Symbol has no size", sym);
+		}
+
+		if(symbol_lookup_address(&bf->sym_table, sym->address +
+				sym->size / 2, NULL) != sym) {
+			fail("Symbol not resolved", sym);
+		}
+
+		count++;
+	}
+
+	if(count != 2) {
+		fail("Symbols sharing a name missing", NULL);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file * bf;
+	bfd_vma *	  addrs;
+	size_t		  count;
+	char		  target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	bf    = load_bin_file(target_path, NULL);
+	count = test_single_lookups(bf, &addrs);
+	test_duplicate_names(bf);
+	test_batch_lookups(bf, addrs, count);
+
+	printf("Symbolized %zu addresses\n", count);
+	free(addrs);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
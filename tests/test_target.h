@@ -0,0 +1,85 @@
+/*
+ * Finding the target programs built in tests/detour_targets, shared by the
+ * tests which run against them.
+ */
+
+#ifndef TEST_TARGET_H
+#define TEST_TARGET_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+
+/*
+ * Gets path to a version of the target program, e.g. "detour_target_v2_"
+ * followed by the bitiness.
+ */
+static inline bool get_named_target_path(char * target_path, size_t size,
+		const char * name, const char * bitiness)
+{
+	char * dir = getenv("TEST_BUILD_DIR");
+	int    target_desc;
+
+	if(!dir) {
+		return FALSE;
+	}
+
+	snprintf(target_path, size, "%s/detour_targets/%s%s", dir, name,
+			bitiness);
+	target_desc = open(target_path, O_RDONLY);
+
+	if(target_desc == -1) {
+		return FALSE;
+	} else {
+		close(target_desc);
+		return TRUE;
+	}
+}
+
+/*
+ * Gets path to target program.
+ */
+static inline bool get_target_path(char * target_path, size_t size,
+		const char * bitiness)
+{
+	return get_named_target_path(target_path, size, "detour_target_",
+			bitiness);
+}
+
+/*
+ * Exits unless the test was invoked with the bitiness of the target.
+ */
+static inline void check_test_args(int argc, char * argv[])
+{
+	if(argc != 2 || (strcmp(argv[1], "32") != 0 &&
+			strcmp(argv[1], "64") != 0)) {
+		fprintf(stderr, "%s should be invoked with parameter 32 or 64 "\
+				"depending on which version of the target "\
+				"should be tested against.\n",
+				lbasename(argv[0]));
+		xexit(-1);
+	}
+}
+
+/*
+ * Checks the arguments of the test and gets path to the target program
+ * they ask for.
+ */
+static inline void init_test_target(int argc, char * argv[],
+		char * target_path, size_t size)
+{
+	check_test_args(argc, argv);
+
+	if(!get_target_path(target_path, size, argv[1])) {
+		perror("Unable to find detour target.");
+		xexit(-1);
+	}
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libiberty.h>
+
+#include <binary_file.h>
+#include <cache.h>
+#include <func.h>
+#include <xref_index.h>
+
+#include "test_target.h"
+
+#define NUM_THREADS 4
+
+struct QUERY_THREAD {
+	struct bf_xref_index * index;
+	bfd_vma		       vma;
+	bool		       done;
+};
+
+void fail(char * msg, bfd_vma vma)
+{
+	fprintf(stderr, "%s: 0x%lx\n", msg, (unsigned long)vma);
+	xexit(-1);
+}
+
+/*
+ * Copies every reference held by the index.
+ */
+struct bf_xref * copy_xrefs(struct bf_xref_index * index, size_t * count)
+{
+	struct bf_xref * xrefs;
+	struct bf_xref * copy;
+
+	*count = bf_get_xrefs(index, 0, (bfd_vma)-1, &xrefs);
+	copy   = xmalloc((*count + 1) * sizeof(struct bf_xref));
+	memcpy(copy, xrefs, *count * sizeof(struct bf_xref));
+	return copy;
+}
+
+void compare_xrefs(struct bf_xref * xrefs, size_t count,
+		struct bf_xref * xrefs2, size_t count2)
+{
+	if(count != count2) {
+		fail("Different number of references", count);
+	}
+
+	for(size_t i = 0; i < count; i++) {
+		if(xrefs[i].target != xrefs2[i].target ||
+				xrefs[i].from != xrefs2[i].from ||
+				xrefs[i].insn != xrefs2[i].insn ||
+				xrefs[i].kind != xrefs2[i].kind) {
+			fail("Different reference", xrefs[i].from);
+		}
+	}
+}
+
+/*
+ * Queries the index while the disassembler is still adding to it.
+ */
+void * query_xrefs(void * param)
+{
+	struct QUERY_THREAD * query = param;
+
+	while(!__atomic_load_n(&query->done, __ATOMIC_ACQUIRE)) {
+		struct bf_xref * xrefs;
+		size_t		 count = bf_get_xrefs_to(query->index,
+				query->vma, &xrefs);
+
+		for(size_t i = 0; i < count; i++) {
+			if(xrefs[i].target != query->vma) {
+				fail("Reference to another address",
+						xrefs[i].target);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Checks that main calls func1.
+ */
+void test_call(struct bin_file * bf, struct bf_xref_index * index)
+{
+	struct symbol *	 main_sym = symbol_find(&bf->sym_table, "main");
+	struct bf_func * func1	  = bf_get_func_from_name(bf, "func1");
+	struct bf_xref * xrefs;
+	size_t		 count;
+	bool		 found	  = FALSE;
+
+	if(main_sym == NULL || func1 == NULL) {
+		fail("Unable to locate main or func1", 0);
+	}
+
+	count = bf_get_xrefs_to(index, func1->vma, &xrefs);
+
+	for(size_t i = 0; i < count; i++) {
+		struct bf_insn * insn = bf_get_insn_by_id(bf, xrefs[i].insn);
+
+		if(insn == NULL || insn->vma != xrefs[i].from) {
+			fail("Reference from an unknown instruction",
+					xrefs[i].from);
+		}
+
+		if(xrefs[i].kind == BF_XREF_CALL &&
+				xrefs[i].from >= main_sym->address &&
+				xrefs[i].from < main_sym->address +
+				main_sym->size) {
+			found = TRUE;
+		}
+	}
+
+	if(!found) {
+		fail("Call from main not found", func1->vma);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bin_file *      bf;
+	struct bf_xref_index * index;
+	struct QUERY_THREAD    query;
+	pthread_t	       thread;
+	struct bf_xref *       incremental;
+	struct bf_xref *       rebuilt;
+	size_t		       count;
+	size_t		       count2;
+	char		       target_path[PATH_MAX] = {0};
+
+	init_test_target(argc, argv, target_path, ARRAY_SIZE(target_path));
+
+	/*
+	 * A restored analysis would be indexed by bf_init_xref_index, so the
+	 * cache is off to make the disassembler feed the index.
+	 */
+	bf_disable_cache();
+	bf    = load_bin_file(target_path, NULL);
+	index = bf_init_xref_index(bf, 1);
+
+	query.index = index;
+	query.vma   = symbol_find(&bf->sym_table, "func1")->address;
+	query.done  = FALSE;
+
+	if(pthread_create(&thread, NULL, query_xrefs, &query) != 0) {
+		perror("Unable to start the query thread.");
+		xexit(-1);
+	}
+
+	disasm_all_func_sym_parallel(bf, NUM_THREADS);
+	__atomic_store_n(&query.done, TRUE, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+
+	incremental = copy_xrefs(index, &count);
+	test_call(bf, index);
+
+	bf_rebuild_xref_index(index, 1);
+	rebuilt = copy_xrefs(index, &count2);
+	compare_xrefs(incremental, count, rebuilt, count2);
+	free(rebuilt);
+
+	bf_rebuild_xref_index(index, NUM_THREADS);
+	rebuilt = copy_xrefs(index, &count2);
+	compare_xrefs(incremental, count, rebuilt, count2);
+	free(rebuilt);
+
+	printf("Indexed %zu references\n", count);
+	free(incremental);
+	close_bin_file(bf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1004 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * bf-analyze exposes the common libbf operations on the command line:
+ *
+ *	bf-analyze [options] load <binary>
+ *	bf-analyze [options] disasm <binary>
+ *	bf-analyze [options] dump <binary>
+ *	bf-analyze [options] diff <binary> <binary>
+ *	bf-analyze [options] match <binary> <binary>
+ *	bf-analyze [options] index <index> <binary>
+ *	bf-analyze [options] search <index> <binary> <function>
+ *	bf-analyze [options] loops <binary>
+ *	bf-analyze [options] calls <binary>
+ *	bf-analyze [options] xrefs <binary> <symbol|address>
+ *	bf-analyze [options] find <binary> <mnemonic>
+ *	bf-analyze [options] grep <binary> <pattern>
+ *	bf-analyze [options] scan <binary> <signature>...
+ *	bf-analyze [options] hook <binary> <from> <to> -o <output>
+ *
+ * Diagnostics, --stats and --time go to stderr so that the results on stdout
+ * can be piped.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libiberty.h>
+
+#include "binary_file.h"
+#include "basic_blk.h"
+#include "func.h"
+#include "insn.h"
+#include "cfg.h"
+#include "cache.h"
+#include "detour.h"
+#include "parallel.h"
+#include "diff.h"
+#include "sim_index.h"
+#include "func_flow.h"
+#include "call_graph.h"
+#include "xref_index.h"
+#include "insn_index.h"
+#include "insn_pattern.h"
+#include "byte_scan.h"
+
+enum dump_format {
+	DUMP_TEXT,
+	DUMP_DOT,
+	DUMP_SEMANTIC
+};
+
+struct analyze_options {
+	unsigned int	 threads;
+	bool		 stats;
+	bool		 time;
+	bool		 entry;
+	bool		 syms;
+	bool		 sweep;
+	bool		 trampoline;
+	enum dump_format format;
+	char *		 output;
+};
+
+static void usage(const char * name)
+{
+	fprintf(stderr, "Usage: %s [options] <command> <binary> [args]\n"
+			"Commands:\n"
+			"  load <binary>              load the binary\n"
+			"  disasm <binary>            disassemble the binary\n"
+			"  dump <binary>              print the disassembly\n"
+			"  diff <binary> <binary>     compare functions by "
+			"name\n"
+			"  match <binary> <binary>    match functions by "
+			"similarity\n"
+			"  index <index> <binary>     add the functions to a "
+			"similarity index\n"
+			"  search <index> <binary> <function>\n"
+			"                             find functions similar "
+			"to <function>\n"
+			"  loops <binary>             list the loops of every "
+			"function\n"
+			"  calls <binary>             print the call graph\n"
+			"  xrefs <binary> <symbol|address>\n"
+			"                             list the references to "
+			"a symbol\n"
+			"  find <binary> <mnemonic>   list the instructions "
+			"with a mnemonic\n"
+			"  grep <binary> <pattern>    list the instruction "
+			"sequences matching\n"
+			"                             <pattern>\n"
+			"  scan <binary> <signature>...\n"
+			"                             list the bytes matching "
+			"hex signatures,\n"
+			"                             e.g. \"55 48 ?? e5 4?\"\n"
+			"  hook <binary> <from> <to>  detour function <from> "
+			"to <to>\n"
+			"Options:\n"
+			"  -r, --roots LIST     comma separated roots: entry, "
+			"syms, sweep\n"
+			"                       (default entry,syms)\n"
+			"  -f, --format FMT     dump format: text, dot, "
+			"semantic (default text)\n"
+			"  -o, --output FILE    output file of dump and hook\n"
+			"  -T, --trampoline     hook with a trampoline back\n"
+			"  -j, --threads N      number of threads (default "
+			"LIBBF_THREADS or CPUs)\n"
+			"  -c, --cache[=DIR]    enable the on-disk cache\n"
+			"  -s, --stats          print object counts\n"
+			"  -t, --time           print the time of each phase\n"
+			"  -h, --help           show this message\n", name);
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void report_time(struct analyze_options * opts, const char * phase,
+		double start)
+{
+	if(opts->time) {
+		fprintf(stderr, "%s: %.1fms\n", phase, now_ms() - start);
+	}
+}
+
+static struct bin_file * open_binary(struct analyze_options * opts,
+		char * path, char * output)
+{
+	double		  start = now_ms();
+	struct bin_file * bf	= load_bin_file(path, output);
+
+	if(bf == NULL) {
+		fprintf(stderr, "Unable to load %s\n", path);
+		exit(1);
+	}
+
+	report_time(opts, "load", start);
+	return bf;
+}
+
+static void disassemble(struct analyze_options * opts, struct bin_file * bf)
+{
+	double start = now_ms();
+
+	if(opts->syms) {
+		disasm_all_func_sym_parallel(bf, opts->threads);
+	}
+
+	if(opts->entry) {
+		disasm_bin_file_entry(bf);
+	}
+
+	if(opts->sweep) {
+		disasm_bin_file_sweep(bf, opts->threads);
+	}
+
+	report_time(opts, "disasm", start);
+}
+
+static void print_stats(struct analyze_options * opts, struct bin_file * bf)
+{
+	if(opts->stats) {
+		/*
+		 * Symbols are loaded on first use, so the count is only
+		 * meaningful once they are.
+		 */
+		symbol_table_ensure(&bf->sym_table);
+		fprintf(stderr, "%s: %zu symbols, %zu functions, %zu basic "
+				"blocks, %zu instructions\n", bf->output_path,
+				bf->sym_table.symbol_count, bf->func_table.count,
+				bf->bb_table.count, bf->insn_table.count);
+	}
+}
+
+static void close_binary(struct analyze_options * opts, struct bin_file * bf)
+{
+	double start = now_ms();
+
+	print_stats(opts, bf);
+	close_bin_file(bf);
+	report_time(opts, "close", start);
+}
+
+static int cmd_load(struct analyze_options * opts, char ** args)
+{
+	struct bin_file * bf = open_binary(opts, args[0], NULL);
+
+	printf("%s: %s, %d-bit\n", args[0], bfd_get_target(bf->abfd),
+			IS_BF_ARCH_32(bf) ? 32 : 64);
+	close_binary(opts, bf);
+	return 0;
+}
+
+static int cmd_disasm(struct analyze_options * opts, char ** args)
+{
+	struct bin_file * bf = open_binary(opts, args[0], NULL);
+
+	disassemble(opts, bf);
+	printf("%s: %zu functions, %zu basic blocks, %zu instructions\n",
+			args[0], bf->func_table.count, bf->bb_table.count,
+			bf->insn_table.count);
+	close_binary(opts, bf);
+	return 0;
+}
+
+static int cmd_dump(struct analyze_options * opts, char ** args)
+{
+	struct bin_file * bf	 = open_binary(opts, args[0], NULL);
+	FILE *		  stream = stdout;
+	double		  start;
+
+	disassemble(opts, bf);
+
+	if(opts->output != NULL) {
+		stream = fopen(opts->output, "w");
+
+		if(stream == NULL) {
+			perror(opts->output);
+			close_binary(opts, bf);
+			return 1;
+		}
+	}
+
+	start = now_ms();
+
+	switch(opts->format) {
+	case DUMP_TEXT:
+		print_all_bf_insn(bf, stream);
+		break;
+	case DUMP_DOT:
+		print_entire_cfg_dot(bf, stream);
+		break;
+	case DUMP_SEMANTIC:
+		print_all_bf_insn_semantic_gen(bf, stream);
+		break;
+	}
+
+	if(stream != stdout) {
+		fclose(stream);
+	}
+
+	report_time(opts, "dump", start);
+	close_binary(opts, bf);
+	return 0;
+}
+
+/*
+ * visited maps the id of every block of the first binary already matched
+ * during one comparison to the block of the second binary it matched.
+ */
+static bool cmp_bb(struct bf_basic_blk ** visited, struct bf_basic_blk * bb,
+		struct bf_basic_blk * bb2)
+{
+	unsigned int length;
+
+	if(bb == NULL || bb2 == NULL) {
+		return bb == bb2;
+	}
+
+	if(visited[bb->entry.id] != NULL) {
+		return visited[bb->entry.id] == bb2;
+	}
+
+	length = bf_get_bb_length(bb);
+
+	if(bf_get_bb_length(bb2) != length) {
+		return FALSE;
+	}
+
+	for(unsigned int i = 0; i < length; i++) {
+		if(bf_get_bb_insn(bb, i)->mnemonic !=
+				bf_get_bb_insn(bb2, i)->mnemonic) {
+			return FALSE;
+		}
+	}
+
+	visited[bb->entry.id] = bb2;
+
+	return cmp_bb(visited, bb->target, bb2->target) &&
+			cmp_bb(visited, bb->target2, bb2->target2);
+}
+
+static bool is_func_sym(struct symbol * sym)
+{
+	return sym != NULL && (sym->type & SYMBOL_FUNCTION) &&
+			sym->address != 0;
+}
+
+enum diff_kind {
+	DIFF_SAME,
+	DIFF_MODIFIED,
+	DIFF_REMOVED,
+	DIFF_ADDED
+};
+
+struct diff_entry {
+	struct symbol * sym;
+	struct symbol * sym2;
+	enum diff_kind	kind;
+};
+
+struct diff_pass {
+	struct bin_file *   bf;
+	struct bin_file *   bf2;
+	struct diff_entry * entries;
+	size_t		    counts[DIFF_ADDED + 1];
+};
+
+static void * diff_func(struct bf_task_ctx * ctx, size_t first, size_t last)
+{
+	struct diff_pass *     pass = ctx->param;
+	struct diff_entry *    diff = &pass->entries[first];
+	struct bf_basic_blk ** visited;
+
+	if(diff->kind != DIFF_MODIFIED) {
+		return NULL;
+	}
+
+	visited = xcalloc(bf_get_num_basic_blks(pass->bf),
+			sizeof(struct bf_basic_blk *));
+
+	if(cmp_bb(visited, bf_get_bb(pass->bf, diff->sym->address),
+			bf_get_bb(pass->bf2, diff->sym2->address))) {
+		diff->kind = DIFF_SAME;
+	}
+
+	free(visited);
+	return NULL;
+}
+
+static void print_diff(size_t first, size_t last, void * result,
+		void * param)
+{
+	static const char   marks[] = {'=', '~', '-', '+'};
+	struct diff_pass *  pass    = param;
+	struct diff_entry * diff    = &pass->entries[first];
+
+	pass->counts[diff->kind]++;
+
+	if(diff->kind != DIFF_SAME) {
+		printf("%c %s\n", marks[diff->kind],
+				symbol_demangled_name(diff->sym));
+	}
+}
+
+static int cmp_diff_entry(const void * elem1, const void * elem2)
+{
+	const struct diff_entry * e1 = elem1;
+	const struct diff_entry * e2 = elem2;
+
+	return strcmp(e1->sym->name, e2->sym->name);
+}
+
+static int cmd_diff(struct analyze_options * opts, char ** args)
+{
+	struct diff_pass pass	  = {0};
+	size_t		 count	  = 0;
+	size_t		 capacity = 64;
+	struct symbol *	 sym;
+	double		 start;
+
+	pass.bf	     = open_binary(opts, args[0], NULL);
+	pass.bf2     = open_binary(opts, args[1], NULL);
+	pass.entries = xmalloc(capacity * sizeof(struct diff_entry));
+
+	disassemble(opts, pass.bf);
+	disassemble(opts, pass.bf2);
+	start = now_ms();
+
+	for(int b = 0; b < 2; b++) {
+		struct bin_file * bf	= b == 0 ? pass.bf : pass.bf2;
+		struct bin_file * other = b == 0 ? pass.bf2 : pass.bf;
+
+		for_each_symbol(sym, &bf->sym_table) {
+			struct symbol * sym2;
+
+			if(!is_func_sym(sym)) {
+				continue;
+			}
+
+			sym2 = symbol_find(&other->sym_table, sym->name);
+
+			/*
+			 * Functions in both binaries are only recorded once.
+			 */
+			if(b == 1 && is_func_sym(sym2)) {
+				continue;
+			}
+
+			if(count == capacity) {
+				capacity     *= 2;
+				pass.entries  = xrealloc(pass.entries,
+						capacity *
+						sizeof(struct diff_entry));
+			}
+
+			pass.entries[count].sym	 = sym;
+			pass.entries[count].sym2 = sym2;
+
+			if(is_func_sym(sym2)) {
+				pass.entries[count].kind = DIFF_MODIFIED;
+			} else {
+				pass.entries[count].kind = b == 0 ?
+						DIFF_REMOVED : DIFF_ADDED;
+			}
+
+			count++;
+		}
+	}
+
+	qsort(pass.entries, count, sizeof(struct diff_entry), cmp_diff_entry);
+	bf_parallel_run(opts->threads, count, 1, diff_func, print_diff, &pass);
+	report_time(opts, "diff", start);
+
+	fprintf(stderr, "%zu same, %zu modified, %zu removed, %zu added\n",
+			pass.counts[DIFF_SAME], pass.counts[DIFF_MODIFIED],
+			pass.counts[DIFF_REMOVED], pass.counts[DIFF_ADDED]);
+
+	free(pass.entries);
+	close_binary(opts, pass.bf);
+	close_binary(opts, pass.bf2);
+	return pass.counts[DIFF_SAME] == count ? 0 : 3;
+}
+
+static int cmd_match(struct analyze_options * opts, char ** args)
+{
+	struct bin_file * bf  = open_binary(opts, args[0], NULL);
+	struct bin_file * bf2 = open_binary(opts, args[1], NULL);
+	struct bf_diff *  diff;
+	size_t		  same = 0;
+	double		  start;
+	int		  result;
+
+	disassemble(opts, bf);
+	disassemble(opts, bf2);
+	start = now_ms();
+	diff  = bf_diff_bins(bf, bf2, opts->threads, 0);
+	report_time(opts, "match", start);
+	bf_print_diff(diff, stdout, FALSE);
+
+	for(size_t i = 0; i < diff->num_matches; i++) {
+		same += diff->matches[i].similarity == 1;
+	}
+
+	fprintf(stderr, "%zu same, %zu changed, %zu removed, %zu added\n",
+			same, diff->num_matches - same, diff->num_removed,
+			diff->num_added);
+
+	result = same == diff->num_matches && diff->num_removed == 0 &&
+			diff->num_added == 0 ? 0 : 3;
+	bf_close_diff(diff);
+	close_binary(opts, bf);
+	close_binary(opts, bf2);
+	return result;
+}
+
+static int cmd_index(struct analyze_options * opts, char ** args)
+{
+	struct bf_sim_index * index = bf_open_sim_index(args[0], TRUE);
+	struct bin_file *     bf;
+	size_t		      added;
+	double		      start;
+
+	if(index == NULL) {
+		fprintf(stderr, "Unable to open index %s\n", args[0]);
+		return 1;
+	}
+
+	bf = open_binary(opts, args[1], NULL);
+	disassemble(opts, bf);
+	start = now_ms();
+	added = bf_add_to_sim_index(index, bf, args[1], opts->threads);
+
+	if(!bf_flush_sim_index(index)) {
+		fprintf(stderr, "Unable to write index %s\n", args[0]);
+		added = 0;
+	}
+
+	report_time(opts, "index", start);
+	fprintf(stderr, "%zu functions added, %zu indexed\n", added,
+			index->num_records);
+
+	bf_close_sim_index(index);
+	close_binary(opts, bf);
+	return added > 0 ? 0 : 1;
+}
+
+#define SEARCH_MAX_MATCHES 50
+
+static int cmd_search(struct analyze_options * opts, char ** args)
+{
+	struct bf_sim_index * index = bf_open_sim_index(args[0], FALSE);
+	struct bf_sim_match   matches[SEARCH_MAX_MATCHES];
+	struct bin_file *     bf;
+	struct bf_func *      func;
+	struct bf_minhash     sig;
+	size_t		      count;
+	double		      start;
+
+	if(index == NULL) {
+		fprintf(stderr, "Unable to open index %s\n", args[0]);
+		return 1;
+	}
+
+	bf = open_binary(opts, args[1], NULL);
+	disassemble(opts, bf);
+	func = bf_get_func_from_name(bf, args[2]);
+
+	if(func == NULL) {
+		fprintf(stderr, "Unable to find function %s\n", args[2]);
+		bf_close_sim_index(index);
+		close_binary(opts, bf);
+		return 1;
+	}
+
+	if(!bf_get_func_minhash(bf, func, &sig)) {
+		fprintf(stderr, "%s is too small to be searched for reliably\n",
+				args[2]);
+	}
+
+	start = now_ms();
+	count = bf_query_sim_index(index, &sig, 0.5, matches,
+			SEARCH_MAX_MATCHES);
+	report_time(opts, "search", start);
+
+	for(size_t i = 0; i < count; i++) {
+		printf("%.3f %s %s 0x%" PRIx64 "\n", matches[i].similarity,
+				matches[i].binary, matches[i].name ?
+				matches[i].name : "-",
+				(uint64_t)matches[i].vma);
+	}
+
+	bf_close_sim_index(index);
+	close_binary(opts, bf);
+	return count > 0 ? 0 : 3;
+}
+
+static int cmd_loops(struct analyze_options * opts, char ** args)
+{
+	struct bin_file * bf = open_binary(opts, args[0], NULL);
+	struct bf_func ** funcs;
+	size_t		  count;
+	size_t		  num_loops = 0;
+	double		  start;
+
+	disassemble(opts, bf);
+	start = now_ms();
+	bf_analyse_func_flows(bf, opts->threads);
+	report_time(opts, "loops", start);
+
+	funcs = bf_collect_funcs(bf, &count);
+
+	for(size_t i = 0; i < count; i++) {
+		struct bf_func_flow * flow = bf_get_func_flow(bf, funcs[i]);
+		struct symbol *	      sym  = bf_get_func_sym(bf, funcs[i]);
+
+		for(uint32_t l = 0; l < flow->num_loops; l++) {
+			struct bf_loop *      loop   = &flow->loops[l];
+			struct bf_basic_blk * header = flow->blocks[
+					loop->header];
+
+			printf("0x%" PRIx64 " %s depth %u blocks %u\n",
+					(uint64_t)header->vma,
+					sym ? symbol_demangled_name(sym) : "-",
+					loop->depth, loop->num_blocks);
+		}
+
+		num_loops += flow->num_loops;
+	}
+
+	fprintf(stderr, "%zu loops in %zu functions\n", num_loops, count);
+	free(funcs);
+	close_binary(opts, bf);
+	return 0;
+}
+
+static int cmd_calls(struct analyze_options * opts, char ** args)
+{
+	struct bin_file *      bf = open_binary(opts, args[0], NULL);
+	struct bf_call_graph * graph;
+	struct bf_bitmap       reached;
+	double		       start;
+
+	disassemble(opts, bf);
+	start = now_ms();
+	graph = bf_init_call_graph(bf, opts->threads);
+	report_time(opts, "calls", start);
+
+	bf_init_bitmap(&reached, graph->num_nodes);
+
+	for(uint32_t node = 0; node < graph->num_nodes; node++) {
+		struct bf_func * func = graph->funcs[node];
+		struct symbol *	 sym;
+
+		if(func == NULL) {
+			continue;
+		}
+
+		sym = bf_get_func_sym(bf, func);
+
+		printf("0x%" PRIx64 " %s callees %u callers %u reaches %u%s",
+				(uint64_t)func->vma,
+				sym ? symbol_demangled_name(sym) : "-",
+				graph->callee_offsets[node + 1] -
+				graph->callee_offsets[node],
+				graph->caller_offsets[node + 1] -
+				graph->caller_offsets[node],
+				bf_get_reachable_nodes(graph, node, &reached),
+				bf_is_recursive_node(graph, node) ?
+				" recursive" : "");
+
+		if(graph->imports[node] != NULL) {
+			printf(" import %s", graph->imports[node]);
+		}
+
+		printf("\n");
+	}
+
+	fprintf(stderr, "%u edges, %u call sites (%u unresolved), %u "
+			"components\n", graph->num_edges, graph->num_sites,
+			graph->num_unresolved, graph->num_sccs);
+
+	bf_close_bitmap(&reached);
+	bf_close_call_graph(graph);
+	close_binary(opts, bf);
+	return 0;
+}
+
+static int cmd_xrefs(struct analyze_options * opts, char ** args)
+{
+	static const char * const kinds[] = {"call", "branch", "data", "imm",
+			"reloc"};
+
+	struct bin_file *      bf  = open_binary(opts, args[0], NULL);
+	struct symbol *	       sym = symbol_find(&bf->sym_table, args[1]);
+	struct bf_xref_index * index;
+	struct bf_xref *       xrefs;
+	bfd_vma		       start;
+	bfd_vma		       end;
+	size_t		       count;
+	double		       time;
+
+	/*
+	 * A symbol covers its whole object, e.g. every element of a table.
+	 */
+	if(sym != NULL) {
+		start = sym->address;
+		end   = sym->address + (sym->size ? sym->size : 1);
+	} else {
+		char * rest;
+
+		start = strtoull(args[1], &rest, 0);
+		end   = start + 1;
+
+		if(*rest != '\0') {
+			fprintf(stderr, "Unable to find symbol %s\n", args[1]);
+			close_binary(opts, bf);
+			return 1;
+		}
+	}
+
+	disassemble(opts, bf);
+	time  = now_ms();
+	index = bf_init_xref_index(bf, opts->threads);
+	report_time(opts, "xrefs", time);
+
+	count = bf_get_xrefs(index, start, end, &xrefs);
+
+	for(size_t i = 0; i < count; i++) {
+		printf("0x%" PRIx64 " %s 0x%" PRIx64 "\n",
+				(uint64_t)xrefs[i].from, kinds[xrefs[i].kind],
+				(uint64_t)xrefs[i].target);
+	}
+
+	fprintf(stderr, "%zu references of %zu\n", count, index->num_xrefs);
+	close_binary(opts, bf);
+	return count > 0 ? 0 : 3;
+}
+
+static void print_found_insn(struct bin_file * bf, struct bf_insn * insn,
+		void * param)
+{
+	printf("0x%" PRIx64 " ", (uint64_t)insn->vma);
+	bf_print_insn_to_file(stdout, insn);
+	printf("\n");
+}
+
+static int cmd_find(struct analyze_options * opts, char ** args)
+{
+	struct bin_file *      bf = open_binary(opts, args[0], NULL);
+	struct bf_insn_index * index;
+	struct bf_insn	       key;
+	size_t		       count;
+
+	/*
+	 * The index is created first so that the disassembler fills it.
+	 */
+	index = bf_init_insn_index(bf);
+	disassemble(opts, bf);
+
+	bf_set_insn_mnemonic(&key, args[1]);
+	count = bf_count_insns(index, key.mnemonic, BF_ANY_OPERAND);
+	bf_enum_indexed_insn(index, key.mnemonic, BF_ANY_OPERAND,
+			print_found_insn, NULL);
+
+	fprintf(stderr, "%zu of %zu instructions\n", count,
+			index->num_insns);
+	close_binary(opts, bf);
+	return count > 0 ? 0 : 3;
+}
+
+static void print_pattern_match(struct bf_pattern_match * match,
+		void * param)
+{
+	printf("0x%" PRIx64 "-0x%" PRIx64 "\n", (uint64_t)match->first->vma,
+			(uint64_t)(match->last->vma + match->last->size));
+}
+
+static int cmd_grep(struct analyze_options * opts, char ** args)
+{
+	struct bf_pattern_set *	    set = bf_init_pattern_set();
+	struct bf_pattern_matcher * matcher;
+	struct bin_file *	    bf;
+	struct bf_basic_blk *	    bb;
+	uint64_t		    count;
+
+	if(bf_add_pattern(set, args[1], NULL) == -1) {
+		fprintf(stderr, "Malformed pattern %s\n", args[1]);
+		bf_close_pattern_set(set);
+		return 1;
+	}
+
+	bf = open_binary(opts, args[0], NULL);
+	disassemble(opts, bf);
+	matcher = bf_init_pattern_matcher(set, print_pattern_match, NULL);
+
+	bf_for_each_basic_blk(bb, bf) {
+		bf_match_patterns_bb(matcher, bb);
+	}
+
+	count = matcher->num_matches;
+	fprintf(stderr, "%" PRIu64 " matches\n", count);
+
+	bf_close_pattern_matcher(matcher);
+	bf_close_pattern_set(set);
+	close_binary(opts, bf);
+	return count > 0 ? 0 : 3;
+}
+
+static void print_byte_match(struct bf_byte_match * match, void * param)
+{
+	char ** args = param;
+
+	printf("0x%" PRIx64 " %s %s\n", (uint64_t)match->vma,
+			bfd_get_section_name(match->section->owner,
+			match->section), args[match->sig + 1]);
+}
+
+static int cmd_scan(struct analyze_options * opts, char ** args)
+{
+	struct bf_byte_scanner * scanner = bf_init_byte_scanner();
+	struct bin_file *	 bf;
+	double			 time;
+	size_t			 count;
+
+	for(int i = 1; args[i] != NULL; i++) {
+		if(bf_add_byte_signature(scanner, args[i], NULL) == -1) {
+			fprintf(stderr, "Malformed signature %s\n", args[i]);
+			bf_close_byte_scanner(scanner);
+			return 1;
+		}
+	}
+
+	bf    = open_binary(opts, args[0], NULL);
+	time  = now_ms();
+	count = bf_scan_sections(scanner, bf, opts->threads,
+			print_byte_match, args);
+	report_time(opts, "scan", time);
+
+	fprintf(stderr, "%zu matches of %d signatures\n", count,
+			scanner->num_sigs);
+	bf_close_byte_scanner(scanner);
+	close_binary(opts, bf);
+	return count > 0 ? 0 : 3;
+}
+
+static int cmd_hook(struct analyze_options * opts, char ** args)
+{
+	struct bin_file * bf;
+	struct bf_func *  from;
+	struct bf_func *  to;
+	bool		  hooked;
+
+	if(opts->output == NULL) {
+		fprintf(stderr, "hook requires --output\n");
+		return 1;
+	}
+
+	bf = open_binary(opts, args[0], opts->output);
+	disassemble(opts, bf);
+
+	from = bf_get_func_from_name(bf, args[1]);
+	to   = bf_get_func_from_name(bf, args[2]);
+
+	if(from == NULL || to == NULL) {
+		fprintf(stderr, "Unable to find function %s\n",
+				from == NULL ? args[1] : args[2]);
+		close_binary(opts, bf);
+		return 1;
+	}
+
+	if(opts->trampoline) {
+		hooked = bf_trampoline_func(bf, from, to);
+	} else {
+		hooked = bf_detour_func(bf, from, to);
+	}
+
+	if(!hooked) {
+		fprintf(stderr, "Unable to hook %s\n", args[1]);
+	}
+
+	close_binary(opts, bf);
+	return hooked ? 0 : 1;
+}
+
+static bool parse_roots(struct analyze_options * opts, char * list)
+{
+	char * save;
+
+	opts->entry = opts->syms = opts->sweep = FALSE;
+
+	for(char * root = strtok_r(list, ",", &save); root != NULL;
+			root = strtok_r(NULL, ",", &save)) {
+		if(strcmp(root, "entry") == 0) {
+			opts->entry = TRUE;
+		} else if(strcmp(root, "syms") == 0) {
+			opts->syms = TRUE;
+		} else if(strcmp(root, "sweep") == 0) {
+			opts->sweep = TRUE;
+		} else {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static bool parse_format(struct analyze_options * opts, char * format)
+{
+	if(strcmp(format, "text") == 0) {
+		opts->format = DUMP_TEXT;
+	} else if(strcmp(format, "dot") == 0) {
+		opts->format = DUMP_DOT;
+	} else if(strcmp(format, "semantic") == 0) {
+		opts->format = DUMP_SEMANTIC;
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int main(int argc, char * argv[])
+{
+	static struct option long_options[] = {
+		{"roots",      required_argument, NULL, 'r'},
+		{"format",     required_argument, NULL, 'f'},
+		{"output",     required_argument, NULL, 'o'},
+		{"trampoline", no_argument,	  NULL, 'T'},
+		{"threads",    required_argument, NULL, 'j'},
+		{"cache",      optional_argument, NULL, 'c'},
+		{"stats",      no_argument,	  NULL, 's'},
+		{"time",       no_argument,	  NULL, 't'},
+		{"help",       no_argument,	  NULL, 'h'},
+		{NULL,	       0,		  NULL, 0}
+	};
+
+	/*
+	 * A negative num_args is the least number of arguments of a command
+	 * taking a list.
+	 */
+	static const struct {
+		const char * name;
+		int	     num_args;
+		int	     (*run)(struct analyze_options *, char **);
+	} commands[] = {
+		{"load",   1, cmd_load},
+		{"disasm", 1, cmd_disasm},
+		{"dump",   1, cmd_dump},
+		{"diff",   2, cmd_diff},
+		{"match",  2, cmd_match},
+		{"index",  2, cmd_index},
+		{"search", 3, cmd_search},
+		{"loops",  1, cmd_loops},
+		{"calls",  1, cmd_calls},
+		{"xrefs",  2, cmd_xrefs},
+		{"find",   2, cmd_find},
+		{"grep",   2, cmd_grep},
+		{"scan",  -2, cmd_scan},
+		{"hook",   3, cmd_hook}
+	};
+
+	struct analyze_options opts = {0};
+	double		       start;
+	int		       num_args;
+	int		       result;
+	int		       opt;
+
+	opts.entry = TRUE;
+	opts.syms  = TRUE;
+
+	while((opt = getopt_long(argc, argv, "r:f:o:Tj:c::sth", long_options,
+			NULL)) != -1) {
+		switch(opt) {
+		case 'r':
+			if(!parse_roots(&opts, optarg)) {
+				fprintf(stderr, "Unknown root in %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'f':
+			if(!parse_format(&opts, optarg)) {
+				fprintf(stderr, "Unknown format %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'o':
+			opts.output = optarg;
+			break;
+		case 'T':
+			opts.trampoline = TRUE;
+			break;
+		case 'j':
+			opts.threads = atoi(optarg);
+			break;
+		case 'c':
+			bf_enable_cache(optarg);
+			break;
+		case 's':
+			opts.stats = TRUE;
+			break;
+		case 't':
+			opts.time = TRUE;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for(size_t i = 0; i < ARRAY_SIZE(commands); i++) {
+		if(strcmp(argv[optind], commands[i].name) != 0) {
+			continue;
+		}
+
+		num_args = argc - optind - 1;
+
+		if(commands[i].num_args >= 0 ?
+				num_args != commands[i].num_args :
+				num_args < -commands[i].num_args) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		start  = now_ms();
+		result = commands[i].run(&opts, &argv[optind + 1]);
+		report_time(&opts, "total", start);
+		return result;
+	}
+
+	fprintf(stderr, "Unknown command %s\n", argv[optind]);
+	usage(argv[0]);
+	return 1;
+}
@@ -0,0 +1,168 @@
+/*
+ * This file is part of libbf.
+ *
+ * libbf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libbf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libbf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * bf-batch analyses a list of binaries in parallel and prints one line per
+ * binary as soon as it is done:
+ *
+ *	<path> <status> <insns> <basic blocks> <functions> <load ms> <analyse ms>
+ *
+ * The list is read from the file given as argument, or from stdin, one path
+ * per line, e.g.:
+ *
+ *	find /usr/bin -type f | bf-batch -j 16 -m 4096
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libiberty.h>
+
+#include "batch.h"
+
+static const char * status_names[] = {
+	[BF_BATCH_OK]		  = "ok",
+	[BF_BATCH_LOAD_FAILED]	  = "load-failed",
+	[BF_BATCH_ANALYSE_FAILED] = "analyse-failed",
+	[BF_BATCH_CRASHED]	  = "crashed"
+};
+
+static void usage(const char * name)
+{
+	fprintf(stderr, "Usage: %s [options] [list]\n"
+			"  -j, --jobs N       number of worker processes\n"
+			"  -m, --memory MB    memory budget of the binaries "
+			"in flight\n"
+			"  -f, --factor N     estimated memory per byte of "
+			"binary (default 16)\n"
+			"  -n, --no-disasm    only load the binaries\n"
+			"  -h, --help         show this message\n", name);
+}
+
+static void print_result(struct bf_batch_result * result, void * param)
+{
+	FILE * stream = param;
+
+	fprintf(stream, "%s %s %zu %zu %zu %.1f %.1f\n", result->path,
+			status_names[result->status], result->num_insns,
+			result->num_basic_blks, result->num_funcs,
+			result->load_ms, result->analyse_ms);
+	fflush(stream);
+}
+
+static char ** read_paths(FILE * stream, size_t * count)
+{
+	char ** paths	 = NULL;
+	size_t	capacity = 0;
+	char *	line	 = NULL;
+	size_t	size	 = 0;
+	ssize_t len;
+
+	*count = 0;
+
+	while((len = getline(&line, &size, stream)) != -1) {
+		while(len > 0 && (line[len - 1] == '\n' ||
+				line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+
+		if(len == 0) {
+			continue;
+		}
+
+		if(*count == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			paths	 = xrealloc(paths, capacity * sizeof(char *));
+		}
+
+		paths[(*count)++] = xstrdup(line);
+	}
+
+	free(line);
+	return paths;
+}
+
+int main(int argc, char * argv[])
+{
+	static struct option long_options[] = {
+		{"jobs",      required_argument, NULL, 'j'},
+		{"memory",    required_argument, NULL, 'm'},
+		{"factor",    required_argument, NULL, 'f'},
+		{"no-disasm", no_argument,	 NULL, 'n'},
+		{"help",      no_argument,	 NULL, 'h'},
+		{NULL,	      0,		 NULL, 0}
+	};
+
+	struct bf_batch_options options;
+	FILE *			list = stdin;
+	char **			paths;
+	size_t			count;
+	size_t			succeeded;
+	int			opt;
+
+	bf_init_batch_options(&options);
+
+	while((opt = getopt_long(argc, argv, "j:m:f:nh", long_options,
+			NULL)) != -1) {
+		switch(opt) {
+		case 'j':
+			options.num_workers = atoi(optarg);
+			break;
+		case 'm':
+			options.mem_budget = strtoull(optarg, NULL, 10) << 20;
+			break;
+		case 'f':
+			options.mem_factor = atoi(optarg);
+			break;
+		case 'n':
+			options.disasm = FALSE;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind < argc && strcmp(argv[optind], "-") != 0) {
+		list = fopen(argv[optind], "r");
+
+		if(list == NULL) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	paths = read_paths(list, &count);
+
+	if(list != stdin) {
+		fclose(list);
+	}
+
+	succeeded = bf_run_batch(paths, count, &options, print_result, stdout);
+	fprintf(stderr, "%zu of %zu binaries analysed\n", succeeded, count);
+
+	for(size_t i = 0; i < count; i++) {
+		free(paths[i]);
+	}
+
+	free(paths);
+	return succeeded == count ? 0 : 2;
+}